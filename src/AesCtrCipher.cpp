@@ -0,0 +1,397 @@
+#include "AesCtrCipher.h"
+#include "CpuFeatures.h"
+
+#include <tc/crypto.h>
+
+#include <cstring>
+#include <algorithm>
+
+// x86 AES-NI/VAES backends are built with per-function target attributes (GCC/Clang) or intrinsics that need no flags (MSVC)
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+	#if defined(__GNUC__) || defined(__clang__)
+		#define NSTOOL_AESCTR_X86 1
+		#define NSTOOL_AESCTR_TARGET_AESNI __attribute__((target("aes,sse4.1")))
+		#include <immintrin.h>
+		#if defined(__clang__) ? (__clang_major__ >= 6) : (__GNUC__ >= 8)
+			#define NSTOOL_AESCTR_VAES 1
+			#define NSTOOL_AESCTR_TARGET_VAES __attribute__((target("aes,sse4.1,avx512f,vaes")))
+		#endif
+	#elif defined(_MSC_VER)
+		#define NSTOOL_AESCTR_X86 1
+		#define NSTOOL_AESCTR_TARGET_AESNI
+		#include <immintrin.h>
+	#endif
+#endif
+
+namespace {
+
+inline uint64_t swapEndian64(uint64_t value)
+{
+	return  ((value & 0x00000000000000ffULL) << 56) | ((value & 0x000000000000ff00ULL) << 40) | ((value & 0x0000000000ff0000ULL) << 24) | ((value & 0x00000000ff000000ULL) << 8) |
+			((value & 0x000000ff00000000ULL) >> 8)  | ((value & 0x0000ff0000000000ULL) >> 24) | ((value & 0x00ff000000000000ULL) >> 40) | ((value & 0xff00000000000000ULL) >> 56);
+}
+
+inline uint64_t loadBe64(const byte_t* data)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < 8; i++)
+	{
+		value = (value << 8) | data[i];
+	}
+	return value;
+}
+
+inline void storeBe64(byte_t* data, uint64_t value)
+{
+	for (size_t i = 0; i < 8; i++)
+	{
+		data[7 - i] = byte_t(value >> (i * 8));
+	}
+}
+
+#ifdef NSTOOL_AESCTR_X86
+
+// counter block (big-endian 128-bit) from host integers
+NSTOOL_AESCTR_TARGET_AESNI inline __m128i makeCounterBlock(uint64_t hi, uint64_t lo)
+{
+	return _mm_set_epi64x(int64_t(swapEndian64(lo)), int64_t(swapEndian64(hi)));
+}
+
+#endif
+
+}
+
+nstool::AesCtrCipher::AesCtrCipher() :
+	mModuleLabel("nstool::AesCtrCipher"),
+	mBackend(BACKEND_SOFTWARE),
+	mKey(),
+	mCounterHi(0),
+	mCounterLo(0)
+{
+}
+
+void nstool::AesCtrCipher::initialize(const byte_t* key, const byte_t* counter, Backend backend)
+{
+	AesKeySchedule key_schedule;
+	key_schedule.initialize(key);
+	initialize(key_schedule, counter, backend);
+}
+
+void nstool::AesCtrCipher::initialize(const AesKeySchedule& key, const byte_t* counter, Backend backend)
+{
+	if (backend == BACKEND_AUTO)
+	{
+		backend = getPreferredBackend();
+	}
+	if (isBackendSupported(backend) == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel, fmt::format("AES-CTR backend \"{:s}\" is not supported on this CPU.", getBackendName(backend)));
+	}
+
+	if ((backend == BACKEND_AESNI || backend == BACKEND_VAES) && key.hasRoundKeys() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "Key schedule has no round keys.");
+	}
+
+	mBackend = backend;
+	mKey = key;
+	mCounterHi = loadBe64(counter);
+	mCounterLo = loadBe64(counter + 8);
+}
+
+void nstool::AesCtrCipher::crypt(byte_t* dst, const byte_t* src, size_t size, int64_t offset) const
+{
+	if (offset < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::crypt()", "offset cannot be negative.");
+	}
+
+	uint64_t block_index = uint64_t(offset) / kBlockSize;
+	size_t block_offset = size_t(uint64_t(offset) % kBlockSize);
+
+	// partial first block
+	if (block_offset != 0 && size > 0)
+	{
+		byte_t block[kBlockSize] = {0};
+		size_t len = std::min<size_t>(size, kBlockSize - block_offset);
+		memcpy(block + block_offset, src, len);
+		cryptBlocks(block, block, 1, block_index);
+		memcpy(dst, block + block_offset, len);
+
+		dst += len;
+		src += len;
+		size -= len;
+		block_index += 1;
+	}
+
+	// whole blocks
+	size_t block_num = size / kBlockSize;
+	if (block_num > 0)
+	{
+		cryptBlocks(dst, src, block_num, block_index);
+
+		dst += block_num * kBlockSize;
+		src += block_num * kBlockSize;
+		size -= block_num * kBlockSize;
+		block_index += block_num;
+	}
+
+	// partial last block
+	if (size > 0)
+	{
+		byte_t block[kBlockSize] = {0};
+		memcpy(block, src, size);
+		cryptBlocks(block, block, 1, block_index);
+		memcpy(dst, block, size);
+	}
+}
+
+nstool::AesCtrCipher::Backend nstool::AesCtrCipher::getBackend() const
+{
+	return mBackend;
+}
+
+nstool::AesCtrCipher::Backend nstool::AesCtrCipher::getPreferredBackend()
+{
+	if (isBackendSupported(BACKEND_VAES))
+		return BACKEND_VAES;
+	if (isBackendSupported(BACKEND_AESNI))
+		return BACKEND_AESNI;
+	return BACKEND_SOFTWARE;
+}
+
+bool nstool::AesCtrCipher::isBackendSupported(Backend backend)
+{
+	switch (backend)
+	{
+		case (BACKEND_AUTO):
+		case (BACKEND_SOFTWARE):
+			return true;
+#ifdef NSTOOL_AESCTR_X86
+		case (BACKEND_AESNI):
+			return nstool::getCpuFeatures().aesni;
+#endif
+#ifdef NSTOOL_AESCTR_VAES
+		case (BACKEND_VAES):
+			return nstool::getCpuFeatures().vaes;
+#endif
+		default:
+			return false;
+	}
+}
+
+std::string nstool::AesCtrCipher::getBackendName(Backend backend)
+{
+	switch (backend)
+	{
+		case (BACKEND_AUTO):
+			return "Auto";
+		case (BACKEND_SOFTWARE):
+			return "Software";
+		case (BACKEND_AESNI):
+			return "AES-NI";
+		case (BACKEND_VAES):
+			return "VAES/AVX-512";
+		default:
+			return "Unknown";
+	}
+}
+
+std::vector<nstool::AesCtrCipher::Backend> nstool::AesCtrCipher::getSupportedBackends()
+{
+	std::vector<Backend> backends;
+	for (Backend backend : { BACKEND_SOFTWARE, BACKEND_AESNI, BACKEND_VAES })
+	{
+		if (isBackendSupported(backend))
+		{
+			backends.push_back(backend);
+		}
+	}
+	return backends;
+}
+
+void nstool::AesCtrCipher::cryptBlocks(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const
+{
+	switch (mBackend)
+	{
+		case (BACKEND_AESNI):
+			cryptBlocksAesNi(dst, src, block_num, block_index);
+			break;
+		case (BACKEND_VAES):
+			cryptBlocksVaes(dst, src, block_num, block_index);
+			break;
+		default:
+			cryptBlocksSoftware(dst, src, block_num, block_index);
+			break;
+	}
+}
+
+void nstool::AesCtrCipher::getCounterBlock(byte_t* counter, uint64_t block_index) const
+{
+	// 128-bit add, carrying from the low 64 bits into the high 64 bits
+	uint64_t lo = mCounterLo + block_index;
+	uint64_t hi = mCounterHi + (lo < mCounterLo ? 1 : 0);
+	storeBe64(counter, hi);
+	storeBe64(counter + 8, lo);
+}
+
+void nstool::AesCtrCipher::cryptBlocksSoftware(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const
+{
+	// generate the keystream for a batch of counter blocks at a time
+	static const size_t kBatchBlockNum = 64;
+	byte_t keystream[kBatchBlockNum * kBlockSize];
+
+	while (block_num > 0)
+	{
+		size_t batch_num = std::min<size_t>(block_num, kBatchBlockNum);
+		for (size_t i = 0; i < batch_num; i++)
+		{
+			getCounterBlock(keystream + i * kBlockSize, block_index + i);
+		}
+		tc::crypto::EncryptAes128Ecb(keystream, keystream, batch_num * kBlockSize, mKey.getKey().data(), kKeySize);
+
+		for (size_t i = 0; i < batch_num * kBlockSize; i++)
+		{
+			dst[i] = src[i] ^ keystream[i];
+		}
+
+		dst += batch_num * kBlockSize;
+		src += batch_num * kBlockSize;
+		block_num -= batch_num;
+		block_index += batch_num;
+	}
+}
+
+#ifdef NSTOOL_AESCTR_X86
+
+NSTOOL_AESCTR_TARGET_AESNI void nstool::AesCtrCipher::cryptBlocksAesNi(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const
+{
+	__m128i rk[11];
+	for (size_t i = 0; i < 11; i++)
+	{
+		rk[i] = _mm_loadu_si128((const __m128i*)(mKey.getEncryptRoundKeys() + i * 16));
+	}
+
+	uint64_t lo = mCounterLo + block_index;
+	uint64_t hi = mCounterHi + (lo < mCounterLo ? 1 : 0);
+
+	// 8 blocks at a time, so the latency of each aesenc is hidden by the others
+	while (block_num >= 8)
+	{
+		__m128i b[8];
+		for (size_t i = 0; i < 8; i++)
+		{
+			b[i] = _mm_xor_si128(makeCounterBlock(hi, lo), rk[0]);
+			lo += 1;
+			hi += (lo == 0) ? 1 : 0;
+		}
+		for (size_t r = 1; r < 10; r++)
+		{
+			for (size_t i = 0; i < 8; i++)
+			{
+				b[i] = _mm_aesenc_si128(b[i], rk[r]);
+			}
+		}
+		for (size_t i = 0; i < 8; i++)
+		{
+			b[i] = _mm_aesenclast_si128(b[i], rk[10]);
+			_mm_storeu_si128((__m128i*)(dst + i * 16), _mm_xor_si128(b[i], _mm_loadu_si128((const __m128i*)(src + i * 16))));
+		}
+
+		dst += 8 * kBlockSize;
+		src += 8 * kBlockSize;
+		block_num -= 8;
+	}
+
+	for (; block_num > 0; block_num--)
+	{
+		__m128i b = _mm_xor_si128(makeCounterBlock(hi, lo), rk[0]);
+		lo += 1;
+		hi += (lo == 0) ? 1 : 0;
+		for (size_t r = 1; r < 10; r++)
+		{
+			b = _mm_aesenc_si128(b, rk[r]);
+		}
+		b = _mm_aesenclast_si128(b, rk[10]);
+		_mm_storeu_si128((__m128i*)dst, _mm_xor_si128(b, _mm_loadu_si128((const __m128i*)src)));
+
+		dst += kBlockSize;
+		src += kBlockSize;
+	}
+}
+
+#else
+
+void nstool::AesCtrCipher::cryptBlocksAesNi(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const
+{
+	cryptBlocksSoftware(dst, src, block_num, block_index);
+}
+
+#endif
+
+#ifdef NSTOOL_AESCTR_VAES
+
+NSTOOL_AESCTR_TARGET_VAES void nstool::AesCtrCipher::cryptBlocksVaes(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const
+{
+	__m512i rk[11];
+	for (size_t i = 0; i < 11; i++)
+	{
+		rk[i] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(mKey.getEncryptRoundKeys() + i * 16)));
+	}
+
+	uint64_t lo = mCounterLo + block_index;
+	uint64_t hi = mCounterHi + (lo < mCounterLo ? 1 : 0);
+
+	// 32 blocks at a time (8 registers of 4 blocks)
+	while (block_num >= 32)
+	{
+		__m512i b[8];
+		for (size_t i = 0; i < 8; i++)
+		{
+			__m128i c[4];
+			for (size_t j = 0; j < 4; j++)
+			{
+				c[j] = makeCounterBlock(hi, lo);
+				lo += 1;
+				hi += (lo == 0) ? 1 : 0;
+			}
+			__m512i v = _mm512_castsi128_si512(c[0]);
+			v = _mm512_inserti32x4(v, c[1], 1);
+			v = _mm512_inserti32x4(v, c[2], 2);
+			v = _mm512_inserti32x4(v, c[3], 3);
+			b[i] = _mm512_xor_si512(v, rk[0]);
+		}
+		for (size_t r = 1; r < 10; r++)
+		{
+			for (size_t i = 0; i < 8; i++)
+			{
+				b[i] = _mm512_aesenc_epi128(b[i], rk[r]);
+			}
+		}
+		for (size_t i = 0; i < 8; i++)
+		{
+			b[i] = _mm512_aesenclast_epi128(b[i], rk[10]);
+			_mm512_storeu_si512((void*)(dst + i * 64), _mm512_xor_si512(b[i], _mm512_loadu_si512((const void*)(src + i * 64))));
+		}
+
+		dst += 32 * kBlockSize;
+		src += 32 * kBlockSize;
+		block_num -= 32;
+		block_index += 32;
+	}
+
+	// remaining blocks
+	if (block_num > 0)
+	{
+		cryptBlocksAesNi(dst, src, block_num, block_index);
+	}
+}
+
+#else
+
+void nstool::AesCtrCipher::cryptBlocksVaes(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const
+{
+	cryptBlocksAesNi(dst, src, block_num, block_index);
+}
+
+#endif
\ No newline at end of file
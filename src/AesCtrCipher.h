@@ -0,0 +1,65 @@
+#pragma once
+#include "types.h"
+#include "AesKeySchedule.h"
+
+#include <vector>
+
+namespace nstool {
+
+/**
+ * @class AesCtrCipher
+ * @brief AES-128-CTR keystream generator with runtime selected backends.
+ *
+ * The counter is a 128-bit big-endian integer (as used by NCA partitions), incremented once per 16 byte block with carry across all 128 bits.
+ * Backends:
+ * - Software: tc::crypto AES-128-ECB over a batch of counter blocks
+ * - AesNi: x86 AES-NI, 8 blocks interleaved
+ * - Vaes: x86 VAES with AVX-512, 32 blocks (8 ZMM registers of 4 blocks) interleaved
+ */
+class AesCtrCipher
+{
+public:
+	enum Backend
+	{
+		BACKEND_AUTO,
+		BACKEND_SOFTWARE,
+		BACKEND_AESNI,
+		BACKEND_VAES
+	};
+
+	static const size_t kKeySize = 16;
+	static const size_t kCounterSize = 16;
+	static const size_t kBlockSize = 16;
+
+	AesCtrCipher();
+
+	// counter is the counter for the block at offset 0
+	void initialize(const byte_t* key, const byte_t* counter, Backend backend = BACKEND_AUTO);
+	void initialize(const AesKeySchedule& key, const byte_t* counter, Backend backend = BACKEND_AUTO);
+
+	// encrypt/decrypt data located at the specified byte offset of the stream, dst and src may be the same
+	void crypt(byte_t* dst, const byte_t* src, size_t size, int64_t offset) const;
+
+	Backend getBackend() const;
+
+	static Backend getPreferredBackend();
+	static bool isBackendSupported(Backend backend);
+	static std::string getBackendName(Backend backend);
+	static std::vector<Backend> getSupportedBackends();
+private:
+	std::string mModuleLabel;
+
+	Backend mBackend;
+	AesKeySchedule mKey;
+	uint64_t mCounterHi; // big-endian counter, as host integers
+	uint64_t mCounterLo;
+
+	// crypt whole blocks, starting at the specified block index
+	void cryptBlocks(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const;
+	void cryptBlocksSoftware(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const;
+	void cryptBlocksAesNi(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const;
+	void cryptBlocksVaes(byte_t* dst, const byte_t* src, size_t block_num, uint64_t block_index) const;
+	void getCounterBlock(byte_t* counter, uint64_t block_index) const;
+};
+
+}
\ No newline at end of file
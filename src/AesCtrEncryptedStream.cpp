@@ -0,0 +1,157 @@
+#include "AesCtrEncryptedStream.h"
+
+#include <tc/ObjectDisposedException.h>
+
+#include <vector>
+#include <algorithm>
+
+nstool::AesCtrEncryptedStream::AesCtrEncryptedStream(const std::shared_ptr<tc::io::IStream>& stream, const AesKeySchedule& key, const pie::hac::detail::aes_iv_t& counter, const std::shared_ptr<ThreadPool>& thread_pool, AesCtrCipher::Backend backend) :
+	mModuleLabel("nstool::AesCtrEncryptedStream"),
+	mBaseStream(stream),
+	mCipher(),
+	mThreadPool(thread_pool)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "stream is null.");
+	}
+	if (mBaseStream->canRead() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support reading.");
+	}
+	if (mBaseStream->canSeek() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support seeking.");
+	}
+
+	mCipher.initialize(key, counter.data(), backend);
+}
+
+bool nstool::AesCtrEncryptedStream::canRead() const
+{
+	return mBaseStream == nullptr ? false : mBaseStream->canRead();
+}
+
+bool nstool::AesCtrEncryptedStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::AesCtrEncryptedStream::canSeek() const
+{
+	return mBaseStream == nullptr ? false : mBaseStream->canSeek();
+}
+
+int64_t nstool::AesCtrEncryptedStream::length()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mBaseStream->length();
+}
+
+int64_t nstool::AesCtrEncryptedStream::position()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mBaseStream->position();
+}
+
+size_t nstool::AesCtrEncryptedStream::read(byte_t* ptr, size_t count)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	int64_t offset = mBaseStream->position();
+	size_t data_read = mBaseStream->read(ptr, count);
+
+	// decrypt in place
+	if (mThreadPool != nullptr && data_read >= kParallelMinReadSize)
+		cryptParallel(ptr, data_read, offset);
+	else
+		mCipher.crypt(ptr, ptr, data_read, offset);
+
+	return data_read;
+}
+
+size_t nstool::AesCtrEncryptedStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for AesCtrEncryptedStream.");
+}
+
+int64_t nstool::AesCtrEncryptedStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	return mBaseStream->seek(offset, origin);
+}
+
+void nstool::AesCtrEncryptedStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for AesCtrEncryptedStream.");
+}
+
+void nstool::AesCtrEncryptedStream::flush()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+
+	mBaseStream->flush();
+}
+
+void nstool::AesCtrEncryptedStream::dispose()
+{
+	if (mBaseStream.get() != nullptr)
+	{
+		mBaseStream->dispose();
+		mBaseStream.reset();
+	}
+}
+
+const std::shared_ptr<tc::io::IStream>& nstool::AesCtrEncryptedStream::getBaseStream() const
+{
+	return mBaseStream;
+}
+
+const nstool::AesCtrCipher& nstool::AesCtrEncryptedStream::getCipher() const
+{
+	return mCipher;
+}
+
+const std::shared_ptr<nstool::ThreadPool>& nstool::AesCtrEncryptedStream::getThreadPool() const
+{
+	return mThreadPool;
+}
+
+void nstool::AesCtrEncryptedStream::cryptParallel(byte_t* data, size_t size, int64_t offset)
+{
+	// chunk boundaries are aligned to the stream offset, so each chunk starts on a whole counter block (except the first if the read is unaligned)
+	const AesCtrCipher* cipher = &mCipher;
+	std::vector<std::function<void()>> tasks;
+	for (size_t pos = 0; pos < size;)
+	{
+		size_t chunk_end = size_t(((uint64_t(offset) + pos) / kParallelChunkSize + 1) * kParallelChunkSize - uint64_t(offset));
+		size_t chunk_size = std::min<size_t>(chunk_end, size) - pos;
+		byte_t* chunk_data = data + pos;
+		int64_t chunk_offset = offset + int64_t(pos);
+		tasks.push_back([cipher, chunk_data, chunk_size, chunk_offset]() {
+			cipher->crypt(chunk_data, chunk_data, chunk_size, chunk_offset);
+		});
+		pos += chunk_size;
+	}
+
+	// the first chunk is decrypted by this thread, the others by the thread pool
+	mThreadPool->execute(tasks);
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+#include "types.h"
+#include "AesCtrCipher.h"
+#include "ThreadPool.h"
+
+#include <pietendo/hac/define/types.h>
+
+namespace nstool {
+
+/**
+ * @class AesCtrEncryptedStream
+ * @brief Read-only AES-128-CTR decryption stream, using the fastest AesCtrCipher backend available.
+ *
+ * Data is read from the base stream directly into the caller's buffer and decrypted in place, so no intermediate buffer is used.
+ * The counter is the counter for offset 0 of the base stream.
+ * If a thread pool is supplied, large reads are split into counter aligned chunks which are decrypted in parallel. Small reads are decrypted inline.
+ */
+class AesCtrEncryptedStream : public tc::io::IStream
+{
+public:
+	// key may be a pie::hac::detail::aes128_key_t, or a precomputed key schedule
+	AesCtrEncryptedStream(const std::shared_ptr<tc::io::IStream>& stream, const AesKeySchedule& key, const pie::hac::detail::aes_iv_t& counter, const std::shared_ptr<ThreadPool>& thread_pool = nullptr, AesCtrCipher::Backend backend = AesCtrCipher::BACKEND_AUTO);
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+
+	// used by readers that decrypt the raw data themselves (e.g. HashTreeStream decrypting and hashing in one pass)
+	const std::shared_ptr<tc::io::IStream>& getBaseStream() const;
+	const AesCtrCipher& getCipher() const;
+	const std::shared_ptr<ThreadPool>& getThreadPool() const;
+private:
+	static const size_t kParallelChunkSize = 0x40000; // size of each chunk decrypted by a worker thread (multiple of the AES block size)
+	static const size_t kParallelMinReadSize = 0x80000; // smaller reads are decrypted inline
+
+	std::string mModuleLabel;
+
+	std::shared_ptr<tc::io::IStream> mBaseStream;
+	AesCtrCipher mCipher;
+	std::shared_ptr<ThreadPool> mThreadPool;
+
+	void cryptParallel(byte_t* data, size_t size, int64_t offset);
+};
+
+}
\ No newline at end of file
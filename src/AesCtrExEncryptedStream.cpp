@@ -0,0 +1,177 @@
+#include "AesCtrExEncryptedStream.h"
+
+#include <tc/ObjectDisposedException.h>
+
+#include <algorithm>
+#include <cstring>
+
+nstool::AesCtrExEncryptedStream::AesCtrExEncryptedStream(const std::shared_ptr<tc::io::IStream>& stream, const AesKeySchedule& key, const pie::hac::detail::aes_iv_t& counter, const std::shared_ptr<BucketTree>& table) :
+	mModuleLabel("nstool::AesCtrExEncryptedStream"),
+	mBaseStream(stream),
+	mKey(key),
+	mCounter(counter),
+	mTable(table),
+	mCipher(),
+	mGenerationCipher(),
+	mGenerationCipherValue(0),
+	mGenerationCipherValid(false),
+	mEntryHint(0)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "stream is null.");
+	}
+	if (mTable == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "table is null.");
+	}
+	if (mBaseStream->canRead() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support reading.");
+	}
+	if (mBaseStream->canSeek() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support seeking.");
+	}
+	if (mTable->getEntrySize() != sizeof(sEntry))
+	{
+		throw tc::ArgumentException(mModuleLabel, "table does not contain AesCtrEx entries.");
+	}
+
+	mCipher.initialize(mKey, mCounter.data());
+}
+
+bool nstool::AesCtrExEncryptedStream::canRead() const
+{
+	return mBaseStream == nullptr ? false : mBaseStream->canRead();
+}
+
+bool nstool::AesCtrExEncryptedStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::AesCtrExEncryptedStream::canSeek() const
+{
+	return mBaseStream == nullptr ? false : mBaseStream->canSeek();
+}
+
+int64_t nstool::AesCtrExEncryptedStream::length()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mBaseStream->length();
+}
+
+int64_t nstool::AesCtrExEncryptedStream::position()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mBaseStream->position();
+}
+
+size_t nstool::AesCtrExEncryptedStream::read(byte_t* ptr, size_t count)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	int64_t offset = mBaseStream->position();
+	size_t data_read = mBaseStream->read(ptr, count);
+
+	// decrypt in place, one table entry at a time
+	for (size_t pos = 0; pos < data_read;)
+	{
+		int64_t data_offset = offset + int64_t(pos);
+		size_t data_size = data_read - pos;
+
+		if (data_offset < mTable->getBeginOffset() || data_offset >= mTable->getEndOffset())
+		{
+			if (data_offset < mTable->getBeginOffset())
+				data_size = std::min<size_t>(data_size, size_t(mTable->getBeginOffset() - data_offset));
+
+			mCipher.crypt(ptr + pos, ptr + pos, data_size, data_offset);
+		}
+		else
+		{
+			mEntryHint = mTable->find(data_offset, mEntryHint);
+			data_size = std::min<size_t>(data_size, size_t(mTable->getEntryEndOffset(mEntryHint) - data_offset));
+
+			sEntry entry;
+			memcpy(&entry, mTable->getEntry(mEntryHint), sizeof(sEntry));
+			if (entry.encryption_value != EncryptionValue_NotEncrypted)
+			{
+				getGenerationCipher(entry.generation.unwrap()).crypt(ptr + pos, ptr + pos, data_size, data_offset);
+			}
+		}
+
+		pos += data_size;
+	}
+
+	return data_read;
+}
+
+size_t nstool::AesCtrExEncryptedStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for AesCtrExEncryptedStream.");
+}
+
+int64_t nstool::AesCtrExEncryptedStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	return mBaseStream->seek(offset, origin);
+}
+
+void nstool::AesCtrExEncryptedStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for AesCtrExEncryptedStream.");
+}
+
+void nstool::AesCtrExEncryptedStream::flush()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+
+	mBaseStream->flush();
+}
+
+void nstool::AesCtrExEncryptedStream::dispose()
+{
+	if (mBaseStream.get() != nullptr)
+	{
+		mBaseStream->dispose();
+		mBaseStream.reset();
+	}
+}
+
+const nstool::AesCtrCipher& nstool::AesCtrExEncryptedStream::getGenerationCipher(uint32_t generation)
+{
+	// entries mostly share a few generations, so the cipher is only re-initialised when the generation changes
+	if (mGenerationCipherValid == false || mGenerationCipherValue != generation)
+	{
+		pie::hac::detail::aes_iv_t counter = mCounter;
+		counter[4] = byte_t(generation >> 24);
+		counter[5] = byte_t(generation >> 16);
+		counter[6] = byte_t(generation >> 8);
+		counter[7] = byte_t(generation);
+
+		mGenerationCipher.initialize(mKey, counter.data());
+		mGenerationCipherValue = generation;
+		mGenerationCipherValid = true;
+	}
+
+	return mGenerationCipher;
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+#include "types.h"
+#include "AesCtrCipher.h"
+#include "BucketTree.h"
+
+#include <pietendo/hac/define/types.h>
+
+namespace nstool {
+
+/**
+ * @class AesCtrExEncryptedStream
+ * @brief Read-only AES-128-CTR decryption stream for the physical data of a patch (AesCtrEx) partition.
+ *
+ * The AesCtrEx table splits the partition into ranges, each with its own counter generation (which replaces bytes 4-7 of the counter) or no encryption at all.
+ * Data outside of the table (e.g. the tables themselves) uses the counter as supplied. The counter is the counter for offset 0 of the base stream.
+ * Consecutive reads continue from the previous table entry, so sequential reads don't search the table.
+ */
+class AesCtrExEncryptedStream : public tc::io::IStream
+{
+public:
+#pragma pack(push,1)
+	struct sEntry
+	{
+		tc::bn::le64<int64_t> offset;
+		byte_t encryption_value;
+		std::array<byte_t, 3> reserved;
+		tc::bn::le32<uint32_t> generation;
+	};
+	static_assert(sizeof(sEntry) == 0x10, "sEntry size.");
+#pragma pack(pop)
+
+	enum EncryptionValue
+	{
+		EncryptionValue_Encrypted = 0,
+		EncryptionValue_NotEncrypted = 1
+	};
+
+	AesCtrExEncryptedStream(const std::shared_ptr<tc::io::IStream>& stream, const AesKeySchedule& key, const pie::hac::detail::aes_iv_t& counter, const std::shared_ptr<BucketTree>& table);
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	std::string mModuleLabel;
+
+	std::shared_ptr<tc::io::IStream> mBaseStream;
+	AesKeySchedule mKey;
+	pie::hac::detail::aes_iv_t mCounter;
+	std::shared_ptr<BucketTree> mTable;
+
+	// cipher for data outside of the table
+	AesCtrCipher mCipher;
+
+	// cipher for the generation of the last entry used
+	AesCtrCipher mGenerationCipher;
+	uint32_t mGenerationCipherValue;
+	bool mGenerationCipherValid;
+
+	// last entry used, to continue from on the next read
+	size_t mEntryHint;
+
+	const AesCtrCipher& getGenerationCipher(uint32_t generation);
+};
+
+}
\ No newline at end of file
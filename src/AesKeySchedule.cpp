@@ -0,0 +1,164 @@
+#include "AesKeySchedule.h"
+#include "CpuFeatures.h"
+
+#include <tc/crypto.h>
+
+#include <cstring>
+
+// x86 AES-NI key expansion is built with per-function target attributes (GCC/Clang) or intrinsics that need no flags (MSVC)
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+	#if defined(__GNUC__) || defined(__clang__)
+		#define NSTOOL_AESKEY_X86 1
+		#define NSTOOL_AESKEY_TARGET_AESNI __attribute__((target("aes,sse4.1")))
+		#include <immintrin.h>
+	#elif defined(_MSC_VER)
+		#define NSTOOL_AESKEY_X86 1
+		#define NSTOOL_AESKEY_TARGET_AESNI
+		#include <immintrin.h>
+	#endif
+#endif
+
+namespace {
+
+#ifdef NSTOOL_AESKEY_X86
+
+template <int rcon>
+NSTOOL_AESKEY_TARGET_AESNI inline __m128i expandKeyRound(__m128i key)
+{
+	__m128i keygened = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(key, rcon), _MM_SHUFFLE(3,3,3,3));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, keygened);
+}
+
+NSTOOL_AESKEY_TARGET_AESNI void expandKeyAesNi(const byte_t* key, byte_t* encrypt_round_key, byte_t* decrypt_round_key)
+{
+	__m128i rk[11];
+	rk[0] = _mm_loadu_si128((const __m128i*)key);
+	rk[1] = expandKeyRound<0x01>(rk[0]);
+	rk[2] = expandKeyRound<0x02>(rk[1]);
+	rk[3] = expandKeyRound<0x04>(rk[2]);
+	rk[4] = expandKeyRound<0x08>(rk[3]);
+	rk[5] = expandKeyRound<0x10>(rk[4]);
+	rk[6] = expandKeyRound<0x20>(rk[5]);
+	rk[7] = expandKeyRound<0x40>(rk[6]);
+	rk[8] = expandKeyRound<0x80>(rk[7]);
+	rk[9] = expandKeyRound<0x1b>(rk[8]);
+	rk[10] = expandKeyRound<0x36>(rk[9]);
+	for (size_t i = 0; i < 11; i++)
+	{
+		_mm_storeu_si128((__m128i*)(encrypt_round_key + i * 16), rk[i]);
+	}
+
+	// decryption round keys are the encryption round keys in reverse order, with InvMixColumns applied to the middle rounds
+	_mm_storeu_si128((__m128i*)(decrypt_round_key), rk[10]);
+	for (size_t i = 1; i < 10; i++)
+	{
+		_mm_storeu_si128((__m128i*)(decrypt_round_key + i * 16), _mm_aesimc_si128(rk[10 - i]));
+	}
+	_mm_storeu_si128((__m128i*)(decrypt_round_key + 10 * 16), rk[0]);
+}
+
+NSTOOL_AESKEY_TARGET_AESNI void encryptAesNi(byte_t* dst, const byte_t* src, size_t block_num, const byte_t* round_key)
+{
+	for (size_t i = 0; i < block_num; i++)
+	{
+		__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i * 16)), _mm_loadu_si128((const __m128i*)round_key));
+		for (size_t r = 1; r < 10; r++)
+		{
+			b = _mm_aesenc_si128(b, _mm_loadu_si128((const __m128i*)(round_key + r * 16)));
+		}
+		_mm_storeu_si128((__m128i*)(dst + i * 16), _mm_aesenclast_si128(b, _mm_loadu_si128((const __m128i*)(round_key + 10 * 16))));
+	}
+}
+
+NSTOOL_AESKEY_TARGET_AESNI void decryptAesNi(byte_t* dst, const byte_t* src, size_t block_num, const byte_t* round_key)
+{
+	for (size_t i = 0; i < block_num; i++)
+	{
+		__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i * 16)), _mm_loadu_si128((const __m128i*)round_key));
+		for (size_t r = 1; r < 10; r++)
+		{
+			b = _mm_aesdec_si128(b, _mm_loadu_si128((const __m128i*)(round_key + r * 16)));
+		}
+		_mm_storeu_si128((__m128i*)(dst + i * 16), _mm_aesdeclast_si128(b, _mm_loadu_si128((const __m128i*)(round_key + 10 * 16))));
+	}
+}
+
+#endif
+
+}
+
+nstool::AesKeySchedule::AesKeySchedule() :
+	mKey(),
+	mHasRoundKeys(false)
+{
+	memset(mKey.data(), 0, mKey.size());
+	memset(mEncryptRoundKey, 0, sizeof(mEncryptRoundKey));
+	memset(mDecryptRoundKey, 0, sizeof(mDecryptRoundKey));
+}
+
+nstool::AesKeySchedule::AesKeySchedule(const pie::hac::detail::aes128_key_t& key) :
+	AesKeySchedule()
+{
+	initialize(key.data());
+}
+
+void nstool::AesKeySchedule::initialize(const byte_t* key)
+{
+	memcpy(mKey.data(), key, kKeySize);
+	mHasRoundKeys = false;
+
+#ifdef NSTOOL_AESKEY_X86
+	if (nstool::getCpuFeatures().aesni)
+	{
+		expandKeyAesNi(mKey.data(), mEncryptRoundKey, mDecryptRoundKey);
+		mHasRoundKeys = true;
+	}
+#endif
+}
+
+const pie::hac::detail::aes128_key_t& nstool::AesKeySchedule::getKey() const
+{
+	return mKey;
+}
+
+bool nstool::AesKeySchedule::hasRoundKeys() const
+{
+	return mHasRoundKeys;
+}
+
+const byte_t* nstool::AesKeySchedule::getEncryptRoundKeys() const
+{
+	return mEncryptRoundKey;
+}
+
+const byte_t* nstool::AesKeySchedule::getDecryptRoundKeys() const
+{
+	return mDecryptRoundKey;
+}
+
+void nstool::AesKeySchedule::encrypt(byte_t* dst, const byte_t* src, size_t size) const
+{
+#ifdef NSTOOL_AESKEY_X86
+	if (mHasRoundKeys)
+	{
+		encryptAesNi(dst, src, size / kBlockSize, mEncryptRoundKey);
+		return;
+	}
+#endif
+	tc::crypto::EncryptAes128Ecb(dst, src, size, mKey.data(), mKey.size());
+}
+
+void nstool::AesKeySchedule::decrypt(byte_t* dst, const byte_t* src, size_t size) const
+{
+#ifdef NSTOOL_AESKEY_X86
+	if (mHasRoundKeys)
+	{
+		decryptAesNi(dst, src, size / kBlockSize, mDecryptRoundKey);
+		return;
+	}
+#endif
+	tc::crypto::DecryptAes128Ecb(dst, src, size, mKey.data(), mKey.size());
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+#include "types.h"
+
+#include <pietendo/hac/define/types.h>
+
+namespace nstool {
+
+/**
+ * @class AesKeySchedule
+ * @brief AES-128 key with its encryption and decryption round keys, expanded once so that keys used many times (KEKs, common keys, content keys) aren't expanded on every use.
+ *
+ * Round keys are only expanded when the CPU supports AES-NI, as the AES-NI backends of AesCtrCipher/AesXtsCipher are the only users of them.
+ * Otherwise encrypt()/decrypt() use tc::crypto AES-128-ECB with the key.
+ */
+class AesKeySchedule
+{
+public:
+	static const size_t kKeySize = 16;
+	static const size_t kBlockSize = 16;
+	static const size_t kRoundKeyNum = 11;
+
+	AesKeySchedule();
+	AesKeySchedule(const pie::hac::detail::aes128_key_t& key);
+
+	void initialize(const byte_t* key);
+
+	const pie::hac::detail::aes128_key_t& getKey() const;
+
+	// round keys, only available when hasRoundKeys() is true
+	bool hasRoundKeys() const;
+	const byte_t* getEncryptRoundKeys() const;
+	const byte_t* getDecryptRoundKeys() const; // in decryption order, for aesdec
+
+	// AES-128-ECB, size must be a multiple of the block size, dst and src may be the same
+	void encrypt(byte_t* dst, const byte_t* src, size_t size) const;
+	void decrypt(byte_t* dst, const byte_t* src, size_t size) const;
+private:
+	pie::hac::detail::aes128_key_t mKey;
+	bool mHasRoundKeys;
+	alignas(16) byte_t mEncryptRoundKey[kRoundKeyNum * kBlockSize];
+	alignas(16) byte_t mDecryptRoundKey[kRoundKeyNum * kBlockSize];
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include "AesXtsCipher.h"
+#include "CpuFeatures.h"
+
+#include <tc/crypto.h>
+
+#include <cstring>
+#include <algorithm>
+
+// x86 AES-NI backend is built with per-function target attributes (GCC/Clang) or intrinsics that need no flags (MSVC)
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+	#if defined(__GNUC__) || defined(__clang__)
+		#define NSTOOL_AESXTS_X86 1
+		#define NSTOOL_AESXTS_TARGET_AESNI __attribute__((target("aes,sse4.1")))
+		#include <immintrin.h>
+	#elif defined(_MSC_VER)
+		#define NSTOOL_AESXTS_X86 1
+		#define NSTOOL_AESXTS_TARGET_AESNI
+		#include <immintrin.h>
+	#endif
+#endif
+
+namespace {
+
+// tweak block for a sector (128-bit big-endian sector number)
+inline void getTweakBlock(byte_t* tweak, uint64_t sector_index)
+{
+	memset(tweak, 0, 8);
+	for (size_t i = 0; i < 8; i++)
+	{
+		tweak[15 - i] = byte_t(sector_index >> (i * 8));
+	}
+}
+
+// multiply the tweak by x in GF(2^128), the tweak is little-endian
+inline void multiplyTweak(byte_t* tweak)
+{
+	byte_t carry = 0;
+	for (size_t i = 0; i < 16; i++)
+	{
+		byte_t next_carry = tweak[i] >> 7;
+		tweak[i] = byte_t(tweak[i] << 1) | carry;
+		carry = next_carry;
+	}
+	if (carry)
+	{
+		tweak[0] ^= 0x87;
+	}
+}
+
+#ifdef NSTOOL_AESXTS_X86
+
+// multiply the tweak by x in GF(2^128): shift each 32-bit lane left and carry the top bit of each lane into the next (0x87 for the top lane)
+NSTOOL_AESXTS_TARGET_AESNI inline __m128i multiplyTweakAesNi(__m128i tweak)
+{
+	__m128i carry = _mm_shuffle_epi32(_mm_srai_epi32(tweak, 31), _MM_SHUFFLE(2,1,0,3));
+	carry = _mm_and_si128(carry, _mm_set_epi32(1, 1, 1, 0x87));
+	return _mm_xor_si128(_mm_slli_epi32(tweak, 1), carry);
+}
+
+#endif
+
+}
+
+nstool::AesXtsCipher::AesXtsCipher() :
+	mModuleLabel("nstool::AesXtsCipher"),
+	mBackend(BACKEND_SOFTWARE),
+	mSectorSize(0),
+	mDataKey(),
+	mTweakKey()
+{
+}
+
+void nstool::AesXtsCipher::initialize(const byte_t* data_key, const byte_t* tweak_key, size_t sector_size, Backend backend)
+{
+	AesKeySchedule data_key_schedule;
+	AesKeySchedule tweak_key_schedule;
+	data_key_schedule.initialize(data_key);
+	tweak_key_schedule.initialize(tweak_key);
+	initialize(data_key_schedule, tweak_key_schedule, sector_size, backend);
+}
+
+void nstool::AesXtsCipher::initialize(const AesKeySchedule& data_key, const AesKeySchedule& tweak_key, size_t sector_size, Backend backend)
+{
+	if (sector_size == 0 || sector_size % kBlockSize != 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel, "sector_size must be a non-zero multiple of the AES block size.");
+	}
+	if (backend == BACKEND_AUTO)
+	{
+		backend = getPreferredBackend();
+	}
+	if (isBackendSupported(backend) == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel, fmt::format("AES-XTS backend \"{:s}\" is not supported on this CPU.", getBackendName(backend)));
+	}
+
+	if (backend == BACKEND_AESNI && (data_key.hasRoundKeys() == false || tweak_key.hasRoundKeys() == false))
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "Key schedule has no round keys.");
+	}
+
+	mBackend = backend;
+	mSectorSize = sector_size;
+	mDataKey = data_key;
+	mTweakKey = tweak_key;
+}
+
+void nstool::AesXtsCipher::decrypt(byte_t* dst, const byte_t* src, size_t size, uint64_t sector_index) const
+{
+	if (mSectorSize == 0)
+	{
+		throw tc::InvalidOperationException(mModuleLabel+"::decrypt()", "Cipher is not initialized.");
+	}
+	if (size % mSectorSize != 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::decrypt()", "size must be a multiple of the sector size.");
+	}
+
+	if (mBackend == BACKEND_AESNI)
+		decryptSectorsAesNi(dst, src, size / mSectorSize, sector_index);
+	else
+		decryptSectorsSoftware(dst, src, size / mSectorSize, sector_index);
+}
+
+size_t nstool::AesXtsCipher::getSectorSize() const
+{
+	return mSectorSize;
+}
+
+nstool::AesXtsCipher::Backend nstool::AesXtsCipher::getBackend() const
+{
+	return mBackend;
+}
+
+nstool::AesXtsCipher::Backend nstool::AesXtsCipher::getPreferredBackend()
+{
+	if (isBackendSupported(BACKEND_AESNI))
+		return BACKEND_AESNI;
+	return BACKEND_SOFTWARE;
+}
+
+bool nstool::AesXtsCipher::isBackendSupported(Backend backend)
+{
+	switch (backend)
+	{
+		case (BACKEND_AUTO):
+		case (BACKEND_SOFTWARE):
+			return true;
+#ifdef NSTOOL_AESXTS_X86
+		case (BACKEND_AESNI):
+			return nstool::getCpuFeatures().aesni;
+#endif
+		default:
+			return false;
+	}
+}
+
+std::string nstool::AesXtsCipher::getBackendName(Backend backend)
+{
+	switch (backend)
+	{
+		case (BACKEND_AUTO):
+			return "Auto";
+		case (BACKEND_SOFTWARE):
+			return "Software";
+		case (BACKEND_AESNI):
+			return "AES-NI";
+		default:
+			return "Unknown";
+	}
+}
+
+std::vector<nstool::AesXtsCipher::Backend> nstool::AesXtsCipher::getSupportedBackends()
+{
+	std::vector<Backend> backends;
+	for (Backend backend : { BACKEND_SOFTWARE, BACKEND_AESNI })
+	{
+		if (isBackendSupported(backend))
+		{
+			backends.push_back(backend);
+		}
+	}
+	return backends;
+}
+
+void nstool::AesXtsCipher::decryptSectorsSoftware(byte_t* dst, const byte_t* src, size_t sector_num, uint64_t sector_index) const
+{
+	tc::ByteData tweak_data(mSectorSize);
+	byte_t* tweaks = tweak_data.data();
+
+	for (size_t sector = 0; sector < sector_num; sector++)
+	{
+		// generate the tweaks for every block of the sector
+		getTweakBlock(tweaks, sector_index + sector);
+		tc::crypto::EncryptAes128Ecb(tweaks, tweaks, kBlockSize, mTweakKey.getKey().data(), kKeySize);
+		for (size_t i = kBlockSize; i < mSectorSize; i += kBlockSize)
+		{
+			memcpy(tweaks + i, tweaks + i - kBlockSize, kBlockSize);
+			multiplyTweak(tweaks + i);
+		}
+
+		// decrypt the whole sector at once
+		for (size_t i = 0; i < mSectorSize; i++)
+		{
+			dst[i] = src[i] ^ tweaks[i];
+		}
+		tc::crypto::DecryptAes128Ecb(dst, dst, mSectorSize, mDataKey.getKey().data(), kKeySize);
+		for (size_t i = 0; i < mSectorSize; i++)
+		{
+			dst[i] ^= tweaks[i];
+		}
+
+		dst += mSectorSize;
+		src += mSectorSize;
+	}
+}
+
+#ifdef NSTOOL_AESXTS_X86
+
+NSTOOL_AESXTS_TARGET_AESNI void nstool::AesXtsCipher::decryptSectorsAesNi(byte_t* dst, const byte_t* src, size_t sector_num, uint64_t sector_index) const
+{
+	__m128i dk[11];
+	__m128i tk[11];
+	for (size_t i = 0; i < 11; i++)
+	{
+		dk[i] = _mm_loadu_si128((const __m128i*)(mDataKey.getDecryptRoundKeys() + i * 16));
+		tk[i] = _mm_loadu_si128((const __m128i*)(mTweakKey.getEncryptRoundKeys() + i * 16));
+	}
+
+	size_t sector_block_num = mSectorSize / kBlockSize;
+
+	while (sector_num > 0)
+	{
+		// encrypt the initial tweaks of up to 8 sectors together
+		size_t batch_sector_num = std::min<size_t>(sector_num, 8);
+		__m128i sector_tweak[8];
+		for (size_t i = 0; i < batch_sector_num; i++)
+		{
+			byte_t tweak_block[kBlockSize];
+			getTweakBlock(tweak_block, sector_index + i);
+			sector_tweak[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)tweak_block), tk[0]);
+		}
+		for (size_t r = 1; r < 10; r++)
+		{
+			for (size_t i = 0; i < batch_sector_num; i++)
+			{
+				sector_tweak[i] = _mm_aesenc_si128(sector_tweak[i], tk[r]);
+			}
+		}
+		for (size_t i = 0; i < batch_sector_num; i++)
+		{
+			sector_tweak[i] = _mm_aesenclast_si128(sector_tweak[i], tk[10]);
+		}
+
+		for (size_t sector = 0; sector < batch_sector_num; sector++)
+		{
+			__m128i tweak = sector_tweak[sector];
+			size_t block_num = sector_block_num;
+
+			// 8 blocks at a time, so the latency of each aesdec is hidden by the others
+			while (block_num >= 8)
+			{
+				__m128i t[8];
+				__m128i b[8];
+				for (size_t i = 0; i < 8; i++)
+				{
+					t[i] = tweak;
+					tweak = multiplyTweakAesNi(tweak);
+					b[i] = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)(src + i * 16)), t[i]), dk[0]);
+				}
+				for (size_t r = 1; r < 10; r++)
+				{
+					for (size_t i = 0; i < 8; i++)
+					{
+						b[i] = _mm_aesdec_si128(b[i], dk[r]);
+					}
+				}
+				for (size_t i = 0; i < 8; i++)
+				{
+					b[i] = _mm_aesdeclast_si128(b[i], dk[10]);
+					_mm_storeu_si128((__m128i*)(dst + i * 16), _mm_xor_si128(b[i], t[i]));
+				}
+
+				dst += 8 * kBlockSize;
+				src += 8 * kBlockSize;
+				block_num -= 8;
+			}
+
+			for (; block_num > 0; block_num--)
+			{
+				__m128i b = _mm_xor_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)src), tweak), dk[0]);
+				for (size_t r = 1; r < 10; r++)
+				{
+					b = _mm_aesdec_si128(b, dk[r]);
+				}
+				b = _mm_aesdeclast_si128(b, dk[10]);
+				_mm_storeu_si128((__m128i*)dst, _mm_xor_si128(b, tweak));
+				tweak = multiplyTweakAesNi(tweak);
+
+				dst += kBlockSize;
+				src += kBlockSize;
+			}
+		}
+
+		sector_num -= batch_sector_num;
+		sector_index += batch_sector_num;
+	}
+}
+
+#else
+
+void nstool::AesXtsCipher::decryptSectorsAesNi(byte_t* dst, const byte_t* src, size_t sector_num, uint64_t sector_index) const
+{
+	decryptSectorsSoftware(dst, src, sector_num, sector_index);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+#include "types.h"
+#include "AesKeySchedule.h"
+
+#include <vector>
+
+namespace nstool {
+
+/**
+ * @class AesXtsCipher
+ * @brief AES-128-XTS sector decryption with runtime selected backends.
+ *
+ * The tweak for each sector is the sector number as a 128-bit big-endian integer (the "Nintendo" tweak, as used by NCA headers), encrypted with the tweak key.
+ * Backends:
+ * - Software: tc::crypto AES-128-ECB over whole sectors, with the tweaks for a sector generated up front
+ * - AesNi: x86 AES-NI, 8 blocks interleaved, with the tweaks for the next blocks computed in registers while the current blocks are decrypted
+ */
+class AesXtsCipher
+{
+public:
+	enum Backend
+	{
+		BACKEND_AUTO,
+		BACKEND_SOFTWARE,
+		BACKEND_AESNI
+	};
+
+	static const size_t kKeySize = 16;
+	static const size_t kBlockSize = 16;
+
+	AesXtsCipher();
+
+	// data_key decrypts the data, tweak_key encrypts the sector number. sector_size must be a non-zero multiple of the AES block size
+	void initialize(const byte_t* data_key, const byte_t* tweak_key, size_t sector_size, Backend backend = BACKEND_AUTO);
+	void initialize(const AesKeySchedule& data_key, const AesKeySchedule& tweak_key, size_t sector_size, Backend backend = BACKEND_AUTO);
+
+	// decrypt whole sectors, the first of which is sector_index. size must be a multiple of the sector size, dst and src may be the same
+	void decrypt(byte_t* dst, const byte_t* src, size_t size, uint64_t sector_index) const;
+
+	size_t getSectorSize() const;
+	Backend getBackend() const;
+
+	static Backend getPreferredBackend();
+	static bool isBackendSupported(Backend backend);
+	static std::string getBackendName(Backend backend);
+	static std::vector<Backend> getSupportedBackends();
+private:
+	std::string mModuleLabel;
+
+	Backend mBackend;
+	size_t mSectorSize;
+	AesKeySchedule mDataKey;
+	AesKeySchedule mTweakKey;
+
+	void decryptSectorsSoftware(byte_t* dst, const byte_t* src, size_t sector_num, uint64_t sector_index) const;
+	void decryptSectorsAesNi(byte_t* dst, const byte_t* src, size_t sector_num, uint64_t sector_index) const;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "AesXtsEncryptedStream.h"
+
+#include <tc/ObjectDisposedException.h>
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+nstool::AesXtsEncryptedStream::AesXtsEncryptedStream(const std::shared_ptr<tc::io::IStream>& stream, const pie::hac::detail::aes128_xtskey_t& key, size_t sector_size, const std::shared_ptr<ThreadPool>& thread_pool, AesXtsCipher::Backend backend) :
+	AesXtsEncryptedStream(stream, AesKeySchedule(key[0]), AesKeySchedule(key[1]), sector_size, thread_pool, backend)
+{
+}
+
+nstool::AesXtsEncryptedStream::AesXtsEncryptedStream(const std::shared_ptr<tc::io::IStream>& stream, const AesKeySchedule& data_key, const AesKeySchedule& tweak_key, size_t sector_size, const std::shared_ptr<ThreadPool>& thread_pool, AesXtsCipher::Backend backend) :
+	mModuleLabel("nstool::AesXtsEncryptedStream"),
+	mBaseStream(stream),
+	mCipher(),
+	mThreadPool(thread_pool),
+	mSectorBuffer()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "stream is null.");
+	}
+	if (mBaseStream->canRead() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support reading.");
+	}
+	if (mBaseStream->canSeek() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support seeking.");
+	}
+
+	mCipher.initialize(data_key, tweak_key, sector_size, backend);
+
+	if (mBaseStream->length() % tc::io::IOUtil::castSizeToInt64(sector_size) != 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel, "stream length is not a multiple of the sector size.");
+	}
+
+	mSectorBuffer = tc::ByteData(sector_size);
+}
+
+bool nstool::AesXtsEncryptedStream::canRead() const
+{
+	return mBaseStream == nullptr ? false : mBaseStream->canRead();
+}
+
+bool nstool::AesXtsEncryptedStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::AesXtsEncryptedStream::canSeek() const
+{
+	return mBaseStream == nullptr ? false : mBaseStream->canSeek();
+}
+
+int64_t nstool::AesXtsEncryptedStream::length()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mBaseStream->length();
+}
+
+int64_t nstool::AesXtsEncryptedStream::position()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mBaseStream->position();
+}
+
+size_t nstool::AesXtsEncryptedStream::read(byte_t* ptr, size_t count)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	int64_t sector_size = tc::io::IOUtil::castSizeToInt64(mCipher.getSectorSize());
+	int64_t start = mBaseStream->position();
+	int64_t end = std::min<int64_t>(start + tc::io::IOUtil::castSizeToInt64(count), mBaseStream->length());
+
+	int64_t pos = start;
+	while (pos < end)
+	{
+		int64_t sector_index = pos / sector_size;
+		int64_t sector_offset = pos % sector_size;
+
+		// whole sectors are read directly into the caller's buffer and decrypted in place
+		int64_t sector_num = sector_offset == 0 ? (end - pos) / sector_size : 0;
+		if (sector_num > 0)
+		{
+			size_t size = tc::io::IOUtil::castInt64ToSize(sector_num * sector_size);
+			byte_t* data = ptr + (pos - start);
+			readBaseStream(pos, data, size);
+			if (mThreadPool != nullptr && size >= kParallelMinReadSize)
+				decryptParallel(data, size, uint64_t(sector_index));
+			else
+				mCipher.decrypt(data, data, size, uint64_t(sector_index));
+
+			pos += sector_num * sector_size;
+			continue;
+		}
+
+		// a partially read sector is decrypted in the sector buffer
+		readBaseStream(sector_index * sector_size, mSectorBuffer.data(), mSectorBuffer.size());
+		mCipher.decrypt(mSectorBuffer.data(), mSectorBuffer.data(), mSectorBuffer.size(), uint64_t(sector_index));
+
+		int64_t len = std::min<int64_t>(end, (sector_index + 1) * sector_size) - pos;
+		memcpy(ptr + (pos - start), mSectorBuffer.data() + sector_offset, tc::io::IOUtil::castInt64ToSize(len));
+		pos += len;
+	}
+
+	mBaseStream->seek(pos, tc::io::SeekOrigin::Begin);
+
+	return tc::io::IOUtil::castInt64ToSize(pos - start);
+}
+
+size_t nstool::AesXtsEncryptedStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for AesXtsEncryptedStream.");
+}
+
+int64_t nstool::AesXtsEncryptedStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	return mBaseStream->seek(offset, origin);
+}
+
+void nstool::AesXtsEncryptedStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for AesXtsEncryptedStream.");
+}
+
+void nstool::AesXtsEncryptedStream::flush()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+
+	mBaseStream->flush();
+}
+
+void nstool::AesXtsEncryptedStream::dispose()
+{
+	if (mBaseStream.get() != nullptr)
+	{
+		mBaseStream->dispose();
+		mBaseStream.reset();
+	}
+}
+
+void nstool::AesXtsEncryptedStream::readBaseStream(int64_t offset, byte_t* data, size_t size)
+{
+	mBaseStream->seek(offset, tc::io::SeekOrigin::Begin);
+	for (size_t pos = 0; pos < size;)
+	{
+		size_t len = mBaseStream->read(data + pos, size - pos);
+		if (len == 0)
+		{
+			throw tc::io::IOException(mModuleLabel, fmt::format("Failed to read sector data at offset 0x{:x}.", offset + tc::io::IOUtil::castSizeToInt64(pos)));
+		}
+		pos += len;
+	}
+}
+
+void nstool::AesXtsEncryptedStream::decryptParallel(byte_t* data, size_t size, uint64_t sector_index)
+{
+	size_t sector_size = mCipher.getSectorSize();
+	size_t chunk_size = std::max<size_t>(kParallelChunkSize / sector_size, 1) * sector_size;
+
+	const AesXtsCipher* cipher = &mCipher;
+	std::vector<std::function<void()>> tasks;
+	for (size_t pos = 0; pos < size; pos += chunk_size)
+	{
+		byte_t* chunk_data = data + pos;
+		size_t chunk_data_size = std::min<size_t>(chunk_size, size - pos);
+		uint64_t chunk_sector_index = sector_index + pos / sector_size;
+		tasks.push_back([cipher, chunk_data, chunk_data_size, chunk_sector_index]() {
+			cipher->decrypt(chunk_data, chunk_data, chunk_data_size, chunk_sector_index);
+		});
+	}
+
+	// the first chunk is decrypted by this thread, the others by the thread pool
+	mThreadPool->execute(tasks);
+}
\ No newline at end of file
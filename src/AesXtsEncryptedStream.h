@@ -0,0 +1,51 @@
+#pragma once
+#include "types.h"
+#include "AesXtsCipher.h"
+#include "ThreadPool.h"
+
+#include <pietendo/hac/define/types.h>
+
+namespace nstool {
+
+/**
+ * @class AesXtsEncryptedStream
+ * @brief Read-only AES-128-XTS decryption stream, using the fastest AesXtsCipher backend available.
+ *
+ * Sectors are numbered from offset 0 of the base stream, and the base stream length must be a multiple of the sector size.
+ * Whole sectors are read from the base stream directly into the caller's buffer and decrypted in place, partially read sectors go through a sector buffer.
+ * If a thread pool is supplied, large reads are split into chunks of whole sectors which are decrypted in parallel. Small reads are decrypted inline.
+ */
+class AesXtsEncryptedStream : public tc::io::IStream
+{
+public:
+	// key[0] is the data key, key[1] is the tweak key (same layout as KeyBag::nca_header_key)
+	AesXtsEncryptedStream(const std::shared_ptr<tc::io::IStream>& stream, const pie::hac::detail::aes128_xtskey_t& key, size_t sector_size, const std::shared_ptr<ThreadPool>& thread_pool = nullptr, AesXtsCipher::Backend backend = AesXtsCipher::BACKEND_AUTO);
+	AesXtsEncryptedStream(const std::shared_ptr<tc::io::IStream>& stream, const AesKeySchedule& data_key, const AesKeySchedule& tweak_key, size_t sector_size, const std::shared_ptr<ThreadPool>& thread_pool = nullptr, AesXtsCipher::Backend backend = AesXtsCipher::BACKEND_AUTO);
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	static const size_t kParallelChunkSize = 0x40000; // size of each chunk decrypted by a worker thread (rounded down to a multiple of the sector size)
+	static const size_t kParallelMinReadSize = 0x80000; // smaller reads are decrypted inline
+
+	std::string mModuleLabel;
+
+	std::shared_ptr<tc::io::IStream> mBaseStream;
+	AesXtsCipher mCipher;
+	std::shared_ptr<ThreadPool> mThreadPool;
+	tc::ByteData mSectorBuffer;
+
+	void readBaseStream(int64_t offset, byte_t* data, size_t size);
+	void decryptParallel(byte_t* data, size_t size, uint64_t sector_index);
+};
+
+}
\ No newline at end of file
@@ -53,6 +53,41 @@ void nstool::AssetProcess::setRomfsExtractJobs(const std::vector<nstool::Extract
 	mRomfs.setExtractJobs(extract_jobs);
 }
 
+void nstool::AssetProcess::setRomfsShowExtractPlan(bool show_extract_plan)
+{
+	mRomfs.setShowExtractPlan(show_extract_plan);
+}
+
+void nstool::AssetProcess::setRomfsResumeMode(bool resume)
+{
+	mRomfs.setResumeMode(resume);
+}
+
+void nstool::AssetProcess::setRomfsDedupeMode(bool dedupe)
+{
+	mRomfs.setDedupeMode(dedupe);
+}
+
+void nstool::AssetProcess::setRomfsMappedOutputMode(bool mapped_output)
+{
+	mRomfs.setMappedOutputMode(mapped_output);
+}
+
+void nstool::AssetProcess::setRomfsIoQueueDepth(size_t io_queue_depth)
+{
+	mRomfs.setIoQueueDepth(io_queue_depth);
+}
+
+void nstool::AssetProcess::setRomfsExtractFormat(nstool::ExtractFormat extract_format)
+{
+	mRomfs.setExtractFormat(extract_format);
+}
+
+void nstool::AssetProcess::setRomfsThreadNum(size_t thread_num)
+{
+	mRomfs.setThreadNum(thread_num);
+}
+
 void nstool::AssetProcess::importHeader()
 {
 	if (mFile == nullptr)
@@ -23,6 +23,13 @@ public:
 	
 	void setRomfsShowFsTree(bool show_fs_tree);
 	void setRomfsExtractJobs(const std::vector<nstool::ExtractJob>& extract_jobs);
+	void setRomfsShowExtractPlan(bool show_extract_plan);
+	void setRomfsResumeMode(bool resume);
+	void setRomfsDedupeMode(bool dedupe);
+	void setRomfsMappedOutputMode(bool mapped_output);
+	void setRomfsIoQueueDepth(size_t io_queue_depth);
+	void setRomfsExtractFormat(nstool::ExtractFormat extract_format);
+	void setRomfsThreadNum(size_t thread_num);
 private:
 	std::string mModuleName;
 
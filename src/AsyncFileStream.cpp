@@ -0,0 +1,818 @@
+#include "AsyncFileStream.h"
+
+#include <tc/ObjectDisposedException.h>
+#include <tc/io/FileNotFoundException.h>
+#include <tc/io/FileExistsException.h>
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define NSTOOL_ASYNCFILESTREAM_IO_URING 1
+#endif
+#endif
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+struct nstool::AsyncFileStream::sState
+{
+	// file
+	int fd;
+	bool can_read;
+	bool can_write;
+	int64_t length;
+	int64_t position;
+
+	// io_uring
+	int ring_fd;
+	byte_t* sq_map;
+	size_t sq_map_size;
+	byte_t* cq_map;
+	size_t cq_map_size;
+	io_uring_sqe* sqes;
+	size_t sqes_map_size;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	io_uring_cqe* cqes;
+	size_t inflight_num;
+
+	// each block buffer can have one read or write in flight
+	enum SlotState
+	{
+		SLOT_FREE,
+		SLOT_FILLING, // write data is being buffered
+		SLOT_READ_PENDING,
+		SLOT_READ_COMPLETE,
+		SLOT_WRITE_PENDING
+	};
+	struct sSlot
+	{
+		SlotState state;
+		int64_t offset;
+		size_t length;
+		int32_t result;
+		struct iovec iov;
+		tc::ByteData buffer;
+	};
+	std::vector<sSlot> slots;
+	size_t block_size;
+
+	std::deque<size_t> read_queue; // readahead slots, in offset order
+	size_t read_window; // number of blocks to read ahead
+	int64_t write_slot; // slot being filled with write data, or -1
+	std::string write_error;
+
+	sState() :
+		fd(-1),
+		can_read(false),
+		can_write(false),
+		length(0),
+		position(0),
+		ring_fd(-1),
+		sq_map(nullptr),
+		sq_map_size(0),
+		cq_map(nullptr),
+		cq_map_size(0),
+		sqes(nullptr),
+		sqes_map_size(0),
+		sq_tail(nullptr),
+		sq_mask(nullptr),
+		sq_array(nullptr),
+		cq_head(nullptr),
+		cq_tail(nullptr),
+		cq_mask(nullptr),
+		cqes(nullptr),
+		inflight_num(0),
+		slots(),
+		block_size(0),
+		read_queue(),
+		read_window(1),
+		write_slot(-1),
+		write_error()
+	{}
+
+	bool setupRing(unsigned entries)
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+
+		ring_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+		if (ring_fd < 0)
+		{
+			ring_fd = -1;
+			return false;
+		}
+
+		sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			sq_map_size = cq_map_size = std::max<size_t>(sq_map_size, cq_map_size);
+		}
+
+		void* map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+		if (map == MAP_FAILED)
+		{
+			return false;
+		}
+		sq_map = (byte_t*)map;
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			cq_map = sq_map;
+		}
+		else
+		{
+			map = mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+			if (map == MAP_FAILED)
+			{
+				return false;
+			}
+			cq_map = (byte_t*)map;
+		}
+
+		sqes_map_size = params.sq_entries * sizeof(io_uring_sqe);
+		map = mmap(nullptr, sqes_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+		if (map == MAP_FAILED)
+		{
+			return false;
+		}
+		sqes = (io_uring_sqe*)map;
+
+		sq_tail = (unsigned*)(sq_map + params.sq_off.tail);
+		sq_mask = (unsigned*)(sq_map + params.sq_off.ring_mask);
+		sq_array = (unsigned*)(sq_map + params.sq_off.array);
+		cq_head = (unsigned*)(cq_map + params.cq_off.head);
+		cq_tail = (unsigned*)(cq_map + params.cq_off.tail);
+		cq_mask = (unsigned*)(cq_map + params.cq_off.ring_mask);
+		cqes = (io_uring_cqe*)(cq_map + params.cq_off.cqes);
+
+		return true;
+	}
+
+	void closeRing()
+	{
+		if (sqes != nullptr)
+		{
+			munmap(sqes, sqes_map_size);
+			sqes = nullptr;
+		}
+		if (cq_map != nullptr && cq_map != sq_map)
+		{
+			munmap(cq_map, cq_map_size);
+		}
+		cq_map = nullptr;
+		if (sq_map != nullptr)
+		{
+			munmap(sq_map, sq_map_size);
+			sq_map = nullptr;
+		}
+		if (ring_fd != -1)
+		{
+			close(ring_fd);
+			ring_fd = -1;
+		}
+	}
+
+	int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+	{
+		int ret;
+		do {
+			ret = int(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+		} while (ret < 0 && errno == EINTR);
+
+		return ret;
+	}
+
+	void submit(size_t slot_index, uint8_t opcode)
+	{
+		sSlot& slot = slots[slot_index];
+		slot.iov.iov_base = slot.buffer.data();
+		slot.iov.iov_len = slot.length;
+
+		// there are never more requests in flight than slots, so the submission queue always has room
+		unsigned tail = *sq_tail;
+		unsigned index = tail & *sq_mask;
+		io_uring_sqe* sqe = &sqes[index];
+		memset(sqe, 0, sizeof(io_uring_sqe));
+		sqe->opcode = opcode;
+		sqe->fd = fd;
+		sqe->addr = uint64_t(uintptr_t(&slot.iov));
+		sqe->len = 1;
+		sqe->off = uint64_t(slot.offset);
+		sqe->user_data = slot_index;
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+		if (enter(1, 0, 0) != 1)
+		{
+			throw tc::io::IOException("nstool::AsyncFileStream", fmt::format("Failed to submit io_uring request ({:s}).", strerror(errno)));
+		}
+
+		slot.state = (opcode == IORING_OP_READV) ? SLOT_READ_PENDING : SLOT_WRITE_PENDING;
+		inflight_num++;
+	}
+
+	void complete(size_t slot_index, int32_t result, bool is_read)
+	{
+		sSlot& slot = slots[slot_index];
+		slot.result = result;
+
+		if (is_read)
+		{
+			slot.state = SLOT_READ_COMPLETE;
+			return;
+		}
+
+		// finish short writes synchronously
+		size_t written = result < 0 ? 0 : size_t(result);
+		while (result >= 0 && written < slot.length)
+		{
+			ssize_t res = pwrite(fd, slot.buffer.data() + written, slot.length - written, off_t(slot.offset + int64_t(written)));
+			if (res <= 0)
+			{
+				result = res < 0 ? -errno : -EIO;
+				break;
+			}
+			written += size_t(res);
+		}
+		if (result < 0 && write_error.empty())
+		{
+			write_error = fmt::format("Failed to write to file ({:s}).", strerror(-result));
+		}
+		slot.state = SLOT_FREE;
+	}
+
+	// process completed requests, optionally waiting for at least one
+	void reap(bool wait)
+	{
+		if (wait && inflight_num > 0 && __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) == *cq_head)
+		{
+			enter(0, 1, IORING_ENTER_GETEVENTS);
+		}
+
+		unsigned head = *cq_head;
+		unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			io_uring_cqe* cqe = &cqes[head & *cq_mask];
+			size_t slot_index = size_t(cqe->user_data);
+			int32_t result = cqe->res;
+
+			inflight_num--;
+			complete(slot_index, result, slots[slot_index].state == SLOT_READ_PENDING);
+		}
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	void waitSlot(size_t slot_index)
+	{
+		while (slots[slot_index].state == SLOT_READ_PENDING || slots[slot_index].state == SLOT_WRITE_PENDING)
+		{
+			reap(true);
+		}
+	}
+
+	int64_t getFreeSlot(bool wait)
+	{
+		while (true)
+		{
+			for (size_t i = 0; i < slots.size(); i++)
+			{
+				if (slots[i].state == SLOT_FREE)
+				{
+					return int64_t(i);
+				}
+			}
+
+			if (wait == false || inflight_num == 0)
+			{
+				return -1;
+			}
+			reap(true);
+		}
+	}
+
+	void releaseReadSlot(size_t slot_index)
+	{
+		waitSlot(slot_index);
+		slots[slot_index].state = SLOT_FREE;
+	}
+
+	void discardReadahead()
+	{
+		for (auto itr = read_queue.begin(); itr != read_queue.end(); itr++)
+		{
+			releaseReadSlot(*itr);
+		}
+		read_queue.clear();
+		read_window = 1;
+	}
+
+	void submitWriteSlot()
+	{
+		if (write_slot != -1)
+		{
+			size_t slot_index = size_t(write_slot);
+			write_slot = -1;
+			submit(slot_index, IORING_OP_WRITEV);
+		}
+	}
+
+	void drainWrites()
+	{
+		submitWriteSlot();
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			while (slots[i].state == SLOT_WRITE_PENDING)
+			{
+				reap(true);
+			}
+		}
+	}
+};
+
+#else
+
+struct nstool::AsyncFileStream::sState
+{
+};
+
+#endif
+
+nstool::AsyncFileStream::AsyncFileStream(const tc::io::Path& path, tc::io::FileMode mode, tc::io::FileAccess access, size_t queue_depth, size_t block_size) :
+	mModuleLabel("nstool::AsyncFileStream"),
+	mState()
+{
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	if (queue_depth == 0 || block_size == 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel, "queue_depth and block_size must be non-zero.");
+	}
+
+	std::unique_ptr<sState> state = std::unique_ptr<sState>(new sState());
+
+	// determine open flags
+	int flags = O_CLOEXEC;
+	switch (access)
+	{
+		case (tc::io::FileAccess::Read):
+			flags |= O_RDONLY;
+			state->can_read = true;
+			break;
+		case (tc::io::FileAccess::Write):
+			flags |= O_WRONLY;
+			state->can_write = true;
+			break;
+		case (tc::io::FileAccess::ReadWrite):
+			flags |= O_RDWR;
+			state->can_read = true;
+			state->can_write = true;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel, "Unknown file access.");
+	}
+	switch (mode)
+	{
+		case (tc::io::FileMode::CreateNew):
+			flags |= O_CREAT | O_EXCL;
+			break;
+		case (tc::io::FileMode::Create):
+			flags |= O_CREAT | O_TRUNC;
+			break;
+		case (tc::io::FileMode::Open):
+			break;
+		case (tc::io::FileMode::OpenOrCreate):
+			flags |= O_CREAT;
+			break;
+		case (tc::io::FileMode::Truncate):
+			flags |= O_TRUNC;
+			break;
+		case (tc::io::FileMode::Append):
+			flags |= O_CREAT;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel, "Unknown file mode.");
+	}
+
+	state->fd = open(path.to_string().c_str(), flags, 0666);
+	if (state->fd == -1)
+	{
+		int err = errno;
+		if (err == ENOENT)
+			throw tc::io::FileNotFoundException(mModuleLabel, fmt::format("Failed to open file ({:s}).", path.to_string()));
+		if (err == EEXIST)
+			throw tc::io::FileExistsException(mModuleLabel, fmt::format("File already exists ({:s}).", path.to_string()));
+		throw tc::io::IOException(mModuleLabel, fmt::format("Failed to open file ({:s}): {:s}", path.to_string(), strerror(err)));
+	}
+
+	struct stat file_stat;
+	if (fstat(state->fd, &file_stat) != 0)
+	{
+		close(state->fd);
+		throw tc::io::IOException(mModuleLabel, "Failed to get file status.");
+	}
+	state->length = int64_t(file_stat.st_size);
+	state->position = (mode == tc::io::FileMode::Append) ? state->length : 0;
+
+	if (state->setupRing(unsigned(queue_depth)) == false)
+	{
+		state->closeRing();
+		close(state->fd);
+		throw tc::NotSupportedException(mModuleLabel, "Failed to create io_uring instance.");
+	}
+
+	state->block_size = block_size;
+	state->slots.resize(queue_depth);
+	for (auto itr = state->slots.begin(); itr != state->slots.end(); itr++)
+	{
+		itr->state = sState::SLOT_FREE;
+		itr->offset = 0;
+		itr->length = 0;
+		itr->result = 0;
+		itr->buffer = tc::ByteData(block_size);
+	}
+
+	mState = std::move(state);
+#else
+	throw tc::NotSupportedException(mModuleLabel, "io_uring is not supported on this platform.");
+#endif
+}
+
+nstool::AsyncFileStream::~AsyncFileStream()
+{
+	try {
+		dispose();
+	}
+	catch (...) {
+		// errors can't be reported from a destructor
+	}
+}
+
+bool nstool::AsyncFileStream::isSupported()
+{
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	// io_uring may be missing (kernel < 5.1) or disabled (e.g. by seccomp or sysctl)
+	static const bool is_supported = []() {
+		sState state;
+		bool ret = state.setupRing(1);
+		state.closeRing();
+		return ret;
+	}();
+
+	return is_supported;
+#else
+	return false;
+#endif
+}
+
+bool nstool::AsyncFileStream::canRead() const
+{
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	return mState != nullptr && mState->can_read;
+#else
+	return false;
+#endif
+}
+
+bool nstool::AsyncFileStream::canWrite() const
+{
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	return mState != nullptr && mState->can_write;
+#else
+	return false;
+#endif
+}
+
+bool nstool::AsyncFileStream::canSeek() const
+{
+	return mState != nullptr;
+}
+
+int64_t nstool::AsyncFileStream::length()
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	return mState->length;
+#else
+	return 0;
+#endif
+}
+
+int64_t nstool::AsyncFileStream::position()
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	return mState->position;
+#else
+	return 0;
+#endif
+}
+
+size_t nstool::AsyncFileStream::read(byte_t* ptr, size_t count)
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	sState& s = *mState;
+	if (s.can_read == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel+"::read()", "Stream does not support reading.");
+	}
+
+	// written data must reach the file before it can be read back
+	if (s.can_write)
+	{
+		s.drainWrites();
+	}
+
+	if (s.position >= s.length)
+	{
+		return 0;
+	}
+	count = size_t(std::min<int64_t>(int64_t(count), s.length - s.position));
+
+	size_t read_len = 0;
+	while (read_len < count)
+	{
+		// discard readahead blocks that don't contain the position, if the position moved backwards or jumped ahead readahead restarts
+		while (s.read_queue.empty() == false)
+		{
+			sState::sSlot& front = s.slots[s.read_queue.front()];
+			if (front.offset <= s.position && s.position < front.offset + int64_t(front.length))
+			{
+				break;
+			}
+
+			bool is_sequential = s.position >= front.offset + int64_t(front.length) && s.position < front.offset + int64_t(front.length) + int64_t(s.block_size);
+			s.releaseReadSlot(s.read_queue.front());
+			s.read_queue.pop_front();
+			if (is_sequential == false)
+			{
+				s.discardReadahead();
+			}
+		}
+
+		// queue reads up to the readahead window
+		int64_t next_offset = s.read_queue.empty() ? (s.position - (s.position % int64_t(s.block_size))) : (s.slots[s.read_queue.back()].offset + int64_t(s.slots[s.read_queue.back()].length));
+		while (s.read_queue.size() < s.read_window && next_offset < s.length)
+		{
+			int64_t slot_index = s.getFreeSlot(s.read_queue.empty());
+			if (slot_index == -1)
+			{
+				break;
+			}
+
+			sState::sSlot& slot = s.slots[size_t(slot_index)];
+			slot.offset = next_offset;
+			slot.length = size_t(std::min<int64_t>(int64_t(s.block_size), s.length - next_offset));
+			s.read_queue.push_back(size_t(slot_index));
+			s.submit(size_t(slot_index), IORING_OP_READV);
+
+			next_offset += int64_t(slot.length);
+		}
+
+		// wait for the block containing the position
+		size_t slot_index = s.read_queue.front();
+		sState::sSlot& slot = s.slots[slot_index];
+		s.waitSlot(slot_index);
+		if (slot.result < 0)
+		{
+			int err = -slot.result;
+			s.discardReadahead();
+			throw tc::io::IOException(mModuleLabel+"::read()", fmt::format("Failed to read from file ({:s}).", strerror(err)));
+		}
+
+		// finish short reads synchronously
+		while (size_t(slot.result) < slot.length)
+		{
+			ssize_t res = pread(s.fd, slot.buffer.data() + slot.result, slot.length - size_t(slot.result), off_t(slot.offset + slot.result));
+			if (res <= 0)
+			{
+				s.discardReadahead();
+				throw tc::io::IOException(mModuleLabel+"::read()", "Failed to read from file (unexpected end of file).");
+			}
+			slot.result += int32_t(res);
+		}
+
+		size_t slot_pos = size_t(s.position - slot.offset);
+		size_t copy_len = std::min<size_t>(count - read_len, slot.length - slot_pos);
+		memcpy(ptr + read_len, slot.buffer.data() + slot_pos, copy_len);
+		read_len += copy_len;
+		s.position += int64_t(copy_len);
+
+		// block was fully read, so grow the readahead window
+		if (slot_pos + copy_len == slot.length)
+		{
+			s.releaseReadSlot(slot_index);
+			s.read_queue.pop_front();
+			s.read_window = std::min<size_t>(s.read_window * 2, s.slots.size());
+		}
+	}
+
+	return read_len;
+#else
+	return 0;
+#endif
+}
+
+size_t nstool::AsyncFileStream::write(const byte_t* ptr, size_t count)
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::write()", "Failed to write to stream (stream is disposed)");
+	}
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	sState& s = *mState;
+	if (s.can_write == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel+"::write()", "Stream does not support writing.");
+	}
+	if (s.write_error.empty() == false)
+	{
+		throw tc::io::IOException(mModuleLabel+"::write()", s.write_error);
+	}
+
+	// readahead is stale once the file is modified
+	s.discardReadahead();
+
+	size_t write_len = 0;
+	while (write_len < count)
+	{
+		// data is buffered into blocks, which are written once full or when the position is moved
+		if (s.write_slot != -1)
+		{
+			sState::sSlot& slot = s.slots[size_t(s.write_slot)];
+			if (slot.offset + int64_t(slot.length) != s.position || slot.length == s.block_size)
+			{
+				s.submitWriteSlot();
+			}
+		}
+		if (s.write_slot == -1)
+		{
+			s.write_slot = s.getFreeSlot(true);
+			sState::sSlot& slot = s.slots[size_t(s.write_slot)];
+			slot.state = sState::SLOT_FILLING;
+			slot.offset = s.position;
+			slot.length = 0;
+		}
+
+		sState::sSlot& slot = s.slots[size_t(s.write_slot)];
+		size_t copy_len = std::min<size_t>(count - write_len, s.block_size - slot.length);
+		memcpy(slot.buffer.data() + slot.length, ptr + write_len, copy_len);
+		slot.length += copy_len;
+		write_len += copy_len;
+		s.position += int64_t(copy_len);
+		s.length = std::max<int64_t>(s.length, s.position);
+
+		if (slot.length == s.block_size)
+		{
+			s.submitWriteSlot();
+		}
+
+		if (s.write_error.empty() == false)
+		{
+			throw tc::io::IOException(mModuleLabel+"::write()", s.write_error);
+		}
+	}
+
+	// collect completed writes, so slots are available without waiting
+	s.reap(false);
+
+	return write_len;
+#else
+	return 0;
+#endif
+}
+
+int64_t nstool::AsyncFileStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	int64_t new_position = 0;
+	switch (origin)
+	{
+		case (tc::io::SeekOrigin::Begin):
+			new_position = offset;
+			break;
+		case (tc::io::SeekOrigin::Current):
+			new_position = mState->position + offset;
+			break;
+		case (tc::io::SeekOrigin::End):
+			new_position = mState->length + offset;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Unknown seek origin.");
+	}
+
+	if (new_position < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Stream position cannot be negative.");
+	}
+
+	// readahead/write-behind is adjusted on the next read()/write()
+	mState->position = new_position;
+
+	return mState->position;
+#else
+	return 0;
+#endif
+}
+
+void nstool::AsyncFileStream::setLength(int64_t length)
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::setLength()", "Failed to set stream length (stream is disposed)");
+	}
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	if (mState->can_write == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel+"::setLength()", "Stream does not support writing.");
+	}
+
+	flush();
+	mState->discardReadahead();
+	if (ftruncate(mState->fd, off_t(length)) != 0)
+	{
+		throw tc::io::IOException(mModuleLabel+"::setLength()", "Failed to set file length.");
+	}
+	mState->length = length;
+#endif
+}
+
+void nstool::AsyncFileStream::flush()
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	mState->drainWrites();
+	if (mState->write_error.empty() == false)
+	{
+		throw tc::io::IOException(mModuleLabel+"::flush()", mState->write_error);
+	}
+#endif
+}
+
+void nstool::AsyncFileStream::dispose()
+{
+	if (mState == nullptr)
+	{
+		return;
+	}
+
+#ifdef NSTOOL_ASYNCFILESTREAM_IO_URING
+	// all requests must be complete before their buffers are released
+	std::unique_ptr<sState> state = std::move(mState);
+	state->discardReadahead();
+	state->drainWrites();
+	state->closeRing();
+	int close_result = close(state->fd);
+
+	if (state->write_error.empty() == false)
+	{
+		throw tc::io::IOException(mModuleLabel+"::dispose()", state->write_error);
+	}
+	if (close_result != 0)
+	{
+		throw tc::io::IOException(mModuleLabel+"::dispose()", "Failed to close file.");
+	}
+#else
+	mState.reset();
+#endif
+}
\ No newline at end of file
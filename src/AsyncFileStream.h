@@ -0,0 +1,44 @@
+#pragma once
+#include "types.h"
+
+namespace nstool {
+
+/**
+ * @class AsyncFileStream
+ * @brief File stream that keeps several reads (readahead) or writes (write-behind) in flight using io_uring.
+ *
+ * Sequential reads are served from blocks read ahead of the stream position, the readahead window grows while reads stay sequential.
+ * Writes are buffered into blocks that are written asynchronously, errors from these writes are thrown by the next write()/flush().
+ * This is only available on Linux kernels with io_uring, see isSupported(). Like FileStream, an instance must only be used by one thread at a time.
+ */
+class AsyncFileStream : public tc::io::IStream
+{
+public:
+	static const size_t kDefaultBlockSize = 0x40000;
+
+	AsyncFileStream(const tc::io::Path& path, tc::io::FileMode mode, tc::io::FileAccess access, size_t queue_depth, size_t block_size = kDefaultBlockSize);
+	~AsyncFileStream();
+
+	// returns true if io_uring can be used by this process
+	static bool isSupported();
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	std::string mModuleLabel;
+
+	// io_uring/file state (defined in the source file, so platform headers aren't exposed)
+	struct sState;
+	std::unique_ptr<sState> mState;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "BenchmarkProcess.h"
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+nstool::BenchmarkProcess::BenchmarkProcess() :
+	mModuleName("nstool::BenchmarkProcess")
+{
+}
+
+void nstool::BenchmarkProcess::process()
+{
+	benchmarkAesCtr();
+	benchmarkAesXts();
+	benchmarkSha256();
+	benchmarkBucketTree();
+}
+
+void nstool::BenchmarkProcess::benchmarkAesCtr()
+{
+	// fixed key/counter, the counter low half is close to wrapping so the carry path is exercised
+	byte_t key[AesCtrCipher::kKeySize];
+	byte_t counter[AesCtrCipher::kCounterSize];
+	for (size_t i = 0; i < AesCtrCipher::kKeySize; i++)
+	{
+		key[i] = byte_t(i * 0x11);
+	}
+	memset(counter, 0, sizeof(counter));
+	memset(counter + 8, 0xff, 7);
+
+	tc::ByteData src(kBufferSize);
+	tc::ByteData dst(kBufferSize);
+	tc::ByteData reference(kBufferSize);
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		src.data()[i] = byte_t(i * 7);
+	}
+
+	// software output is the reference each other backend is checked against
+	AesCtrCipher reference_cipher;
+	reference_cipher.initialize(key, counter, AesCtrCipher::BACKEND_SOFTWARE);
+	reference_cipher.crypt(reference.data(), src.data(), src.size(), 0);
+
+	fmt::print("[AES-128-CTR Benchmark]\n");
+	fmt::print("  Buffer Size:  0x{:x} ({:d} iterations)\n", kBufferSize, kIterationNum);
+	fmt::print("  Preferred:    {:s}\n", AesCtrCipher::getBackendName(AesCtrCipher::getPreferredBackend()));
+	for (auto backend : AesCtrCipher::getSupportedBackends())
+	{
+		AesCtrCipher cipher;
+		cipher.initialize(key, counter, backend);
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < kIterationNum; i++)
+		{
+			cipher.crypt(dst.data(), src.data(), src.size(), 0);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		double gbps = (double(kBufferSize) * double(kIterationNum)) / (seconds * 1e9);
+		bool is_valid = memcmp(dst.data(), reference.data(), dst.size()) == 0;
+
+		fmt::print("  {:<14s}{:8.2f} GB/s {:s}\n", AesCtrCipher::getBackendName(backend) + ":", gbps, is_valid ? "(output OK)" : "(output MISMATCH)");
+	}
+}
+
+void nstool::BenchmarkProcess::benchmarkAesXts()
+{
+	// fixed data/tweak keys, NCA sector size
+	static const size_t kSectorSize = 0x200;
+	byte_t data_key[AesXtsCipher::kKeySize];
+	byte_t tweak_key[AesXtsCipher::kKeySize];
+	for (size_t i = 0; i < AesXtsCipher::kKeySize; i++)
+	{
+		data_key[i] = byte_t(i * 0x11);
+		tweak_key[i] = byte_t(i * 0x13 + 1);
+	}
+
+	tc::ByteData src(kBufferSize);
+	tc::ByteData dst(kBufferSize);
+	tc::ByteData reference(kBufferSize);
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		src.data()[i] = byte_t(i * 7);
+	}
+
+	// software output is the reference each other backend is checked against
+	AesXtsCipher reference_cipher;
+	reference_cipher.initialize(data_key, tweak_key, kSectorSize, AesXtsCipher::BACKEND_SOFTWARE);
+	reference_cipher.decrypt(reference.data(), src.data(), src.size(), 0);
+
+	fmt::print("[AES-128-XTS Benchmark]\n");
+	fmt::print("  Buffer Size:  0x{:x} ({:d} iterations)\n", kBufferSize, kIterationNum);
+	fmt::print("  Sector Size:  0x{:x}\n", kSectorSize);
+	fmt::print("  Preferred:    {:s}\n", AesXtsCipher::getBackendName(AesXtsCipher::getPreferredBackend()));
+	for (auto backend : AesXtsCipher::getSupportedBackends())
+	{
+		AesXtsCipher cipher;
+		cipher.initialize(data_key, tweak_key, kSectorSize, backend);
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < kIterationNum; i++)
+		{
+			cipher.decrypt(dst.data(), src.data(), src.size(), 0);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		double gbps = (double(kBufferSize) * double(kIterationNum)) / (seconds * 1e9);
+		bool is_valid = memcmp(dst.data(), reference.data(), dst.size()) == 0;
+
+		fmt::print("  {:<14s}{:8.2f} GB/s {:s}\n", AesXtsCipher::getBackendName(backend) + ":", gbps, is_valid ? "(output OK)" : "(output MISMATCH)");
+	}
+}
+
+void nstool::BenchmarkProcess::benchmarkSha256()
+{
+	tc::ByteData src(kBufferSize);
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		src.data()[i] = byte_t(i * 7);
+	}
+
+	// split the buffer into hash-tree sized blocks
+	std::vector<const byte_t*> blocks;
+	for (size_t offset = 0; offset < src.size(); offset += kHashTreeBlockSize)
+	{
+		blocks.push_back(src.data() + offset);
+	}
+
+	// software output is the reference each other backend is checked against
+	byte_t reference[Sha256Generator::kHashSize];
+	Sha256Generator reference_gen(Sha256Generator::BACKEND_SOFTWARE);
+	reference_gen.initialize();
+	reference_gen.update(src.data(), src.size());
+	reference_gen.getHash(reference);
+
+	tc::ByteData block_reference(blocks.size() * Sha256Generator::kHashSize);
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		reference_gen.initialize();
+		reference_gen.update(blocks[i], kHashTreeBlockSize);
+		reference_gen.getHash(block_reference.data() + i * Sha256Generator::kHashSize);
+	}
+
+	fmt::print("[SHA-256 Benchmark]\n");
+	fmt::print("  Buffer Size:  0x{:x} ({:d} iterations)\n", kBufferSize, kIterationNum);
+	fmt::print("  Preferred:    {:s}\n", Sha256Generator::getBackendName(Sha256Generator::getPreferredBackend()));
+	for (auto backend : Sha256Generator::getSupportedBackends())
+	{
+		Sha256Generator hash_gen(backend);
+		byte_t hash[Sha256Generator::kHashSize];
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < kIterationNum; i++)
+		{
+			hash_gen.initialize();
+			hash_gen.update(src.data(), src.size());
+			hash_gen.getHash(hash);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		double gbps = (double(kBufferSize) * double(kIterationNum)) / (seconds * 1e9);
+		bool is_valid = memcmp(hash, reference, sizeof(hash)) == 0;
+
+		fmt::print("  {:<14s}{:8.2f} GB/s {:s}\n", Sha256Generator::getBackendName(backend) + ":", gbps, is_valid ? "(output OK)" : "(output MISMATCH)");
+	}
+
+	// independent blocks, as hashed when verifying a hash-tree
+	fmt::print("  Hash-Tree Blocks (0x{:x} bytes each):\n", kHashTreeBlockSize);
+	for (bool use_multi_buffer : { false, true })
+	{
+		if (use_multi_buffer && Sha256Generator::isMultiBufferSupported() == false)
+			continue;
+
+		tc::ByteData block_hash(blocks.size() * Sha256Generator::kHashSize);
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < kIterationNum; i++)
+		{
+			Sha256Generator::generateHashes(block_hash.data(), blocks, kHashTreeBlockSize, use_multi_buffer);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		double gbps = (double(kBufferSize) * double(kIterationNum)) / (seconds * 1e9);
+		bool is_valid = memcmp(block_hash.data(), block_reference.data(), block_hash.size()) == 0;
+
+		std::string label = use_multi_buffer ? "AVX2 x8" : Sha256Generator::getBackendName(Sha256Generator::getPreferredBackend());
+		fmt::print("    {:<12s}{:8.2f} GB/s {:s}\n", label + ":", gbps, is_valid ? "(output OK)" : "(output MISMATCH)");
+	}
+}
+
+void nstool::BenchmarkProcess::benchmarkBucketTree()
+{
+	// synthetic IndirectStorage table with entries of varying size, laid out as stored in a patch partition
+	static const size_t kEntrySize = 0x14;
+	static const size_t kEntryPerSet = (BucketTree::kNodeSize - sizeof(BucketTree::sNodeHeader)) / kEntrySize;
+
+	std::vector<int64_t> offsets;
+	int64_t end_offset = 0;
+	for (size_t i = 0; i < kRelocationEntryNum; i++)
+	{
+		offsets.push_back(end_offset);
+		end_offset += int64_t(((i * 0x9E3779B1) % 0x40) + 1) * 0x200;
+	}
+
+	size_t entry_set_num = (offsets.size() + kEntryPerSet - 1) / kEntryPerSet;
+	size_t node_storage_size = BucketTree::getNodeStorageSize(kEntrySize, offsets.size());
+	tc::ByteData table(node_storage_size + entry_set_num * BucketTree::kNodeSize);
+	memset(table.data(), 0, table.size());
+	for (size_t i = 0; i < entry_set_num; i++)
+	{
+		size_t entry_index = i * kEntryPerSet;
+		size_t entry_num = std::min<size_t>(kEntryPerSet, offsets.size() - entry_index);
+		byte_t* entry_set = table.data() + node_storage_size + i * BucketTree::kNodeSize;
+
+		BucketTree::sNodeHeader node_hdr;
+		node_hdr.index.wrap(int32_t(i));
+		node_hdr.count.wrap(int32_t(entry_num));
+		node_hdr.end_offset.wrap(entry_index + entry_num < offsets.size() ? offsets[entry_index + entry_num] : end_offset);
+		memcpy(entry_set, &node_hdr, sizeof(node_hdr));
+
+		for (size_t j = 0; j < entry_num; j++)
+		{
+			tc::bn::le64<int64_t> entry_offset;
+			entry_offset.wrap(offsets[entry_index + j]);
+			memcpy(entry_set + sizeof(BucketTree::sNodeHeader) + j * kEntrySize, &entry_offset, sizeof(entry_offset));
+		}
+	}
+
+	BucketTree::sHeader table_hdr;
+	table_hdr.magic.wrap(BucketTree::kMagic);
+	table_hdr.version.wrap(BucketTree::kVersion);
+	table_hdr.entry_count.wrap(int32_t(offsets.size()));
+	table_hdr.reserved.wrap(0);
+
+	auto import_start = std::chrono::steady_clock::now();
+	BucketTree tree;
+	tree.initialize(table_hdr, table.data(), table.size(), kEntrySize);
+	auto import_end = std::chrono::steady_clock::now();
+
+	// random lookups (e.g. RomFs metadata and small files), and sequential reads of 0x10000 bytes (e.g. extracting large files)
+	std::vector<int64_t> random_lookups;
+	uint64_t rng = 0x123456789abcdef;
+	for (size_t i = 0; i < kLookupNum; i++)
+	{
+		rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+		random_lookups.push_back(int64_t(rng % uint64_t(end_offset)));
+	}
+
+	fmt::print("[BucketTree Lookup Benchmark]\n");
+	fmt::print("  Entries:      {:d} (0x{:x} byte table, imported in {:.2f} ms)\n", offsets.size(), table.size(), std::chrono::duration<double>(import_end - import_start).count() * 1e3);
+	fmt::print("  Lookups:      {:d}\n", kLookupNum);
+
+	// binary search of the sorted offsets, as the reference
+	std::vector<size_t> reference(random_lookups.size());
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < random_lookups.size(); i++)
+		{
+			reference[i] = size_t(std::upper_bound(offsets.begin(), offsets.end(), random_lookups[i]) - offsets.begin()) - 1;
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		fmt::print("  {:<14s}{:8.2f} M lookups/s\n", "Binary Search:", double(random_lookups.size()) / (seconds * 1e6));
+	}
+
+	{
+		bool is_valid = true;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < random_lookups.size(); i++)
+		{
+			is_valid &= tree.find(random_lookups[i]) == reference[i];
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		fmt::print("  {:<14s}{:8.2f} M lookups/s {:s}\n", "Eytzinger:", double(random_lookups.size()) / (seconds * 1e6), is_valid ? "(output OK)" : "(output MISMATCH)");
+	}
+
+	{
+		// reads are split at entry boundaries (as in IndirectStream), so each lookup continues from the previous entry
+		static const int64_t kReadSize = 0x10000;
+
+		bool is_valid = true;
+		size_t lookup_num = 0;
+		size_t hint = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int64_t offset = 0; lookup_num < kLookupNum; lookup_num++)
+		{
+			hint = tree.find(offset, hint);
+			is_valid &= offset >= tree.getEntryBeginOffset(hint) && offset < tree.getEntryEndOffset(hint);
+
+			offset = std::min<int64_t>(offset + kReadSize, tree.getEntryEndOffset(hint));
+			if (offset == end_offset)
+				offset = 0;
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		fmt::print("  {:<14s}{:8.2f} M lookups/s {:s}\n", "Sequential:", double(lookup_num) / (seconds * 1e6), is_valid ? "(output OK)" : "(output MISMATCH)");
+	}
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+#include "types.h"
+#include "AesCtrCipher.h"
+#include "AesXtsCipher.h"
+#include "Sha256Generator.h"
+#include "BucketTree.h"
+
+namespace nstool {
+
+class BenchmarkProcess
+{
+public:
+	BenchmarkProcess();
+
+	void process();
+private:
+	static const size_t kBufferSize = 0x4000000; // 64MiB
+	static const size_t kIterationNum = 8;
+	static const size_t kHashTreeBlockSize = 0x4000; // typical hash-tree block size, for the multi-buffer hash benchmark
+	static const size_t kRelocationEntryNum = 500000; // entries in the synthetic IndirectStorage table, similar to a large patch
+	static const size_t kLookupNum = 0x1000000;
+
+	std::string mModuleName;
+
+	void benchmarkAesCtr();
+	void benchmarkAesXts();
+	void benchmarkSha256();
+	void benchmarkBucketTree();
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "BucketTree.h"
+
+#include <tc/ArgumentOutOfRangeException.h>
+
+#include <cstring>
+
+nstool::BucketTree::BucketTree() :
+	mModuleLabel("nstool::BucketTree"),
+	mEntrySize(0),
+	mEntries(),
+	mOffsets(),
+	mSearchOffsets(),
+	mSearchIndex()
+{
+}
+
+void nstool::BucketTree::initialize(const sHeader& header, const byte_t* table, size_t table_size, size_t entry_size)
+{
+	if (header.magic.unwrap() != kMagic)
+	{
+		throw tc::ArgumentException(mModuleLabel, "BucketTree header had invalid magic.");
+	}
+	if (header.version.unwrap() != kVersion)
+	{
+		throw tc::ArgumentException(mModuleLabel, fmt::format("BucketTree version {:d} is not supported.", header.version.unwrap()));
+	}
+	if (header.entry_count.unwrap() < 0)
+	{
+		throw tc::ArgumentException(mModuleLabel, "BucketTree header had invalid entry count.");
+	}
+	if (entry_size < sizeof(int64_t) || entry_size > kNodeSize - sizeof(sNodeHeader))
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel, "Invalid entry size.");
+	}
+
+	size_t entry_num = size_t(header.entry_count.unwrap());
+	size_t entry_per_set = (kNodeSize - sizeof(sNodeHeader)) / entry_size;
+	size_t entry_set_num = (entry_num + entry_per_set - 1) / entry_per_set;
+	size_t node_storage_size = getNodeStorageSize(entry_size, entry_num);
+	if (table_size < node_storage_size + entry_set_num * kNodeSize)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel, "BucketTree table was too small for the number of entries.");
+	}
+
+	mEntrySize = entry_size;
+	mEntries.clear();
+	mEntries.reserve(entry_num * entry_size);
+	mOffsets.clear();
+	mOffsets.reserve(entry_num + 1);
+
+	// the node storage only indexes the entry sets, which are imported in order
+	int64_t end_offset = 0;
+	for (size_t i = 0; i < entry_set_num; i++)
+	{
+		const byte_t* entry_set = table + node_storage_size + i * kNodeSize;
+
+		sNodeHeader node_hdr;
+		memcpy(&node_hdr, entry_set, sizeof(sNodeHeader));
+		if (node_hdr.index.unwrap() != int32_t(i) || node_hdr.count.unwrap() <= 0 || size_t(node_hdr.count.unwrap()) > entry_per_set)
+		{
+			throw tc::ArgumentException(mModuleLabel, fmt::format("BucketTree entry set {:d} had an invalid header.", i));
+		}
+
+		for (size_t j = 0; j < size_t(node_hdr.count.unwrap()); j++)
+		{
+			const byte_t* entry = entry_set + sizeof(sNodeHeader) + j * entry_size;
+
+			tc::bn::le64<int64_t> entry_offset;
+			memcpy(&entry_offset, entry, sizeof(entry_offset));
+			if (entry_offset.unwrap() < 0 || (mOffsets.empty() == false && entry_offset.unwrap() < mOffsets.back()))
+			{
+				throw tc::ArgumentException(mModuleLabel, "BucketTree entries were not sorted by offset.");
+			}
+
+			mOffsets.push_back(entry_offset.unwrap());
+			mEntries.insert(mEntries.end(), entry, entry + entry_size);
+		}
+
+		end_offset = node_hdr.end_offset.unwrap();
+	}
+	if (mOffsets.size() != entry_num)
+	{
+		throw tc::ArgumentException(mModuleLabel, "BucketTree entry count did not match the entry sets.");
+	}
+	if (entry_num != 0 && end_offset < mOffsets.back())
+	{
+		throw tc::ArgumentException(mModuleLabel, "BucketTree end offset was before the last entry.");
+	}
+	mOffsets.push_back(end_offset);
+
+	// arrange the offsets for searching
+	mSearchOffsets = std::vector<int64_t>(entry_num + 1, 0);
+	mSearchIndex = std::vector<uint32_t>(entry_num + 1, 0);
+	size_t entry_index = 0;
+	buildSearchTree(entry_index, 1);
+}
+
+void nstool::BucketTree::initialize(const sInfo& info, const std::shared_ptr<tc::io::IStream>& stream, size_t entry_size)
+{
+	if (info.offset.unwrap() < 0 || info.size.unwrap() < 0 || stream->length() < info.offset.unwrap() + info.size.unwrap())
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel, "BucketTree table was not located inside the partition.");
+	}
+
+	tc::ByteData table = tc::ByteData(tc::io::IOUtil::castInt64ToSize(info.size.unwrap()));
+	stream->seek(info.offset.unwrap(), tc::io::SeekOrigin::Begin);
+	if (stream->read(table.data(), table.size()) != table.size())
+	{
+		throw tc::io::IOException(mModuleLabel, "Failed to read BucketTree table (stream was too small).");
+	}
+
+	initialize(info.header, table.data(), table.size(), entry_size);
+}
+
+size_t nstool::BucketTree::getEntryNum() const
+{
+	return mOffsets.empty() ? 0 : mOffsets.size() - 1;
+}
+
+size_t nstool::BucketTree::getEntrySize() const
+{
+	return mEntrySize;
+}
+
+const byte_t* nstool::BucketTree::getEntry(size_t index) const
+{
+	return mEntries.data() + index * mEntrySize;
+}
+
+int64_t nstool::BucketTree::getEntryBeginOffset(size_t index) const
+{
+	return mOffsets[index];
+}
+
+int64_t nstool::BucketTree::getEntryEndOffset(size_t index) const
+{
+	return mOffsets[index + 1];
+}
+
+int64_t nstool::BucketTree::getBeginOffset() const
+{
+	return mOffsets.empty() ? 0 : mOffsets.front();
+}
+
+int64_t nstool::BucketTree::getEndOffset() const
+{
+	return mOffsets.empty() ? 0 : mOffsets.back();
+}
+
+size_t nstool::BucketTree::find(int64_t offset) const
+{
+	if (getEntryNum() == 0 || offset < getBeginOffset() || offset >= getEndOffset())
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::find()", fmt::format("Offset 0x{:x} is outside of the table.", offset));
+	}
+
+	// descend to the first element greater than offset, the path taken is recorded in the bits of k
+	size_t element_num = mSearchOffsets.size() - 1;
+	size_t k = 1;
+	while (k <= element_num)
+	{
+		k = 2 * k + (mSearchOffsets[k] <= offset ? 1 : 0);
+	}
+
+	// undo the right turns made after the last left turn, and the last left turn itself
+	while (k & 1)
+	{
+		k >>= 1;
+	}
+	k >>= 1;
+
+	// the entry containing offset is the one before the first entry that begins after offset (or the last entry if there is none)
+	return k == 0 ? element_num - 1 : size_t(mSearchIndex[k]) - 1;
+}
+
+size_t nstool::BucketTree::find(int64_t offset, size_t hint) const
+{
+	for (size_t i = hint; i < hint + 2 && i < getEntryNum(); i++)
+	{
+		if (offset >= mOffsets[i] && offset < mOffsets[i + 1])
+		{
+			return i;
+		}
+	}
+
+	return find(offset);
+}
+
+size_t nstool::BucketTree::getNodeStorageSize(size_t entry_size, size_t entry_num)
+{
+	size_t offset_per_node = (kNodeSize - sizeof(sNodeHeader)) / sizeof(int64_t);
+	size_t entry_per_set = (kNodeSize - sizeof(sNodeHeader)) / entry_size;
+	size_t entry_set_num = (entry_num + entry_per_set - 1) / entry_per_set;
+
+	// the L1 node indexes the entry sets directly, unless there are too many, then some are indexed through L2 nodes
+	size_t l2_node_num = 0;
+	if (entry_set_num > offset_per_node)
+	{
+		size_t l2_node_max = (entry_set_num + offset_per_node - 1) / offset_per_node;
+		if (l2_node_max > offset_per_node)
+		{
+			throw tc::ArgumentOutOfRangeException("nstool::BucketTree::getNodeStorageSize()", "BucketTree has too many entries.");
+		}
+		l2_node_num = (entry_set_num - (offset_per_node - (l2_node_max - 1)) + offset_per_node - 1) / offset_per_node;
+	}
+
+	return kNodeSize * (1 + l2_node_num);
+}
+
+void nstool::BucketTree::buildSearchTree(size_t& entry_index, size_t element)
+{
+	// in-order traversal of the implicit tree assigns the sorted offsets
+	if (element >= mSearchOffsets.size())
+	{
+		return;
+	}
+
+	buildSearchTree(entry_index, 2 * element);
+	mSearchOffsets[element] = mOffsets[entry_index];
+	mSearchIndex[element] = uint32_t(entry_index);
+	entry_index++;
+	buildSearchTree(entry_index, 2 * element + 1);
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+#include "types.h"
+
+namespace nstool {
+
+/**
+ * @class BucketTree
+ * @brief Flattened, read-only copy of a BucketTree table (e.g. the IndirectStorage and AesCtrEx tables of a patch partition).
+ *
+ * A BucketTree maps offset ranges to fixed size entries. Each entry begins with the (little endian int64) offset of its range, which continues until the offset of the next entry, or the end offset of the table.
+ * On disk the table is a node storage (which only indexes the entry sets) followed by entry sets of up to kNodeSize bytes. The entry sets are imported in order into one array,
+ * and the entry offsets are also stored in Eytzinger (breadth first) order, so a lookup walks one array from front to back and the top levels of the search stay in cache.
+ */
+class BucketTree
+{
+public:
+	static const size_t kNodeSize = 0x4000;
+	static const uint32_t kMagic = 0x52544B42; // "BKTR"
+	static const uint32_t kVersion = 1;
+
+#pragma pack(push,1)
+	struct sHeader
+	{
+		tc::bn::le32<uint32_t> magic;
+		tc::bn::le32<uint32_t> version;
+		tc::bn::le32<int32_t> entry_count;
+		tc::bn::le32<uint32_t> reserved;
+	};
+	static_assert(sizeof(sHeader) == 0x10, "sHeader size.");
+
+	// location of a table in a partition, as stored in the NCA fs header
+	struct sInfo
+	{
+		tc::bn::le64<int64_t> offset;
+		tc::bn::le64<int64_t> size;
+		sHeader header;
+	};
+	static_assert(sizeof(sInfo) == 0x20, "sInfo size.");
+
+	struct sNodeHeader
+	{
+		tc::bn::le32<int32_t> index;
+		tc::bn::le32<int32_t> count;
+		tc::bn::le64<int64_t> end_offset;
+	};
+	static_assert(sizeof(sNodeHeader) == 0x10, "sNodeHeader size.");
+#pragma pack(pop)
+
+	BucketTree();
+
+	// import a table, entry_size is the size of each entry (including the offset at the start of each entry)
+	void initialize(const sHeader& header, const byte_t* table, size_t table_size, size_t entry_size);
+
+	// read and import the table described by info from a (decrypted) partition stream
+	void initialize(const sInfo& info, const std::shared_ptr<tc::io::IStream>& stream, size_t entry_size);
+
+	size_t getEntryNum() const;
+	size_t getEntrySize() const;
+	const byte_t* getEntry(size_t index) const;
+	int64_t getEntryBeginOffset(size_t index) const;
+	int64_t getEntryEndOffset(size_t index) const;
+	int64_t getBeginOffset() const;
+	int64_t getEndOffset() const;
+
+	// get the index of the entry containing offset, throws if offset is outside of the table
+	size_t find(int64_t offset) const;
+
+	// same as find(), but the entry at hint and the entry after it are checked before searching, so sequential reads (using the previous result as the hint) don't search the table
+	size_t find(int64_t offset, size_t hint) const;
+
+	// size of the node storage at the start of a table
+	static size_t getNodeStorageSize(size_t entry_size, size_t entry_num);
+private:
+	std::string mModuleLabel;
+
+	size_t mEntrySize;
+	std::vector<byte_t> mEntries;
+
+	// begin offset of each entry, followed by the end offset of the table
+	std::vector<int64_t> mOffsets;
+
+	// entry begin offsets in Eytzinger order (index 0 is unused, the children of element k are 2k and 2k+1), and the entry index of each element
+	std::vector<int64_t> mSearchOffsets;
+	std::vector<uint32_t> mSearchIndex;
+
+	void buildSearchTree(size_t& entry_index, size_t element);
+};
+
+}
\ No newline at end of file
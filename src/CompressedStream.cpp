@@ -0,0 +1,368 @@
+#include "CompressedStream.h"
+
+#include <tc/ObjectDisposedException.h>
+#include <tc/ArgumentOutOfRangeException.h>
+
+#include <lz4.h>
+
+#include <algorithm>
+#include <cstring>
+
+nstool::CompressedStream::Cache::Cache(size_t block_num) :
+	mMutex(),
+	mBlockNum(block_num),
+	mBlocks(),
+	mBlockMap()
+{
+}
+
+std::shared_ptr<tc::ByteData> nstool::CompressedStream::Cache::getBlock(size_t index)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto itr = mBlockMap.find(index);
+	if (itr == mBlockMap.end())
+	{
+		return nullptr;
+	}
+
+	// move to the front of the list, as the most recently used block
+	mBlocks.splice(mBlocks.begin(), mBlocks, itr->second);
+	return itr->second->second;
+}
+
+void nstool::CompressedStream::Cache::addBlock(size_t index, const std::shared_ptr<tc::ByteData>& block)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// another stream may have decompressed the same block
+	if (mBlockMap.find(index) != mBlockMap.end())
+	{
+		return;
+	}
+
+	mBlocks.push_front(std::make_pair(index, block));
+	mBlockMap[index] = mBlocks.begin();
+
+	// evict the least recently used blocks
+	while (mBlocks.size() > mBlockNum)
+	{
+		mBlockMap.erase(mBlocks.back().first);
+		mBlocks.pop_back();
+	}
+}
+
+nstool::CompressedStream::CompressedStream(const std::shared_ptr<tc::io::IStream>& data_stream, const std::shared_ptr<BucketTree>& table, const std::shared_ptr<Cache>& cache, const std::shared_ptr<ThreadPool>& thread_pool) :
+	mModuleLabel("nstool::CompressedStream"),
+	mDataStream(data_stream),
+	mTable(table),
+	mCache(cache),
+	mThreadPool(thread_pool),
+	mPosition(0),
+	mEntryHint(0),
+	mReadEndOffset(0)
+{
+	if (mDataStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "data_stream is null.");
+	}
+	if (mTable == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "table is null.");
+	}
+	if (mCache == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "cache is null.");
+	}
+	if (mDataStream->canRead() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "data_stream does not support reading.");
+	}
+	if (mDataStream->canSeek() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "data_stream does not support seeking.");
+	}
+	if (mTable->getEntrySize() != sizeof(sEntry))
+	{
+		throw tc::ArgumentException(mModuleLabel, "table does not contain CompressedStorage entries.");
+	}
+	if (mTable->getEntryNum() == 0 || mTable->getBeginOffset() != 0)
+	{
+		throw tc::ArgumentException(mModuleLabel, "table does not cover the start of the partition.");
+	}
+}
+
+bool nstool::CompressedStream::canRead() const
+{
+	return mTable != nullptr;
+}
+
+bool nstool::CompressedStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::CompressedStream::canSeek() const
+{
+	return mTable != nullptr;
+}
+
+int64_t nstool::CompressedStream::length()
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mTable->getEndOffset();
+}
+
+int64_t nstool::CompressedStream::position()
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mPosition;
+}
+
+size_t nstool::CompressedStream::read(byte_t* ptr, size_t count)
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	// clamp read to the end of the stream
+	if (mPosition >= mTable->getEndOffset() || count == 0)
+	{
+		return 0;
+	}
+	count = size_t(std::min<int64_t>(int64_t(count), mTable->getEndOffset() - mPosition));
+
+	// entries covering the read
+	size_t begin_index = mTable->find(mPosition, mEntryHint);
+	size_t end_index = mTable->find(mPosition + int64_t(count) - 1, begin_index) + 1;
+
+	// when reading sequentially, the next blocks are decompressed along with these so the thread pool has enough work
+	size_t read_ahead_end_index = end_index;
+	if (mThreadPool != nullptr && mPosition == mReadEndOffset)
+	{
+		size_t read_ahead_num = std::min<size_t>((mThreadPool->getThreadNum() + 1) * kReadAheadBlockNumPerThread, mCache->mBlockNum / 2);
+		read_ahead_end_index = std::min<size_t>(end_index + read_ahead_num, mTable->getEntryNum());
+	}
+
+	std::map<size_t, std::shared_ptr<tc::ByteData>> blocks;
+	readBlocks(begin_index, read_ahead_end_index, blocks);
+
+	// copy each entry's range of the read
+	size_t data_read = 0;
+	for (size_t i = begin_index; i < end_index; i++)
+	{
+		sEntry entry = getEntry(i);
+
+		int64_t entry_offset = mPosition - mTable->getEntryBeginOffset(i);
+		size_t data_size = size_t(std::min<int64_t>(int64_t(count - data_read), mTable->getEntryEndOffset(i) - mPosition));
+
+		switch (entry.compression_type)
+		{
+			case (CompressionType_None):
+			{
+				mDataStream->seek(entry.physical_offset.unwrap() + entry_offset, tc::io::SeekOrigin::Begin);
+				if (mDataStream->read(ptr + data_read, data_size) != data_size)
+				{
+					throw tc::io::IOException(mModuleLabel+"::read()", "Failed to read CompressedStorage data (storage was too small).");
+				}
+				break;
+			}
+			case (CompressionType_Zeros):
+				memset(ptr + data_read, 0, data_size);
+				break;
+			case (CompressionType_Lz4):
+				memcpy(ptr + data_read, blocks[i]->data() + entry_offset, data_size);
+				break;
+		}
+
+		data_read += data_size;
+		mPosition += int64_t(data_size);
+	}
+
+	mEntryHint = end_index - 1;
+	mReadEndOffset = mPosition;
+
+	return data_read;
+}
+
+size_t nstool::CompressedStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for CompressedStream.");
+}
+
+int64_t nstool::CompressedStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	int64_t new_position = 0;
+	switch (origin)
+	{
+		case (tc::io::SeekOrigin::Begin):
+			new_position = offset;
+			break;
+		case (tc::io::SeekOrigin::Current):
+			new_position = mPosition + offset;
+			break;
+		case (tc::io::SeekOrigin::End):
+			new_position = mTable->getEndOffset() + offset;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Unknown seek origin.");
+	}
+
+	if (new_position < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Stream position cannot be negative.");
+	}
+
+	mPosition = new_position;
+	return mPosition;
+}
+
+void nstool::CompressedStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for CompressedStream.");
+}
+
+void nstool::CompressedStream::flush()
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+}
+
+void nstool::CompressedStream::dispose()
+{
+	if (mDataStream.get() != nullptr)
+	{
+		mDataStream->dispose();
+		mDataStream.reset();
+	}
+	mTable.reset();
+	mCache.reset();
+	mThreadPool.reset();
+}
+
+nstool::CompressedStream::sEntry nstool::CompressedStream::getEntry(size_t index) const
+{
+	sEntry entry;
+	memcpy(&entry, mTable->getEntry(index), sizeof(sEntry));
+
+	if (entry.compression_type != CompressionType_None && entry.compression_type != CompressionType_Zeros && entry.compression_type != CompressionType_Lz4)
+	{
+		throw tc::io::IOException(mModuleLabel, fmt::format("CompressedStorage entry had unsupported compression type ({:d}).", entry.compression_type));
+	}
+
+	return entry;
+}
+
+void nstool::CompressedStream::readBlocks(size_t begin_index, size_t end_index, std::map<size_t, std::shared_ptr<tc::ByteData>>& blocks)
+{
+	// compressed blocks that aren't cached
+	struct sBlock
+	{
+		size_t index;
+		sEntry entry;
+		const byte_t* src;
+		std::shared_ptr<tc::ByteData> dst;
+	};
+	std::vector<sBlock> missing;
+	for (size_t i = begin_index; i < end_index; i++)
+	{
+		sEntry entry = getEntry(i);
+		if (entry.compression_type != CompressionType_Lz4)
+		{
+			continue;
+		}
+
+		std::shared_ptr<tc::ByteData> block = mCache->getBlock(i);
+		if (block != nullptr)
+		{
+			blocks[i] = block;
+			continue;
+		}
+
+		int64_t block_size = mTable->getEntryEndOffset(i) - mTable->getEntryBeginOffset(i);
+		if (block_size > int64_t(kBlockSizeMax) || entry.physical_size.unwrap() >= uint32_t(LZ4_MAX_INPUT_SIZE))
+		{
+			throw tc::io::IOException(mModuleLabel, fmt::format("CompressedStorage block {:d} was too large.", i));
+		}
+
+		missing.push_back({i, entry, nullptr, std::make_shared<tc::ByteData>(tc::ByteData(size_t(block_size)))});
+	}
+	if (missing.empty())
+	{
+		return;
+	}
+
+	// read compressed data, blocks stored one after another are read together
+	std::vector<tc::ByteData> src_data;
+	src_data.reserve(missing.size());
+	for (size_t i = 0; i < missing.size();)
+	{
+		int64_t src_begin = missing[i].entry.physical_offset.unwrap();
+		int64_t src_end = src_begin + int64_t(missing[i].entry.physical_size.unwrap());
+		size_t j = i + 1;
+		for (; j < missing.size() && missing[j].entry.physical_offset.unwrap() == src_end; j++)
+		{
+			src_end += int64_t(missing[j].entry.physical_size.unwrap());
+		}
+
+		src_data.push_back(tc::ByteData(size_t(src_end - src_begin)));
+		mDataStream->seek(src_begin, tc::io::SeekOrigin::Begin);
+		if (mDataStream->read(src_data.back().data(), src_data.back().size()) != src_data.back().size())
+		{
+			throw tc::io::IOException(mModuleLabel+"::read()", "Failed to read CompressedStorage data (storage was too small).");
+		}
+
+		for (; i < j; i++)
+		{
+			missing[i].src = src_data.back().data() + (missing[i].entry.physical_offset.unwrap() - src_begin);
+		}
+	}
+
+	// decompress blocks, in parallel if there is a thread pool
+	std::vector<std::function<void()>> tasks;
+	for (auto itr = missing.begin(); itr != missing.end(); itr++)
+	{
+		sBlock* block = &(*itr);
+		tasks.push_back([this, block]() {
+			int decomp_size = LZ4_decompress_safe((const char*)block->src, (char*)block->dst->data(), int(block->entry.physical_size.unwrap()), int(block->dst->size()));
+			if (decomp_size < 0 || size_t(decomp_size) != block->dst->size())
+			{
+				throw tc::io::IOException(mModuleLabel+"::read()", fmt::format("Failed to decompress CompressedStorage block {:d}.", block->index));
+			}
+		});
+	}
+
+	if (mThreadPool != nullptr && tasks.size() > 1)
+	{
+		mThreadPool->execute(tasks);
+	}
+	else
+	{
+		for (auto itr = tasks.begin(); itr != tasks.end(); itr++)
+		{
+			(*itr)();
+		}
+	}
+
+	for (auto itr = missing.begin(); itr != missing.end(); itr++)
+	{
+		mCache->addBlock(itr->index, itr->dst);
+		blocks[itr->index] = itr->dst;
+	}
+}
\ No newline at end of file
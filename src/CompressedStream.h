@@ -0,0 +1,110 @@
+#pragma once
+#include "types.h"
+#include "BucketTree.h"
+#include "ThreadPool.h"
+
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace nstool {
+
+/**
+ * @class CompressedStream
+ * @brief Read-only stream of a partition stored with CompressedStorage, where the data is split into blocks that are compressed separately.
+ *
+ * Each entry of the CompressedStorage table maps a range of the stream to a block of the data stream, which is stored as is, LZ4 compressed, or not stored at all (read as zeros).
+ * Decompressed blocks are kept in a small LRU Cache, which can be shared by streams over the same partition (e.g. concurrent extraction).
+ * When reading sequentially with a thread pool, the compressed blocks after the read are decompressed with it (along with the blocks being read), so the next read is served from the cache.
+ */
+class CompressedStream : public tc::io::IStream
+{
+public:
+#pragma pack(push,1)
+	// CompressedStorage info, as stored in the NCA fs header (after the SparseStorage info)
+	struct sCompressionInfo
+	{
+		BucketTree::sInfo bucket;
+		std::array<byte_t, 8> reserved;
+	};
+	static_assert(sizeof(sCompressionInfo) == 0x28, "sCompressionInfo size.");
+
+	struct sEntry
+	{
+		tc::bn::le64<int64_t> virtual_offset;
+		tc::bn::le64<int64_t> physical_offset;
+		byte_t compression_type;
+		int8_t compression_level;
+		std::array<byte_t, 2> reserved;
+		tc::bn::le32<uint32_t> physical_size;
+	};
+	static_assert(sizeof(sEntry) == 0x18, "sEntry size.");
+#pragma pack(pop)
+
+	enum CompressionType
+	{
+		CompressionType_None = 0,
+		CompressionType_Zeros = 1,
+		CompressionType_Two = 2,
+		CompressionType_Lz4 = 3
+	};
+
+	// largest decompressed block supported (blocks are usually at most 64KiB)
+	static const size_t kBlockSizeMax = 0x100000;
+	static const size_t kDefaultCacheBlockNum = 64;
+
+	class Cache
+	{
+	public:
+		Cache(size_t block_num = kDefaultCacheBlockNum);
+	private:
+		friend class CompressedStream;
+
+		std::mutex mMutex;
+		size_t mBlockNum;
+
+		// decompressed blocks by entry index, most recently used first
+		std::list<std::pair<size_t, std::shared_ptr<tc::ByteData>>> mBlocks;
+		std::map<size_t, std::list<std::pair<size_t, std::shared_ptr<tc::ByteData>>>::iterator> mBlockMap;
+
+		// these lock the cache mutex
+		std::shared_ptr<tc::ByteData> getBlock(size_t index);
+		void addBlock(size_t index, const std::shared_ptr<tc::ByteData>& block);
+	};
+
+	CompressedStream(const std::shared_ptr<tc::io::IStream>& data_stream, const std::shared_ptr<BucketTree>& table, const std::shared_ptr<Cache>& cache, const std::shared_ptr<ThreadPool>& thread_pool = nullptr);
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	std::string mModuleLabel;
+
+	// blocks decompressed ahead of a sequential read, for each thread
+	static const size_t kReadAheadBlockNumPerThread = 2;
+
+	std::shared_ptr<tc::io::IStream> mDataStream;
+	std::shared_ptr<BucketTree> mTable;
+	std::shared_ptr<Cache> mCache;
+	std::shared_ptr<ThreadPool> mThreadPool;
+	int64_t mPosition;
+
+	// last entry used, to continue from on the next read
+	size_t mEntryHint;
+
+	// end of the previous read, a read starting here is sequential
+	int64_t mReadEndOffset;
+
+	sEntry getEntry(size_t index) const;
+	void readBlocks(size_t begin_index, size_t end_index, std::map<size_t, std::shared_ptr<tc::ByteData>>& blocks);
+};
+
+}
\ No newline at end of file
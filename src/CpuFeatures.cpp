@@ -0,0 +1,96 @@
+#include "CpuFeatures.h"
+
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+	#define NSTOOL_CPUFEATURES_X86 1
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#elif defined(__aarch64__) && defined(__linux__)
+	#define NSTOOL_CPUFEATURES_ARM64_LINUX 1
+	#include <sys/auxv.h>
+	#include <asm/hwcap.h>
+#endif
+
+namespace {
+
+#ifdef NSTOOL_CPUFEATURES_X86
+
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuidex(info, int(leaf), int(subleaf));
+	for (size_t i = 0; i < 4; i++)
+		regs[i] = uint32_t(info[i]);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+uint64_t xgetbv(uint32_t index)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return _xgetbv(index);
+#else
+	uint32_t eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+	return (uint64_t(edx) << 32) | eax;
+#endif
+}
+
+#endif
+
+nstool::sCpuFeatures detectCpuFeatures()
+{
+	nstool::sCpuFeatures f = { false, false, false, false, false };
+
+#if defined(NSTOOL_CPUFEATURES_X86)
+	uint32_t regs[4] = { 0, 0, 0, 0 };
+	cpuid(0, 0, regs);
+	uint32_t max_leaf = regs[0];
+	if (max_leaf < 1)
+		return f;
+
+	cpuid(1, 0, regs);
+	bool has_ssse3 = (regs[2] & (1u << 9)) != 0;
+	bool has_sse41 = (regs[2] & (1u << 19)) != 0;
+	bool has_aesni = (regs[2] & (1u << 25)) != 0;
+	bool has_osxsave = (regs[2] & (1u << 27)) != 0;
+	f.aesni = has_sse41 && has_aesni;
+
+	if (max_leaf >= 7)
+	{
+		cpuid(7, 0, regs);
+		bool has_avx2 = (regs[1] & (1u << 5)) != 0;
+		bool has_avx512f = (regs[1] & (1u << 16)) != 0;
+		bool has_sha = (regs[1] & (1u << 29)) != 0;
+		bool has_vaes = (regs[2] & (1u << 9)) != 0;
+
+		// AVX registers are only usable if the OS saves their state (XCR0 bits 1,2 for YMM, and 5,6,7 for ZMM)
+		uint64_t xcr0 = has_osxsave ? xgetbv(0) : 0;
+		bool has_ymm_state = (xcr0 & 0x06) == 0x06;
+		bool has_zmm_state = (xcr0 & 0xe6) == 0xe6;
+
+		f.sha_ni = has_sha && has_ssse3 && has_sse41;
+		f.avx2 = has_avx2 && has_ymm_state;
+		f.vaes = f.aesni && has_vaes && has_avx512f && has_zmm_state;
+	}
+#elif defined(NSTOOL_CPUFEATURES_ARM64_LINUX)
+	f.armv8_sha2 = (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+	// other platforms (e.g. macOS) don't expose HWCAP, but the compiler target guarantees the extension
+	f.armv8_sha2 = true;
+#endif
+
+	return f;
+}
+
+}
+
+const nstool::sCpuFeatures& nstool::getCpuFeatures()
+{
+	static const sCpuFeatures features = detectCpuFeatures();
+	return features;
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+#include "types.h"
+
+namespace nstool {
+
+/**
+ * @brief Instruction set extensions usable by this process, detected once at runtime.
+ *
+ * A feature is only reported if both the CPU and the OS (register state saving) support it.
+ */
+struct sCpuFeatures
+{
+	// x86
+	bool aesni;
+	bool vaes; // VAES with AVX-512F
+	bool sha_ni;
+	bool avx2;
+
+	// ARMv8
+	bool armv8_sha2;
+};
+
+const sCpuFeatures& getCpuFeatures();
+
+}
\ No newline at end of file
@@ -8,7 +8,8 @@ nstool::EsCertProcess::EsCertProcess() :
 	mModuleName("nstool::EsCertProcess"),
 	mFile(),
 	mCliOutputMode(true, false, false, false),
-	mVerify(false)
+	mVerify(false),
+	mSignatureCache()
 {
 }
 
@@ -43,6 +44,11 @@ void nstool::EsCertProcess::setVerifyMode(bool verify)
 	mVerify = verify;
 }
 
+void nstool::EsCertProcess::setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache)
+{
+	mSignatureCache = sig_cache;
+}
+
 void nstool::EsCertProcess::importCerts()
 {
 	if (mFile == nullptr)
@@ -80,6 +86,7 @@ void nstool::EsCertProcess::validateCerts()
 	
 	try
 	{
+		pki.setSignatureCache(mSignatureCache);
 		pki.setKeyCfg(mKeyCfg);
 		pki.addCertificates(mCert);
 	}
@@ -1,6 +1,7 @@
 #pragma once
 #include "types.h"
 #include "KeyBag.h"
+#include "SignatureCache.h"
 
 #include <pietendo/hac/es/SignedData.h>
 #include <pietendo/hac/es/CertificateBody.h>
@@ -18,6 +19,7 @@ public:
 	void setKeyCfg(const KeyBag& keycfg);
 	void setCliOutputMode(CliOutputMode type);
 	void setVerifyMode(bool verify);
+	void setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache);
 
 private:
 	std::string mModuleName;
@@ -26,6 +28,7 @@ private:
 	KeyBag mKeyCfg;
 	CliOutputMode mCliOutputMode;
 	bool mVerify;
+	std::shared_ptr<SignatureCache> mSignatureCache;
 
 	std::vector<pie::hac::es::SignedData<pie::hac::es::CertificateBody>> mCert;
 
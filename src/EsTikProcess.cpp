@@ -7,7 +7,8 @@ nstool::EsTikProcess::EsTikProcess() :
 	mModuleName("nstool::EsTikProcess"),
 	mFile(),
 	mCliOutputMode(true, false, false, false),
-	mVerify(false)
+	mVerify(false),
+	mSignatureCache()
 {
 }
 
@@ -47,6 +48,11 @@ void nstool::EsTikProcess::setVerifyMode(bool verify)
 	mVerify = verify;
 }
 
+void nstool::EsTikProcess::setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache)
+{
+	mSignatureCache = sig_cache;
+}
+
 void nstool::EsTikProcess::importTicket()
 {
 	if (mFile == nullptr)
@@ -92,6 +98,7 @@ void nstool::EsTikProcess::verifyTicket()
 
 	try 
 	{
+		pki_validator.setSignatureCache(mSignatureCache);
 		pki_validator.setKeyCfg(mKeyCfg);
 		pki_validator.addCertificates(mCerts);
 		pki_validator.validateSignature(mTik.getBody().getIssuer(), mTik.getSignature().getSignType(), mTik.getSignature().getSignature(), tik_hash);
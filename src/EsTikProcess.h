@@ -1,6 +1,7 @@
 #pragma once
 #include "types.h"
 #include "KeyBag.h"
+#include "SignatureCache.h"
 
 #include <pietendo/hac/es/SignedData.h>
 #include <pietendo/hac/es/CertificateBody.h>
@@ -20,6 +21,7 @@ public:
 	void setCertificateChain(const std::vector<pie::hac::es::SignedData<pie::hac::es::CertificateBody>>& certs);
 	void setCliOutputMode(CliOutputMode mode);
 	void setVerifyMode(bool verify);
+	void setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache);
 private:
 	std::string mModuleName;
 
@@ -27,6 +29,7 @@ private:
 	KeyBag mKeyCfg;
 	CliOutputMode mCliOutputMode;
 	bool mVerify;
+	std::shared_ptr<SignatureCache> mSignatureCache;
 	
 	std::vector<pie::hac::es::SignedData<pie::hac::es::CertificateBody>> mCerts;
 
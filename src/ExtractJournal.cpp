@@ -0,0 +1,95 @@
+#include "ExtractJournal.h"
+
+#include <tc/io/FileStream.h>
+#include <tc/io/FileNotFoundException.h>
+
+#include <sstream>
+
+const std::string nstool::ExtractJournal::kManifestFileName = ".nstool_manifest";
+
+nstool::ExtractJournal::ExtractJournal(const tc::io::Path& manifest_path) :
+	mModuleLabel("nstool::ExtractJournal"),
+	mRecords(),
+	mManifestStream()
+{
+	importManifest(manifest_path);
+
+	mManifestStream = std::make_shared<tc::io::FileStream>(tc::io::FileStream(manifest_path, tc::io::FileMode::Append, tc::io::FileAccess::Write));
+}
+
+bool nstool::ExtractJournal::getRecord(const std::string& extract_path, sRecord& record)
+{
+	std::lock_guard<std::mutex> lock(mLock);
+
+	auto itr = mRecords.find(extract_path);
+	if (itr == mRecords.end())
+	{
+		return false;
+	}
+
+	record = itr->second;
+	return true;
+}
+
+void nstool::ExtractJournal::writeBeginRecord(const std::string& extract_path, const std::string& virtual_path, int64_t size, int64_t offset)
+{
+	writeRecord(extract_path, { false, size, offset, "-", virtual_path });
+}
+
+void nstool::ExtractJournal::writeCompleteRecord(const std::string& extract_path, const std::string& virtual_path, int64_t size, int64_t offset, const std::string& hash)
+{
+	writeRecord(extract_path, { true, size, offset, hash, virtual_path });
+}
+
+void nstool::ExtractJournal::importManifest(const tc::io::Path& manifest_path)
+{
+	// read existing manifest (if any)
+	std::string manifest;
+	try {
+		tc::io::FileStream stream = tc::io::FileStream(manifest_path, tc::io::FileMode::Open, tc::io::FileAccess::Read);
+		tc::ByteData data = tc::ByteData(tc::io::IOUtil::castInt64ToSize(stream.length()));
+		stream.read(data.data(), data.size());
+		manifest = std::string((const char*)data.data(), data.size());
+	}
+	catch (tc::io::FileNotFoundException&) {
+		return;
+	}
+
+	// parse records, ignoring malformed lines (e.g. a record that was partially written when nstool was stopped)
+	std::istringstream manifest_stream(manifest);
+	std::string line;
+	while (std::getline(manifest_stream, line))
+	{
+		std::vector<std::string> field;
+		std::istringstream line_stream(line);
+		for (std::string value; std::getline(line_stream, value, '\t');)
+		{
+			field.push_back(value);
+		}
+		if (field.size() != 6 || (field[0] != "B" && field[0] != "F"))
+		{
+			continue;
+		}
+
+		sRecord record;
+		record.is_complete = field[0] == "F";
+		record.size = strtoll(field[1].c_str(), nullptr, 10);
+		record.offset = strtoll(field[2].c_str(), nullptr, 10);
+		record.hash = field[3];
+		record.virtual_path = field[4];
+
+		mRecords[field[5]] = record;
+	}
+}
+
+void nstool::ExtractJournal::writeRecord(const std::string& extract_path, const sRecord& record)
+{
+	std::string line = fmt::format("{:s}\t{:d}\t{:d}\t{:s}\t{:s}\t{:s}\n", (record.is_complete ? "F" : "B"), record.size, record.offset, record.hash, record.virtual_path, extract_path);
+
+	std::lock_guard<std::mutex> lock(mLock);
+
+	mManifestStream->write((const byte_t*)line.c_str(), line.size());
+	mManifestStream->flush();
+
+	mRecords[extract_path] = record;
+}
\ No newline at end of file
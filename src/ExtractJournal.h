@@ -0,0 +1,48 @@
+#pragma once
+#include "types.h"
+
+#include <mutex>
+
+namespace nstool {
+
+/**
+ * @class ExtractJournal
+ * @brief Manifest of files extracted to a directory, used to skip or resume files when an extraction is run again.
+ *
+ * The manifest is a text file with one tab separated record per line, records are only ever appended:
+ * - "B <size> <source offset> - <virtual path> <extract path>" is written before a file is written
+ * - "F <size> <source offset> <sha256> <virtual path> <extract path>" is written once a file is complete, sha256 is the hash of the source data
+ * The last record for an extract path determines its state. Source offset is -1 if unknown.
+ */
+class ExtractJournal
+{
+public:
+	// name of the manifest file kept in an extract directory
+	static const std::string kManifestFileName;
+
+	struct sRecord
+	{
+		bool is_complete;
+		int64_t size;
+		int64_t offset;
+		std::string hash;
+		std::string virtual_path;
+	};
+
+	ExtractJournal(const tc::io::Path& manifest_path);
+
+	bool getRecord(const std::string& extract_path, sRecord& record);
+	void writeBeginRecord(const std::string& extract_path, const std::string& virtual_path, int64_t size, int64_t offset);
+	void writeCompleteRecord(const std::string& extract_path, const std::string& virtual_path, int64_t size, int64_t offset, const std::string& hash);
+private:
+	std::string mModuleLabel;
+
+	std::map<std::string, sRecord> mRecords;
+	std::shared_ptr<tc::io::IStream> mManifestStream;
+	std::mutex mLock;
+
+	void importManifest(const tc::io::Path& manifest_path);
+	void writeRecord(const std::string& extract_path, const sRecord& record);
+};
+
+}
\ No newline at end of file
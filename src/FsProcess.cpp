@@ -1,20 +1,43 @@
 #include "FsProcess.h"
 #include "util.h"
+#include "StdoutStream.h"
+#include "TarArchiveWriter.h"
+#include "Sha256Generator.h"
+#include "HashingStream.h"
 
 #include <memory>
+#include <atomic>
+#include <set>
+#include <algorithm>
+#include <cstdio>
 #include <tc/io/FileNotFoundException.h>
 #include <tc/io/DirectoryNotFoundException.h>
 
 nstool::FsProcess::FsProcess() :
 	mModuleLabel("nstool::FsProcess"),
 	mInputFs(),
+	mInputFsFactory(),
+	mInputFilePath(),
+	mInputFileLayout(),
 	mFsFormatName(),
 	mShowFsInfo(false),
 	mProperties(),
 	mShowFsTree(false),
 	mFsRootLabel(),
 	mExtractJobs(),
-	mDataCache(0x10000)
+	mShowExtractPlan(false),
+	mExtractFormat(EXTRACT_FORMAT_DIR),
+	mResume(false),
+	mExtractJournals(),
+	mDedupe(false),
+	mDedupeState(),
+	mDataCache(0x10000),
+	mIoQueueDepth(0),
+	mMappedOutput(false),
+	mExtractFileFilter(),
+	mThreadNum(1),
+	mThreadPool(),
+	mExtractWorkers()
 {
 
 }
@@ -51,6 +74,21 @@ void nstool::FsProcess::setInputFileSystem(const std::shared_ptr<tc::io::IFileSy
 	mInputFs = input_fs;
 }
 
+void nstool::FsProcess::setInputFileSystemFactory(const FileSystemFactory& input_fs_factory)
+{
+	mInputFsFactory = input_fs_factory;
+}
+
+void nstool::FsProcess::setInputFilePath(const tc::io::Path& input_file_path)
+{
+	mInputFilePath = input_file_path;
+}
+
+void nstool::FsProcess::setInputFileLayout(const std::map<tc::io::Path, nstool::FileExtent>& input_file_layout)
+{
+	mInputFileLayout = input_file_layout;
+}
+
 void nstool::FsProcess::setFsFormatName(const std::string& fs_format_name)
 {
 	mFsFormatName = fs_format_name;
@@ -81,22 +119,76 @@ void nstool::FsProcess::setExtractJobs(const std::vector<nstool::ExtractJob>& ex
 	mExtractJobs = extract_jobs;
 }
 
+void nstool::FsProcess::setShowExtractPlan(bool show_extract_plan)
+{
+	mShowExtractPlan = show_extract_plan;
+}
+
+void nstool::FsProcess::setThreadNum(size_t thread_num)
+{
+	mThreadNum = thread_num;
+}
+
+void nstool::FsProcess::setResumeMode(bool resume)
+{
+	mResume = resume;
+}
+
+void nstool::FsProcess::setExtractFormat(nstool::ExtractFormat extract_format)
+{
+	mExtractFormat = extract_format;
+}
+
+void nstool::FsProcess::setDedupeMode(bool dedupe)
+{
+	mDedupe = dedupe;
+}
+
+void nstool::FsProcess::setIoQueueDepth(size_t io_queue_depth)
+{
+	mIoQueueDepth = io_queue_depth;
+}
+
+void nstool::FsProcess::setMappedOutputMode(bool mapped_output)
+{
+	mMappedOutput = mapped_output;
+}
+
+void nstool::FsProcess::setExtractFileFilter(const ExtractFileFilter& extract_file_filter)
+{
+	mExtractFileFilter = extract_file_filter;
+}
+
 void nstool::FsProcess::printFs()
 {
 	fmt::print("[{:s}/Tree]\n", (mFsFormatName.isSet() ? mFsFormatName.get() : "FileSystem"));
-	visitDir(tc::io::Path("/"), tc::io::Path("/"), false, true);
+	std::vector<sExtractFileEntry> extract_list;
+	visitDir(tc::io::Path("/"), tc::io::Path("/"), false, true, extract_list);
 }
 
 void nstool::FsProcess::extractFs()
 {
+	if (mExtractFormat == EXTRACT_FORMAT_TAR)
+	{
+		extractFsToArchive();
+		return;
+	}
+
 	fmt::print("[{:s}/Extract]\n", (mFsFormatName.isSet() ? mFsFormatName.get() : "FileSystem"));
 
+	// collect the files for all jobs, so they can be extracted in the order they are stored
+	std::vector<sExtractFileEntry> extract_list;
 	for (auto itr = mExtractJobs.begin(); itr != mExtractJobs.end(); itr++)
 	{
 		// check if root path (legacy case)
 		if (itr->virtual_path == tc::io::Path("/"))
 		{
-			visitDir(tc::io::Path("/"), itr->extract_path, true, false);
+			size_t first_entry = extract_list.size();
+			visitDir(tc::io::Path("/"), itr->extract_path, true, false, extract_list);
+			for (size_t i = first_entry; i < extract_list.size(); i++)
+			{
+				extract_list[i].journal_dir = itr->extract_path;
+			}
 
 			//fmt::print("Root Dir Virtual Path: \"{:s}\"\n", itr->virtual_path.to_string());
 
@@ -124,9 +216,7 @@ void nstool::FsProcess::extractFs()
 
 				tc::io::Path file_extract_path = itr->extract_path + itr->virtual_path.back();
 
-				fmt::print("Saving {:s}...\n", file_extract_path.to_string());
-
-				writeStreamToFile(file_stream, itr->extract_path + itr->virtual_path.back(), mDataCache);
+				extract_list.push_back({itr->virtual_path, file_extract_path, fmt::format("Saving {:s}...\n", file_extract_path.to_string()), itr->extract_path});
 
 				continue;
 
@@ -150,9 +240,7 @@ void nstool::FsProcess::extractFs()
 				tc::io::sDirectoryListing dir_listing;
 				local_fs->getDirectoryListing(parent_dir_path, dir_listing);
 
-				fmt::print("Saving {:s} as {:s}...\n", itr->virtual_path.to_string(), itr->extract_path.to_string());
-
-				writeStreamToFile(file_stream, itr->extract_path, mDataCache);
+				extract_list.push_back({itr->virtual_path, itr->extract_path, fmt::format("Saving {:s} as {:s}...\n", itr->virtual_path.to_string(), itr->extract_path.to_string()), parent_dir_path});
 
 				continue;
 			} catch (tc::io::DirectoryNotFoundException&) {
@@ -172,7 +260,12 @@ void nstool::FsProcess::extractFs()
 			tc::io::sDirectoryListing dir_listing;
 			mInputFs->getDirectoryListing(itr->virtual_path, dir_listing);
 
-			visitDir(itr->virtual_path, itr->extract_path, true, false);
+			size_t first_entry = extract_list.size();
+			visitDir(itr->virtual_path, itr->extract_path, true, false, extract_list);
+			for (size_t i = first_entry; i < extract_list.size(); i++)
+			{
+				extract_list[i].journal_dir = itr->extract_path;
+			}
 
 			//fmt::print("Valid Directory Path: \"{:s}\"\n", itr->virtual_path.to_string());
 
@@ -185,10 +278,11 @@ void nstool::FsProcess::extractFs()
 
 		fmt::print("[WARNING] Failed to extract virtual path: \"{:s}\"\n", itr->virtual_path.to_string());
 	}
-	
+
+	extractFileList(extract_list);
 }
 
-void nstool::FsProcess::visitDir(const tc::io::Path& v_path, const tc::io::Path& l_path, bool extract_fs, bool print_fs)
+void nstool::FsProcess::visitDir(const tc::io::Path& v_path, const tc::io::Path& l_path, bool extract_fs, bool print_fs, std::vector<sExtractFileEntry>& extract_list)
 {
 	tc::io::LocalFileSystem local_fs;
 
@@ -203,17 +297,14 @@ void nstool::FsProcess::visitDir(const tc::io::Path& v_path, const tc::io::Path&
 
 		fmt::print("{:s}/\n", ((v_path.size() == 1) ? (mFsRootLabel.isSet() ? (mFsRootLabel.get() + ":")  : "Root:") : v_path.back()));
 	}
-	if (extract_fs)
+	if (extract_fs && mShowExtractPlan == false)
 	{
 		// create local dir
 		local_fs.createDirectory(l_path);
 	}
 
 	// iterate thru child files
-	size_t cache_read_len;
 	tc::io::Path out_path;
-	std::shared_ptr<tc::io::IStream> in_stream;
-	std::shared_ptr<tc::io::IStream> out_stream;
 	for (auto itr = info.file_list.begin(); itr != info.file_list.end(); itr++)
 	{
 		if (print_fs)
@@ -222,37 +313,759 @@ void nstool::FsProcess::visitDir(const tc::io::Path& v_path, const tc::io::Path&
 				fmt::print(" ");
 			fmt::print(" {:s}\n", *itr);
 		}
-		if (extract_fs)
+		if (extract_fs && (mExtractFileFilter == nullptr || mExtractFileFilter(v_path + *itr)))
 		{
 			// build out path
 			out_path = l_path + *itr;
 
-			fmt::print("Saving {:s}...\n", out_path.to_string());
+			// queue file for export
+			extract_list.push_back({v_path + *itr, out_path, fmt::format("Saving {:s}...\n", out_path.to_string()), l_path});
+		}
+	}
+
+	// iterate thru child dirs
+	for (auto itr = info.dir_list.begin(); itr != info.dir_list.end(); itr++)
+	{
+		visitDir(v_path + *itr, l_path + *itr, extract_fs, print_fs, extract_list);
+	}
+}
+
+void nstool::FsProcess::extractFsToArchive()
+{
+	// jobs with the same extract path are written to the same archive, in the order they were specified
+	std::vector<tc::io::Path> archive_path_list;
+	for (auto itr = mExtractJobs.begin(); itr != mExtractJobs.end(); itr++)
+	{
+		if (std::find(archive_path_list.begin(), archive_path_list.end(), itr->extract_path) == archive_path_list.end())
+		{
+			archive_path_list.push_back(itr->extract_path);
+		}
+	}
+
+	for (auto archive_itr = archive_path_list.begin(); archive_itr != archive_path_list.end(); archive_itr++)
+	{
+		// "-" writes the archive to stdout, so messages are written to stderr to keep them out of the archive
+		bool is_stdout = *archive_itr == tc::io::Path("-");
+		FILE* log = is_stdout ? stderr : stdout;
+
+		fmt::print(log, "[{:s}/Extract]\n", (mFsFormatName.isSet() ? mFsFormatName.get() : "FileSystem"));
+
+		// collect the directories and files for all jobs writing to this archive, member names are relative to the job's virtual path
+		std::vector<std::string> dir_list;
+		std::vector<sExtractFileEntry> extract_list;
+		std::vector<std::string> member_list;
+		for (auto itr = mExtractJobs.begin(); itr != mExtractJobs.end(); itr++)
+		{
+			if (itr->extract_path != *archive_itr)
+			{
+				continue;
+			}
+
+			// check if root path (legacy case)
+			if (itr->virtual_path == tc::io::Path("/"))
+			{
+				visitArchiveDir(tc::io::Path("/"), "", dir_list, extract_list, member_list);
+				continue;
+			}
+
+			// otherwise determine if this is a file or subdirectory
+			try {
+				std::shared_ptr<tc::io::IStream> file_stream;
+				mInputFs->openFile(itr->virtual_path, tc::io::FileMode::Open, tc::io::FileAccess::Read, file_stream);
+
+				std::string member_name = itr->virtual_path.back();
+				extract_list.push_back({itr->virtual_path, tc::io::Path(member_name), fmt::format("Adding {:s}...\n", member_name), tc::io::Path()});
+				member_list.push_back(member_name);
+				continue;
+			} catch (tc::io::FileNotFoundException&) {
+				// acceptable exception, just means file didn't exist
+			}
+
+			try {
+				visitArchiveDir(itr->virtual_path, "", dir_list, extract_list, member_list);
+				continue;
+			} catch (tc::io::DirectoryNotFoundException&) {
+				// acceptable exception, just means directory didn't exist
+			}
+
+			fmt::print(log, "[WARNING] Failed to extract virtual path: \"{:s}\"\n", itr->virtual_path.to_string());
+		}
+
+		// files are added in the order they are stored, after all directories
+		std::vector<sExtractRun> extract_plan;
+		generateExtractPlan(extract_list, extract_plan);
+
+		if (mShowExtractPlan)
+		{
+			printExtractPlan(extract_list, extract_plan);
+			continue;
+		}
+
+		std::shared_ptr<tc::io::IStream> out_stream;
+		if (is_stdout)
+		{
+			out_stream = std::make_shared<StdoutStream>();
+		}
+		else
+		{
+			out_stream = std::make_shared<tc::io::FileStream>(tc::io::FileStream(*archive_itr, tc::io::FileMode::Create, tc::io::FileAccess::Write));
+		}
+
+		TarArchiveWriter archive(out_stream);
+		for (auto itr = dir_list.begin(); itr != dir_list.end(); itr++)
+		{
+			archive.addDirectory(*itr);
+		}
+		for (auto run_itr = extract_plan.begin(); run_itr != extract_plan.end(); run_itr++)
+		{
+			for (auto entry_itr = run_itr->entry_index.begin(); entry_itr != run_itr->entry_index.end(); entry_itr++)
+			{
+				const sExtractFileEntry& entry = extract_list[*entry_itr];
+				fmt::print(log, "{:s}", entry.log_message);
+
+				std::shared_ptr<tc::io::IStream> in_stream;
+				mInputFs->openFile(entry.virtual_path, tc::io::FileMode::Open, tc::io::FileAccess::Read, in_stream);
+				archive.addFile(member_list[*entry_itr], in_stream, mDataCache);
+			}
+		}
+		archive.close();
+		out_stream->dispose();
+	}
+}
+
+void nstool::FsProcess::visitArchiveDir(const tc::io::Path& v_path, const std::string& member_prefix, std::vector<std::string>& dir_list, std::vector<sExtractFileEntry>& extract_list, std::vector<std::string>& member_list)
+{
+	// get listing for directory
+	tc::io::sDirectoryListing info;
+	mInputFs->getDirectoryListing(v_path, info);
+
+	// queue child files for export
+	for (auto itr = info.file_list.begin(); itr != info.file_list.end(); itr++)
+	{
+		if (mExtractFileFilter != nullptr && mExtractFileFilter(v_path + *itr) == false)
+		{
+			continue;
+		}
+
+		std::string member_name = member_prefix + *itr;
+		extract_list.push_back({v_path + *itr, tc::io::Path(member_name), fmt::format("Adding {:s}...\n", member_name), tc::io::Path()});
+		member_list.push_back(member_name);
+	}
+
+	// add child dirs and their contents
+	for (auto itr = info.dir_list.begin(); itr != info.dir_list.end(); itr++)
+	{
+		std::string member_name = member_prefix + *itr;
+		dir_list.push_back(member_name);
+		visitArchiveDir(v_path + *itr, member_name + "/", dir_list, extract_list, member_list);
+	}
+}
+
+void nstool::FsProcess::extractFileList(const std::vector<sExtractFileEntry>& extract_list)
+{
+	// order the files by where they are stored
+	std::vector<sExtractRun> extract_plan;
+	generateExtractPlan(extract_list, extract_plan);
+
+	if (mShowExtractPlan)
+	{
+		printExtractPlan(extract_list, extract_plan);
+		return;
+	}
+
+	// open the manifest journal for each extract directory before any files are written
+	if (mResume)
+	{
+		for (auto itr = extract_list.begin(); itr != extract_list.end(); itr++)
+		{
+			std::string journal_dir = itr->journal_dir.to_string();
+			if (mExtractJournals.find(journal_dir) == mExtractJournals.end())
+			{
+				mExtractJournals[journal_dir] = std::make_shared<ExtractJournal>(itr->journal_dir + ExtractJournal::kManifestFileName);
+			}
+		}
+	}
+
+	if (mDedupe && mDedupeState == nullptr)
+	{
+		mDedupeState = std::make_shared<sDedupeState>();
+		mDedupeState->linked_file_num = 0;
+		mDedupeState->linked_size = 0;
+	}
+
+	// use worker threads if there is more than one run and the input filesystem can be opened more than once
+	if (mThreadNum > 1 && mInputFsFactory != nullptr && extract_plan.size() > 1)
+	{
+		extractFileListConcurrently(extract_list, extract_plan);
+	}
+	else
+	{
+		for (auto itr = extract_plan.begin(); itr != extract_plan.end(); itr++)
+		{
+			for (auto entry_itr = itr->entry_index.begin(); entry_itr != itr->entry_index.end(); entry_itr++)
+			{
+				fmt::print("{:s}", extract_list[*entry_itr].log_message);
+			}
+
+			extractRun(mInputFs, extract_list, *itr, mDataCache);
+		}
+	}
+
+	if (mDedupe && mDedupeState->linked_file_num > 0)
+	{
+		fmt::print("Linked {:d} duplicate file(s), saving 0x{:x} bytes.\n", mDedupeState->linked_file_num, mDedupeState->linked_size);
+	}
+}
+
+void nstool::FsProcess::extractFileListConcurrently(const std::vector<sExtractFileEntry>& extract_list, const std::vector<sExtractRun>& extract_plan)
+{
+	// create worker state on this thread, so any output from opening the input filesystem stays in order
+	if (mThreadPool == nullptr)
+	{
+		mThreadPool = std::make_shared<ThreadPool>(mThreadNum);
+	}
+	while (mExtractWorkers.size() < mThreadPool->getThreadNum())
+	{
+		mExtractWorkers.push_back({mInputFsFactory(), tc::ByteData(mDataCache.size())});
+	}
+
+	// extract state for each run
+	std::mutex state_lock;
+	std::condition_variable run_complete_event;
+	std::vector<bool> is_complete(extract_plan.size(), false);
+	std::vector<std::exception_ptr> extract_exception(extract_plan.size());
+	std::atomic<size_t> next_run_index(0);
+	std::atomic<bool> stop_workers(false);
+
+	// each worker takes the next run in the plan until there are none left
+	for (size_t worker_index = 0; worker_index < mExtractWorkers.size(); worker_index++)
+	{
+		mThreadPool->enqueue([&, worker_index]() {
+			sExtractWorker& worker = mExtractWorkers[worker_index];
+			for (size_t i = next_run_index++; i < extract_plan.size() && stop_workers == false; i = next_run_index++)
+			{
+				std::exception_ptr e;
+				try {
+					extractRun(worker.input_fs, extract_list, extract_plan[i], worker.data_cache);
+				}
+				catch (...) {
+					e = std::current_exception();
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(state_lock);
+					is_complete[i] = true;
+					extract_exception[i] = e;
+				}
+				run_complete_event.notify_all();
+			}
+		});
+	}
+
+	// report files in plan order as they complete, so output is the same regardless of how the work was scheduled
+	for (size_t i = 0; i < extract_plan.size(); i++)
+	{
+		std::exception_ptr e;
+		{
+			std::unique_lock<std::mutex> lock(state_lock);
+			run_complete_event.wait(lock, [&]() { return is_complete[i] == true; });
+			e = extract_exception[i];
+		}
+
+		for (auto entry_itr = extract_plan[i].entry_index.begin(); entry_itr != extract_plan[i].entry_index.end(); entry_itr++)
+		{
+			fmt::print("{:s}", extract_list[*entry_itr].log_message);
+		}
+
+		if (e != nullptr)
+		{
+			stop_workers = true;
+			mThreadPool->wait();
+			std::rethrow_exception(e);
+		}
+	}
+
+	mThreadPool->wait();
+}
+
+void nstool::FsProcess::generateExtractPlan(const std::vector<sExtractFileEntry>& extract_list, std::vector<sExtractRun>& extract_plan) const
+{
+	extract_plan.clear();
+
+	// split files into those with a known location in the input file and those without, skipping duplicate requests
+	std::vector<std::pair<size_t, nstool::FileExtent>> located_list;
+	std::vector<size_t> unlocated_list;
+	std::set<std::pair<std::string, std::string>> requested_set;
+	for (size_t i = 0; i < extract_list.size(); i++)
+	{
+		if (requested_set.insert(std::make_pair(extract_list[i].virtual_path.to_string(), extract_list[i].extract_path.to_string())).second == false)
+		{
+			continue;
+		}
+
+		auto extent = mInputFileLayout.find(extract_list[i].virtual_path);
+		if (extent != mInputFileLayout.end())
+		{
+			located_list.push_back(std::make_pair(i, extent->second));
+		}
+		else
+		{
+			unlocated_list.push_back(i);
+		}
+	}
+
+	// sort by physical offset
+	std::stable_sort(located_list.begin(), located_list.end(), [](const std::pair<size_t, nstool::FileExtent>& a, const std::pair<size_t, nstool::FileExtent>& b) {
+		return a.second.offset < b.second.offset || (a.second.offset == b.second.offset && a.second.size < b.second.size);
+	});
+
+	// group small plaintext files that are close together into runs that can be read with one sequential read
+	for (auto itr = located_list.begin(); itr != located_list.end(); itr++)
+	{
+		const nstool::FileExtent& extent = itr->second;
+		bool can_coalesce = mInputFilePath.isSet() && mResume == false && mDedupe == false && extent.is_plaintext && extent.size <= kPlanMaxCoalesceFileSize;
+
+		if (can_coalesce && extract_plan.empty() == false && extract_plan.back().can_coalesce)
+		{
+			sExtractRun& run = extract_plan.back();
+			int64_t run_end = run.offset + run.size;
+			int64_t new_run_size = std::max<int64_t>(run_end, extent.offset + extent.size) - run.offset;
+
+			if (extent.offset <= run_end + kPlanMaxGapSize && new_run_size <= kPlanMaxRunSize)
+			{
+				run.size = new_run_size;
+				run.entry_index.push_back(itr->first);
+				run.is_coalesced = true;
+				continue;
+			}
+		}
+
+		sExtractRun run;
+		run.is_located = true;
+		run.can_coalesce = can_coalesce;
+		run.is_coalesced = false;
+		run.offset = extent.offset;
+		run.size = extent.size;
+		run.entry_index.push_back(itr->first);
+		extract_plan.push_back(run);
+	}
+
+	// files with no known location are extracted last, in listing order
+	for (auto itr = unlocated_list.begin(); itr != unlocated_list.end(); itr++)
+	{
+		sExtractRun run;
+		run.is_located = false;
+		run.can_coalesce = false;
+		run.is_coalesced = false;
+		run.offset = 0;
+		run.size = 0;
+		run.entry_index.push_back(*itr);
+		extract_plan.push_back(run);
+	}
+}
+
+void nstool::FsProcess::printExtractPlan(const std::vector<sExtractFileEntry>& extract_list, const std::vector<sExtractRun>& extract_plan)
+{
+	fmt::print("[{:s}/ExtractPlan]\n", (mFsFormatName.isSet() ? mFsFormatName.get() : "FileSystem"));
+
+	size_t file_num = 0;
+	size_t seek_num = 0;
+	int64_t read_size = 0;
+	int64_t unlocated_size = 0;
+	int64_t prev_run_end = -1;
+	for (size_t i = 0; i < extract_plan.size(); i++)
+	{
+		const sExtractRun& run = extract_plan[i];
+
+		if (run.is_located)
+		{
+			fmt::print("  Run {:d}: Offset=0x{:x} Size=0x{:x} Files={:d}{:s}\n", i, run.offset, run.size, run.entry_index.size(), (run.is_coalesced ? " (SequentialRead)" : ""));
+			if (run.offset != prev_run_end)
+			{
+				seek_num += 1;
+			}
+			prev_run_end = run.offset + run.size;
+			read_size += run.size;
+		}
+		else
+		{
+			fmt::print("  Run {:d}: Offset=Unknown Files={:d}\n", i, run.entry_index.size());
+		}
+
+		for (auto itr = run.entry_index.begin(); itr != run.entry_index.end(); itr++)
+		{
+			const sExtractFileEntry& entry = extract_list[*itr];
+			auto extent = mInputFileLayout.find(entry.virtual_path);
+			if (extent != mInputFileLayout.end())
+			{
+				fmt::print("    0x{:012x} 0x{:012x} {:s} -> {:s}\n", extent->second.offset, extent->second.size, entry.virtual_path.to_string(), entry.extract_path.to_string());
+			}
+			else
+			{
+				std::shared_ptr<tc::io::IStream> file_stream;
+				mInputFs->openFile(entry.virtual_path, tc::io::FileMode::Open, tc::io::FileAccess::Read, file_stream);
+				unlocated_size += file_stream->length();
+
+				fmt::print("    {:14s} 0x{:012x} {:s} -> {:s}\n", "", file_stream->length(), entry.virtual_path.to_string(), entry.extract_path.to_string());
+			}
+			file_num += 1;
+		}
+	}
+
+	fmt::print("  Total:\n");
+	fmt::print("    Files:          {:d}\n", file_num);
+	fmt::print("    Runs:           {:d}\n", extract_plan.size());
+	fmt::print("    Seeks:          {:d}\n", seek_num);
+	fmt::print("    ReadSize:       0x{:x}\n", read_size);
+	if (unlocated_size != 0)
+	{
+		fmt::print("    UnlocatedSize:  0x{:x}\n", unlocated_size);
+	}
+}
+
+void nstool::FsProcess::extractRun(const std::shared_ptr<tc::io::IFileSystem>& input_fs, const std::vector<sExtractFileEntry>& extract_list, const sExtractRun& run, tc::ByteData& cache)
+{
+	if (run.is_coalesced == false)
+	{
+		for (auto itr = run.entry_index.begin(); itr != run.entry_index.end(); itr++)
+		{
+			extractFile(input_fs, extract_list[*itr], cache);
+		}
+		return;
+	}
+
+	// read the whole run sequentially from the input file, writing each file as its data is read
+	tc::io::FileStream in_stream = tc::io::FileStream(mInputFilePath.get(), tc::io::FileMode::Open, tc::io::FileAccess::Read);
+	in_stream.seek(run.offset, tc::io::SeekOrigin::Begin);
+
+	tc::ByteData run_cache = tc::ByteData(kPlanReadSize);
+	size_t next_entry = 0;
+	std::vector<std::pair<nstool::FileExtent, std::shared_ptr<tc::io::IStream>>> open_files;
+	auto openNextFile = [&]() {
+		const sExtractFileEntry& entry = extract_list[run.entry_index[next_entry]];
+		nstool::FileExtent extent = mInputFileLayout.at(entry.virtual_path);
+		std::shared_ptr<tc::io::IStream> out_stream = openFileStream(entry.extract_path, tc::io::FileMode::Create, tc::io::FileAccess::Write, mIoQueueDepth);
+		if (extent.size > 0)
+		{
+			open_files.push_back(std::make_pair(extent, out_stream));
+		}
+		next_entry++;
+	};
+
+	for (int64_t pos = run.offset, run_end = run.offset + run.size; pos < run_end;)
+	{
+		// read next chunk of the run
+		size_t chunk_size = tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(run_end - pos, tc::io::IOUtil::castSizeToInt64(run_cache.size())));
+		for (size_t read_len = 0; read_len < chunk_size;)
+		{
+			size_t len = in_stream.read(run_cache.data() + read_len, chunk_size - read_len);
+			if (len == 0)
+			{
+				throw tc::io::IOException(mModuleLabel, "Failed to read from input file.");
+			}
+			read_len += len;
+		}
+		int64_t chunk_end = pos + tc::io::IOUtil::castSizeToInt64(chunk_size);
+
+		// open files that start in this chunk
+		while (next_entry < run.entry_index.size() && mInputFileLayout.at(extract_list[run.entry_index[next_entry]].virtual_path).offset < chunk_end)
+		{
+			openNextFile();
+		}
+
+		// write the part of this chunk that belongs to each open file, closing files once they are complete
+		for (auto itr = open_files.begin(); itr != open_files.end();)
+		{
+			int64_t file_end = itr->first.offset + itr->first.size;
+			int64_t write_begin = std::max<int64_t>(pos, itr->first.offset);
+			int64_t write_end = std::min<int64_t>(chunk_end, file_end);
+			if (write_end > write_begin)
+			{
+				itr->second->write(run_cache.data() + (write_begin - pos), tc::io::IOUtil::castInt64ToSize(write_end - write_begin));
+			}
+
+			if (file_end <= chunk_end)
+			{
+				itr->second->dispose();
+				itr = open_files.erase(itr);
+			}
+			else
+			{
+				itr++;
+			}
+		}
+
+		pos = chunk_end;
+	}
+
+	// create any remaining (empty) files
+	while (next_entry < run.entry_index.size())
+	{
+		openNextFile();
+	}
+	for (auto itr = open_files.begin(); itr != open_files.end(); itr++)
+	{
+		itr->second->dispose();
+	}
+}
+
+void nstool::FsProcess::extractFile(const std::shared_ptr<tc::io::IFileSystem>& input_fs, const sExtractFileEntry& entry, tc::ByteData& cache)
+{
+	std::shared_ptr<tc::io::IStream> in_stream;
+	input_fs->openFile(entry.virtual_path, tc::io::FileMode::Open, tc::io::FileAccess::Read, in_stream);
+
+	if (mResume)
+	{
+		extractFileIncremental(entry, in_stream, cache);
+		return;
+	}
+
+	writeFileData(entry, in_stream, cache);
+}
+
+void nstool::FsProcess::writeFileData(const sExtractFileEntry& entry, const std::shared_ptr<tc::io::IStream>& in_stream, tc::ByteData& cache)
+{
+	// if an identical file was already extracted, link to it instead of writing the data again
+	std::string fingerprint;
+	std::string hash;
+	if (mDedupe && in_stream->length() > 0)
+	{
+		fingerprint = getFileFingerprint(in_stream, cache);
+		if (extractFileAsLink(entry, in_stream, fingerprint, hash, cache))
+		{
+			return;
+		}
+
+		// the existing file may be a link from a previous extract, so it is removed rather than overwritten
+		std::remove(entry.extract_path.to_string().c_str());
+	}
+
+	// if the file is stored as is in the input file, try to have the OS copy it directly
+	bool is_copied = false;
+	if (mInputFilePath.isSet())
+	{
+		auto extent = mInputFileLayout.find(entry.virtual_path);
+		is_copied = extent != mInputFileLayout.end() && extent->second.is_plaintext && copyFileRange(mInputFilePath.get(), extent->second.offset, extent->second.size, entry.extract_path);
+	}
+
+	// otherwise have the input stream (e.g. decryption layer) write directly into the output file pages
+	if (is_copied == false && mMappedOutput)
+	{
+		is_copied = writeStreamToMappedFile(in_stream, entry.extract_path);
+	}
 
-			// begin export
-			mInputFs->openFile(v_path + *itr, tc::io::FileMode::Open, tc::io::FileAccess::Read, in_stream);
-			local_fs.openFile(out_path, tc::io::FileMode::OpenOrCreate, tc::io::FileAccess::Write, out_stream);
+	if (is_copied == false)
+	{
+		in_stream->seek(0, tc::io::SeekOrigin::Begin);
+		std::shared_ptr<tc::io::IStream> out_stream = openFileStream(entry.extract_path, tc::io::FileMode::Create, tc::io::FileAccess::Write, mIoQueueDepth);
+		writeStreamToStream(in_stream, out_stream, cache);
+		out_stream->dispose();
+	}
+
+	if (fingerprint.empty() == false)
+	{
+		std::lock_guard<std::mutex> lock(mDedupeState->lock);
+		mDedupeState->file_map[fingerprint].push_back({entry.extract_path, hash});
+	}
+}
+
+bool nstool::FsProcess::extractFileAsLink(const sExtractFileEntry& entry, const std::shared_ptr<tc::io::IStream>& in_stream, const std::string& fingerprint, std::string& hash, tc::ByteData& cache)
+{
+	// get files with the same fingerprint
+	std::vector<sDedupeFile> candidate_list;
+	{
+		std::lock_guard<std::mutex> lock(mDedupeState->lock);
+		auto itr = mDedupeState->file_map.find(fingerprint);
+		if (itr != mDedupeState->file_map.end())
+		{
+			candidate_list = itr->second;
+		}
+	}
 
-			in_stream->seek(0, tc::io::SeekOrigin::Begin);
-			out_stream->seek(0, tc::io::SeekOrigin::Begin);
-			for (int64_t remaining_data = in_stream->length(); remaining_data > 0;)
+	// the fingerprint only samples the file, so compare the hash of the whole file before linking
+	for (auto itr = candidate_list.begin(); itr != candidate_list.end(); itr++)
+	{
+		if (hash.empty())
+		{
+			hash = getFileHash(in_stream, cache);
+		}
+		if (itr->hash.empty())
+		{
+			itr->hash = getFileHash(std::make_shared<tc::io::FileStream>(tc::io::FileStream(itr->extract_path, tc::io::FileMode::Open, tc::io::FileAccess::Read)), cache);
+
+			std::lock_guard<std::mutex> lock(mDedupeState->lock);
+			std::vector<sDedupeFile>& file_list = mDedupeState->file_map[fingerprint];
+			for (auto file_itr = file_list.begin(); file_itr != file_list.end(); file_itr++)
 			{
-				cache_read_len = in_stream->read(mDataCache.data(), mDataCache.size());
-				if (cache_read_len == 0)
+				if (file_itr->extract_path == itr->extract_path)
 				{
-					throw tc::io::IOException(mModuleLabel, fmt::format("Failed to read from {:s}file.", (mFsFormatName.isSet() ? (mFsFormatName.get() + " ") : "")));
+					file_itr->hash = itr->hash;
 				}
+			}
+		}
+
+		if (itr->hash == hash && linkFile(itr->extract_path, entry.extract_path))
+		{
+			std::lock_guard<std::mutex> lock(mDedupeState->lock);
+			mDedupeState->linked_file_num += 1;
+			mDedupeState->linked_size += in_stream->length();
+			return true;
+		}
+	}
 
-				out_stream->write(mDataCache.data(), cache_read_len);
+	return false;
+}
 
-				remaining_data -= int64_t(cache_read_len);
+std::string nstool::FsProcess::getFileFingerprint(const std::shared_ptr<tc::io::IStream>& stream, tc::ByteData& cache)
+{
+	// fingerprint is the file size, and the hash of the start and end of the file
+	Sha256Generator hash_gen;
+	hash_gen.initialize();
+
+	int64_t size = stream->length();
+	int64_t sample_size = kDedupeSampleSize;
+	int64_t sample_offset[2] = { 0, std::max<int64_t>(sample_size, size - sample_size) };
+	for (size_t i = 0; i < 2; i++)
+	{
+		stream->seek(sample_offset[i], tc::io::SeekOrigin::Begin);
+		for (int64_t pos = sample_offset[i], end = std::min<int64_t>(size, sample_offset[i] + sample_size); pos < end;)
+		{
+			size_t len = stream->read(cache.data(), tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(end - pos, tc::io::IOUtil::castSizeToInt64(cache.size()))));
+			if (len == 0)
+			{
+				throw tc::io::IOException(mModuleLabel, "Failed to read from input file.");
 			}
+			hash_gen.update(cache.data(), len);
+			pos += tc::io::IOUtil::castSizeToInt64(len);
 		}
 	}
 
-	// iterate thru child dirs
-	for (auto itr = info.dir_list.begin(); itr != info.dir_list.end(); itr++)
+	tc::ByteData hash = tc::ByteData(Sha256Generator::kHashSize);
+	hash_gen.getHash(hash.data());
+
+	return fmt::format("{:x}:{:s}", size, tc::cli::FormatUtil::formatBytesAsString(hash.data(), hash.size(), false, ""));
+}
+
+std::string nstool::FsProcess::getFileHash(const std::shared_ptr<tc::io::IStream>& stream, tc::ByteData& cache)
+{
+	Sha256Generator hash_gen;
+	hash_gen.initialize();
+
+	int64_t size = stream->length();
+	stream->seek(0, tc::io::SeekOrigin::Begin);
+	for (int64_t pos = 0; pos < size;)
+	{
+		size_t len = stream->read(cache.data(), tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(size - pos, tc::io::IOUtil::castSizeToInt64(cache.size()))));
+		if (len == 0)
+		{
+			throw tc::io::IOException(mModuleLabel, "Failed to read file data.");
+		}
+		hash_gen.update(cache.data(), len);
+		pos += tc::io::IOUtil::castSizeToInt64(len);
+	}
+
+	tc::ByteData hash = tc::ByteData(Sha256Generator::kHashSize);
+	hash_gen.getHash(hash.data());
+
+	return tc::cli::FormatUtil::formatBytesAsString(hash.data(), hash.size(), false, "");
+}
+
+void nstool::FsProcess::extractFileIncremental(const sExtractFileEntry& entry, const std::shared_ptr<tc::io::IStream>& in_stream, tc::ByteData& cache)
+{
+	std::shared_ptr<ExtractJournal> journal = mExtractJournals.at(entry.journal_dir.to_string());
+	std::string extract_path = entry.extract_path.to_string();
+	std::string virtual_path = entry.virtual_path.to_string();
+
+	int64_t size = in_stream->length();
+
+	auto extent = mInputFileLayout.find(entry.virtual_path);
+	int64_t offset = extent != mInputFileLayout.end() ? extent->second.offset : -1;
+
+	// determine the state of the file from the previous extract (if any)
+	ExtractJournal::sRecord record;
+	bool has_record = journal->getRecord(extract_path, record) && record.size == size && record.offset == offset && record.virtual_path == virtual_path;
+
+	std::shared_ptr<tc::io::IStream> out_stream;
+	int64_t out_length = -1;
+	if (has_record)
+	{
+		try {
+			out_stream = std::make_shared<tc::io::FileStream>(tc::io::FileStream(entry.extract_path, tc::io::FileMode::Open, tc::io::FileAccess::Read));
+			out_length = out_stream->length();
+		}
+		catch (tc::io::FileNotFoundException&) {
+			// acceptable exception, the file will be written again
+		}
+	}
+
+	// the manifest records the hash of the source data, which is hashed as it is read (to be compared or copied)
+	std::shared_ptr<HashingStream> hashed_stream = std::make_shared<HashingStream>(in_stream);
+
+	// file was already extracted, if the source data (e.g. from a newer input file) still has the recorded hash, and so does the extracted file
+	if (has_record && record.is_complete && out_length == size)
 	{
-		visitDir(v_path + *itr, l_path + *itr, extract_fs, print_fs);
+		bool is_extracted = getFileHash(hashed_stream, cache) == record.hash && getFileHash(out_stream, cache) == record.hash;
+		if (is_extracted)
+		{
+			out_stream->dispose();
+			return;
+		}
 	}
+
+	// a partially written file is resumed (from a multiple of kResumeAlignSize), if the data already written matches the source data
+	int64_t resume_pos = 0;
+	if (has_record && record.is_complete == false && out_length > 0)
+	{
+		resume_pos = std::min<int64_t>(out_length, size);
+		resume_pos -= resume_pos % kResumeAlignSize;
+
+		tc::ByteData out_cache = tc::ByteData(cache.size());
+		hashed_stream->seek(0, tc::io::SeekOrigin::Begin);
+		out_stream->seek(0, tc::io::SeekOrigin::Begin);
+		for (int64_t pos = 0; pos < resume_pos;)
+		{
+			size_t len = hashed_stream->read(cache.data(), tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(resume_pos - pos, tc::io::IOUtil::castSizeToInt64(cache.size()))));
+			if (len == 0)
+			{
+				throw tc::io::IOException(mModuleLabel, "Failed to read from input file.");
+			}
+			if (out_stream->read(out_cache.data(), len) != len)
+			{
+				throw tc::io::IOException(mModuleLabel, "Failed to read from partially extracted file.");
+			}
+
+			// otherwise the file is written again from the start
+			if (memcmp(cache.data(), out_cache.data(), len) != 0)
+			{
+				resume_pos = 0;
+				break;
+			}
+			pos += tc::io::IOUtil::castSizeToInt64(len);
+		}
+	}
+	if (out_stream != nullptr)
+	{
+		out_stream->dispose();
+	}
+
+	journal->writeBeginRecord(extract_path, virtual_path, size, offset);
+
+	if (resume_pos == 0)
+	{
+		writeFileData(entry, hashed_stream, cache);
+	}
+	else
+	{
+		// write the rest of the file after the data already written
+		std::shared_ptr<tc::io::IStream> resume_out_stream = openFileStream(entry.extract_path, tc::io::FileMode::Open, tc::io::FileAccess::Write, mIoQueueDepth);
+		resume_out_stream->setLength(size);
+		writeStreamToStream(std::make_shared<tc::io::SubStream>(tc::io::SubStream(hashed_stream, resume_pos, size - resume_pos)), std::make_shared<tc::io::SubStream>(tc::io::SubStream(resume_out_stream, resume_pos, size - resume_pos)), cache);
+		resume_out_stream->dispose();
+	}
+
+	// hash the source data that wasn't read while writing the file (e.g. when it was copied by the OS)
+	tc::ByteData hash = tc::ByteData(Sha256Generator::kHashSize);
+	hashed_stream->getHash(hash.data());
+
+	journal->writeCompleteRecord(extract_path, virtual_path, size, offset, tc::cli::FormatUtil::formatBytesAsString(hash.data(), hash.size(), false, ""));
 }
\ No newline at end of file
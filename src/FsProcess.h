@@ -2,7 +2,12 @@
 #include <tc/Optional.h>
 #include <tc/io.h>
 
+#include <functional>
+#include <map>
+
 #include "types.h"
+#include "ThreadPool.h"
+#include "ExtractJournal.h"
 
 namespace nstool
 {
@@ -10,21 +15,55 @@ namespace nstool
 class FsProcess
 {
 public:
+	// creates an independent reader for the input filesystem, so files can be extracted concurrently
+	using FileSystemFactory = std::function<std::shared_ptr<tc::io::IFileSystem>()>;
+
+	// decides if a file (by virtual path) found while extracting a directory is extracted
+	using ExtractFileFilter = std::function<bool(const tc::io::Path&)>;
+
 	FsProcess();
 
 	void process();
 
 	void setInputFileSystem(const std::shared_ptr<tc::io::IFileSystem>& input_fs);
+	void setInputFileSystemFactory(const FileSystemFactory& input_fs_factory);
+	void setInputFilePath(const tc::io::Path& input_file_path);
+	void setInputFileLayout(const std::map<tc::io::Path, nstool::FileExtent>& input_file_layout);
 	void setFsFormatName(const std::string& fs_format_name);
 	void setFsProperties(const std::vector<std::string>& properties);
 	void setShowFsInfo(bool show_fs_info);
 	void setShowFsTree(bool show_fs_tree);
 	void setFsRootLabel(const std::string& root_label);
 	void setExtractJobs(const std::vector<nstool::ExtractJob>& extract_jobs);
+	void setShowExtractPlan(bool show_extract_plan);
+	void setThreadNum(size_t thread_num);
+	void setResumeMode(bool resume);
+	void setExtractFormat(nstool::ExtractFormat extract_format);
+	void setDedupeMode(bool dedupe);
+	void setIoQueueDepth(size_t io_queue_depth);
+	void setMappedOutputMode(bool mapped_output);
+	void setExtractFileFilter(const ExtractFileFilter& extract_file_filter);
 private:
+	// extract plan tuning
+	static const int64_t kPlanMaxCoalesceFileSize = 0x100000; // larger files are read by themselves
+	static const int64_t kPlanMaxGapSize = 0x10000; // max unused data read between two files in a run
+	static const int64_t kPlanMaxRunSize = 0x2000000;
+	static const size_t kPlanReadSize = 0x400000;
+
+	// resumable extract
+	static const int64_t kResumeAlignSize = 0x100000; // partially written files are resumed from a multiple of this
+
+	// de-duplicated extract
+	static const int64_t kDedupeSampleSize = 0x10000; // size of the start/end of a file hashed for its fingerprint
+
 	std::string mModuleLabel;
 
 	std::shared_ptr<tc::io::IFileSystem> mInputFs;
+	FileSystemFactory mInputFsFactory;
+
+	// where file data is located in the input file (if known), so it can be copied without going through the filesystem
+	tc::Optional<tc::io::Path> mInputFilePath;
+	std::map<tc::io::Path, nstool::FileExtent> mInputFileLayout;
 
 	// fs info
 	tc::Optional<std::string> mFsFormatName;
@@ -37,14 +76,90 @@ private:
 
 	// extract jobs
 	std::vector<nstool::ExtractJob> mExtractJobs;
+	bool mShowExtractPlan;
+	nstool::ExtractFormat mExtractFormat;
+
+	// manifest journal for each extract directory, used to skip or resume files already extracted
+	bool mResume;
+	std::map<std::string, std::shared_ptr<ExtractJournal>> mExtractJournals;
+
+	// files already extracted, so identical files can be linked to them instead of written again
+	struct sDedupeFile
+	{
+		tc::io::Path extract_path;
+		std::string hash; // sha256 of the whole file, empty until needed
+	};
+	struct sDedupeState
+	{
+		std::mutex lock;
+		std::map<std::string, std::vector<sDedupeFile>> file_map; // key is the file fingerprint
+		size_t linked_file_num;
+		int64_t linked_size;
+	};
+	bool mDedupe;
+	std::shared_ptr<sDedupeState> mDedupeState;
 
 	// cache for file extract
 	tc::ByteData mDataCache;
-	
+
+	// number of asynchronous writes in flight for each extracted file (0 uses synchronous I/O)
+	size_t mIoQueueDepth;
+
+	// files are written by reading the input directly into a memory mapping of the output file
+	bool mMappedOutput;
+
+	// files in extracted directories are skipped if this returns false
+	ExtractFileFilter mExtractFileFilter;
+
+	// concurrent file extract
+	struct sExtractWorker
+	{
+		std::shared_ptr<tc::io::IFileSystem> input_fs;
+		tc::ByteData data_cache;
+	};
+	size_t mThreadNum;
+	std::shared_ptr<ThreadPool> mThreadPool;
+	std::vector<sExtractWorker> mExtractWorkers;
+
+	// file queued for extraction
+	struct sExtractFileEntry
+	{
+		tc::io::Path virtual_path;
+		tc::io::Path extract_path;
+		std::string log_message;
+		tc::io::Path journal_dir; // directory the manifest journal for this file is kept in
+	};
+
+	// files to be extracted together, ordered by their location in the input file
+	struct sExtractRun
+	{
+		bool is_located; // offset/size are known
+		bool can_coalesce; // more files can be added to this run
+		bool is_coalesced; // run is read from the input file with one sequential read
+		int64_t offset;
+		int64_t size;
+		std::vector<size_t> entry_index;
+	};
+
 	void printFs();
 	void extractFs();
 
-	void visitDir(const tc::io::Path& v_path, const tc::io::Path& l_path, bool extract_fs, bool print_fs);
+	void visitDir(const tc::io::Path& v_path, const tc::io::Path& l_path, bool extract_fs, bool print_fs, std::vector<sExtractFileEntry>& extract_list);
+
+	void extractFsToArchive();
+	void visitArchiveDir(const tc::io::Path& v_path, const std::string& member_prefix, std::vector<std::string>& dir_list, std::vector<sExtractFileEntry>& extract_list, std::vector<std::string>& member_list);
+
+	void extractFileList(const std::vector<sExtractFileEntry>& extract_list);
+	void extractFileListConcurrently(const std::vector<sExtractFileEntry>& extract_list, const std::vector<sExtractRun>& extract_plan);
+	void generateExtractPlan(const std::vector<sExtractFileEntry>& extract_list, std::vector<sExtractRun>& extract_plan) const;
+	void printExtractPlan(const std::vector<sExtractFileEntry>& extract_list, const std::vector<sExtractRun>& extract_plan);
+	void extractRun(const std::shared_ptr<tc::io::IFileSystem>& input_fs, const std::vector<sExtractFileEntry>& extract_list, const sExtractRun& run, tc::ByteData& cache);
+	void extractFile(const std::shared_ptr<tc::io::IFileSystem>& input_fs, const sExtractFileEntry& entry, tc::ByteData& cache);
+	void writeFileData(const sExtractFileEntry& entry, const std::shared_ptr<tc::io::IStream>& in_stream, tc::ByteData& cache);
+	bool extractFileAsLink(const sExtractFileEntry& entry, const std::shared_ptr<tc::io::IStream>& in_stream, const std::string& fingerprint, std::string& hash, tc::ByteData& cache);
+	std::string getFileFingerprint(const std::shared_ptr<tc::io::IStream>& stream, tc::ByteData& cache);
+	std::string getFileHash(const std::shared_ptr<tc::io::IStream>& stream, tc::ByteData& cache);
+	void extractFileIncremental(const sExtractFileEntry& entry, const std::shared_ptr<tc::io::IStream>& in_stream, tc::ByteData& cache);
 };
 
 }
\ No newline at end of file
@@ -9,13 +9,17 @@
 
 #include <pietendo/hac/GameCardFsSnapshotGenerator.h>
 #include "FsProcess.h"
+#include "SharedStream.h"
+#include "Sha256Generator.h"
 
 
 nstool::GameCardProcess::GameCardProcess() :
 	mModuleName("nstool::GameCardProcess"),
 	mFile(),
+	mFilePath(),
 	mCliOutputMode(true, false, false, false),
 	mVerify(false),
+	mSignatureCache(),
 	mIsTrueSdkXci(false),
 	mIsSdkXciEncrypted(false),
 	mGcHeaderOffset(0),
@@ -46,6 +50,11 @@ void nstool::GameCardProcess::setInputFile(const std::shared_ptr<tc::io::IStream
 	mFile = file;
 }
 
+void nstool::GameCardProcess::setInputFilePath(const tc::io::Path& path)
+{
+	mFilePath = path;
+}
+
 void nstool::GameCardProcess::setKeyCfg(const KeyBag& keycfg)
 {
 	mKeyCfg = keycfg;
@@ -61,6 +70,11 @@ void nstool::GameCardProcess::setVerifyMode(bool verify)
 	mVerify = verify;
 }
 
+void nstool::GameCardProcess::setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache)
+{
+	mSignatureCache = sig_cache;
+}
+
 void nstool::GameCardProcess::setShowFsTree(bool show_fs_tree)
 {
 	mFsProcess.setShowFsTree(show_fs_tree);
@@ -71,6 +85,41 @@ void nstool::GameCardProcess::setExtractJobs(const std::vector<nstool::ExtractJo
 	mFsProcess.setExtractJobs(extract_jobs);
 }
 
+void nstool::GameCardProcess::setShowExtractPlan(bool show_extract_plan)
+{
+	mFsProcess.setShowExtractPlan(show_extract_plan);
+}
+
+void nstool::GameCardProcess::setResumeMode(bool resume)
+{
+	mFsProcess.setResumeMode(resume);
+}
+
+void nstool::GameCardProcess::setDedupeMode(bool dedupe)
+{
+	mFsProcess.setDedupeMode(dedupe);
+}
+
+void nstool::GameCardProcess::setMappedOutputMode(bool mapped_output)
+{
+	mFsProcess.setMappedOutputMode(mapped_output);
+}
+
+void nstool::GameCardProcess::setIoQueueDepth(size_t io_queue_depth)
+{
+	mFsProcess.setIoQueueDepth(io_queue_depth);
+}
+
+void nstool::GameCardProcess::setExtractFormat(nstool::ExtractFormat extract_format)
+{
+	mFsProcess.setExtractFormat(extract_format);
+}
+
+void nstool::GameCardProcess::setThreadNum(size_t thread_num)
+{
+	mFsProcess.setThreadNum(thread_num);
+}
+
 void nstool::GameCardProcess::importHeader()
 {
 	if (mFile == nullptr)
@@ -114,7 +163,7 @@ void nstool::GameCardProcess::importHeader()
 	pie::hac::sGcHeader_Rsa2048Signed* hdr_ptr = (pie::hac::sGcHeader_Rsa2048Signed*)(scratch.data() + mGcHeaderOffset);
 
 	// generate hash of raw header
-	tc::crypto::GenerateSha2256Hash(mHdrHash.data(), (byte_t*)&hdr_ptr->header, sizeof(pie::hac::sGcHeader));
+	GenerateSha256Hash(mHdrHash.data(), (byte_t*)&hdr_ptr->header, sizeof(pie::hac::sGcHeader));
 	
 	// save the signature
 	memcpy(mHdrSignature.data(), hdr_ptr->signature.data(), mHdrSignature.size());
@@ -225,7 +274,7 @@ bool nstool::GameCardProcess::validateRegionOfFile(int64_t offset, int64_t len,
 	mFile->read(scratch.data(), scratch.size());
 
 	// update hash
-	tc::crypto::Sha2256Generator sha256_gen;
+	Sha256Generator sha256_gen;
 	sha256_gen.initialize();
 	sha256_gen.update(scratch.data(), scratch.size());
 	if (use_salt)
@@ -247,7 +296,7 @@ void nstool::GameCardProcess::validateXciSignature()
 {
 	if (mKeyCfg.xci_header_sign_key.isSet())
 	{
-		if (tc::crypto::VerifyRsa2048Pkcs1Sha2256(mHdrSignature.data(), mHdrHash.data(), mKeyCfg.xci_header_sign_key.get()) == false)
+		if (VerifySignature(mSignatureCache, SignatureCache::SIGN_RSA2048_PKCS1_SHA256, mHdrSignature.data(), mHdrHash.data(), mKeyCfg.xci_header_sign_key.get()) == false)
 		{
 			fmt::print("[WARNING] GameCard Header Signature: FAIL\n");
 		}
@@ -265,12 +314,32 @@ void nstool::GameCardProcess::processRootPfs()
 		fmt::print("[WARNING] GameCard Root HFS0: FAIL (bad hash)\n");
 	}
 
-	std::shared_ptr<tc::io::IStream> gc_fs_raw = std::make_shared<tc::io::SubStream>(tc::io::SubStream(mFile, mHdr.getPartitionFsAddress(), pie::hac::GameCardUtil::blockToAddr(mHdr.getValidDataEndPage()+1) - mHdr.getPartitionFsAddress()));
+	int64_t gc_fs_offset = mHdr.getPartitionFsAddress();
+	int64_t gc_fs_size = pie::hac::GameCardUtil::blockToAddr(mHdr.getValidDataEndPage()+1) - mHdr.getPartitionFsAddress();
+	std::shared_ptr<tc::io::IStream> gc_fs_raw = std::make_shared<tc::io::SubStream>(tc::io::SubStream(mFile, gc_fs_offset, gc_fs_size));
 
 	auto gc_vfs_snapshot = pie::hac::GameCardFsSnapshotGenerator(gc_fs_raw, mHdr.getPartitionFsSize(), mVerify ? pie::hac::GameCardFsSnapshotGenerator::ValidationMode_Warn : pie::hac::GameCardFsSnapshotGenerator::ValidationMode_None);
 	mFileSystem = std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(gc_vfs_snapshot) );
 
 	mFsProcess.setInputFileSystem(mFileSystem);
+
+	// allow FsProcess to open more readers for concurrent extraction
+	std::shared_ptr<SharedStream> shared_file = std::make_shared<SharedStream>(mFile);
+	int64_t gc_fs_hdr_size = mHdr.getPartitionFsSize();
+	mFsProcess.setInputFileSystemFactory([shared_file, gc_fs_offset, gc_fs_size, gc_fs_hdr_size]() -> std::shared_ptr<tc::io::IFileSystem> {
+		std::shared_ptr<tc::io::IStream> gc_fs_raw = std::make_shared<tc::io::SubStream>(tc::io::SubStream(shared_file->clone(), gc_fs_offset, gc_fs_size));
+		return std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(pie::hac::GameCardFsSnapshotGenerator(gc_fs_raw, gc_fs_hdr_size, pie::hac::GameCardFsSnapshotGenerator::ValidationMode_None)));
+	});
+
+	// tell FsProcess where each file is stored, if the input is a local file files can also be copied straight from it
+	std::map<tc::io::Path, nstool::FileExtent> file_layout;
+	generateFileLayout(file_layout);
+	mFsProcess.setInputFileLayout(file_layout);
+	if (mFilePath.isSet())
+	{
+		mFsProcess.setInputFilePath(mFilePath.get());
+	}
+
 	mFsProcess.setFsFormatName("PartitionFs");
 	mFsProcess.setFsProperties({
 		fmt::format("Type:      Nested HFS0"),
@@ -280,4 +349,50 @@ void nstool::GameCardProcess::processRootPfs()
 	mFsProcess.setShowFsInfo(mCliOutputMode.show_basic_info);
 	mFsProcess.setFsRootLabel(kXciMountPointName);
 	mFsProcess.process();
+}
+
+void nstool::GameCardProcess::generateFileLayout(std::map<tc::io::Path, nstool::FileExtent>& layout)
+{
+	layout.clear();
+
+	try {
+		// read root HFS0 header
+		int64_t root_offset = mHdr.getPartitionFsAddress();
+		tc::ByteData scratch = tc::ByteData(tc::io::IOUtil::castInt64ToSize(mHdr.getPartitionFsSize()));
+		mFile->seek(root_offset, tc::io::SeekOrigin::Begin);
+		mFile->read(scratch.data(), scratch.size());
+
+		pie::hac::PartitionFsHeader root_hdr;
+		root_hdr.fromBytes(scratch.data(), scratch.size());
+
+		// read each partition HFS0 header
+		for (auto partition = root_hdr.getFileList().begin(); partition != root_hdr.getFileList().end(); partition++)
+		{
+			int64_t partition_offset = root_offset + partition->offset;
+
+			scratch = tc::ByteData(sizeof(pie::hac::sPfsHeader));
+			mFile->seek(partition_offset, tc::io::SeekOrigin::Begin);
+			mFile->read(scratch.data(), scratch.size());
+			if (PfsProcess::validateHeaderMagic((pie::hac::sPfsHeader*)scratch.data()) == false)
+			{
+				continue;
+			}
+
+			scratch = tc::ByteData(PfsProcess::determineHeaderSize((pie::hac::sPfsHeader*)scratch.data()));
+			mFile->seek(partition_offset, tc::io::SeekOrigin::Begin);
+			mFile->read(scratch.data(), scratch.size());
+
+			pie::hac::PartitionFsHeader partition_hdr;
+			partition_hdr.fromBytes(scratch.data(), scratch.size());
+
+			for (auto file = partition_hdr.getFileList().begin(); file != partition_hdr.getFileList().end(); file++)
+			{
+				layout[tc::io::Path("/") + partition->name + file->name] = { partition_offset + file->offset, file->size, true };
+			}
+		}
+	}
+	catch (const tc::Exception&) {
+		// the layout is optional, files will just be extracted through the filesystem
+		layout.clear();
+	}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "types.h"
 #include "KeyBag.h"
+#include "SignatureCache.h"
 #include "PfsProcess.h"
 
 #include <pietendo/hac/GameCardHeader.h>
@@ -16,22 +17,33 @@ public:
 
 	// generic
 	void setInputFile(const std::shared_ptr<tc::io::IStream>& file);
+	void setInputFilePath(const tc::io::Path& path);
 	void setKeyCfg(const KeyBag& keycfg);
 	void setCliOutputMode(CliOutputMode type);
 	void setVerifyMode(bool verify);
+	void setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache);
 
 	// fs specific
 	void setShowFsTree(bool show_fs_tree);
 	void setExtractJobs(const std::vector<nstool::ExtractJob> extract_jobs);
+	void setShowExtractPlan(bool show_extract_plan);
+	void setResumeMode(bool resume);
+	void setDedupeMode(bool dedupe);
+	void setMappedOutputMode(bool mapped_output);
+	void setIoQueueDepth(size_t io_queue_depth);
+	void setExtractFormat(nstool::ExtractFormat extract_format);
+	void setThreadNum(size_t thread_num);
 private:
 	const std::string kXciMountPointName = "gamecard";
 
 	std::string mModuleName;
 
 	std::shared_ptr<tc::io::IStream> mFile;
+	tc::Optional<tc::io::Path> mFilePath;
 	KeyBag mKeyCfg;
 	CliOutputMode mCliOutputMode;
 	bool mVerify;
+	std::shared_ptr<SignatureCache> mSignatureCache;
 	
 	bool mIsTrueSdkXci;
 	bool mIsSdkXciEncrypted;
@@ -51,6 +63,7 @@ private:
 	bool validateRegionOfFile(int64_t offset, int64_t len, const byte_t* test_hash);
 	void validateXciSignature();
 	void processRootPfs();
+	void generateFileLayout(std::map<tc::io::Path, nstool::FileExtent>& layout);
 };
 
 }
\ No newline at end of file
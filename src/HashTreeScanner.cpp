@@ -0,0 +1,235 @@
+#include "HashTreeScanner.h"
+#include "Sha256Generator.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+nstool::HashTreeScanner::HashTreeScanner() :
+	mModuleLabel("nstool::HashTreeScanner"),
+	mStream(),
+	mLayout(),
+	mThreadNum(1),
+	mBadBlocks(),
+	mScannedSize(0),
+	mBlockNum(0),
+	mElapsedSeconds(0)
+{
+}
+
+void nstool::HashTreeScanner::scan()
+{
+	if (mStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "No input stream set.");
+	}
+	if (mLayout.layers.empty() || mLayout.master_hash_list.empty())
+	{
+		throw tc::ArgumentException(mModuleLabel, "No hash layers set.");
+	}
+
+	mBadBlocks.clear();
+	mScannedSize = 0;
+	mBlockNum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	ThreadPool thread_pool(std::max<size_t>(mThreadNum, 1));
+	std::mutex bad_block_mutex;
+
+	// the top layer is verified by the master hash(es)
+	tc::ByteData parent_hashes(mLayout.master_hash_list.size() * Sha256Generator::kHashSize);
+	for (size_t i = 0; i < mLayout.master_hash_list.size(); i++)
+	{
+		memcpy(parent_hashes.data() + i * Sha256Generator::kHashSize, mLayout.master_hash_list[i].data(), Sha256Generator::kHashSize);
+	}
+
+	for (size_t layer_index = 0; layer_index < mLayout.layers.size(); layer_index++)
+	{
+		const HashTreeStream::sLayer& layer = mLayout.layers[layer_index];
+		bool is_data_layer = layer_index + 1 == mLayout.layers.size();
+
+		if (layer.size <= 0)
+		{
+			continue;
+		}
+		if (layer.block_size <= 0)
+		{
+			throw tc::ArgumentOutOfRangeException(mModuleLabel, fmt::format("Hash layer {:d} has an invalid block size.", layer_index));
+		}
+
+		int64_t block_num = (layer.size + layer.block_size - 1) / layer.block_size;
+		if (block_num > tc::io::IOUtil::castSizeToInt64(parent_hashes.size() / Sha256Generator::kHashSize))
+		{
+			throw tc::Exception(mModuleLabel, fmt::format("Hash layer {:d} has more blocks than its parent has hashes.", layer_index));
+		}
+
+		// hash layers are read whole (they are verified and become the parent of the next layer), the data layer is read in batches
+		size_t chunk_block_num = std::max<size_t>(kChunkSize / size_t(layer.block_size), 1);
+		size_t chunk_size = chunk_block_num * size_t(layer.block_size);
+		size_t batch_chunk_num = thread_pool.getThreadNum();
+
+		tc::ByteData layer_data;
+		std::vector<tc::ByteData> batch_buffers[2];
+		if (is_data_layer)
+		{
+			for (size_t i = 0; i < 2; i++)
+			{
+				for (size_t j = 0; j < batch_chunk_num; j++)
+				{
+					batch_buffers[i].push_back(tc::ByteData(size_t(std::min<int64_t>(tc::io::IOUtil::castSizeToInt64(chunk_size), layer.size))));
+				}
+			}
+		}
+		else
+		{
+			layer_data = tc::ByteData(tc::io::IOUtil::castInt64ToSize(layer.size));
+		}
+
+		// read batch n while batch n-1 is being hashed
+		size_t batch_index = 0;
+		for (int64_t pos = 0; pos < layer.size; batch_index++)
+		{
+			std::vector<std::function<void()>> tasks;
+			for (size_t i = 0; i < batch_chunk_num && pos < layer.size; i++)
+			{
+				size_t size = tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(tc::io::IOUtil::castSizeToInt64(chunk_size), layer.size - pos));
+				byte_t* data = is_data_layer ? batch_buffers[batch_index % 2][i].data() : layer_data.data() + pos;
+				readData(layer.offset + pos, data, size);
+
+				int64_t block_index = pos / layer.block_size;
+				const byte_t* expected_hashes = parent_hashes.data() + block_index * Sha256Generator::kHashSize;
+				tasks.push_back([this, layer_index, layer, data, size, block_index, expected_hashes, &bad_block_mutex]() {
+					std::vector<sBadBlock> bad_blocks;
+					verifyChunk(layer_index, layer, data, size, block_index, expected_hashes, bad_blocks);
+					if (bad_blocks.empty() == false)
+					{
+						std::lock_guard<std::mutex> lock(bad_block_mutex);
+						mBadBlocks.insert(mBadBlocks.end(), bad_blocks.begin(), bad_blocks.end());
+					}
+				});
+
+				pos += tc::io::IOUtil::castSizeToInt64(size);
+			}
+
+			thread_pool.wait();
+			for (auto itr = tasks.begin(); itr != tasks.end(); itr++)
+			{
+				thread_pool.enqueue(*itr);
+			}
+		}
+		thread_pool.wait();
+
+		mScannedSize += layer.size;
+		mBlockNum += block_num;
+
+		// this layer verifies the next
+		if (is_data_layer == false)
+		{
+			parent_hashes = std::move(layer_data);
+		}
+	}
+
+	std::sort(mBadBlocks.begin(), mBadBlocks.end(), [](const sBadBlock& a, const sBadBlock& b) { return a.layer_index != b.layer_index ? a.layer_index < b.layer_index : a.offset < b.offset; });
+
+	auto end = std::chrono::steady_clock::now();
+	mElapsedSeconds = std::chrono::duration<double>(end - start).count();
+}
+
+void nstool::HashTreeScanner::setInputStream(const std::shared_ptr<tc::io::IStream>& stream)
+{
+	mStream = stream;
+}
+
+void nstool::HashTreeScanner::setLayout(const HashTreeStream::sLayout& layout)
+{
+	mLayout = layout;
+}
+
+void nstool::HashTreeScanner::setThreadNum(size_t thread_num)
+{
+	mThreadNum = thread_num;
+}
+
+const std::vector<nstool::HashTreeStream::sLayer>& nstool::HashTreeScanner::getLayerList() const
+{
+	return mLayout.layers;
+}
+
+const std::vector<nstool::HashTreeScanner::sBadBlock>& nstool::HashTreeScanner::getBadBlockList() const
+{
+	return mBadBlocks;
+}
+
+int64_t nstool::HashTreeScanner::getScannedSize() const
+{
+	return mScannedSize;
+}
+
+int64_t nstool::HashTreeScanner::getBlockNum() const
+{
+	return mBlockNum;
+}
+
+double nstool::HashTreeScanner::getElapsedSeconds() const
+{
+	return mElapsedSeconds;
+}
+
+void nstool::HashTreeScanner::readData(int64_t offset, byte_t* data, size_t size)
+{
+	mStream->seek(offset, tc::io::SeekOrigin::Begin);
+	for (size_t pos = 0; pos < size;)
+	{
+		size_t len = mStream->read(data + pos, size - pos);
+		if (len == 0)
+		{
+			throw tc::io::IOException(mModuleLabel, fmt::format("Failed to read hash layer data at offset 0x{:x}.", offset + tc::io::IOUtil::castSizeToInt64(pos)));
+		}
+		pos += len;
+	}
+}
+
+void nstool::HashTreeScanner::verifyChunk(size_t layer_index, const HashTreeStream::sLayer& layer, const byte_t* data, size_t size, int64_t block_index, const byte_t* expected_hashes, std::vector<sBadBlock>& bad_blocks)
+{
+	size_t block_size = size_t(layer.block_size);
+	size_t full_block_num = size / block_size;
+	size_t final_block_size = size % block_size;
+
+	tc::ByteData hashes((full_block_num + (final_block_size != 0 ? 1 : 0)) * Sha256Generator::kHashSize);
+
+	// whole blocks are hashed together
+	std::vector<const byte_t*> blocks;
+	for (size_t i = 0; i < full_block_num; i++)
+	{
+		blocks.push_back(data + i * block_size);
+	}
+	Sha256Generator::generateHashes(hashes.data(), blocks, block_size);
+
+	// partial final block of the layer
+	if (final_block_size != 0)
+	{
+		Sha256Generator hash_gen;
+		hash_gen.initialize();
+		hash_gen.update(data + full_block_num * block_size, final_block_size);
+		if (mLayout.pad_final_block)
+		{
+			tc::ByteData padding(block_size - final_block_size);
+			hash_gen.update(padding.data(), padding.size());
+		}
+		hash_gen.getHash(hashes.data() + full_block_num * Sha256Generator::kHashSize);
+	}
+
+	for (size_t i = 0; i * Sha256Generator::kHashSize < hashes.size(); i++)
+	{
+		if (memcmp(hashes.data() + i * Sha256Generator::kHashSize, expected_hashes + i * Sha256Generator::kHashSize, Sha256Generator::kHashSize) != 0)
+		{
+			sBadBlock bad_block;
+			bad_block.layer_index = layer_index;
+			bad_block.offset = layer.offset + (block_index + tc::io::IOUtil::castSizeToInt64(i)) * layer.block_size;
+			bad_block.size = std::min<int64_t>(layer.block_size, layer.offset + layer.size - bad_block.offset);
+			bad_blocks.push_back(bad_block);
+		}
+	}
+}
\ No newline at end of file
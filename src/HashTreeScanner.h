@@ -0,0 +1,57 @@
+#pragma once
+#include "types.h"
+#include "HashTreeStream.h"
+
+namespace nstool {
+
+/**
+ * @class HashTreeScanner
+ * @brief Verifies every block of a hash-tree (HierarchicalSha256 or HierarchicalIntegrity) against its parent hash layer.
+ *
+ * Layers are verified from the top (verified by the master hash) down to the data layer. Each block is read once, hash layers are
+ * kept in memory to verify the layer below. Blocks are hashed on a thread pool while the next batch of blocks is read.
+ */
+class HashTreeScanner
+{
+public:
+	struct sBadBlock
+	{
+		size_t layer_index;
+		int64_t offset; // offset in input stream
+		int64_t size;
+	};
+
+	HashTreeScanner();
+
+	void scan();
+
+	// input stream is the decrypted partition, layer offsets are relative to this stream
+	void setInputStream(const std::shared_ptr<tc::io::IStream>& stream);
+	void setLayout(const HashTreeStream::sLayout& layout);
+	void setThreadNum(size_t thread_num);
+
+	// post scan() results
+	const std::vector<HashTreeStream::sLayer>& getLayerList() const;
+	const std::vector<sBadBlock>& getBadBlockList() const;
+	int64_t getScannedSize() const; // total size of all layers read
+	int64_t getBlockNum() const; // total number of blocks verified
+	double getElapsedSeconds() const;
+private:
+	static const size_t kChunkSize = 0x400000; // size of data hashed by each task (rounded down to a multiple of the block size)
+
+	std::string mModuleLabel;
+
+	std::shared_ptr<tc::io::IStream> mStream;
+	HashTreeStream::sLayout mLayout;
+	size_t mThreadNum;
+
+	std::vector<sBadBlock> mBadBlocks;
+	int64_t mScannedSize;
+	int64_t mBlockNum;
+	double mElapsedSeconds;
+
+	void readData(int64_t offset, byte_t* data, size_t size);
+	void verifyChunk(size_t layer_index, const HashTreeStream::sLayer& layer, const byte_t* data, size_t size, int64_t block_index, const byte_t* expected_hashes, std::vector<sBadBlock>& bad_blocks);
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,530 @@
+#include "HashTreeStream.h"
+#include "Sha256Generator.h"
+
+#include <tc/ObjectDisposedException.h>
+
+#include <cstring>
+#include <algorithm>
+
+nstool::HashTreeStream::sLayout nstool::HashTreeStream::generateLayout(const pie::hac::HierarchicalSha256Header& hdr)
+{
+	// the first layer is hashed whole by the master hash, the other layers are hashed in blocks (the final block is not padded)
+	sLayout layout;
+	for (size_t i = 0; i < hdr.getLayerInfo().size(); i++)
+	{
+		sLayer layer;
+		layer.offset = hdr.getLayerInfo()[i].offset;
+		layer.size = hdr.getLayerInfo()[i].size;
+		layer.block_size = i == 0 ? layer.size : hdr.getHashBlockSize();
+		layout.layers.push_back(layer);
+	}
+	layout.master_hash_list = { hdr.getMasterHash() };
+	layout.pad_final_block = false;
+
+	return layout;
+}
+
+nstool::HashTreeStream::sLayout nstool::HashTreeStream::generateLayout(const pie::hac::HierarchicalIntegrityHeader& hdr)
+{
+	sLayout layout;
+	for (size_t i = 0; i < hdr.getLayerInfo().size(); i++)
+	{
+		sLayer layer;
+		layer.offset = hdr.getLayerInfo()[i].offset;
+		layer.size = hdr.getLayerInfo()[i].size;
+		layer.block_size = hdr.getLayerInfo()[i].block_size;
+		layout.layers.push_back(layer);
+	}
+	layout.master_hash_list = hdr.getMasterHashList();
+	layout.pad_final_block = true;
+
+	return layout;
+}
+
+nstool::HashTreeStream::Cache::Cache(const sLayout& layout) :
+	mModuleLabel("nstool::HashTreeStream::Cache"),
+	mMutex(),
+	mLayout(layout),
+	mVerifiedBlocks(),
+	mHashLayerData(),
+	mStats()
+{
+	if (mLayout.layers.empty() || mLayout.master_hash_list.empty())
+	{
+		throw tc::ArgumentException(mModuleLabel, "Hash tree layout has no layers.");
+	}
+	for (size_t i = 0; i < mLayout.layers.size(); i++)
+	{
+		if (mLayout.layers[i].size < 0 || mLayout.layers[i].block_size <= 0)
+		{
+			throw tc::ArgumentOutOfRangeException(mModuleLabel, fmt::format("Hash layer {:d} has an invalid size or block size.", i));
+		}
+		mVerifiedBlocks.push_back(std::vector<bool>(tc::io::IOUtil::castInt64ToSize(getBlockNum(i)), false));
+	}
+	mHashLayerData.resize(mLayout.layers.size() - 1);
+
+	memset(&mStats, 0, sizeof(mStats));
+	mStats.data_block_num = getBlockNum(mLayout.layers.size() - 1);
+}
+
+const nstool::HashTreeStream::sLayout& nstool::HashTreeStream::Cache::getLayout() const
+{
+	return mLayout;
+}
+
+nstool::HashTreeStream::Cache::sStats nstool::HashTreeStream::Cache::getStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void nstool::HashTreeStream::Cache::invalidate()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto itr = mVerifiedBlocks.begin(); itr != mVerifiedBlocks.end(); itr++)
+	{
+		std::fill(itr->begin(), itr->end(), false);
+	}
+	for (auto itr = mHashLayerData.begin(); itr != mHashLayerData.end(); itr++)
+	{
+		*itr = tc::ByteData();
+	}
+	mStats.data_verified_block_num = 0;
+	mStats.invalidate_num += 1;
+}
+
+int64_t nstool::HashTreeStream::Cache::getBlockNum(size_t layer_index) const
+{
+	const sLayer& layer = mLayout.layers[layer_index];
+	return (layer.size + layer.block_size - 1) / layer.block_size;
+}
+
+nstool::HashTreeStream::HashTreeStream(const std::shared_ptr<tc::io::IStream>& stream, const std::shared_ptr<Cache>& cache) :
+	mModuleLabel("nstool::HashTreeStream"),
+	mBaseStream(stream),
+	mAesCtrStream(),
+	mCache(cache),
+	mPosition(0),
+	mBlockBuffer()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "stream is null.");
+	}
+	if (mCache == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "cache is null.");
+	}
+	if (mBaseStream->canRead() == false || mBaseStream->canSeek() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support reading and seeking.");
+	}
+
+	mBlockBuffer = tc::ByteData(tc::io::IOUtil::castInt64ToSize(mCache->getLayout().layers.back().block_size));
+
+	// fuse decryption and hashing, unless hashing 8 blocks at a time with AVX2 (which the fused path can't do) is faster
+	if (Sha256Generator::getPreferredBackend() != Sha256Generator::BACKEND_SOFTWARE || Sha256Generator::isMultiBufferSupported() == false)
+	{
+		mAesCtrStream = std::dynamic_pointer_cast<AesCtrEncryptedStream>(mBaseStream);
+	}
+}
+
+bool nstool::HashTreeStream::canRead() const
+{
+	return mBaseStream == nullptr ? false : true;
+}
+
+bool nstool::HashTreeStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::HashTreeStream::canSeek() const
+{
+	return mBaseStream == nullptr ? false : true;
+}
+
+int64_t nstool::HashTreeStream::length()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mCache->getLayout().layers.back().size;
+}
+
+int64_t nstool::HashTreeStream::position()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mPosition;
+}
+
+size_t nstool::HashTreeStream::read(byte_t* ptr, size_t count)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	size_t data_layer_index = mCache->getLayout().layers.size() - 1;
+	const sLayer& data_layer = mCache->getLayout().layers.back();
+	int64_t block_size = data_layer.block_size;
+
+	int64_t start = mPosition;
+	int64_t end = std::min<int64_t>(data_layer.size, mPosition + tc::io::IOUtil::castSizeToInt64(count));
+	int64_t pos = start;
+	while (pos < end)
+	{
+		int64_t block_index = pos / block_size;
+
+		// find the run of blocks (from this block) with the same verified state, as they are processed together
+		bool is_verified;
+		int64_t run_end_block = block_index + 1;
+		{
+			std::lock_guard<std::mutex> lock(mCache->mMutex);
+			const std::vector<bool>& verified_blocks = mCache->mVerifiedBlocks[data_layer_index];
+			is_verified = verified_blocks[size_t(block_index)];
+			while (run_end_block * block_size < end && verified_blocks[size_t(run_end_block)] == is_verified)
+			{
+				run_end_block++;
+			}
+		}
+		int64_t run_end = std::min<int64_t>(run_end_block * block_size, data_layer.size);
+
+		// verified blocks are read without hashing
+		if (is_verified)
+		{
+			int64_t len = std::min<int64_t>(run_end, end) - pos;
+			readBaseStream(data_layer.offset + pos, ptr + (pos - start), tc::io::IOUtil::castInt64ToSize(len));
+
+			std::lock_guard<std::mutex> lock(mCache->mMutex);
+			mCache->mStats.data_reused_block_num += run_end_block - block_index;
+
+			pos += len;
+			continue;
+		}
+
+		// whole blocks are read directly into the caller's buffer, a partially read block is read into the block buffer
+		int64_t block_num = 0;
+		if (pos == block_index * block_size)
+		{
+			block_num = end >= run_end ? run_end_block - block_index : (end - pos) / block_size;
+		}
+
+		byte_t* data;
+		int64_t data_size;
+		if (block_num > 0)
+		{
+			data = ptr + (pos - start);
+			data_size = std::min<int64_t>(block_num * block_size, data_layer.size - pos);
+		}
+		else
+		{
+			block_num = 1;
+			data = mBlockBuffer.data();
+			data_size = std::min<int64_t>(block_size, data_layer.size - block_index * block_size);
+		}
+		tc::ByteData hashes(tc::io::IOUtil::castInt64ToSize(block_num) * Sha256Generator::kHashSize);
+		if (mAesCtrStream != nullptr)
+			readDataBlocksFused(block_index, block_num, data, data_size, hashes.data());
+		else
+			readDataBlocks(block_index, block_num, data, data_size, hashes.data());
+
+		// compare against the hash layer (which takes the cache mutex only for lookups), then record the verified blocks
+		for (int64_t i = 0; i < block_num; i++)
+		{
+			byte_t expected_hash[Sha256Generator::kHashSize];
+			getExpectedHash(data_layer_index, block_index + i, expected_hash);
+			if (memcmp(hashes.data() + i * Sha256Generator::kHashSize, expected_hash, sizeof(expected_hash)) != 0)
+			{
+				throw tc::Exception(mModuleLabel, fmt::format("Data block at offset 0x{:x} failed hash verification.", (block_index + i) * block_size));
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(mCache->mMutex);
+			std::vector<bool>& verified_blocks = mCache->mVerifiedBlocks[data_layer_index];
+			for (int64_t i = 0; i < block_num; i++)
+			{
+				// another stream may have verified the same block meanwhile
+				if (verified_blocks[size_t(block_index + i)] == false)
+				{
+					verified_blocks[size_t(block_index + i)] = true;
+					mCache->mStats.data_verified_block_num += 1;
+				}
+			}
+			mCache->mStats.data_hashed_block_num += block_num;
+		}
+
+		// copy the requested part of a partially read block
+		if (data == mBlockBuffer.data())
+		{
+			int64_t len = std::min<int64_t>(end, block_index * block_size + data_size) - pos;
+			memcpy(ptr + (pos - start), data + (pos - block_index * block_size), tc::io::IOUtil::castInt64ToSize(len));
+			pos += len;
+		}
+		else
+		{
+			pos += data_size;
+		}
+	}
+
+	mPosition = pos;
+	return tc::io::IOUtil::castInt64ToSize(pos - start);
+}
+
+size_t nstool::HashTreeStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for HashTreeStream.");
+}
+
+int64_t nstool::HashTreeStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	int64_t new_position = 0;
+	switch (origin)
+	{
+		case (tc::io::SeekOrigin::Begin):
+			new_position = offset;
+			break;
+		case (tc::io::SeekOrigin::Current):
+			new_position = mPosition + offset;
+			break;
+		case (tc::io::SeekOrigin::End):
+			new_position = length() + offset;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Unknown seek origin.");
+	}
+
+	if (new_position < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Stream position cannot be negative.");
+	}
+
+	mPosition = new_position;
+
+	return mPosition;
+}
+
+void nstool::HashTreeStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for HashTreeStream.");
+}
+
+void nstool::HashTreeStream::flush()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+
+	mBaseStream->flush();
+}
+
+void nstool::HashTreeStream::dispose()
+{
+	if (mBaseStream.get() != nullptr)
+	{
+		mBaseStream->dispose();
+		mBaseStream.reset();
+	}
+	mAesCtrStream.reset();
+	mCache.reset();
+}
+
+void nstool::HashTreeStream::getExpectedHash(size_t layer_index, int64_t block_index, byte_t* hash)
+{
+	// the first layer is verified by the master hash(es)
+	if (layer_index == 0)
+	{
+		if (block_index >= tc::io::IOUtil::castSizeToInt64(mCache->mLayout.master_hash_list.size()))
+		{
+			throw tc::Exception(mModuleLabel, "Hash layer 0 has more blocks than there are master hashes.");
+		}
+		memcpy(hash, mCache->mLayout.master_hash_list[size_t(block_index)].data(), Sha256Generator::kHashSize);
+		return;
+	}
+
+	// otherwise the hash is in the parent layer, which must be verified first
+	size_t parent_index = layer_index - 1;
+	const sLayer& parent = mCache->mLayout.layers[parent_index];
+	int64_t hash_offset = block_index * tc::io::IOUtil::castSizeToInt64(Sha256Generator::kHashSize);
+	if (hash_offset + tc::io::IOUtil::castSizeToInt64(Sha256Generator::kHashSize) > parent.size)
+	{
+		throw tc::Exception(mModuleLabel, fmt::format("Hash layer {:d} has more blocks than its parent has hashes.", layer_index));
+	}
+
+	int64_t parent_block_index = hash_offset / parent.block_size;
+
+	// use the cached parent block if it is verified
+	{
+		std::lock_guard<std::mutex> lock(mCache->mMutex);
+		if (mCache->mVerifiedBlocks[parent_index][size_t(parent_block_index)])
+		{
+			mCache->mStats.hash_block_reused_num += 1;
+			memcpy(hash, mCache->mHashLayerData[parent_index].data() + hash_offset, Sha256Generator::kHashSize);
+			return;
+		}
+	}
+
+	tc::ByteData block_data;
+	verifyHashBlock(parent_index, parent_block_index, block_data);
+	memcpy(hash, block_data.data() + (hash_offset - parent_block_index * parent.block_size), Sha256Generator::kHashSize);
+}
+
+void nstool::HashTreeStream::verifyHashBlock(size_t layer_index, int64_t block_index, tc::ByteData& block_data)
+{
+	const sLayer& layer = mCache->mLayout.layers[layer_index];
+	int64_t block_offset = block_index * layer.block_size;
+	size_t block_data_size = tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(layer.block_size, layer.size - block_offset));
+
+	// read and hash the block without holding the cache mutex
+	block_data = tc::ByteData(block_data_size);
+	readBaseStream(layer.offset + block_offset, block_data.data(), block_data.size());
+
+	byte_t hash[Sha256Generator::kHashSize];
+	byte_t expected_hash[Sha256Generator::kHashSize];
+	hashBlock(layer, block_data.data(), block_data.size(), hash);
+	getExpectedHash(layer_index, block_index, expected_hash);
+	if (memcmp(hash, expected_hash, sizeof(hash)) != 0)
+	{
+		throw tc::Exception(mModuleLabel, fmt::format("Hash layer {:d} block at offset 0x{:x} failed hash verification.", layer_index, block_offset));
+	}
+
+	// add the verified block to the cache, unless another stream verified it meanwhile
+	std::lock_guard<std::mutex> lock(mCache->mMutex);
+	mCache->mStats.hash_block_read_num += 1;
+	if (mCache->mVerifiedBlocks[layer_index][size_t(block_index)])
+	{
+		return;
+	}
+
+	tc::ByteData& layer_data = mCache->mHashLayerData[layer_index];
+	if (layer_data.size() == 0)
+	{
+		layer_data = tc::ByteData(tc::io::IOUtil::castInt64ToSize(layer.size));
+	}
+	memcpy(layer_data.data() + block_offset, block_data.data(), block_data.size());
+	mCache->mVerifiedBlocks[layer_index][size_t(block_index)] = true;
+}
+
+void nstool::HashTreeStream::readBaseStream(int64_t offset, byte_t* data, size_t size)
+{
+	mBaseStream->seek(offset, tc::io::SeekOrigin::Begin);
+	for (size_t pos = 0; pos < size;)
+	{
+		size_t len = mBaseStream->read(data + pos, size - pos);
+		if (len == 0)
+		{
+			throw tc::io::IOException(mModuleLabel, fmt::format("Failed to read hash-tree data at offset 0x{:x}.", offset + tc::io::IOUtil::castSizeToInt64(pos)));
+		}
+		pos += len;
+	}
+}
+
+void nstool::HashTreeStream::readDataBlocks(int64_t block_index, int64_t block_num, byte_t* data, int64_t data_size, byte_t* hashes)
+{
+	const sLayer& data_layer = mCache->getLayout().layers.back();
+	int64_t block_size = data_layer.block_size;
+
+	readBaseStream(data_layer.offset + block_index * block_size, data, tc::io::IOUtil::castInt64ToSize(data_size));
+
+	// hash the blocks, the final block of the layer may be partial
+	std::vector<const byte_t*> full_blocks;
+	for (int64_t i = 0; i < block_num; i++)
+	{
+		int64_t block_data_size = std::min<int64_t>(block_size, data_size - i * block_size);
+		if (block_data_size == block_size)
+			full_blocks.push_back(data + i * block_size);
+		else
+			hashBlock(data_layer, data + i * block_size, tc::io::IOUtil::castInt64ToSize(block_data_size), hashes + i * Sha256Generator::kHashSize);
+	}
+	Sha256Generator::generateHashes(hashes, full_blocks, tc::io::IOUtil::castInt64ToSize(block_size));
+}
+
+void nstool::HashTreeStream::readDataBlocksFused(int64_t block_index, int64_t block_num, byte_t* data, int64_t data_size, byte_t* hashes)
+{
+	const sLayer& data_layer = mCache->getLayout().layers.back();
+	int64_t block_size = data_layer.block_size;
+	int64_t offset = data_layer.offset + block_index * block_size;
+	bool pad_final_block = mCache->getLayout().pad_final_block;
+
+	// read the encrypted data directly from the base of the decryption stream
+	const std::shared_ptr<tc::io::IStream>& raw_stream = mAesCtrStream->getBaseStream();
+	raw_stream->seek(offset, tc::io::SeekOrigin::Begin);
+	for (int64_t pos = 0; pos < data_size;)
+	{
+		size_t len = raw_stream->read(data + pos, tc::io::IOUtil::castInt64ToSize(data_size - pos));
+		if (len == 0)
+		{
+			throw tc::io::IOException(mModuleLabel, fmt::format("Failed to read hash-tree data at offset 0x{:x}.", offset + pos));
+		}
+		pos += tc::io::IOUtil::castSizeToInt64(len);
+	}
+
+	// decrypt each tile of a block in place then hash it, the final block of the layer may be partial
+	const AesCtrCipher* cipher = &mAesCtrStream->getCipher();
+	auto crypt_and_hash_blocks = [cipher, block_size, pad_final_block, offset, data, data_size, hashes](int64_t first_block, int64_t last_block) {
+		Sha256Generator hash_gen;
+		for (int64_t i = first_block; i < last_block; i++)
+		{
+			int64_t block_offset = i * block_size;
+			int64_t block_data_size = std::min<int64_t>(block_size, data_size - block_offset);
+
+			hash_gen.initialize();
+			for (int64_t tile_offset = block_offset; tile_offset < block_offset + block_data_size;)
+			{
+				size_t tile_size = tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(kFusedTileSize, block_offset + block_data_size - tile_offset));
+				cipher->crypt(data + tile_offset, data + tile_offset, tile_size, offset + tile_offset);
+				hash_gen.update(data + tile_offset, tile_size);
+				tile_offset += tc::io::IOUtil::castSizeToInt64(tile_size);
+			}
+			if (pad_final_block && block_data_size < block_size)
+			{
+				tc::ByteData padding(tc::io::IOUtil::castInt64ToSize(block_size - block_data_size));
+				hash_gen.update(padding.data(), padding.size());
+			}
+			hash_gen.getHash(hashes + i * Sha256Generator::kHashSize);
+		}
+	};
+
+	// large reads are split into groups of blocks which are decrypted and hashed in parallel
+	const std::shared_ptr<ThreadPool>& thread_pool = mAesCtrStream->getThreadPool();
+	if (thread_pool != nullptr && data_size >= tc::io::IOUtil::castSizeToInt64(kFusedParallelMinReadSize) && block_num > 1)
+	{
+		int64_t chunk_block_num = std::max<int64_t>(tc::io::IOUtil::castSizeToInt64(kFusedParallelChunkSize) / block_size, 1);
+		std::vector<std::function<void()>> tasks;
+		for (int64_t i = 0; i < block_num; i += chunk_block_num)
+		{
+			int64_t last_block = std::min<int64_t>(i + chunk_block_num, block_num);
+			tasks.push_back([crypt_and_hash_blocks, i, last_block]() { crypt_and_hash_blocks(i, last_block); });
+		}
+		thread_pool->execute(tasks);
+	}
+	else
+	{
+		crypt_and_hash_blocks(0, block_num);
+	}
+}
+
+void nstool::HashTreeStream::hashBlock(const sLayer& layer, const byte_t* data, size_t size, byte_t* hash) const
+{
+	Sha256Generator hash_gen;
+	hash_gen.initialize();
+	hash_gen.update(data, size);
+	if (mCache->mLayout.pad_final_block && tc::io::IOUtil::castSizeToInt64(size) < layer.block_size)
+	{
+		tc::ByteData padding(tc::io::IOUtil::castInt64ToSize(layer.block_size) - size);
+		hash_gen.update(padding.data(), padding.size());
+	}
+	hash_gen.getHash(hash);
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+#include "types.h"
+#include "AesCtrEncryptedStream.h"
+
+#include <mutex>
+#include <pietendo/hac/define/types.h>
+#include <pietendo/hac/HierarchicalIntegrityHeader.h>
+#include <pietendo/hac/HierarchicalSha256Header.h>
+
+namespace nstool {
+
+/**
+ * @class HashTreeStream
+ * @brief Read-only stream of the data layer of a hash-tree (HierarchicalSha256 or HierarchicalIntegrity), verifying data as it is read.
+ *
+ * Verification state is kept in a Cache, which can be shared by streams over the same partition (e.g. concurrent extraction):
+ * - a bitmap of verified blocks for each layer, so re-reading a verified block doesn't hash it again
+ * - the hash layers (which are small compared to the data layer), so verified hashes don't need to be read again
+ *
+ * If the base stream is an AesCtrEncryptedStream, unverified data blocks are read encrypted and each tile is hashed right after it is decrypted,
+ * while it is still in cache (instead of decrypting the whole read, then reading it all again to hash it). Other base streams are read then hashed.
+ */
+class HashTreeStream : public tc::io::IStream
+{
+public:
+	struct sLayer
+	{
+		int64_t offset;
+		int64_t size;
+		int64_t block_size;
+	};
+
+	struct sLayout
+	{
+		std::vector<sLayer> layers; // the last layer is the data layer
+		std::vector<pie::hac::detail::sha256_hash_t> master_hash_list; // hashes of the blocks of the first layer
+		bool pad_final_block; // partial final blocks are hashed padded with zeros to the block size
+	};
+
+	static sLayout generateLayout(const pie::hac::HierarchicalSha256Header& hdr);
+	static sLayout generateLayout(const pie::hac::HierarchicalIntegrityHeader& hdr);
+
+	class Cache
+	{
+	public:
+		struct sStats
+		{
+			int64_t data_block_num; // blocks in data layer
+			int64_t data_verified_block_num; // data blocks currently verified
+			int64_t data_hashed_block_num; // data blocks read and hashed
+			int64_t data_reused_block_num; // data blocks re-read without hashing, since they were already verified
+			int64_t hash_block_read_num; // hash layer blocks read and verified
+			int64_t hash_block_reused_num; // hash layer block lookups served from the cache
+			int64_t invalidate_num;
+		};
+
+		Cache(const sLayout& layout);
+
+		const sLayout& getLayout() const;
+		sStats getStats();
+
+		// forget all verified blocks (e.g. the underlying data or keys changed)
+		void invalidate();
+	private:
+		friend class HashTreeStream;
+
+		std::string mModuleLabel;
+		std::mutex mMutex;
+
+		sLayout mLayout;
+		std::vector<std::vector<bool>> mVerifiedBlocks;
+		std::vector<tc::ByteData> mHashLayerData;
+		sStats mStats;
+
+		int64_t getBlockNum(size_t layer_index) const;
+	};
+
+	HashTreeStream(const std::shared_ptr<tc::io::IStream>& stream, const std::shared_ptr<Cache>& cache);
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	std::string mModuleLabel;
+
+	static const size_t kFusedTileSize = 0x8000; // size decrypted then hashed at a time (fits in L1/L2 cache)
+	static const size_t kFusedParallelChunkSize = 0x40000; // size of blocks decrypted and hashed by each worker thread
+	static const size_t kFusedParallelMinReadSize = 0x80000; // smaller reads are decrypted and hashed inline
+
+	std::shared_ptr<tc::io::IStream> mBaseStream;
+	std::shared_ptr<AesCtrEncryptedStream> mAesCtrStream; // set when decryption and hashing are fused
+	std::shared_ptr<Cache> mCache;
+	int64_t mPosition;
+	tc::ByteData mBlockBuffer;
+
+	// these lock the cache mutex only to look up or add verified hash blocks, reading and hashing is done without it
+	void getExpectedHash(size_t layer_index, int64_t block_index, byte_t* hash);
+	void verifyHashBlock(size_t layer_index, int64_t block_index, tc::ByteData& block_data);
+
+	void readBaseStream(int64_t offset, byte_t* data, size_t size);
+	void readDataBlocks(int64_t block_index, int64_t block_num, byte_t* data, int64_t data_size, byte_t* hashes);
+	void readDataBlocksFused(int64_t block_index, int64_t block_num, byte_t* data, int64_t data_size, byte_t* hashes);
+	void hashBlock(const sLayer& layer, const byte_t* data, size_t size, byte_t* hash) const;
+};
+
+}
\ No newline at end of file
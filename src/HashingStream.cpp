@@ -0,0 +1,149 @@
+#include "HashingStream.h"
+
+#include <tc/ObjectDisposedException.h>
+
+nstool::HashingStream::HashingStream(const std::shared_ptr<tc::io::IStream>& stream) :
+	mModuleLabel("nstool::HashingStream"),
+	mBaseStream(stream),
+	mPosition(0),
+	mHashGen(),
+	mHashedSize(0)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "stream is null.");
+	}
+	if (mBaseStream->canRead() == false || mBaseStream->canSeek() == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel, "stream requires read/seek permissions.");
+	}
+
+	mHashGen.initialize();
+}
+
+void nstool::HashingStream::getHash(byte_t* hash)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::getHash()", "Failed to get hash (stream is disposed)");
+	}
+
+	// hash the data that wasn't read through this stream
+	int64_t length = mBaseStream->length();
+	if (mHashedSize < length)
+	{
+		tc::ByteData cache = tc::ByteData(kReadSize);
+		mBaseStream->seek(mHashedSize, tc::io::SeekOrigin::Begin);
+		while (mHashedSize < length)
+		{
+			size_t read_len = mBaseStream->read(cache.data(), tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(length - mHashedSize, tc::io::IOUtil::castSizeToInt64(cache.size()))));
+			if (read_len == 0)
+			{
+				throw tc::io::IOException(mModuleLabel+"::getHash()", "Failed to read from base stream.");
+			}
+			hashData(mHashedSize, cache.data(), read_len);
+		}
+		mBaseStream->seek(mPosition, tc::io::SeekOrigin::Begin);
+	}
+
+	mHashGen.getHash(hash);
+}
+
+bool nstool::HashingStream::canRead() const
+{
+	return mBaseStream != nullptr;
+}
+
+bool nstool::HashingStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::HashingStream::canSeek() const
+{
+	return mBaseStream != nullptr;
+}
+
+int64_t nstool::HashingStream::length()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mBaseStream->length();
+}
+
+int64_t nstool::HashingStream::position()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mPosition;
+}
+
+size_t nstool::HashingStream::read(byte_t* ptr, size_t count)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	size_t read_len = mBaseStream->read(ptr, count);
+	hashData(mPosition, ptr, read_len);
+	mPosition += tc::io::IOUtil::castSizeToInt64(read_len);
+
+	return read_len;
+}
+
+size_t nstool::HashingStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for HashingStream");
+}
+
+int64_t nstool::HashingStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	mPosition = mBaseStream->seek(offset, origin);
+
+	return mPosition;
+}
+
+void nstool::HashingStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for HashingStream");
+}
+
+void nstool::HashingStream::flush()
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+}
+
+void nstool::HashingStream::dispose()
+{
+	if (mBaseStream.get() != nullptr)
+	{
+		mBaseStream->dispose();
+		mBaseStream.reset();
+	}
+}
+
+void nstool::HashingStream::hashData(int64_t offset, const byte_t* data, size_t size)
+{
+	// only the part of the data that continues on from the hashed data can be hashed
+	int64_t end = offset + tc::io::IOUtil::castSizeToInt64(size);
+	if (offset <= mHashedSize && end > mHashedSize)
+	{
+		mHashGen.update(data + (mHashedSize - offset), tc::io::IOUtil::castInt64ToSize(end - mHashedSize));
+		mHashedSize = end;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+#include "types.h"
+#include "Sha256Generator.h"
+
+namespace nstool {
+
+/**
+ * @class HashingStream
+ * @brief Read-only stream wrapper that computes the SHA-256 hash of the base stream from the data read through it.
+ *
+ * Data is hashed as it is read, as long as it continues on from what was already hashed (reads elsewhere are passed through without being hashed),
+ * so copying the stream from start to end hashes it without reading it again. getHash() reads any data that wasn't hashed.
+ */
+class HashingStream : public tc::io::IStream
+{
+public:
+	HashingStream(const std::shared_ptr<tc::io::IStream>& stream);
+
+	// get the hash of the whole base stream, reading (and hashing) the rest of the base stream if required
+	void getHash(byte_t* hash);
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	static const size_t kReadSize = 0x100000; // size of reads made by getHash()
+
+	std::string mModuleLabel;
+
+	std::shared_ptr<tc::io::IStream> mBaseStream;
+	int64_t mPosition;
+
+	Sha256Generator mHashGen;
+	int64_t mHashedSize; // size of the data hashed so far, from the start of the base stream
+
+	void hashData(int64_t offset, const byte_t* data, size_t size);
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "IndirectStream.h"
+
+#include <tc/ObjectDisposedException.h>
+#include <tc/ArgumentOutOfRangeException.h>
+
+#include <algorithm>
+#include <cstring>
+
+nstool::IndirectStream::IndirectStream(const std::shared_ptr<tc::io::IStream>& base_stream, const std::shared_ptr<tc::io::IStream>& patch_stream, const std::shared_ptr<BucketTree>& table) :
+	mModuleLabel("nstool::IndirectStream"),
+	mBaseStream(base_stream),
+	mPatchStream(patch_stream),
+	mTable(table),
+	mPosition(0),
+	mEntryHint(0)
+{
+	if (mBaseStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "base_stream is null.");
+	}
+	if (mPatchStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "patch_stream is null.");
+	}
+	if (mTable == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "table is null.");
+	}
+	if (mBaseStream->canRead() == false || mPatchStream->canRead() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support reading.");
+	}
+	if (mBaseStream->canSeek() == false || mPatchStream->canSeek() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support seeking.");
+	}
+	if (mTable->getEntrySize() != sizeof(sEntry))
+	{
+		throw tc::ArgumentException(mModuleLabel, "table does not contain IndirectStorage entries.");
+	}
+	if (mTable->getEntryNum() == 0 || mTable->getBeginOffset() != 0)
+	{
+		throw tc::ArgumentException(mModuleLabel, "table does not cover the start of the partition.");
+	}
+}
+
+bool nstool::IndirectStream::canRead() const
+{
+	return mTable != nullptr;
+}
+
+bool nstool::IndirectStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::IndirectStream::canSeek() const
+{
+	return mTable != nullptr;
+}
+
+int64_t nstool::IndirectStream::length()
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mTable->getEndOffset();
+}
+
+int64_t nstool::IndirectStream::position()
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mPosition;
+}
+
+size_t nstool::IndirectStream::read(byte_t* ptr, size_t count)
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	// clamp read to the end of the stream
+	if (mPosition >= mTable->getEndOffset())
+	{
+		return 0;
+	}
+	count = size_t(std::min<int64_t>(int64_t(count), mTable->getEndOffset() - mPosition));
+
+	// read each entry's range from the storage it is mapped to
+	size_t data_read = 0;
+	while (data_read < count)
+	{
+		mEntryHint = mTable->find(mPosition, mEntryHint);
+
+		sEntry entry;
+		memcpy(&entry, mTable->getEntry(mEntryHint), sizeof(sEntry));
+
+		std::shared_ptr<tc::io::IStream> storage;
+		if (entry.storage_index.unwrap() == StorageIndex_Base)
+		{
+			storage = mBaseStream;
+		}
+		else if (entry.storage_index.unwrap() == StorageIndex_Patch)
+		{
+			storage = mPatchStream;
+		}
+		else
+		{
+			throw tc::io::IOException(mModuleLabel+"::read()", fmt::format("IndirectStorage entry had invalid storage index ({:d}).", entry.storage_index.unwrap()));
+		}
+
+		size_t data_size = size_t(std::min<int64_t>(int64_t(count - data_read), mTable->getEntryEndOffset(mEntryHint) - mPosition));
+		storage->seek(entry.physical_offset.unwrap() + (mPosition - mTable->getEntryBeginOffset(mEntryHint)), tc::io::SeekOrigin::Begin);
+		size_t storage_read = storage->read(ptr + data_read, data_size);
+		if (storage_read != data_size)
+		{
+			throw tc::io::IOException(mModuleLabel+"::read()", "Failed to read IndirectStorage data (storage was too small).");
+		}
+
+		data_read += storage_read;
+		mPosition += int64_t(storage_read);
+	}
+
+	return data_read;
+}
+
+size_t nstool::IndirectStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for IndirectStream.");
+}
+
+int64_t nstool::IndirectStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	int64_t new_position = 0;
+	switch (origin)
+	{
+		case (tc::io::SeekOrigin::Begin):
+			new_position = offset;
+			break;
+		case (tc::io::SeekOrigin::Current):
+			new_position = mPosition + offset;
+			break;
+		case (tc::io::SeekOrigin::End):
+			new_position = mTable->getEndOffset() + offset;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Unknown seek origin.");
+	}
+
+	if (new_position < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Stream position cannot be negative.");
+	}
+
+	mPosition = new_position;
+	return mPosition;
+}
+
+void nstool::IndirectStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for IndirectStream.");
+}
+
+void nstool::IndirectStream::flush()
+{
+	if (mTable == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+}
+
+void nstool::IndirectStream::dispose()
+{
+	if (mBaseStream.get() != nullptr)
+	{
+		mBaseStream->dispose();
+		mBaseStream.reset();
+	}
+	if (mPatchStream.get() != nullptr)
+	{
+		mPatchStream->dispose();
+		mPatchStream.reset();
+	}
+	mTable.reset();
+}
\ No newline at end of file
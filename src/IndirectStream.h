@@ -0,0 +1,58 @@
+#pragma once
+#include "types.h"
+#include "BucketTree.h"
+
+namespace nstool {
+
+/**
+ * @class IndirectStream
+ * @brief Read-only stream that assembles a patched partition (IndirectStorage) from the partition of the base NCA and the data of the patch partition.
+ *
+ * Each entry of the IndirectStorage table maps a range of the patched partition to an offset in either the base partition (storage index 0) or the patch data (storage index 1).
+ * Consecutive reads continue from the previous table entry, so sequential reads don't search the table.
+ */
+class IndirectStream : public tc::io::IStream
+{
+public:
+#pragma pack(push,1)
+	struct sEntry
+	{
+		tc::bn::le64<int64_t> virtual_offset;
+		tc::bn::le64<int64_t> physical_offset;
+		tc::bn::le32<int32_t> storage_index;
+	};
+	static_assert(sizeof(sEntry) == 0x14, "sEntry size.");
+#pragma pack(pop)
+
+	enum StorageIndex
+	{
+		StorageIndex_Base = 0,
+		StorageIndex_Patch = 1
+	};
+
+	IndirectStream(const std::shared_ptr<tc::io::IStream>& base_stream, const std::shared_ptr<tc::io::IStream>& patch_stream, const std::shared_ptr<BucketTree>& table);
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	std::string mModuleLabel;
+
+	std::shared_ptr<tc::io::IStream> mBaseStream;
+	std::shared_ptr<tc::io::IStream> mPatchStream;
+	std::shared_ptr<BucketTree> mTable;
+	int64_t mPosition;
+
+	// last entry used, to continue from on the next read
+	size_t mEntryHint;
+};
+
+}
\ No newline at end of file
@@ -12,6 +12,49 @@
 #include <pietendo/hac/es/CertificateBody.h>
 #include <pietendo/hac/es/TicketBody_V2.h>
 
+nstool::KeyBag::Aes128KeyTable::Aes128KeyTable() :
+	mIsSet(),
+	mKeySchedule()
+{
+}
+
+bool nstool::KeyBag::Aes128KeyTable::isSet(key_generation_t key_generation) const
+{
+	return key_generation < mIsSet.size() && mIsSet[key_generation];
+}
+
+const nstool::KeyBag::aes128_key_t& nstool::KeyBag::Aes128KeyTable::get(key_generation_t key_generation) const
+{
+	return getSchedule(key_generation).getKey();
+}
+
+const nstool::AesKeySchedule& nstool::KeyBag::Aes128KeyTable::getSchedule(key_generation_t key_generation) const
+{
+	if (isSet(key_generation) == false)
+	{
+		throw tc::ArgumentOutOfRangeException("nstool::KeyBag::Aes128KeyTable", fmt::format("No key for key generation 0x{:02x}.", key_generation));
+	}
+
+	return mKeySchedule[key_generation];
+}
+
+void nstool::KeyBag::Aes128KeyTable::set(key_generation_t key_generation, const aes128_key_t& key)
+{
+	if (key_generation >= mIsSet.size())
+	{
+		mIsSet.resize(size_t(key_generation) + 1, false);
+		mKeySchedule.resize(size_t(key_generation) + 1);
+	}
+
+	mIsSet[key_generation] = true;
+	mKeySchedule[key_generation].initialize(key.data());
+}
+
+size_t nstool::KeyBag::Aes128KeyTable::size() const
+{
+	return mIsSet.size();
+}
+
 nstool::KeyBagInitializer::KeyBagInitializer(bool isDev, const tc::Optional<tc::io::Path>& keyfile_path, const tc::Optional<tc::io::Path>& titlekeyfile_path, const std::vector<tc::io::Path>& tik_path_list, const tc::Optional<tc::io::Path>& cert_path)
 {
 	if (keyfile_path.isSet())
@@ -73,6 +116,22 @@ void nstool::KeyBagInitializer::importBaseKeyFile(const tc::io::Path& keyfile_pa
 	} \
 	}
 
+#define _SAVE_AES128KEY_TABLE(key_name, table, key_generation) \
+	{ \
+	std::string key,val; \
+	tc::ByteData dec_val; \
+	aes128_key_t tmp_aes128_key; \
+	key = (key_name); \
+	val = keyfile_dict[key]; \
+	if (val.empty() == false) { \
+		dec_val = tc::cli::FormatUtil::hexStringToBytes(val); \
+		if (dec_val.size() != tmp_aes128_key.size()) \
+			throw tc::ArgumentException("nstool::KeyBagInitializer", "Key: \"" + key_name + "\" has incorrect length"); \
+		memcpy(tmp_aes128_key.data(), dec_val.data(), tmp_aes128_key.size()); \
+		(table).set((key_generation), tmp_aes128_key); \
+	} \
+	}
+
 #define _SAVE_AES128XTSKEY(key_name, dst) \
 	{ \
 	std::string key,val; \
@@ -262,7 +321,7 @@ void nstool::KeyBagInitializer::importBaseKeyFile(const tc::io::Path& keyfile_pa
 			for (size_t keygen_rev = 0; keygen_rev < kKeyGenerationNum; keygen_rev++)
 			{
 				//fmt::print("{:s}_{:02x}\n", kTicketCommonKeyBase[name_idx], keygen_rev);
-				_SAVE_AES128KEY(fmt::format("{:s}_{:02x}", kTicketCommonKeyBase[name_idx], keygen_rev), etik_common_key[(byte_t)keygen_rev]);
+				_SAVE_AES128KEY_TABLE(fmt::format("{:s}_{:02x}", kTicketCommonKeyBase[name_idx], keygen_rev), etik_common_key, (byte_t)keygen_rev);
 			}
 		}
 
@@ -297,7 +356,7 @@ void nstool::KeyBagInitializer::importBaseKeyFile(const tc::io::Path& keyfile_pa
 				for (size_t keak_idx = 0; keak_idx < kNcaKeyAreaKeyIndexStr.size(); keak_idx++)
 				{
 					//fmt::print("{:s}_{:s}_{:02x}\n", kNcaKeyAreaEncKeyBase[name_idx], kNcaKeyAreaKeyIndexStr[keak_idx], keygen_rev);
-					_SAVE_AES128KEY(fmt::format("{:s}_{:s}_{:02x}", kNcaKeyAreaEncKeyBase[name_idx], kNcaKeyAreaKeyIndexStr[keak_idx], keygen_rev), nca_key_area_encryption_key[keak_idx][(byte_t)keygen_rev]);
+					_SAVE_AES128KEY_TABLE(fmt::format("{:s}_{:s}_{:02x}", kNcaKeyAreaEncKeyBase[name_idx], kNcaKeyAreaKeyIndexStr[keak_idx], keygen_rev), nca_key_area_encryption_key[keak_idx], (byte_t)keygen_rev);
 				}
 			}
 		}
@@ -309,7 +368,7 @@ void nstool::KeyBagInitializer::importBaseKeyFile(const tc::io::Path& keyfile_pa
 				for (size_t keak_idx = 0; keak_idx < kNcaKeyAreaKeyIndexStr.size(); keak_idx++)
 				{
 					//fmt::print("{:s}_{:s}_{:02x}\n", kNcaKeyAreaEncKeyHwBase[name_idx], kNcaKeyAreaKeyIndexStr[keak_idx], keygen_rev);
-					_SAVE_AES128KEY(fmt::format("{:s}_{:s}_{:02x}", kNcaKeyAreaEncKeyHwBase[name_idx], kNcaKeyAreaKeyIndexStr[keak_idx], keygen_rev), nca_key_area_encryption_key_hw[keak_idx][(byte_t)keygen_rev]);
+					_SAVE_AES128KEY_TABLE(fmt::format("{:s}_{:s}_{:02x}", kNcaKeyAreaEncKeyHwBase[name_idx], kNcaKeyAreaKeyIndexStr[keak_idx], keygen_rev), nca_key_area_encryption_key_hw[keak_idx], (byte_t)keygen_rev);
 				}
 			}
 		}
@@ -397,6 +456,7 @@ void nstool::KeyBagInitializer::importBaseKeyFile(const tc::io::Path& keyfile_pa
 
 #undef _SAVE_RSAKEY
 #undef _SAVE_AES128XTSKEY
+#undef _SAVE_AES128KEY_TABLE
 #undef _SAVE_AES128KEY
 
 	// Derive Keys
@@ -421,19 +481,19 @@ void nstool::KeyBagInitializer::importBaseKeyFile(const tc::io::Path& keyfile_pa
 
 			for (size_t keak_idx = 0; keak_idx < pie::hac::nca::kKeyAreaEncryptionKeyNum; keak_idx++)
 			{
-				if (key_area_key_source[keak_idx].isSet() && nca_key_area_encryption_key[keak_idx].find(itr->first) != nca_key_area_encryption_key[keak_idx].end())
+				if (key_area_key_source[keak_idx].isSet() && nca_key_area_encryption_key[keak_idx].isSet(itr->first))
 				{
 					aes128_key_t nca_key_area_encryption_key_tmp;
 					pie::hac::AesKeygen::generateKey(nca_key_area_encryption_key_tmp.data(), aes_kek_generation_source.get().data(), key_area_key_source[keak_idx].get().data(), aes_key_generation_source.get().data(), itr->second.data());
-					nca_key_area_encryption_key[keak_idx][itr->first] = nca_key_area_encryption_key_tmp;
+					nca_key_area_encryption_key[keak_idx].set(itr->first, nca_key_area_encryption_key_tmp);
 				}
 			}
 		}
-		if (ticket_titlekek_source.isSet() && etik_common_key.find(itr->first) == etik_common_key.end())
+		if (ticket_titlekek_source.isSet() && etik_common_key.isSet(itr->first) == false)
 		{
 			aes128_key_t etik_common_key_tmp;
 			pie::hac::AesKeygen::generateKey(etik_common_key_tmp.data(), ticket_titlekek_source.get().data(), itr->second.data());
-			etik_common_key[itr->first] = etik_common_key_tmp;
+			etik_common_key.set(itr->first, etik_common_key_tmp);
 		}
 		if (package2_key_source.isSet() && pkg2_key.find(itr->first) == pkg2_key.end())
 		{
@@ -607,7 +667,7 @@ void nstool::KeyBagInitializer::importTicket(const tc::io::Path& tik_path)
 		// convert key_generation
 		common_key_index = pie::hac::AesKeygen::getMasterKeyRevisionFromKeyGeneration(common_key_index);
 
-		if (etik_common_key.find(common_key_index) == etik_common_key.end())
+		if (etik_common_key.isSet(common_key_index) == false)
 		{
 			fmt::print("[WARNING] Ticket \"{:s}\" will not be imported. Could not decrypt title key.\n", tc::cli::FormatUtil::formatBytesAsString(rights_id.data(), rights_id.size(), true, ""));
 			return;
@@ -615,7 +675,7 @@ void nstool::KeyBagInitializer::importTicket(const tc::io::Path& tik_path)
 
 		// decrypt title key
 		aes128_key_t dec_title_key;
-		tc::crypto::DecryptAes128Ecb(dec_title_key.data(), enc_title_key.data(), sizeof(aes128_key_t), etik_common_key[common_key_index].data(), sizeof(aes128_key_t));
+		etik_common_key.getSchedule(common_key_index).decrypt(dec_title_key.data(), enc_title_key.data(), sizeof(aes128_key_t));
 
 		// add to decrypted key dict
 		external_content_keys[rights_id] = dec_title_key;
@@ -8,6 +8,7 @@
 #include <pietendo/hac/es/SignUtils.h>
 #include <pietendo/hac/define/types.h>
 #include <pietendo/hac/define/nca.h>
+#include "AesKeySchedule.h"
 
 namespace nstool {
 
@@ -22,6 +23,24 @@ struct KeyBag
 	using broadon_issuer_t = std::string;
 	static const size_t kNcaKeakNum = pie::hac::nca::kKeyAreaEncryptionKeyNum;
 
+	// dense table of AES-128 keys indexed by key generation, each key's schedule is expanded once when it is set
+	class Aes128KeyTable
+	{
+	public:
+		Aes128KeyTable();
+
+		bool isSet(key_generation_t key_generation) const;
+		const aes128_key_t& get(key_generation_t key_generation) const;
+		const AesKeySchedule& getSchedule(key_generation_t key_generation) const;
+		void set(key_generation_t key_generation, const aes128_key_t& key);
+
+		// number of key generation slots (one more than the highest key generation set)
+		size_t size() const;
+	private:
+		std::vector<bool> mIsSet;
+		std::vector<AesKeySchedule> mKeySchedule;
+	};
+
 
 	// acid
 	std::map<key_generation_t, rsa_key_t> acid_sign_key;
@@ -34,8 +53,8 @@ struct KeyBag
 	// nca
 	tc::Optional<aes128_xtskey_t> nca_header_key;
 	std::map<key_generation_t, rsa_key_t> nca_header_sign0_key;
-	std::array<std::map<key_generation_t, aes128_key_t>, kNcaKeakNum> nca_key_area_encryption_key;
-	std::array<std::map<key_generation_t, aes128_key_t>, kNcaKeakNum> nca_key_area_encryption_key_hw;
+	std::array<Aes128KeyTable, kNcaKeakNum> nca_key_area_encryption_key;
+	std::array<Aes128KeyTable, kNcaKeakNum> nca_key_area_encryption_key_hw;
 
 	// external content keys (nca<->ticket)
 	std::map<rights_id_t, aes128_key_t> external_content_keys;
@@ -53,7 +72,7 @@ struct KeyBag
 	tc::Optional<rsa_key_t> xci_cert_sign_key;
 
 	// ticket
-	std::map<key_generation_t, aes128_key_t> etik_common_key;
+	Aes128KeyTable etik_common_key;
 
 	// BroadOn signer profiles (for es cert and es tik)
 	// BroadOn Keys
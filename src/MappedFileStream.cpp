@@ -0,0 +1,243 @@
+#include "MappedFileStream.h"
+
+#include <tc/ObjectDisposedException.h>
+#include <tc/io/FileNotFoundException.h>
+
+#include <cstring>
+#include <algorithm>
+
+#ifndef _WIN32
+#define NSTOOL_MAPPEDFILESTREAM_MMAP 1
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+nstool::MappedFileStream::MappedFileStream(const tc::io::Path& path) :
+	mModuleLabel("nstool::MappedFileStream"),
+	mIsOpen(false),
+	mData(nullptr),
+	mLength(0),
+	mPosition(0),
+	mLastReadEnd(-1),
+	mReadaheadEnd(0),
+	mIsSequential(false)
+{
+#ifdef NSTOOL_MAPPEDFILESTREAM_MMAP
+	int fd = open(path.to_string().c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		if (errno == ENOENT)
+			throw tc::io::FileNotFoundException(mModuleLabel, fmt::format("Failed to open file ({:s}).", path.to_string()));
+		throw tc::io::IOException(mModuleLabel, fmt::format("Failed to open file ({:s}): {:s}", path.to_string(), strerror(errno)));
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0)
+	{
+		close(fd);
+		throw tc::io::IOException(mModuleLabel, "Failed to get file status.");
+	}
+	mLength = int64_t(file_stat.st_size);
+
+	// an empty file can't be mapped, but there is nothing to read anyway
+	if (mLength > 0)
+	{
+		if (uint64_t(mLength) > uint64_t(SIZE_MAX))
+		{
+			close(fd);
+			throw tc::NotSupportedException(mModuleLabel, "File is too large to be mapped.");
+		}
+
+		void* map = mmap(nullptr, size_t(mLength), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+		{
+			int err = errno;
+			close(fd);
+			throw tc::io::IOException(mModuleLabel, fmt::format("Failed to map file ({:s}): {:s}", path.to_string(), strerror(err)));
+		}
+		mData = (byte_t*)map;
+
+		// nothing is known about the access pattern yet, so start with random access (no readahead)
+		madvise(mData, size_t(mLength), MADV_RANDOM);
+	}
+
+	// the mapping stays valid after the file is closed
+	close(fd);
+	mIsOpen = true;
+#else
+	throw tc::NotSupportedException(mModuleLabel, "File mapping is not supported on this platform.");
+#endif
+}
+
+nstool::MappedFileStream::~MappedFileStream()
+{
+	dispose();
+}
+
+bool nstool::MappedFileStream::isSupported()
+{
+#ifdef NSTOOL_MAPPEDFILESTREAM_MMAP
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool nstool::MappedFileStream::canRead() const
+{
+	return mIsOpen;
+}
+
+bool nstool::MappedFileStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::MappedFileStream::canSeek() const
+{
+	return mIsOpen;
+}
+
+int64_t nstool::MappedFileStream::length()
+{
+	if (mIsOpen == false)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mLength;
+}
+
+int64_t nstool::MappedFileStream::position()
+{
+	if (mIsOpen == false)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mPosition;
+}
+
+size_t nstool::MappedFileStream::read(byte_t* ptr, size_t count)
+{
+	if (mIsOpen == false)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	// clamp count to what is left in the stream
+	if (mPosition >= mLength)
+	{
+		return 0;
+	}
+	if (tc::io::IOUtil::castSizeToInt64(count) > mLength - mPosition)
+	{
+		count = tc::io::IOUtil::castInt64ToSize(mLength - mPosition);
+	}
+
+	adviseReadPattern(mPosition, count);
+
+	memcpy(ptr, mData + mPosition, count);
+	mPosition += tc::io::IOUtil::castSizeToInt64(count);
+
+	return count;
+}
+
+size_t nstool::MappedFileStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for MappedFileStream");
+}
+
+int64_t nstool::MappedFileStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mIsOpen == false)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	int64_t new_position = 0;
+	switch (origin)
+	{
+		case (tc::io::SeekOrigin::Begin):
+			new_position = offset;
+			break;
+		case (tc::io::SeekOrigin::Current):
+			new_position = mPosition + offset;
+			break;
+		case (tc::io::SeekOrigin::End):
+			new_position = mLength + offset;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Unknown seek origin.");
+	}
+
+	if (new_position < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Stream position cannot be negative.");
+	}
+
+	mPosition = new_position;
+
+	return mPosition;
+}
+
+void nstool::MappedFileStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for MappedFileStream");
+}
+
+void nstool::MappedFileStream::flush()
+{
+	if (mIsOpen == false)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+}
+
+void nstool::MappedFileStream::dispose()
+{
+#ifdef NSTOOL_MAPPEDFILESTREAM_MMAP
+	if (mData != nullptr)
+	{
+		munmap(mData, size_t(mLength));
+	}
+#endif
+	mIsOpen = false;
+	mData = nullptr;
+	mLength = 0;
+	mPosition = 0;
+}
+
+void nstool::MappedFileStream::adviseReadPattern(int64_t offset, size_t count)
+{
+#ifdef NSTOOL_MAPPEDFILESTREAM_MMAP
+	// a read that continues from the previous read is sequential, so ask the kernel to read ahead of it
+	bool is_sequential = offset == mLastReadEnd;
+	int64_t read_end = offset + tc::io::IOUtil::castSizeToInt64(count);
+	mLastReadEnd = read_end;
+
+	if (is_sequential != mIsSequential)
+	{
+		mIsSequential = is_sequential;
+		mReadaheadEnd = offset;
+	}
+
+	if (mIsSequential && read_end + kSequentialReadaheadSize / 2 > mReadaheadEnd)
+	{
+		// madvise() requires a page aligned address
+		static const int64_t page_size = int64_t(sysconf(_SC_PAGESIZE));
+
+		int64_t advise_begin = std::max<int64_t>(offset, mReadaheadEnd);
+		advise_begin -= advise_begin % page_size;
+		int64_t advise_end = std::min<int64_t>(mLength, read_end + kSequentialReadaheadSize);
+		if (advise_end > advise_begin)
+		{
+			madvise(mData + advise_begin, size_t(advise_end - advise_begin), MADV_WILLNEED);
+		}
+		mReadaheadEnd = advise_end;
+	}
+#endif
+}
\ No newline at end of file
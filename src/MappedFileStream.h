@@ -0,0 +1,52 @@
+#pragma once
+#include "types.h"
+
+namespace nstool {
+
+/**
+ * @class MappedFileStream
+ * @brief Read-only file stream backed by a memory mapping of the whole file.
+ *
+ * Reads are copied from the mapping, so they don't require a syscall (other than page faults). The kernel is advised
+ * to read ahead once reads are sequential, and not to read ahead while reads are random (e.g. header/table parsing).
+ * Only available on POSIX platforms, see isSupported().
+ */
+class MappedFileStream : public tc::io::IStream
+{
+public:
+	MappedFileStream(const tc::io::Path& path);
+	~MappedFileStream();
+
+	// returns true if file mapping is implemented for this platform
+	static bool isSupported();
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	static const int64_t kSequentialReadaheadSize = 0x400000; // amount of data requested ahead of sequential reads
+
+	std::string mModuleLabel;
+
+	bool mIsOpen;
+	byte_t* mData;
+	int64_t mLength;
+	int64_t mPosition;
+
+	// access pattern tracking
+	int64_t mLastReadEnd;
+	int64_t mReadaheadEnd;
+	bool mIsSequential;
+
+	void adviseReadPattern(int64_t offset, size_t count);
+};
+
+}
\ No newline at end of file
@@ -1,21 +1,43 @@
 #include "NcaProcess.h"
 #include "MetaProcess.h"
 #include "util.h"
+#include "SharedStream.h"
+#include "PfsProcess.h"
+#include "RomfsProcess.h"
+#include "AesCtrEncryptedStream.h"
+#include "AesXtsEncryptedStream.h"
+#include "AesCtrExEncryptedStream.h"
+#include "IndirectStream.h"
+#include "SparseStream.h"
+#include "Sha256Generator.h"
+#include "HashTreeScanner.h"
 
 #include <pietendo/hac/ContentArchiveUtil.h>
 #include <pietendo/hac/AesKeygen.h>
-#include <pietendo/hac/HierarchicalSha256Stream.h>
-#include <pietendo/hac/HierarchicalIntegrityStream.h>
-#include <pietendo/hac/BKTREncryptedStream.h>
 #include <pietendo/hac/PartitionFsSnapshotGenerator.h>
 #include <pietendo/hac/RomFsSnapshotGenerator.h>
 #include <pietendo/hac/CombinedFsSnapshotGenerator.h>
 
+#include <algorithm>
+#include <set>
+
 nstool::NcaProcess::NcaProcess() :
 	mModuleName("nstool::NcaProcess"),
 	mFile(),
+	mFilePath(),
 	mCliOutputMode(true, false, false, false),
 	mVerify(false),
+	mSignatureCache(),
+	mVerifyData(false),
+	mBaseNcaCache(std::make_shared<BaseNcaCache>()),
+	mPlaintextNcaPath(),
+	mChangedOnly(false),
+	mIoQueueDepth(0),
+	mThreadNum(1),
+	mDecryptThreadPool(),
+	mHashTreeCaches(),
+	mStorageTables(),
+	mCompressionCaches(),
 	mFileSystem(),
 	mFsProcess()
 {
@@ -40,6 +62,14 @@ void nstool::NcaProcess::process()
 	if (mCliOutputMode.show_basic_info)
 		displayHeader();
 
+	// validate all hash layers of each partition
+	if (mVerifyData)
+		validatePartitionData();
+
+	// write decrypted copy of the NCA
+	if (mPlaintextNcaPath.isSet())
+		exportPlaintextNca();
+
 	// process partition
 	processPartitions();
 }
@@ -47,6 +77,12 @@ void nstool::NcaProcess::process()
 void nstool::NcaProcess::setInputFile(const std::shared_ptr<tc::io::IStream>& file)
 {
 	mFile = file;
+	invalidatePartitionCaches();
+}
+
+void nstool::NcaProcess::setInputFilePath(const tc::io::Path& path)
+{
+	mFilePath = path;
 }
 
 void nstool::NcaProcess::setBaseNcaPath(const tc::Optional<tc::io::Path>& nca_path)
@@ -54,9 +90,20 @@ void nstool::NcaProcess::setBaseNcaPath(const tc::Optional<tc::io::Path>& nca_pa
 	mBaseNcaPath = nca_path;
 }
 
+void nstool::NcaProcess::setPlaintextNcaPath(const tc::Optional<tc::io::Path>& out_path)
+{
+	mPlaintextNcaPath = out_path;
+}
+
+void nstool::NcaProcess::setBaseNcaCache(const std::shared_ptr<BaseNcaCache>& base_nca_cache)
+{
+	mBaseNcaCache = base_nca_cache;
+}
+
 void nstool::NcaProcess::setKeyCfg(const KeyBag& keycfg)
 {
 	mKeyCfg = keycfg;
+	invalidatePartitionCaches();
 }
 
 void nstool::NcaProcess::setCliOutputMode(CliOutputMode type)
@@ -69,6 +116,16 @@ void nstool::NcaProcess::setVerifyMode(bool verify)
 	mVerify = verify;
 }
 
+void nstool::NcaProcess::setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache)
+{
+	mSignatureCache = sig_cache;
+}
+
+void nstool::NcaProcess::setVerifyDataMode(bool verify_data)
+{
+	mVerifyData = verify_data;
+}
+
 void nstool::NcaProcess::setShowFsTree(bool show_fs_tree)
 {
 	mFsProcess.setShowFsTree(show_fs_tree);
@@ -84,6 +141,48 @@ void nstool::NcaProcess::setExtractJobs(const std::vector<nstool::ExtractJob>& e
 	mFsProcess.setExtractJobs(extract_jobs);
 }
 
+void nstool::NcaProcess::setShowExtractPlan(bool show_extract_plan)
+{
+	mFsProcess.setShowExtractPlan(show_extract_plan);
+}
+
+void nstool::NcaProcess::setResumeMode(bool resume)
+{
+	mFsProcess.setResumeMode(resume);
+}
+
+void nstool::NcaProcess::setDedupeMode(bool dedupe)
+{
+	mFsProcess.setDedupeMode(dedupe);
+}
+
+void nstool::NcaProcess::setMappedOutputMode(bool mapped_output)
+{
+	mFsProcess.setMappedOutputMode(mapped_output);
+}
+
+void nstool::NcaProcess::setIoQueueDepth(size_t io_queue_depth)
+{
+	mIoQueueDepth = io_queue_depth;
+	mFsProcess.setIoQueueDepth(io_queue_depth);
+}
+
+void nstool::NcaProcess::setExtractFormat(nstool::ExtractFormat extract_format)
+{
+	mFsProcess.setExtractFormat(extract_format);
+}
+
+void nstool::NcaProcess::setThreadNum(size_t thread_num)
+{
+	mThreadNum = thread_num;
+	mFsProcess.setThreadNum(thread_num);
+}
+
+void nstool::NcaProcess::setChangedOnlyMode(bool changed_only)
+{
+	mChangedOnly = changed_only;
+}
+
 const std::shared_ptr<tc::io::IFileSystem>& nstool::NcaProcess::getFileSystem() const
 {
 	return mFileSystem;
@@ -116,7 +215,7 @@ void nstool::NcaProcess::importHeader()
 	pie::hac::ContentArchiveUtil::decryptContentArchiveHeader((byte_t*)&mHdrBlock, (byte_t*)&mHdrBlock, mKeyCfg.nca_header_key.get());
 
 	// generate header hash
-	tc::crypto::GenerateSha2256Hash(mHdrHash.data(), (byte_t*)&mHdrBlock.header, sizeof(pie::hac::sContentArchiveHeader));
+	GenerateSha256Hash(mHdrHash.data(), (byte_t*)&mHdrBlock.header, sizeof(pie::hac::sContentArchiveHeader));
 
 	// proccess main header
 	mHdr.fromBytes((byte_t*)&mHdrBlock.header, sizeof(pie::hac::sContentArchiveHeader));
@@ -142,16 +241,16 @@ void nstool::NcaProcess::generateNcaBodyEncryptionKeys()
 			kak.enc = mHdr.getKeyArea()[i];
 			kak.decrypted = false;
 			// key[0-3]
-			if (i < 4 && mKeyCfg.nca_key_area_encryption_key[keak_index].find(masterkey_rev) != mKeyCfg.nca_key_area_encryption_key[keak_index].end())
+			if (i < 4 && mKeyCfg.nca_key_area_encryption_key[keak_index].isSet(masterkey_rev))
 			{
 				kak.decrypted = true;
-				pie::hac::AesKeygen::generateKey(kak.dec.data(), kak.enc.data(), mKeyCfg.nca_key_area_encryption_key[keak_index][masterkey_rev].data());
+				mKeyCfg.nca_key_area_encryption_key[keak_index].getSchedule(masterkey_rev).decrypt(kak.dec.data(), kak.enc.data(), kak.enc.size());
 			}
 			// key[KeyBankIndex_AesCtrHw]
-			else if (i == pie::hac::nca::KeyBankIndex_AesCtrHw && mKeyCfg.nca_key_area_encryption_key_hw[keak_index].find(masterkey_rev) != mKeyCfg.nca_key_area_encryption_key_hw[keak_index].end())
+			else if (i == pie::hac::nca::KeyBankIndex_AesCtrHw && mKeyCfg.nca_key_area_encryption_key_hw[keak_index].isSet(masterkey_rev))
 			{
 				kak.decrypted = true;
-				pie::hac::AesKeygen::generateKey(kak.dec.data(), kak.enc.data(), mKeyCfg.nca_key_area_encryption_key_hw[keak_index][masterkey_rev].data());
+				mKeyCfg.nca_key_area_encryption_key_hw[keak_index].getSchedule(masterkey_rev).decrypt(kak.dec.data(), kak.enc.data(), kak.enc.size());
 			}
 			else
 			{
@@ -163,6 +262,7 @@ void nstool::NcaProcess::generateNcaBodyEncryptionKeys()
 
 	// clear content key
 	mContentKey.aes_ctr = tc::Optional<pie::hac::detail::aes128_key_t>();
+	mContentKey.aes_xts = tc::Optional<pie::hac::detail::aes128_xtskey_t>();
 
 	// if this has a rights id, the key needs to be sourced from a ticket
 	if (mHdr.hasRightsId() == true)
@@ -179,18 +279,18 @@ void nstool::NcaProcess::generateNcaBodyEncryptionKeys()
 		else if (mKeyCfg.external_enc_content_keys.find(mHdr.getRightsId()) != mKeyCfg.external_enc_content_keys.end())
 		{
 			tmp_key = mKeyCfg.external_enc_content_keys[mHdr.getRightsId()];
-			if (mKeyCfg.etik_common_key.find(masterkey_rev) != mKeyCfg.etik_common_key.end())
+			if (mKeyCfg.etik_common_key.isSet(masterkey_rev))
 			{
-				pie::hac::AesKeygen::generateKey(tmp_key.data(), tmp_key.data(), mKeyCfg.etik_common_key[masterkey_rev].data());
+				mKeyCfg.etik_common_key.getSchedule(masterkey_rev).decrypt(tmp_key.data(), tmp_key.data(), tmp_key.size());
 				mContentKey.aes_ctr = tmp_key;
 			}
 		}
 		else if (mKeyCfg.fallback_enc_content_key.isSet())
 		{
 			tmp_key = mKeyCfg.fallback_enc_content_key.get();
-			if (mKeyCfg.etik_common_key.find(masterkey_rev) != mKeyCfg.etik_common_key.end())
+			if (mKeyCfg.etik_common_key.isSet(masterkey_rev))
 			{
-				pie::hac::AesKeygen::generateKey(tmp_key.data(), tmp_key.data(), mKeyCfg.etik_common_key[masterkey_rev].data());
+				mKeyCfg.etik_common_key.getSchedule(masterkey_rev).decrypt(tmp_key.data(), tmp_key.data(), tmp_key.size());
 				mContentKey.aes_ctr = tmp_key;
 			}
 		}
@@ -205,6 +305,30 @@ void nstool::NcaProcess::generateNcaBodyEncryptionKeys()
 				mContentKey.aes_ctr = mContentKey.kak_list[i].dec;
 			}
 		}
+
+		// the AES-XTS key is made of two key area keys (data key, then tweak key)
+		pie::hac::detail::aes128_xtskey_t xts_key;
+		bool xts_key_found[2] = {false, false};
+		for (size_t i = 0; i < mContentKey.kak_list.size(); i++)
+		{
+			if (mContentKey.kak_list[i].decrypted == false)
+				continue;
+
+			if (mContentKey.kak_list[i].index == pie::hac::nca::KeyBankIndex_AesXts0)
+			{
+				xts_key[0] = mContentKey.kak_list[i].dec;
+				xts_key_found[0] = true;
+			}
+			else if (mContentKey.kak_list[i].index == pie::hac::nca::KeyBankIndex_AesXts1)
+			{
+				xts_key[1] = mContentKey.kak_list[i].dec;
+				xts_key_found[1] = true;
+			}
+		}
+		if (xts_key_found[0] && xts_key_found[1])
+		{
+			mContentKey.aes_xts = xts_key;
+		}
 	}
 
 	// if the keys weren't generated, check if the keys were supplied by the user
@@ -215,41 +339,50 @@ void nstool::NcaProcess::generateNcaBodyEncryptionKeys()
 			mContentKey.aes_ctr = mKeyCfg.fallback_content_key.get();
 		}
 	}
+
+	// expand the content key schedules
+	if (mContentKey.aes_ctr.isSet())
+	{
+		mContentKey.aes_ctr_schedule.initialize(mContentKey.aes_ctr.get().data());
+	}
+	if (mContentKey.aes_xts.isSet())
+	{
+		mContentKey.aes_xts_schedule[0].initialize(mContentKey.aes_xts.get()[0].data());
+		mContentKey.aes_xts_schedule[1].initialize(mContentKey.aes_xts.get()[1].data());
+	}
 	
 	if (mCliOutputMode.show_keydata)
 	{
-		if (mContentKey.aes_ctr.isSet())
+		if (mContentKey.aes_ctr.isSet() || mContentKey.aes_xts.isSet())
 		{
 			fmt::print("[NCA Content Key]\n");
+		}
+		if (mContentKey.aes_ctr.isSet())
+		{
 			fmt::print("  AES-CTR Key: {:s}\n", tc::cli::FormatUtil::formatBytesAsString(mContentKey.aes_ctr.get().data(), mContentKey.aes_ctr.get().size(), true, ""));
 		}
+		if (mContentKey.aes_xts.isSet())
+		{
+			fmt::print("  AES-XTS Key: {:s} {:s}\n", tc::cli::FormatUtil::formatBytesAsString(mContentKey.aes_xts.get()[0].data(), mContentKey.aes_xts.get()[0].size(), true, ""), tc::cli::FormatUtil::formatBytesAsString(mContentKey.aes_xts.get()[1].data(), mContentKey.aes_xts.get()[1].size(), true, ""));
+		}
 	}
 }
 
-nstool::NcaProcess nstool::NcaProcess::readBaseNCA()
+std::shared_ptr<tc::io::IStream> nstool::NcaProcess::readBaseNcaRomFs()
 {
-	// open base nca stream
 	if (mBaseNcaPath.isNull())
 	{
 		throw tc::Exception(mModuleName, "Base NCA not supplied. Necessary for update NCA.");
 	}
-	std::shared_ptr<tc::io::IStream> base_stream = std::make_shared<tc::io::FileStream>(tc::io::FileStream(mBaseNcaPath.get(), tc::io::FileMode::Open, tc::io::FileAccess::Read));
 
-	// process base nca with output suppressed
-	NcaProcess obj;
-	nstool::CliOutputMode cliOutput;
-	cliOutput.show_basic_info = false;
-	cliOutput.show_extended_info = false;
-	cliOutput.show_keydata = false;
-	cliOutput.show_layout = false;
-	obj.setCliOutputMode(cliOutput);
-	obj.setVerifyMode(true);
-	obj.setKeyCfg(mKeyCfg);
-	obj.setInputFile(base_stream);
-	obj.process();
+	uint64_t base_program_id;
+	std::shared_ptr<tc::io::IStream> base_reader = mBaseNcaCache->getRomFsReader(mBaseNcaPath.get(), mKeyCfg, base_program_id);
+	if (base_program_id != mHdr.getProgramId())
+	{
+		throw tc::Exception(mModuleName, "Invalid base nca. ProgramID diferent.");
+	}
 
-	// return processed base nca
-	return obj;
+	return base_reader;
 }
 
 void nstool::NcaProcess::generatePartitionConfiguration()
@@ -265,7 +398,7 @@ void nstool::NcaProcess::generatePartitionConfiguration()
 
 		// validate header hash
 		pie::hac::detail::sha256_hash_t fs_header_hash;
-		tc::crypto::GenerateSha2256Hash(fs_header_hash.data(), (const byte_t*)&mHdrBlock.fs_header[partition.header_index], sizeof(pie::hac::sContentArchiveFsHeader));
+		GenerateSha256Hash(fs_header_hash.data(), (const byte_t*)&mHdrBlock.fs_header[partition.header_index], sizeof(pie::hac::sContentArchiveFsHeader));
 		if (fs_header_hash != partition.fs_header_hash)
 		{
 			throw tc::Exception(mModuleName, fmt::format("NCA FS Header [{:d}] Hash: FAIL", partition.header_index));
@@ -286,6 +419,9 @@ void nstool::NcaProcess::generatePartitionConfiguration()
 		info.hash_type = (pie::hac::nca::HashType)fs_header.hash_type;
 		info.enc_type = (pie::hac::nca::EncryptionType)fs_header.encryption_type;
 		info.metadata_hash_type = (pie::hac::nca::MetaDataHashType)fs_header.meta_data_hash_type;
+		info.sparse_info.generation = 0;
+		info.sparse_info.physical_offset = 0;
+		info.sparse_info.physical_size = 0;
 
 		if (info.hash_type == pie::hac::nca::HashType_HierarchicalSha256)
 		{
@@ -302,7 +438,54 @@ void nstool::NcaProcess::generatePartitionConfiguration()
 			// handle partition encryption and partition compaction (sparse layer)
 			if (fs_header.sparse_info.generation.unwrap() != 0)
 			{
-				throw tc::Exception("SparseStorage: Not currently supported.");
+				SparseStream::sSparseInfo sparse_info;
+				memcpy(&sparse_info, (const byte_t*)&fs_header.sparse_info, sizeof(SparseStream::sSparseInfo));
+				info.sparse_info.generation = sparse_info.generation.unwrap();
+				info.sparse_info.physical_offset = sparse_info.physical_offset.unwrap();
+				info.sparse_info.physical_size = sparse_info.bucket.offset.unwrap() + sparse_info.bucket.size.unwrap();
+
+				// create raw partition (only the stored data, followed by the SparseStorage table)
+				info.raw_reader = std::make_shared<tc::io::SubStream>(tc::io::SubStream(mFile, info.sparse_info.physical_offset, info.sparse_info.physical_size));
+
+				if (info.enc_type != pie::hac::nca::EncryptionType_None && info.enc_type != pie::hac::nca::EncryptionType_AesCtr)
+					throw tc::Exception(mModuleName, fmt::format("SparseStorage: EncryptionType({:s}) is not supported", pie::hac::ContentArchiveUtil::getEncryptionTypeAsString(info.enc_type)));
+				if (info.enc_type == pie::hac::nca::EncryptionType_AesCtr && mContentKey.aes_ctr.isNull())
+					throw tc::Exception(mModuleName, "AES-CTR Key was not determined");
+
+				// import the SparseStorage table once, it is shared by every reader of the partition
+				if (mStorageTables[partition.header_index].sparse == nullptr)
+				{
+					std::shared_ptr<BucketTree> sparse_table = std::make_shared<BucketTree>();
+					if (sparse_info.bucket.header.entry_count.unwrap() != 0)
+					{
+						std::shared_ptr<tc::io::IStream> table_reader = info.raw_reader;
+						if (info.enc_type == pie::hac::nca::EncryptionType_AesCtr)
+						{
+							// the table is encrypted with the partition counter, with the sparse generation in place of the partition generation
+							pie::hac::detail::aes_iv_t table_ctr = info.aes_ctr;
+							uint32_t table_generation = uint32_t(info.sparse_info.generation) << 16;
+							table_ctr[4] = byte_t(table_generation >> 24);
+							table_ctr[5] = byte_t(table_generation >> 16);
+							table_ctr[6] = byte_t(table_generation >> 8);
+							table_ctr[7] = byte_t(table_generation);
+							tc::crypto::IncrementCounterAes128Ctr(table_ctr.data(), info.sparse_info.physical_offset >> 4);
+
+							table_reader = std::make_shared<AesCtrEncryptedStream>(info.raw_reader, mContentKey.aes_ctr_schedule, table_ctr);
+						}
+
+						sparse_table->initialize(sparse_info.bucket, table_reader, sizeof(IndirectStream::sEntry));
+					}
+					mStorageTables[partition.header_index].sparse = sparse_table;
+				}
+
+				// create decryption stream (the SparseStorage maps NCA offsets, ranges that aren't stored are read as zeros)
+				std::shared_ptr<tc::io::IStream> sparse_reader;
+				if (info.enc_type == pie::hac::nca::EncryptionType_AesCtr)
+					sparse_reader = std::make_shared<SparseStream>(info.raw_reader, mStorageTables[partition.header_index].sparse, info.offset + info.size, mContentKey.aes_ctr_schedule, info.aes_ctr);
+				else
+					sparse_reader = std::make_shared<SparseStream>(info.raw_reader, mStorageTables[partition.header_index].sparse, info.offset + info.size);
+
+				info.decrypt_reader = std::make_shared<tc::io::SubStream>(tc::io::SubStream(sparse_reader, info.offset, info.size));
 			}
 			else
 			{
@@ -327,49 +510,61 @@ void nstool::NcaProcess::generatePartitionConfiguration()
 					pie::hac::detail::aes_iv_t partition_ctr = info.aes_ctr;
 					tc::crypto::IncrementCounterAes128Ctr(partition_ctr.data(), info.offset >> 4);
 
-					// create decryption stream
-					info.decrypt_reader = std::make_shared<tc::crypto::Aes128CtrEncryptedStream>(tc::crypto::Aes128CtrEncryptedStream(info.raw_reader, partition_key, partition_ctr));
+					// large reads are decrypted in parallel when multiple threads are enabled
+					if (mThreadNum > 1 && mDecryptThreadPool == nullptr)
+						mDecryptThreadPool = std::make_shared<ThreadPool>(mThreadNum - 1);
+
+					// create decryption stream (use the hardware accelerated stream when the CPU supports it, or when decrypting in parallel)
+					if (AesCtrCipher::isBackendSupported(AesCtrCipher::BACKEND_AESNI) || mDecryptThreadPool != nullptr)
+						info.decrypt_reader = std::make_shared<AesCtrEncryptedStream>(info.raw_reader, mContentKey.aes_ctr_schedule, partition_ctr, mDecryptThreadPool);
+					else
+						info.decrypt_reader = std::make_shared<tc::crypto::Aes128CtrEncryptedStream>(tc::crypto::Aes128CtrEncryptedStream(info.raw_reader, partition_key, partition_ctr));
 				}
 				else if (info.enc_type == pie::hac::nca::EncryptionType_AesCtrEx)
 				{
 					if (mContentKey.aes_ctr.isNull())
 						throw tc::Exception(mModuleName, "AES-CTR Key was not determined");
 
-					// get partition key
-					pie::hac::detail::aes128_key_t partition_key = mContentKey.aes_ctr.get();
-
 					// get partition counter
 					pie::hac::detail::aes_iv_t partition_ctr = info.aes_ctr;
 					tc::crypto::IncrementCounterAes128Ctr(partition_ctr.data(), info.offset >> 4);
 
-					// TODO see if AesCtrEx encryption can just be for creating the transparent decryption, with IndirectStorage IStream construction being done after decryption but before hash layer processing
-					// this might be relevant when processing compressed or sparse storage
-
-					NcaProcess nca_base = readBaseNCA();
-					if (nca_base.mHdr.getProgramId() != mHdr.getProgramId())
+					// import the patch tables (stored in the partition, encrypted with the partition counter) once, they are shared by every reader of the partition
+					if (mStorageTables[partition.header_index].indirect == nullptr)
 					{
-						throw tc::Exception(mModuleName, "Invalid base nca. ProgramID diferent.");
-					}
+						BucketTree::sInfo indirect_info, aes_ctr_ex_info;
+						memcpy(&indirect_info, (const byte_t*)&fs_header.patch_info, sizeof(BucketTree::sInfo));
+						memcpy(&aes_ctr_ex_info, (const byte_t*)&fs_header.patch_info + sizeof(BucketTree::sInfo), sizeof(BucketTree::sInfo));
 
-					std::shared_ptr<tc::io::IStream> base_reader;
-					for (auto& partition_base : nca_base.mPartitions)
-					{
-						if (partition_base.format_type == pie::hac::nca::FormatType::FormatType_RomFs && partition_base.raw_reader != nullptr)
-						{
-							base_reader = partition_base.decrypt_reader;
-						}
-					}
-					if (base_reader == nullptr)
-					{
-						throw tc::Exception(mModuleName, "Cannot determine RomFs from base nca.");
+						std::shared_ptr<tc::io::IStream> table_reader = std::make_shared<AesCtrEncryptedStream>(info.raw_reader, mContentKey.aes_ctr_schedule, partition_ctr);
+
+						std::shared_ptr<BucketTree> indirect_table = std::make_shared<BucketTree>();
+						indirect_table->initialize(indirect_info, table_reader, sizeof(IndirectStream::sEntry));
+
+						std::shared_ptr<BucketTree> aes_ctr_ex_table = std::make_shared<BucketTree>();
+						aes_ctr_ex_table->initialize(aes_ctr_ex_info, table_reader, sizeof(AesCtrExEncryptedStream::sEntry));
+
+						mStorageTables[partition.header_index].indirect = indirect_table;
+						mStorageTables[partition.header_index].aes_ctr_ex = aes_ctr_ex_table;
 					}
 
-					// create decryption stream
-					info.decrypt_reader = std::make_shared<pie::hac::BKTREncryptedStream>(pie::hac::BKTREncryptedStream(info.raw_reader, partition_key, partition_ctr, fs_header.patch_info, base_reader));
+					std::shared_ptr<tc::io::IStream> base_reader = readBaseNcaRomFs();
+
+					// create decryption stream (patch data decrypted with the counter generation of each AesCtrEx entry, then combined with the base partition)
+					std::shared_ptr<tc::io::IStream> patch_reader = std::make_shared<AesCtrExEncryptedStream>(info.raw_reader, mContentKey.aes_ctr_schedule, partition_ctr, mStorageTables[partition.header_index].aes_ctr_ex);
+					info.decrypt_reader = std::make_shared<IndirectStream>(base_reader, patch_reader, mStorageTables[partition.header_index].indirect);
 				}
 				else if (info.enc_type == pie::hac::nca::EncryptionType_AesXts)
 				{
-					throw tc::Exception(mModuleName, fmt::format("EncryptionType({:s}): UNSUPPORTED", pie::hac::ContentArchiveUtil::getEncryptionTypeAsString(info.enc_type)));
+					if (mContentKey.aes_xts.isNull())
+						throw tc::Exception(mModuleName, "AES-XTS Key was not determined");
+
+					// large reads are decrypted in parallel when multiple threads are enabled
+					if (mThreadNum > 1 && mDecryptThreadPool == nullptr)
+						mDecryptThreadPool = std::make_shared<ThreadPool>(mThreadNum - 1);
+
+					// create decryption stream (sectors are numbered from the start of the partition)
+					info.decrypt_reader = std::make_shared<AesXtsEncryptedStream>(info.raw_reader, mContentKey.aes_xts_schedule[0], mContentKey.aes_xts_schedule[1], pie::hac::nca::kSectorSize, mDecryptThreadPool);
 				}
 				else
 				{
@@ -385,15 +580,41 @@ void nstool::NcaProcess::generatePartitionConfiguration()
 				info.reader = info.decrypt_reader;
 				break;
 			case (pie::hac::nca::HashType_HierarchicalSha256):
-				info.reader = std::make_shared<pie::hac::HierarchicalSha256Stream>(pie::hac::HierarchicalSha256Stream(info.decrypt_reader, info.hierarchicalsha256_hdr));
+				if (mHashTreeCaches[partition.header_index] == nullptr)
+					mHashTreeCaches[partition.header_index] = std::make_shared<HashTreeStream::Cache>(HashTreeStream::generateLayout(info.hierarchicalsha256_hdr));
+				info.reader = std::make_shared<HashTreeStream>(info.decrypt_reader, mHashTreeCaches[partition.header_index]);
 				break;
 			case (pie::hac::nca::HashType_HierarchicalIntegrity):
-				info.reader = std::make_shared<pie::hac::HierarchicalIntegrityStream>(pie::hac::HierarchicalIntegrityStream(info.decrypt_reader, info.hierarchicalintegrity_hdr));
+				if (mHashTreeCaches[partition.header_index] == nullptr)
+					mHashTreeCaches[partition.header_index] = std::make_shared<HashTreeStream::Cache>(HashTreeStream::generateLayout(info.hierarchicalintegrity_hdr));
+				info.reader = std::make_shared<HashTreeStream>(info.decrypt_reader, mHashTreeCaches[partition.header_index]);
 				break;
 			default:
 				throw tc::Exception(mModuleName, fmt::format("HashType({:s}): UNKNOWN", pie::hac::ContentArchiveUtil::getHashTypeAsString(info.hash_type)));
 			}
 
+			// handle compression layer (the compressed blocks and the CompressedStorage table are stored in the hash layer data)
+			CompressedStream::sCompressionInfo compression_info;
+			memcpy(&compression_info, (const byte_t*)&fs_header.sparse_info + sizeof(fs_header.sparse_info), sizeof(CompressedStream::sCompressionInfo));
+			if (compression_info.bucket.offset.unwrap() != 0 && compression_info.bucket.size.unwrap() != 0)
+			{
+				if (mStorageTables[partition.header_index].compression == nullptr)
+				{
+					std::shared_ptr<BucketTree> compression_table = std::make_shared<BucketTree>();
+					compression_table->initialize(compression_info.bucket, info.reader, sizeof(CompressedStream::sEntry));
+					mStorageTables[partition.header_index].compression = compression_table;
+				}
+				if (mCompressionCaches[partition.header_index] == nullptr)
+					mCompressionCaches[partition.header_index] = std::make_shared<CompressedStream::Cache>();
+
+				// blocks are decompressed in parallel when multiple threads are enabled
+				if (mThreadNum > 1 && mDecryptThreadPool == nullptr)
+					mDecryptThreadPool = std::make_shared<ThreadPool>(mThreadNum - 1);
+
+				std::shared_ptr<tc::io::IStream> compressed_data_reader = std::make_shared<tc::io::SubStream>(tc::io::SubStream(info.reader, 0, compression_info.bucket.offset.unwrap()));
+				info.reader = std::make_shared<CompressedStream>(compressed_data_reader, mStorageTables[partition.header_index].compression, mCompressionCaches[partition.header_index], mDecryptThreadPool);
+			}
+
 			// filter out unrecognised format types
 			switch (info.format_type)
 			{
@@ -418,22 +639,16 @@ void nstool::NcaProcess::generatePartitionConfiguration()
 
 void nstool::NcaProcess::validateNcaSignatures()
 {
-	// validate signature[0]
-	if (mKeyCfg.nca_header_sign0_key.find(mHdr.getSignatureKeyGeneration()) != mKeyCfg.nca_header_sign0_key.end())
-	{
-		if (tc::crypto::VerifyRsa2048PssSha2256(mHdrBlock.signature_main.data(), mHdrHash.data(), mKeyCfg.nca_header_sign0_key[mHdr.getSignatureKeyGeneration()]) == false)
-		{
-			fmt::print("[WARNING] NCA Header Main Signature: FAIL\n");
-		}
-	}
-	else
-	{
-		fmt::print("[WARNING] NCA Header Main Signature: FAIL (could not load header key)\n");
-	}
-	
-
-	// validate signature[1]
-	if (mHdr.getContentType() == pie::hac::nca::ContentType_Program)
+	// the two header signatures are independent, so they are checked concurrently and reported in order afterwards
+	bool main_sig_valid = false;
+	bool main_sig_key_found = mKeyCfg.nca_header_sign0_key.find(mHdr.getSignatureKeyGeneration()) != mKeyCfg.nca_header_sign0_key.end();
+	bool acid_sig_required = mHdr.getContentType() == pie::hac::nca::ContentType_Program;
+	std::string acid_sig_fail_reason;
+
+	// the ACID signature key is in the npdm, which is loaded here without being verified (verifying it prints warnings, which must follow the main signature result)
+	MetaProcess npdm;
+	bool npdm_loaded = false;
+	if (acid_sig_required)
 	{
 		try {
 			if (mPartitions[pie::hac::nca::ProgramContentPartitionIndex_Code].format_type == pie::hac::nca::FormatType_PartitionFs)
@@ -448,17 +663,12 @@ void nstool::NcaProcess::validateNcaSignatures()
 						throw tc::Exception(fmt::format("\"{:s}\" not present in ExeFs", kNpdmExefsPath));
 					}
 
-					MetaProcess npdm;
 					npdm.setInputFile(npdm_file);
 					npdm.setKeyCfg(mKeyCfg);
-					npdm.setVerifyMode(true);
+					npdm.setVerifyMode(false);
 					npdm.setCliOutputMode(CliOutputMode(false, false, false, false));
 					npdm.process();
-
-					if (tc::crypto::VerifyRsa2048PssSha2256(mHdrBlock.signature_acid.data(), mHdrHash.data(), npdm.getMeta().getAccessControlInfoDesc().getContentArchiveHeaderSignature2Key()) == false)
-					{
-						throw tc::Exception("Bad signature");
-					}
+					npdm_loaded = true;
 				}
 				else
 				{
@@ -471,9 +681,136 @@ void nstool::NcaProcess::validateNcaSignatures()
 			}
 		}
 		catch (tc::Exception& e) {
-			fmt::print("[WARNING] NCA Header ACID Signature: FAIL ({:s})\n", e.error());
+			acid_sig_fail_reason = e.error();
+		}
+	}
+
+	std::vector<std::function<void()>> tasks;
+
+	// validate signature[0]
+	if (main_sig_key_found)
+	{
+		tasks.push_back([this, &main_sig_valid]() {
+			main_sig_valid = VerifySignature(mSignatureCache, SignatureCache::SIGN_RSA2048_PSS_SHA256, mHdrBlock.signature_main.data(), mHdrHash.data(), mKeyCfg.nca_header_sign0_key[mHdr.getSignatureKeyGeneration()]);
+		});
+	}
+
+	// validate signature[1]
+	bool acid_sig_valid = false;
+	if (npdm_loaded)
+	{
+		tasks.push_back([this, &npdm, &acid_sig_valid]() {
+			acid_sig_valid = VerifySignature(mSignatureCache, SignatureCache::SIGN_RSA2048_PSS_SHA256, mHdrBlock.signature_acid.data(), mHdrHash.data(), npdm.getMeta().getAccessControlInfoDesc().getContentArchiveHeaderSignature2Key());
+		});
+	}
+
+	if (mThreadNum > 1 && mDecryptThreadPool == nullptr)
+		mDecryptThreadPool = std::make_shared<ThreadPool>(mThreadNum - 1);
+
+	if (mDecryptThreadPool != nullptr && tasks.size() > 1)
+	{
+		mDecryptThreadPool->execute(tasks);
+	}
+	else
+	{
+		for (auto itr = tasks.begin(); itr != tasks.end(); itr++)
+		{
+			(*itr)();
+		}
+	}
+
+	if (main_sig_key_found == false)
+	{
+		fmt::print("[WARNING] NCA Header Main Signature: FAIL (could not load header key)\n");
+	}
+	else if (main_sig_valid == false)
+	{
+		fmt::print("[WARNING] NCA Header Main Signature: FAIL\n");
+	}
+
+	// verify the npdm (printing any ACID/ACI warnings) before reporting the ACID signature it was used to check
+	if (npdm_loaded)
+	{
+		try {
+			npdm.setVerifyMode(true);
+			npdm.process();
+
+			if (acid_sig_valid == false)
+			{
+				throw tc::Exception("Bad signature");
+			}
+		}
+		catch (tc::Exception& e) {
+			acid_sig_fail_reason = e.error();
 		}
 	}
+
+	if (acid_sig_required && acid_sig_fail_reason.empty() == false)
+	{
+		fmt::print("[WARNING] NCA Header ACID Signature: FAIL ({:s})\n", acid_sig_fail_reason);
+	}
+}
+
+void nstool::NcaProcess::validatePartitionData()
+{
+	// when the cli output is disabled (e.g. an archive is written to stdout), results are reported on stderr
+	FILE* log = mCliOutputMode.show_basic_info ? stdout : stderr;
+
+	fmt::print(log, "[NCA Partition Data Verification]\n");
+	for (size_t i = 0; i < mHdr.getPartitionEntryList().size(); i++)
+	{
+		uint32_t index = mHdr.getPartitionEntryList()[i].header_index;
+		sPartitionInfo& info = mPartitions[index];
+		if (info.size == 0) continue;
+
+		if (info.decrypt_reader == nullptr)
+		{
+			fmt::print(log, "[WARNING] NCA Partition {:d} Data: FAIL (partition could not be read: {:s})\n", index, info.fail_reason);
+			continue;
+		}
+
+		// ranges compacted out of a sparse partition are read as zeros, so their blocks would all fail
+		if (info.sparse_info.generation != 0)
+		{
+			fmt::print(log, "  Partition {:d}: SKIPPED (sparse partition)\n", index);
+			continue;
+		}
+
+		HashTreeScanner scanner;
+		scanner.setInputStream(info.decrypt_reader);
+		scanner.setThreadNum(mThreadNum);
+		if (info.hash_type == pie::hac::nca::HashType_HierarchicalSha256)
+		{
+			scanner.setLayout(HashTreeStream::generateLayout(info.hierarchicalsha256_hdr));
+		}
+		else if (info.hash_type == pie::hac::nca::HashType_HierarchicalIntegrity)
+		{
+			scanner.setLayout(HashTreeStream::generateLayout(info.hierarchicalintegrity_hdr));
+		}
+		else
+		{
+			fmt::print(log, "  Partition {:d}: SKIPPED (HashType({:s}) has no hash layers)\n", index, pie::hac::ContentArchiveUtil::getHashTypeAsString(info.hash_type));
+			continue;
+		}
+
+		try {
+			scanner.scan();
+		}
+		catch (const tc::Exception& e) {
+			fmt::print(log, "[WARNING] NCA Partition {:d} Data: FAIL ({:s})\n", index, e.error());
+			continue;
+		}
+
+		for (auto itr = scanner.getBadBlockList().begin(); itr != scanner.getBadBlockList().end(); itr++)
+		{
+			std::string layer_name = itr->layer_index + 1 == scanner.getLayerList().size() ? "Data Layer" : fmt::format("Hash Layer {:d}", itr->layer_index);
+			fmt::print(log, "[WARNING] NCA Partition {:d} {:s} block (offset: 0x{:x}, size: 0x{:x}): FAIL (bad hash)\n", index, layer_name, itr->offset, itr->size);
+		}
+
+		double mib_per_sec = scanner.getElapsedSeconds() > 0 ? (double(scanner.getScannedSize()) / double(0x100000)) / scanner.getElapsedSeconds() : 0;
+		std::string result = scanner.getBadBlockList().empty() ? "OK" : fmt::format("FAIL ({:d} bad blocks)", scanner.getBadBlockList().size());
+		fmt::print(log, "  Partition {:d}: {:s} ({:d} blocks, 0x{:x} bytes in {:.2f}s, {:.1f} MiB/s)\n", index, result, scanner.getBlockNum(), scanner.getScannedSize(), scanner.getElapsedSeconds(), mib_per_sec);
+	}
 }
 
 void nstool::NcaProcess::displayHeader()
@@ -534,6 +871,19 @@ void nstool::NcaProcess::displayHeader()
 				fmt::print("      AesCtr Counter:\n");
 				fmt::print("        {:s}\n", tc::cli::FormatUtil::formatBytesAsString(aes_ctr.data(), aes_ctr.size(), true, ""));
 			}
+			if (info.sparse_info.generation != 0)
+			{
+				fmt::print("      SparseStorage:\n");
+				fmt::print("        Generation:      {:d}\n", info.sparse_info.generation);
+				fmt::print("        Physical Offset: 0x{:x}\n", info.sparse_info.physical_offset);
+				fmt::print("        Physical Size:   0x{:x}\n", info.sparse_info.physical_size);
+			}
+			if (mStorageTables[index].compression != nullptr)
+			{
+				fmt::print("      CompressedStorage:\n");
+				fmt::print("        Blocks:          {:d}\n", mStorageTables[index].compression->getEntryNum());
+				fmt::print("        Size:            0x{:x}\n", mStorageTables[index].compression->getEndOffset());
+			}
 			if (info.hash_type == pie::hac::nca::HashType_HierarchicalIntegrity)
 			{
 				auto hash_hdr = info.hierarchicalintegrity_hdr;
@@ -586,24 +936,175 @@ void nstool::NcaProcess::displayHeader()
 }
 
 
+void nstool::NcaProcess::exportPlaintextNca()
+{
+	// the output is the same size as the input, regions that aren't written (padding between partitions) are left as sparse holes
+	std::shared_ptr<tc::io::IStream> out_stream = openFileStream(mPlaintextNcaPath.get(), tc::io::FileMode::Create, tc::io::FileAccess::Write, mIoQueueDepth);
+	out_stream->setLength(mFile->length());
+
+	// write decrypted header block (the fs headers are unchanged, so their hashes in the main header stay valid)
+	out_stream->seek(0, tc::io::SeekOrigin::Begin);
+	out_stream->write((const byte_t*)&mHdrBlock, sizeof(pie::hac::sContentArchiveHeaderBlock));
+
+	// write partitions in the order they are stored, so the input is read in a single sequential pass
+	// large reads are decrypted on the thread pool while the previous read is written (see writeStreamToStream())
+	std::vector<uint32_t> partition_order;
+	for (size_t i = 0; i < mHdr.getPartitionEntryList().size(); i++)
+	{
+		partition_order.push_back(mHdr.getPartitionEntryList()[i].header_index);
+	}
+	std::sort(partition_order.begin(), partition_order.end(), [this](uint32_t a, uint32_t b) { return mPartitions[a].offset < mPartitions[b].offset; });
+
+	for (auto itr = partition_order.begin(); itr != partition_order.end(); itr++)
+	{
+		sPartitionInfo& info = mPartitions[*itr];
+		if (info.size == 0) continue;
+
+		// sparse partitions are compacted, the stored data is decrypted with the counters of the uncompacted offsets, so it can't be decrypted in place
+		if (info.sparse_info.generation != 0)
+		{
+			fmt::print("[WARNING] NCA Partition {:d} was not decrypted (SparseStorage is not supported for plaintext export)\n", *itr);
+			if (info.raw_reader != nullptr)
+				writeStreamToStream(info.raw_reader, std::make_shared<tc::io::SubStream>(tc::io::SubStream(out_stream, info.sparse_info.physical_offset, info.sparse_info.physical_size)));
+			continue;
+		}
+
+		std::shared_ptr<tc::io::IStream> in_stream = info.decrypt_reader;
+		if (info.enc_type == pie::hac::nca::EncryptionType_AesCtrEx && info.raw_reader != nullptr && mStorageTables[*itr].aes_ctr_ex != nullptr)
+		{
+			// the decrypt reader of a patch partition is combined with the base NCA, so the physical data (and tables) are decrypted with the AesCtrEx table instead (this doesn't need the base NCA)
+			pie::hac::detail::aes_iv_t partition_ctr = info.aes_ctr;
+			tc::crypto::IncrementCounterAes128Ctr(partition_ctr.data(), info.offset >> 4);
+			in_stream = std::make_shared<AesCtrExEncryptedStream>(info.raw_reader, mContentKey.aes_ctr_schedule, partition_ctr, mStorageTables[*itr].aes_ctr_ex);
+		}
+		else if (in_stream == nullptr)
+		{
+			fmt::print("[WARNING] NCA Partition {:d} was not decrypted (partition could not be read: {:s})\n", *itr, info.fail_reason);
+			in_stream = std::make_shared<tc::io::SubStream>(tc::io::SubStream(mFile, info.offset, info.size));
+		}
+
+		writeStreamToStream(in_stream, std::make_shared<tc::io::SubStream>(tc::io::SubStream(out_stream, info.offset, info.size)));
+	}
+
+	out_stream->flush();
+}
+
 void nstool::NcaProcess::processPartitions()
+{
+	std::shared_ptr<tc::io::IFileSystem> nca_fs = std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(generateCombinedFsSnapshot(true)));
+
+	mFsProcess.setInputFileSystem(nca_fs);
+
+	// tell FsProcess where each file is stored, so files can be extracted in the order they are stored
+	std::map<tc::io::Path, nstool::FileExtent> file_layout;
+	generateFileLayout(file_layout);
+	mFsProcess.setInputFileLayout(file_layout);
+
+	// only extract files with data from this (patch) NCA
+	if (mChangedOnly)
+	{
+		mFsProcess.setExtractFileFilter(generateChangedFileFilter());
+	}
+	if (mFilePath.isSet())
+	{
+		mFsProcess.setInputFilePath(mFilePath.get());
+	}
+
+	// allow FsProcess to open more readers for concurrent extraction, each with its own decryption/hash layer streams
+	std::shared_ptr<SharedStream> shared_file = std::make_shared<SharedStream>(mFile);
+	std::shared_ptr<NcaProcess> nca_template = std::make_shared<NcaProcess>();
+	nca_template->mKeyCfg = mKeyCfg;
+	nca_template->mBaseNcaPath = mBaseNcaPath;
+	nca_template->mBaseNcaCache = mBaseNcaCache;
+	nca_template->mHdrBlock = mHdrBlock;
+	nca_template->mHdrHash = mHdrHash;
+	nca_template->mHdr = mHdr;
+	nca_template->mContentKey = mContentKey;
+	nca_template->mHashTreeCaches = mHashTreeCaches;
+	nca_template->mStorageTables = mStorageTables;
+	nca_template->mCompressionCaches = mCompressionCaches;
+	mFsProcess.setInputFileSystemFactory([shared_file, nca_template]() -> std::shared_ptr<tc::io::IFileSystem> {
+		NcaProcess nca = *nca_template;
+		nca.mFile = shared_file->clone();
+		nca.generatePartitionConfiguration();
+
+		return std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(nca.generateCombinedFsSnapshot(false)));
+	});
+
+	mFsProcess.setFsFormatName("ContentArchive");
+	mFsProcess.setFsRootLabel(getContentTypeForMountStr(mHdr.getContentType()));
+	mFsProcess.process();
+
+	if (mCliOutputMode.show_extended_info)
+		displayHashTreeCacheStats();
+}
+
+void nstool::NcaProcess::displayHashTreeCacheStats()
+{
+	fmt::print("[NCA Hash Layer Cache]\n");
+	for (size_t i = 0; i < mHdr.getPartitionEntryList().size(); i++)
+	{
+		uint32_t index = mHdr.getPartitionEntryList()[i].header_index;
+		if (mHashTreeCaches[index] == nullptr) continue;
+
+		HashTreeStream::Cache::sStats stats = mHashTreeCaches[index]->getStats();
+		fmt::print("  Partition {:d}:\n", index);
+		fmt::print("    Verified Blocks:       {:d}/{:d}\n", stats.data_verified_block_num, stats.data_block_num);
+		fmt::print("    Hashed Blocks:         {:d}\n", stats.data_hashed_block_num);
+		fmt::print("    Reused Blocks:         {:d} (re-read without hashing)\n", stats.data_reused_block_num);
+		fmt::print("    Hash Layer Reads:      {:d} (lookups from cache: {:d})\n", stats.hash_block_read_num, stats.hash_block_reused_num);
+		if (stats.invalidate_num != 0)
+			fmt::print("    Invalidated:           {:d} time(s)\n", stats.invalidate_num);
+	}
+}
+
+void nstool::NcaProcess::invalidatePartitionCaches()
+{
+	// readers still using a cache must not trust blocks verified against the previous input
+	for (auto itr = mHashTreeCaches.begin(); itr != mHashTreeCaches.end(); itr++)
+	{
+		if (*itr != nullptr)
+		{
+			(*itr)->invalidate();
+			itr->reset();
+		}
+	}
+
+	for (auto itr = mStorageTables.begin(); itr != mStorageTables.end(); itr++)
+	{
+		itr->indirect.reset();
+		itr->aes_ctr_ex.reset();
+		itr->sparse.reset();
+		itr->compression.reset();
+	}
+
+	for (auto itr = mCompressionCaches.begin(); itr != mCompressionCaches.end(); itr++)
+	{
+		itr->reset();
+	}
+}
+
+tc::io::VirtualFileSystem::FileSystemSnapshot nstool::NcaProcess::generateCombinedFsSnapshot(bool show_warnings) const
 {
 	std::vector<pie::hac::CombinedFsSnapshotGenerator::MountPointInfo> mount_points;
 
 	for (size_t i = 0; i < mHdr.getPartitionEntryList().size(); i++)
 	{
 		uint32_t index = mHdr.getPartitionEntryList()[i].header_index;
-		struct sPartitionInfo& partition = mPartitions[index];
+		const struct sPartitionInfo& partition = mPartitions[index];
 
 		// if the reader is null, skip
 		if (partition.fs_reader == nullptr)
 		{
-			fmt::print("[WARNING] NCA Partition {:d} not readable.", index);
-			if (partition.fail_reason.empty() == false)
+			if (show_warnings)
 			{
-				fmt::print(" ({:s})", partition.fail_reason);
+				fmt::print("[WARNING] NCA Partition {:d} not readable.", index);
+				if (partition.fail_reason.empty() == false)
+				{
+					fmt::print(" ({:s})", partition.fail_reason);
+				}
+				fmt::print("\n");
 			}
-			fmt::print("\n");
 			continue;
 		}
 
@@ -622,14 +1123,179 @@ void nstool::NcaProcess::processPartitions()
 		mount_points.push_back( { mount_point_name, partition.fs_snapshot } );
 	}
 
-	tc::io::VirtualFileSystem::FileSystemSnapshot fs_snapshot = pie::hac::CombinedFsSnapshotGenerator(mount_points);
+	return pie::hac::CombinedFsSnapshotGenerator(mount_points);
+}
 
-	std::shared_ptr<tc::io::IFileSystem> nca_fs = std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(fs_snapshot));
+void nstool::NcaProcess::generateFileLayout(std::map<tc::io::Path, nstool::FileExtent>& layout) const
+{
+	for (size_t i = 0; i < mHdr.getPartitionEntryList().size(); i++)
+	{
+		uint32_t index = mHdr.getPartitionEntryList()[i].header_index;
+		const struct sPartitionInfo& partition = mPartitions[index];
 
-	mFsProcess.setInputFileSystem(nca_fs);
-	mFsProcess.setFsFormatName("ContentArchive");
-	mFsProcess.setFsRootLabel(getContentTypeForMountStr(mHdr.getContentType()));
-	mFsProcess.process();
+		// only partitions where the filesystem data is one contiguous range of the NCA can be mapped
+		if (partition.fs_reader == nullptr || partition.sparse_info.generation != 0 || mStorageTables[index].compression != nullptr || (partition.enc_type != pie::hac::nca::EncryptionType_None && partition.enc_type != pie::hac::nca::EncryptionType_AesCtr))
+		{
+			continue;
+		}
+
+		// determine offset of the filesystem data layer within the partition
+		int64_t data_offset = 0;
+		if (getDataLayerOffset(partition, data_offset) == false)
+		{
+			continue;
+		}
+
+		// get file locations within the filesystem
+		tc::io::Path mount_path = tc::io::Path("/") + fmt::format("{:d}", index);
+		std::map<tc::io::Path, nstool::FileExtent> fs_layout;
+		try {
+			if (partition.format_type == pie::hac::nca::FormatType_PartitionFs)
+			{
+				tc::ByteData scratch = tc::ByteData(sizeof(pie::hac::sPfsHeader));
+				partition.reader->seek(0, tc::io::SeekOrigin::Begin);
+				partition.reader->read(scratch.data(), scratch.size());
+				if (PfsProcess::validateHeaderMagic((pie::hac::sPfsHeader*)scratch.data()) == false)
+				{
+					continue;
+				}
+
+				scratch = tc::ByteData(PfsProcess::determineHeaderSize((pie::hac::sPfsHeader*)scratch.data()));
+				partition.reader->seek(0, tc::io::SeekOrigin::Begin);
+				partition.reader->read(scratch.data(), scratch.size());
+
+				pie::hac::PartitionFsHeader pfs_hdr;
+				pfs_hdr.fromBytes(scratch.data(), scratch.size());
+				for (auto itr = pfs_hdr.getFileList().begin(); itr != pfs_hdr.getFileList().end(); itr++)
+				{
+					fs_layout[mount_path + itr->name] = { itr->offset, itr->size, true };
+				}
+			}
+			else if (partition.format_type == pie::hac::nca::FormatType_RomFs)
+			{
+				RomfsProcess::generateFileLayout(partition.reader, mount_path, fs_layout);
+			}
+		}
+		catch (const tc::Exception&) {
+			// the layout is optional, files will just be extracted in listing order
+			continue;
+		}
+
+		// translate to offsets within the NCA, data is only stored as is if there is no encryption or hash layer to process
+		bool is_plaintext = partition.enc_type == pie::hac::nca::EncryptionType_None && partition.hash_type == pie::hac::nca::HashType_None;
+		for (auto itr = fs_layout.begin(); itr != fs_layout.end(); itr++)
+		{
+			layout[itr->first] = { partition.offset + data_offset + itr->second.offset, itr->second.size, is_plaintext };
+		}
+	}
+}
+
+nstool::FsProcess::ExtractFileFilter nstool::NcaProcess::generateChangedFileFilter() const
+{
+	// when the cli output is disabled (e.g. an archive is written to stdout), results are reported on stderr
+	FILE* log = mCliOutputMode.show_basic_info ? stdout : stderr;
+
+	// files of patch partitions that are entirely relocated from the base NCA are unchanged by the patch
+	std::shared_ptr<std::set<tc::io::Path>> unchanged_files = std::make_shared<std::set<tc::io::Path>>();
+
+	bool has_patch_partition = false;
+	for (size_t i = 0; i < mHdr.getPartitionEntryList().size(); i++)
+	{
+		uint32_t index = mHdr.getPartitionEntryList()[i].header_index;
+		const struct sPartitionInfo& partition = mPartitions[index];
+		std::shared_ptr<BucketTree> indirect_table = mStorageTables[index].indirect;
+		if (partition.fs_reader == nullptr || indirect_table == nullptr || partition.format_type != pie::hac::nca::FormatType_RomFs)
+		{
+			continue;
+		}
+		has_patch_partition = true;
+
+		// get file locations within the patched partition
+		int64_t data_offset = 0;
+		std::map<tc::io::Path, nstool::FileExtent> fs_layout;
+		try {
+			if (getDataLayerOffset(partition, data_offset) == false)
+			{
+				throw tc::Exception(fmt::format("HashType({:s}) is not supported", pie::hac::ContentArchiveUtil::getHashTypeAsString(partition.hash_type)));
+			}
+			if (mStorageTables[index].compression != nullptr)
+			{
+				throw tc::Exception("CompressedStorage is not supported");
+			}
+			RomfsProcess::generateFileLayout(partition.reader, tc::io::Path("/") + fmt::format("{:d}", index), fs_layout);
+		}
+		catch (const tc::Exception& e) {
+			fmt::print(log, "[WARNING] NCA Partition {:d} files could not be located, all files will be extracted ({:s})\n", index, e.error());
+			continue;
+		}
+
+		// a file is changed if any of its data is read from the patch NCA (empty files are treated as changed, as they may be new)
+		size_t changed_file_num = 0, unchanged_file_num = 0;
+		int64_t changed_size = 0, unchanged_size = 0;
+		for (auto itr = fs_layout.begin(); itr != fs_layout.end(); itr++)
+		{
+			int64_t file_begin = data_offset + itr->second.offset;
+			int64_t file_end = file_begin + itr->second.size;
+
+			bool is_changed = itr->second.size == 0 || file_begin < indirect_table->getBeginOffset() || file_end > indirect_table->getEndOffset();
+			if (is_changed == false)
+			{
+				for (size_t entry_index = indirect_table->find(file_begin); entry_index < indirect_table->getEntryNum() && indirect_table->getEntryBeginOffset(entry_index) < file_end; entry_index++)
+				{
+					IndirectStream::sEntry entry;
+					memcpy(&entry, indirect_table->getEntry(entry_index), sizeof(IndirectStream::sEntry));
+					if (entry.storage_index.unwrap() != IndirectStream::StorageIndex_Base)
+					{
+						is_changed = true;
+						break;
+					}
+				}
+			}
+
+			if (is_changed)
+			{
+				changed_file_num++;
+				changed_size += itr->second.size;
+			}
+			else
+			{
+				unchanged_files->insert(itr->first);
+				unchanged_file_num++;
+				unchanged_size += itr->second.size;
+			}
+		}
+
+		fmt::print(log, "[NCA Changed Files]\n");
+		fmt::print(log, "  Partition {:d}:\n", index);
+		fmt::print(log, "    Changed Files:   {:d} (0x{:x} bytes)\n", changed_file_num, changed_size);
+		fmt::print(log, "    Unchanged Files: {:d} (0x{:x} bytes, skipped)\n", unchanged_file_num, unchanged_size);
+	}
+
+	if (has_patch_partition == false)
+	{
+		fmt::print(log, "[WARNING] NCA has no patch partitions, so all files will be extracted (--changed-only requires an update NCA and --basenca)\n");
+	}
+
+	return [unchanged_files](const tc::io::Path& path) { return unchanged_files->find(path) == unchanged_files->end(); };
+}
+
+bool nstool::NcaProcess::getDataLayerOffset(const sPartitionInfo& partition, int64_t& offset) const
+{
+	offset = 0;
+	if (partition.hash_type == pie::hac::nca::HashType_HierarchicalSha256 && partition.hierarchicalsha256_hdr.getLayerInfo().empty() == false)
+	{
+		offset = partition.hierarchicalsha256_hdr.getLayerInfo().back().offset;
+	}
+	else if (partition.hash_type == pie::hac::nca::HashType_HierarchicalIntegrity && partition.hierarchicalintegrity_hdr.getLayerInfo().empty() == false)
+	{
+		offset = partition.hierarchicalintegrity_hdr.getLayerInfo().back().offset;
+	}
+	else if (partition.hash_type != pie::hac::nca::HashType_None)
+	{
+		return false;
+	}
+
+	return true;
 }
 
 std::string nstool::NcaProcess::getContentTypeForMountStr(pie::hac::nca::ContentType cont_type) const
@@ -662,4 +1328,81 @@ std::string nstool::NcaProcess::getContentTypeForMountStr(pie::hac::nca::Content
 	}
 
 	return str;
+}
+
+nstool::NcaProcess::BaseNcaCache::BaseNcaCache() :
+	mModuleLabel("nstool::NcaProcess::BaseNcaCache"),
+	mMutex(),
+	mEntries()
+{
+}
+
+std::shared_ptr<tc::io::IStream> nstool::NcaProcess::BaseNcaCache::getRomFsReader(const tc::io::Path& path, const KeyBag& keycfg, uint64_t& program_id)
+{
+	// each reader opens the base nca itself (so readers don't contend for one file stream), the header is read to identify it
+	// the header hash is part of the key, so a base NCA that was replaced at the same path isn't mistaken for the cached one
+	NcaProcess obj;
+	obj.setCliOutputMode(CliOutputMode(false, false, false, false));
+	obj.setVerifyMode(true);
+	obj.setKeyCfg(keycfg);
+	obj.setInputFile(std::make_shared<tc::io::FileStream>(tc::io::FileStream(path, tc::io::FileMode::Open, tc::io::FileAccess::Read)));
+	obj.importHeader();
+	auto cache_key = std::make_pair(path, obj.mHdrHash);
+
+	std::shared_ptr<NcaProcess> nca_template;
+	size_t romfs_index;
+	{
+		// the lock is held while a base NCA is processed, so concurrent requests for the same base NCA only process it once
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto itr = mEntries.find(cache_key);
+		if (itr == mEntries.end())
+		{
+			// process base nca (only the partition readers are needed, so the combined file system isn't processed)
+			obj.generateNcaBodyEncryptionKeys();
+			obj.generatePartitionConfiguration();
+			obj.validateNcaSignatures();
+
+			sEntry entry;
+			entry.program_id = obj.mHdr.getProgramId();
+			entry.romfs_index = obj.mPartitions.size();
+			for (size_t i = 0; i < obj.mPartitions.size(); i++)
+			{
+				if (obj.mPartitions[i].format_type == pie::hac::nca::FormatType::FormatType_RomFs && obj.mPartitions[i].raw_reader != nullptr)
+				{
+					entry.romfs_index = i;
+				}
+			}
+			if (entry.romfs_index == obj.mPartitions.size())
+			{
+				throw tc::Exception(mModuleLabel, "Cannot determine RomFs from base nca.");
+			}
+
+			// keep only what is needed to create more readers, all of which is immutable once imported
+			entry.nca_template = std::make_shared<NcaProcess>();
+			entry.nca_template->mKeyCfg = obj.mKeyCfg;
+			entry.nca_template->mHdrBlock = obj.mHdrBlock;
+			entry.nca_template->mHdrHash = obj.mHdrHash;
+			entry.nca_template->mHdr = obj.mHdr;
+			entry.nca_template->mContentKey = obj.mContentKey;
+			entry.nca_template->mHashTreeCaches = obj.mHashTreeCaches;
+			entry.nca_template->mStorageTables = obj.mStorageTables;
+			entry.nca_template->mCompressionCaches = obj.mCompressionCaches;
+			mEntries.insert(std::make_pair(cache_key, entry));
+
+			program_id = entry.program_id;
+			return obj.mPartitions[entry.romfs_index].decrypt_reader;
+		}
+
+		program_id = itr->second.program_id;
+		nca_template = itr->second.nca_template;
+		romfs_index = itr->second.romfs_index;
+	}
+
+	// otherwise build the decryption streams on this reader's file stream, sharing the imported tables and keys
+	NcaProcess reader = *nca_template;
+	reader.mFile = obj.mFile;
+	reader.generatePartitionConfiguration();
+
+	return reader.mPartitions[romfs_index].decrypt_reader;
 }
\ No newline at end of file
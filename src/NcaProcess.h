@@ -1,7 +1,11 @@
 #pragma once
 #include "types.h"
 #include "KeyBag.h"
+#include "SignatureCache.h"
 #include "FsProcess.h"
+#include "HashTreeStream.h"
+#include "BucketTree.h"
+#include "CompressedStream.h"
 
 #include <pietendo/hac/ContentArchiveHeader.h>
 #include <pietendo/hac/HierarchicalIntegrityHeader.h>
@@ -12,22 +16,60 @@ namespace nstool {
 class NcaProcess
 {
 public:
+	// base NCAs processed for AesCtrEx (update) partitions, so a base NCA shared by several NCAs (or readers of one NCA) is only processed once
+	class BaseNcaCache
+	{
+	public:
+		BaseNcaCache();
+
+		// get a reader for the (decrypted) RomFs partition of a base NCA, processing the base NCA if it isn't cached
+		std::shared_ptr<tc::io::IStream> getRomFsReader(const tc::io::Path& path, const KeyBag& keycfg, uint64_t& program_id);
+	private:
+		std::string mModuleLabel;
+		std::mutex mMutex;
+
+		struct sEntry
+		{
+			uint64_t program_id;
+			size_t romfs_index;
+
+			// the processed base NCA (keys, header and storage tables), each reader is created from a copy of it with its own file stream
+			std::shared_ptr<NcaProcess> nca_template;
+		};
+
+		// base NCAs by path and header hash
+		std::map<std::pair<tc::io::Path, pie::hac::detail::sha256_hash_t>, sEntry> mEntries;
+	};
+
 	NcaProcess();
 
 	void process();
 
 	// generic
 	void setInputFile(const std::shared_ptr<tc::io::IStream>& file);
+	void setInputFilePath(const tc::io::Path& path);
 	void setKeyCfg(const KeyBag& keycfg);
 	void setCliOutputMode(CliOutputMode type);
 	void setVerifyMode(bool verify);
+	void setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache);
+	void setVerifyDataMode(bool verify_data);
 	void setBaseNcaPath(const tc::Optional<tc::io::Path>& nca_path);
+	void setPlaintextNcaPath(const tc::Optional<tc::io::Path>& out_path);
+	void setBaseNcaCache(const std::shared_ptr<BaseNcaCache>& base_nca_cache);
 
 
 	// fs specific
 	void setShowFsTree(bool show_fs_tree);
 	void setFsRootLabel(const std::string& root_label);
 	void setExtractJobs(const std::vector<nstool::ExtractJob>& extract_jobs);
+	void setShowExtractPlan(bool show_extract_plan);
+	void setResumeMode(bool resume);
+	void setDedupeMode(bool dedupe);
+	void setMappedOutputMode(bool mapped_output);
+	void setIoQueueDepth(size_t io_queue_depth);
+	void setExtractFormat(nstool::ExtractFormat extract_format);
+	void setThreadNum(size_t thread_num);
+	void setChangedOnlyMode(bool changed_only);
 
 	// post process() get FS out
 	const std::shared_ptr<tc::io::IFileSystem>& getFileSystem() const;
@@ -38,10 +80,37 @@ private:
 
 	// user options
 	std::shared_ptr<tc::io::IStream> mFile;
+	tc::Optional<tc::io::Path> mFilePath;
 	KeyBag mKeyCfg;
 	CliOutputMode mCliOutputMode;
 	bool mVerify;
+	std::shared_ptr<SignatureCache> mSignatureCache;
+	bool mVerifyData;
 	tc::Optional<tc::io::Path> mBaseNcaPath;
+	std::shared_ptr<BaseNcaCache> mBaseNcaCache;
+	tc::Optional<tc::io::Path> mPlaintextNcaPath;
+	bool mChangedOnly;
+	size_t mIoQueueDepth;
+
+	// partition decryption
+	size_t mThreadNum;
+	std::shared_ptr<ThreadPool> mDecryptThreadPool;
+
+	// verified hash-tree blocks of each partition, shared by all readers of the partition
+	std::array<std::shared_ptr<HashTreeStream::Cache>, pie::hac::nca::kPartitionNum> mHashTreeCaches;
+
+	// storage tables of each patch (AesCtrEx), sparse or compressed partition, imported once and shared by all readers of the partition
+	struct sStorageTables
+	{
+		std::shared_ptr<BucketTree> indirect;
+		std::shared_ptr<BucketTree> aes_ctr_ex;
+		std::shared_ptr<BucketTree> sparse;
+		std::shared_ptr<BucketTree> compression;
+	};
+	std::array<sStorageTables, pie::hac::nca::kPartitionNum> mStorageTables;
+
+	// decompressed blocks of each compressed partition, shared by all readers of the partition
+	std::array<std::shared_ptr<CompressedStream::Cache>, pie::hac::nca::kPartitionNum> mCompressionCaches;
 
 	// fs processing
 	std::shared_ptr<tc::io::IFileSystem> mFileSystem;
@@ -86,11 +155,18 @@ private:
 		std::vector<sKeyAreaKey> kak_list;
 
 		tc::Optional<pie::hac::detail::aes128_key_t> aes_ctr;
+		tc::Optional<pie::hac::detail::aes128_xtskey_t> aes_xts;
+
+		// key schedules of the content keys, expanded once and shared by every partition stream
+		AesKeySchedule aes_ctr_schedule;
+		std::array<AesKeySchedule, 2> aes_xts_schedule;
 	} mContentKey;
 
 	struct SparseInfo
 	{
-
+		uint16_t generation; // non-zero if the partition is sparse
+		int64_t physical_offset; // offset of the stored data (and SparseStorage table) in the NCA
+		int64_t physical_size;
 	};
 
 	// raw partition data
@@ -128,10 +204,18 @@ private:
 	void generateNcaBodyEncryptionKeys();
 	void generatePartitionConfiguration();
 	void validateNcaSignatures();
+	void validatePartitionData();
+	void displayHashTreeCacheStats();
+	void invalidatePartitionCaches();
 	void displayHeader();
+	void exportPlaintextNca();
 	void processPartitions();
+	tc::io::VirtualFileSystem::FileSystemSnapshot generateCombinedFsSnapshot(bool show_warnings) const;
+	void generateFileLayout(std::map<tc::io::Path, nstool::FileExtent>& layout) const;
+	FsProcess::ExtractFileFilter generateChangedFileFilter() const;
+	bool getDataLayerOffset(const sPartitionInfo& partition, int64_t& offset) const;
 
-	NcaProcess readBaseNCA();
+	std::shared_ptr<tc::io::IStream> readBaseNcaRomFs();
 
 	std::string getContentTypeForMountStr(pie::hac::nca::ContentType cont_type) const;
 };
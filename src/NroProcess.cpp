@@ -72,6 +72,41 @@ void nstool::NroProcess::setAssetRomfsExtractJobs(const std::vector<nstool::Extr
 	mAssetProc.setRomfsExtractJobs(extract_jobs);
 }
 
+void nstool::NroProcess::setAssetRomfsShowExtractPlan(bool show_extract_plan)
+{
+	mAssetProc.setRomfsShowExtractPlan(show_extract_plan);
+}
+
+void nstool::NroProcess::setAssetRomfsResumeMode(bool resume)
+{
+	mAssetProc.setRomfsResumeMode(resume);
+}
+
+void nstool::NroProcess::setAssetRomfsDedupeMode(bool dedupe)
+{
+	mAssetProc.setRomfsDedupeMode(dedupe);
+}
+
+void nstool::NroProcess::setAssetRomfsMappedOutputMode(bool mapped_output)
+{
+	mAssetProc.setRomfsMappedOutputMode(mapped_output);
+}
+
+void nstool::NroProcess::setAssetRomfsIoQueueDepth(size_t io_queue_depth)
+{
+	mAssetProc.setRomfsIoQueueDepth(io_queue_depth);
+}
+
+void nstool::NroProcess::setAssetRomfsExtractFormat(nstool::ExtractFormat extract_format)
+{
+	mAssetProc.setRomfsExtractFormat(extract_format);
+}
+
+void nstool::NroProcess::setAssetRomfsThreadNum(size_t thread_num)
+{
+	mAssetProc.setRomfsThreadNum(thread_num);
+}
+
 const nstool::RoMetadataProcess& nstool::NroProcess::getRoMetadataProcess() const
 {
 	return mRoMeta;
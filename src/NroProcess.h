@@ -27,6 +27,13 @@ public:
 	void setAssetNacpExtractPath(const tc::io::Path& path);
 	void setAssetRomfsShowFsTree(bool show_fs_tree);
 	void setAssetRomfsExtractJobs(const std::vector<nstool::ExtractJob>& extract_jobs);
+	void setAssetRomfsShowExtractPlan(bool show_extract_plan);
+	void setAssetRomfsResumeMode(bool resume);
+	void setAssetRomfsDedupeMode(bool dedupe);
+	void setAssetRomfsMappedOutputMode(bool mapped_output);
+	void setAssetRomfsIoQueueDepth(size_t io_queue_depth);
+	void setAssetRomfsExtractFormat(nstool::ExtractFormat extract_format);
+	void setAssetRomfsThreadNum(size_t thread_num);
 
 	const nstool::RoMetadataProcess& getRoMetadataProcess() const;
 private:
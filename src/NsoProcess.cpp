@@ -1,4 +1,5 @@
 #include "NsoProcess.h"
+#include "Sha256Generator.h"
 
 #include <lz4.h>
 
@@ -116,7 +117,7 @@ void nstool::NsoProcess::importCodeSegments()
 	}
 	if (mHdr.getTextSegmentInfo().is_hashed)
 	{
-		tc::crypto::GenerateSha2256Hash(calc_hash.data(), mTextBlob.data(), mTextBlob.size());
+		GenerateSha256Hash(calc_hash.data(), mTextBlob.data(), mTextBlob.size());
 		if (calc_hash != mHdr.getTextSegmentInfo().hash)
 		{
 			throw tc::Exception(mModuleName, "NSO text segment failed SHA256 verification");
@@ -149,7 +150,7 @@ void nstool::NsoProcess::importCodeSegments()
 	}
 	if (mHdr.getRoSegmentInfo().is_hashed)
 	{
-		tc::crypto::GenerateSha2256Hash(calc_hash.data(), mRoBlob.data(), mRoBlob.size());
+		GenerateSha256Hash(calc_hash.data(), mRoBlob.data(), mRoBlob.size());
 		if (calc_hash != mHdr.getRoSegmentInfo().hash)
 		{
 			throw tc::Exception(mModuleName, "NSO ro segment failed SHA256 verification");
@@ -182,7 +183,7 @@ void nstool::NsoProcess::importCodeSegments()
 	}
 	if (mHdr.getDataSegmentInfo().is_hashed)
 	{
-		tc::crypto::GenerateSha2256Hash(calc_hash.data(), mDataBlob.data(), mDataBlob.size());
+		GenerateSha256Hash(calc_hash.data(), mDataBlob.data(), mDataBlob.size());
 		if (calc_hash != mHdr.getDataSegmentInfo().hash)
 		{
 			throw tc::Exception(mModuleName, "NSO data segment failed SHA256 verification");
@@ -1,5 +1,6 @@
 #include "PfsProcess.h"
 #include "util.h"
+#include "SharedStream.h"
 
 #include <pietendo/hac/PartitionFsUtil.h>
 #include <tc/io/LocalFileSystem.h>
@@ -11,6 +12,7 @@
 nstool::PfsProcess::PfsProcess() :
 	mModuleName("nstool::PfsProcess"),
 	mFile(),
+	mFilePath(),
 	mCliOutputMode(true, false, false, false),
 	mVerify(false),
 	mPfs(),
@@ -65,6 +67,24 @@ void nstool::PfsProcess::process()
 	mFileSystem = std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(pie::hac::PartitionFsSnapshotGenerator(mFile, mVerify ? pie::hac::PartitionFsSnapshotGenerator::ValidationMode_Warn : pie::hac::PartitionFsSnapshotGenerator::ValidationMode_None)));
 	mFsProcess.setInputFileSystem(mFileSystem);
 
+	// allow FsProcess to open more readers for concurrent extraction
+	std::shared_ptr<SharedStream> shared_file = std::make_shared<SharedStream>(mFile);
+	mFsProcess.setInputFileSystemFactory([shared_file]() -> std::shared_ptr<tc::io::IFileSystem> {
+		return std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(pie::hac::PartitionFsSnapshotGenerator(shared_file->clone(), pie::hac::PartitionFsSnapshotGenerator::ValidationMode_None)));
+	});
+
+	// tell FsProcess where each file is stored, if the input is a local file files can also be copied straight from it
+	std::map<tc::io::Path, nstool::FileExtent> file_layout;
+	for (auto itr = mPfs.getFileList().begin(); itr != mPfs.getFileList().end(); itr++)
+	{
+		file_layout[tc::io::Path("/") + itr->name] = { itr->offset, itr->size, true };
+	}
+	mFsProcess.setInputFileLayout(file_layout);
+	if (mFilePath.isSet())
+	{
+		mFsProcess.setInputFilePath(mFilePath.get());
+	}
+
 	// set properties for FsProcess
 	mFsProcess.setFsProperties({
 		fmt::format("Type:        {:s}", pie::hac::PartitionFsUtil::getFsTypeAsString(mPfs.getFsType())), 
@@ -79,6 +99,11 @@ void nstool::PfsProcess::setInputFile(const std::shared_ptr<tc::io::IStream>& fi
 	mFile = file;
 }
 
+void nstool::PfsProcess::setInputFilePath(const tc::io::Path& path)
+{
+	mFilePath = path;
+}
+
 void nstool::PfsProcess::setCliOutputMode(CliOutputMode type)
 {
 	mCliOutputMode = type;
@@ -105,6 +130,41 @@ void nstool::PfsProcess::setExtractJobs(const std::vector<nstool::ExtractJob>& e
 	mFsProcess.setExtractJobs(extract_jobs);
 }
 
+void nstool::PfsProcess::setShowExtractPlan(bool show_extract_plan)
+{
+	mFsProcess.setShowExtractPlan(show_extract_plan);
+}
+
+void nstool::PfsProcess::setResumeMode(bool resume)
+{
+	mFsProcess.setResumeMode(resume);
+}
+
+void nstool::PfsProcess::setDedupeMode(bool dedupe)
+{
+	mFsProcess.setDedupeMode(dedupe);
+}
+
+void nstool::PfsProcess::setMappedOutputMode(bool mapped_output)
+{
+	mFsProcess.setMappedOutputMode(mapped_output);
+}
+
+void nstool::PfsProcess::setIoQueueDepth(size_t io_queue_depth)
+{
+	mFsProcess.setIoQueueDepth(io_queue_depth);
+}
+
+void nstool::PfsProcess::setExtractFormat(nstool::ExtractFormat extract_format)
+{
+	mFsProcess.setExtractFormat(extract_format);
+}
+
+void nstool::PfsProcess::setThreadNum(size_t thread_num)
+{
+	mFsProcess.setThreadNum(thread_num);
+}
+
 const pie::hac::PartitionFsHeader& nstool::PfsProcess::getPfsHeader() const
 {
 	return mPfs;
@@ -15,6 +15,7 @@ public:
 
 	// generic
 	void setInputFile(const std::shared_ptr<tc::io::IStream>& file);
+	void setInputFilePath(const tc::io::Path& path);
 	void setCliOutputMode(CliOutputMode type);
 	void setVerifyMode(bool verify);
 
@@ -22,6 +23,17 @@ public:
 	void setShowFsTree(bool show_fs_tree);
 	void setFsRootLabel(const std::string& root_label);
 	void setExtractJobs(const std::vector<nstool::ExtractJob>& extract_jobs);
+	void setShowExtractPlan(bool show_extract_plan);
+	void setResumeMode(bool resume);
+	void setDedupeMode(bool dedupe);
+	void setMappedOutputMode(bool mapped_output);
+	void setIoQueueDepth(size_t io_queue_depth);
+	void setExtractFormat(nstool::ExtractFormat extract_format);
+	void setThreadNum(size_t thread_num);
+
+	// header utils
+	static size_t determineHeaderSize(const pie::hac::sPfsHeader* hdr);
+	static bool validateHeaderMagic(const pie::hac::sPfsHeader* hdr);
 
 	// post process() get PFS/FS out
 	const pie::hac::PartitionFsHeader& getPfsHeader() const;
@@ -33,6 +45,7 @@ private:
 	std::string mModuleName;
 
 	std::shared_ptr<tc::io::IStream> mFile;
+	tc::Optional<tc::io::Path> mFilePath;
 	CliOutputMode mCliOutputMode;
 	bool mVerify;
 
@@ -40,9 +53,6 @@ private:
 
 	std::shared_ptr<tc::io::IFileSystem> mFileSystem;
 	FsProcess mFsProcess;
-	
-	size_t determineHeaderSize(const pie::hac::sPfsHeader* hdr);
-	bool validateHeaderMagic(const pie::hac::sPfsHeader* hdr);
 };
 
 }
\ No newline at end of file
@@ -5,7 +5,8 @@
 #include <pietendo/hac/es/SignUtils.h>
 
 nstool::PkiValidator::PkiValidator() :
-	mModuleName("nstool::PkiValidator")
+	mModuleName("nstool::PkiValidator"),
+	mSignatureCache()
 {
 	clearCertificates();
 }
@@ -28,6 +29,11 @@ void nstool::PkiValidator::setKeyCfg(const KeyBag& keycfg)
 	}
 }
 
+void nstool::PkiValidator::setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache)
+{
+	mSignatureCache = sig_cache;
+}
+
 void nstool::PkiValidator::addCertificates(const std::vector<pie::hac::es::SignedData<pie::hac::es::CertificateBody>>& certs)
 {
 	for (size_t i = 0; i < certs.size(); i++)
@@ -145,19 +151,19 @@ void nstool::PkiValidator::validateSignature(const std::string& issuer, pie::hac
 	// verify signature
 	switch (signature_id) {
 		case (pie::hac::es::sign::SIGN_ID_RSA4096_SHA1):
-			sig_valid = tc::crypto::VerifyRsa4096Pkcs1Sha1(signature.data(), hash.data(), rsa_key);
+			sig_valid = VerifySignature(mSignatureCache, SignatureCache::SIGN_RSA4096_PKCS1_SHA1, signature.data(), hash.data(), rsa_key);
 			break;
 		case (pie::hac::es::sign::SIGN_ID_RSA2048_SHA1):
-			sig_valid = tc::crypto::VerifyRsa2048Pkcs1Sha1(signature.data(), hash.data(), rsa_key);
+			sig_valid = VerifySignature(mSignatureCache, SignatureCache::SIGN_RSA2048_PKCS1_SHA1, signature.data(), hash.data(), rsa_key);
 			break;
 		case (pie::hac::es::sign::SIGN_ID_ECDSA240_SHA1):
 			sig_valid = false;
 			break;
 		case (pie::hac::es::sign::SIGN_ID_RSA4096_SHA256):
-			sig_valid = tc::crypto::VerifyRsa4096Pkcs1Sha2256(signature.data(), hash.data(), rsa_key);
+			sig_valid = VerifySignature(mSignatureCache, SignatureCache::SIGN_RSA4096_PKCS1_SHA256, signature.data(), hash.data(), rsa_key);
 			break;
 		case (pie::hac::es::sign::SIGN_ID_RSA2048_SHA256):
-			sig_valid = tc::crypto::VerifyRsa2048Pkcs1Sha2256(signature.data(), hash.data(), rsa_key);
+			sig_valid = VerifySignature(mSignatureCache, SignatureCache::SIGN_RSA2048_PKCS1_SHA256, signature.data(), hash.data(), rsa_key);
 			break;
 		case (pie::hac::es::sign::SIGN_ID_ECDSA240_SHA256):
 			sig_valid = false;
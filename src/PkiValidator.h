@@ -1,6 +1,7 @@
 #pragma once
 #include "types.h"
 #include "KeyBag.h"
+#include "SignatureCache.h"
 
 #include <pietendo/hac/es/SignedData.h>
 #include <pietendo/hac/es/CertificateBody.h>
@@ -13,6 +14,7 @@ public:
 	PkiValidator();
 
 	void setKeyCfg(const KeyBag& keycfg);
+	void setSignatureCache(const std::shared_ptr<SignatureCache>& sig_cache);
 	void addCertificates(const std::vector<pie::hac::es::SignedData<pie::hac::es::CertificateBody>>& certs);
 	void addCertificate(const pie::hac::es::SignedData<pie::hac::es::CertificateBody>& cert);
 	void clearCertificates();
@@ -23,6 +25,7 @@ private:
 	std::string mModuleName;
 
 	KeyBag mKeyCfg;
+	std::shared_ptr<SignatureCache> mSignatureCache;
 	std::vector<pie::hac::es::SignedData<pie::hac::es::CertificateBody>> mCertificateBank;
 
 	void makeCertIdent(const pie::hac::es::SignedData<pie::hac::es::CertificateBody>& cert, std::string& ident) const;
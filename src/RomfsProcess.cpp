@@ -1,5 +1,6 @@
 #include "RomfsProcess.h"
 #include "util.h"
+#include "SharedStream.h"
 
 #include <tc/io/VirtualFileSystem.h>
 #include <pietendo/hac/RomFsSnapshotGenerator.h>
@@ -8,6 +9,7 @@
 nstool::RomfsProcess::RomfsProcess() :
 	mModuleName("nstool::RomfsProcess"),
 	mFile(),
+	mFilePath(),
 	mCliOutputMode(true, false, false, false),
 	mVerify(false),
 	mDirNum(0),
@@ -111,6 +113,21 @@ void nstool::RomfsProcess::process()
 	mFileSystem = std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(pie::hac::RomFsSnapshotGenerator(mFile)));
 	mFsProcess.setInputFileSystem(mFileSystem);
 
+	// allow FsProcess to open more readers for concurrent extraction
+	std::shared_ptr<SharedStream> shared_file = std::make_shared<SharedStream>(mFile);
+	mFsProcess.setInputFileSystemFactory([shared_file]() -> std::shared_ptr<tc::io::IFileSystem> {
+		return std::make_shared<tc::io::VirtualFileSystem>(tc::io::VirtualFileSystem(pie::hac::RomFsSnapshotGenerator(shared_file->clone())));
+	});
+
+	// tell FsProcess where each file is stored, if the input is a local file files can also be copied straight from it
+	std::map<tc::io::Path, nstool::FileExtent> file_layout;
+	generateFileLayout(mFile, tc::io::Path("/"), file_layout);
+	mFsProcess.setInputFileLayout(file_layout);
+	if (mFilePath.isSet())
+	{
+		mFsProcess.setInputFilePath(mFilePath.get());
+	}
+
 	// set properties for FsProcess
 	mFsProcess.setFsProperties({
 		fmt::format("DirNum:      {:d}", mDirNum), 
@@ -126,6 +143,11 @@ void nstool::RomfsProcess::setInputFile(const std::shared_ptr<tc::io::IStream>&
 	mFile = file;
 }
 
+void nstool::RomfsProcess::setInputFilePath(const tc::io::Path& path)
+{
+	mFilePath = path;
+}
+
 void nstool::RomfsProcess::setCliOutputMode(CliOutputMode type)
 {
 	mCliOutputMode = type;
@@ -150,4 +172,136 @@ void nstool::RomfsProcess::setExtractJobs(const std::vector<nstool::ExtractJob>&
 void nstool::RomfsProcess::setShowFsTree(bool list_fs)
 {
 	mFsProcess.setShowFsTree(list_fs);
+}
+
+void nstool::RomfsProcess::setShowExtractPlan(bool show_extract_plan)
+{
+	mFsProcess.setShowExtractPlan(show_extract_plan);
+}
+
+void nstool::RomfsProcess::setResumeMode(bool resume)
+{
+	mFsProcess.setResumeMode(resume);
+}
+
+void nstool::RomfsProcess::setDedupeMode(bool dedupe)
+{
+	mFsProcess.setDedupeMode(dedupe);
+}
+
+void nstool::RomfsProcess::setMappedOutputMode(bool mapped_output)
+{
+	mFsProcess.setMappedOutputMode(mapped_output);
+}
+
+void nstool::RomfsProcess::setIoQueueDepth(size_t io_queue_depth)
+{
+	mFsProcess.setIoQueueDepth(io_queue_depth);
+}
+
+void nstool::RomfsProcess::setExtractFormat(nstool::ExtractFormat extract_format)
+{
+	mFsProcess.setExtractFormat(extract_format);
+}
+
+void nstool::RomfsProcess::setThreadNum(size_t thread_num)
+{
+	mFsProcess.setThreadNum(thread_num);
+}
+
+void nstool::RomfsProcess::generateFileLayout(const std::shared_ptr<tc::io::IStream>& romfs, const tc::io::Path& root_path, std::map<tc::io::Path, nstool::FileExtent>& layout)
+{
+	std::map<tc::io::Path, nstool::FileExtent> romfs_layout;
+
+	try {
+		// read header
+		pie::hac::sRomfsHeader hdr;
+		if (romfs->length() < tc::io::IOUtil::castSizeToInt64(sizeof(pie::hac::sRomfsHeader)))
+		{
+			return;
+		}
+		romfs->seek(0, tc::io::SeekOrigin::Begin);
+		romfs->read((byte_t*)&hdr, sizeof(hdr));
+		if (hdr.header_size.unwrap() != sizeof(pie::hac::sRomfsHeader))
+		{
+			return;
+		}
+
+		// read entry tables
+		tc::ByteData dir_entry_table = tc::ByteData(tc::io::IOUtil::castInt64ToSize(hdr.dir_entry.size.unwrap()));
+		romfs->seek(hdr.dir_entry.offset.unwrap(), tc::io::SeekOrigin::Begin);
+		romfs->read(dir_entry_table.data(), dir_entry_table.size());
+
+		tc::ByteData file_entry_table = tc::ByteData(tc::io::IOUtil::castInt64ToSize(hdr.file_entry.size.unwrap()));
+		romfs->seek(hdr.file_entry.offset.unwrap(), tc::io::SeekOrigin::Begin);
+		romfs->read(file_entry_table.data(), file_entry_table.size());
+
+		// get entry, if it is within the table
+		auto getDirEntry = [&dir_entry_table](uint32_t v_addr) -> const pie::hac::sRomfsDirEntry* {
+			if (size_t(v_addr) + sizeof(pie::hac::sRomfsDirEntry) > dir_entry_table.size())
+				return nullptr;
+			const pie::hac::sRomfsDirEntry* entry = (const pie::hac::sRomfsDirEntry*)(dir_entry_table.data() + v_addr);
+			if (size_t(v_addr) + sizeof(pie::hac::sRomfsDirEntry) + entry->name_size.unwrap() > dir_entry_table.size())
+				return nullptr;
+			return entry;
+		};
+		auto getFileEntry = [&file_entry_table](uint32_t v_addr) -> const pie::hac::sRomfsFileEntry* {
+			if (size_t(v_addr) + sizeof(pie::hac::sRomfsFileEntry) > file_entry_table.size())
+				return nullptr;
+			const pie::hac::sRomfsFileEntry* entry = (const pie::hac::sRomfsFileEntry*)(file_entry_table.data() + v_addr);
+			if (size_t(v_addr) + sizeof(pie::hac::sRomfsFileEntry) + entry->name_size.unwrap() > file_entry_table.size())
+				return nullptr;
+			return entry;
+		};
+
+		// walk directory tree from the root directory, the visit limit guards against corrupted (looping) tables
+		size_t visit_limit = (dir_entry_table.size() / sizeof(pie::hac::sRomfsDirEntry)) + (file_entry_table.size() / sizeof(pie::hac::sRomfsFileEntry));
+		std::vector<std::pair<uint32_t, tc::io::Path>> dir_queue = { std::make_pair(uint32_t(0), root_path) };
+		while (dir_queue.empty() == false && visit_limit > 0)
+		{
+			uint32_t dir_addr = dir_queue.back().first;
+			tc::io::Path dir_path = dir_queue.back().second;
+			dir_queue.pop_back();
+
+			const pie::hac::sRomfsDirEntry* dir_entry = getDirEntry(dir_addr);
+			if (dir_entry == nullptr)
+			{
+				return;
+			}
+
+			for (uint32_t file_addr = dir_entry->file.unwrap(); file_addr != kRomfsInvalidAddr && visit_limit > 0; visit_limit--)
+			{
+				const pie::hac::sRomfsFileEntry* file_entry = getFileEntry(file_addr);
+				if (file_entry == nullptr)
+				{
+					return;
+				}
+
+				std::string name = std::string((const char*)file_entry + sizeof(pie::hac::sRomfsFileEntry), file_entry->name_size.unwrap());
+				romfs_layout[dir_path + name] = { int64_t(hdr.data_offset.unwrap() + file_entry->offset.unwrap()), int64_t(file_entry->size.unwrap()), true };
+
+				file_addr = file_entry->sibling.unwrap();
+			}
+
+			for (uint32_t child_addr = dir_entry->child.unwrap(); child_addr != kRomfsInvalidAddr && visit_limit > 0; visit_limit--)
+			{
+				const pie::hac::sRomfsDirEntry* child_entry = getDirEntry(child_addr);
+				if (child_entry == nullptr)
+				{
+					return;
+				}
+
+				std::string name = std::string((const char*)child_entry + sizeof(pie::hac::sRomfsDirEntry), child_entry->name_size.unwrap());
+				dir_queue.push_back(std::make_pair(child_addr, dir_path + name));
+
+				child_addr = child_entry->sibling.unwrap();
+			}
+		}
+	}
+	catch (const tc::Exception&) {
+		// the layout is optional, files will just be extracted through the filesystem
+		return;
+	}
+
+	layout.insert(romfs_layout.begin(), romfs_layout.end());
 }
\ No newline at end of file
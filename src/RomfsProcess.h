@@ -15,19 +15,32 @@ public:
 
 	// generic
 	void setInputFile(const std::shared_ptr<tc::io::IStream>& file);
+	void setInputFilePath(const tc::io::Path& path);
 	void setCliOutputMode(CliOutputMode type);
 	void setVerifyMode(bool verify);
 
 	// fs specific
 	void setFsRootLabel(const std::string& root_label);
 	void setExtractJobs(const std::vector<nstool::ExtractJob>& extract_jobs);
+	void setShowExtractPlan(bool show_extract_plan);
+	void setResumeMode(bool resume);
+	void setDedupeMode(bool dedupe);
+	void setMappedOutputMode(bool mapped_output);
+	void setIoQueueDepth(size_t io_queue_depth);
+	void setExtractFormat(nstool::ExtractFormat extract_format);
 	void setShowFsTree(bool show_fs_tree);
+	void setThreadNum(size_t thread_num);
+
+	// add the location of each file's data (relative to the start of the RomFs) to layout, with paths under root_path
+	static void generateFileLayout(const std::shared_ptr<tc::io::IStream>& romfs, const tc::io::Path& root_path, std::map<tc::io::Path, nstool::FileExtent>& layout);
 private:
 	static const size_t kCacheSize = 0x10000;
+	static const uint32_t kRomfsInvalidAddr = 0xffffffff;
 
 	std::string mModuleName;
 
 	std::shared_ptr<tc::io::IStream> mFile;
+	tc::Optional<tc::io::Path> mFilePath;
 	CliOutputMode mCliOutputMode;
 	bool mVerify;
 
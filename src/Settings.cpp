@@ -2,12 +2,15 @@
 #include "types.h"
 #include "version.h"
 #include "util.h"
+#include "StdoutStream.h"
 
 #include <tc/cli.h>
 #include <tc/os/Environment.h>
 #include <tc/ArgumentException.h>
 #include <tc/io/FileStream.h>
 #include <tc/io/StreamSource.h>
+#include <thread>
+#include <algorithm>
 
 #include <pietendo/hac/ContentArchiveUtil.h>
 #include <pietendo/hac/AesKeygen.h>
@@ -442,6 +445,51 @@ private:
 	std::vector<std::string> mOptRegex;
 };
 
+class ExtractFormatOptionHandler : public tc::cli::OptionParser::IOptionHandler
+{
+public:
+	ExtractFormatOptionHandler(nstool::ExtractFormat& param, const std::vector<std::string>& opts) :
+		mParam(param),
+		mOptStrings(opts),
+		mOptRegex()
+	{}
+
+	const std::vector<std::string>& getOptionStrings() const
+	{
+		return mOptStrings;
+	}
+
+	const std::vector<std::string>& getOptionRegexPatterns() const
+	{
+		return mOptRegex;
+	}
+
+	void processOption(const std::string& option, const std::vector<std::string>& params)
+	{
+		if (params.size() != 1)
+		{
+			throw tc::ArgumentOutOfRangeException(fmt::format("Option \"{:s}\" requires a parameter.", option));
+		}
+
+		if (params[0] == "dir")
+		{
+			mParam = nstool::EXTRACT_FORMAT_DIR;
+		}
+		else if (params[0] == "tar")
+		{
+			mParam = nstool::EXTRACT_FORMAT_TAR;
+		}
+		else
+		{
+			throw tc::ArgumentException(fmt::format("Extract format \"{}\" unrecognised. Try \"dir\" or \"tar\"", params[0]));
+		}
+	}
+private:
+	nstool::ExtractFormat& mParam;
+	std::vector<std::string> mOptStrings;
+	std::vector<std::string> mOptRegex;
+};
+
 class ExtractDataPathOptionHandler : public tc::cli::OptionParser::IOptionHandler
 {
 public:
@@ -543,6 +591,11 @@ nstool::SettingsInitializer::SettingsInitializer(const std::vector<std::string>&
 {
 	// parse input arguments
 	parse_args(args);
+
+	// the benchmark doesn't process an input file or need keys
+	if (opt.benchmark)
+		return;
+
 	if (infile.path.isNull())
 		throw tc::ArgumentException(mModuleLabel, "No input file was specified.");
 
@@ -563,6 +616,22 @@ nstool::SettingsInitializer::SettingsInitializer(const std::vector<std::string>&
 		opt.cli_output_mode.show_layout = true;
 	}
 
+	// an archive written to stdout must not be mixed with other output
+	if (fs.extract_format == EXTRACT_FORMAT_TAR && std::find_if(fs.extract_jobs.begin(), fs.extract_jobs.end(), [](const ExtractJob& job) { return job.extract_path == tc::io::Path("-"); }) != fs.extract_jobs.end())
+	{
+		opt.cli_output_mode = CliOutputMode();
+		fs.show_fs_tree = false;
+
+		// warnings and errors are still printed, so they are sent to stderr
+		StdoutStream::reserveStdout();
+	}
+
+	// determine number of worker threads (0 means use all hardware threads)
+	if (opt.thread_num == 0)
+	{
+		opt.thread_num = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	}
+
 	// locate key file, if not specfied
 	if (mKeysetPath.isNull())
 	{
@@ -615,6 +684,16 @@ void nstool::SettingsInitializer::parse_args(const std::vector<std::string>& arg
 		}
 	}
 
+	// detect request for benchmark (no input file is required)
+	for (auto itr = ++(args.begin()); itr != args.end(); itr++)
+	{
+		if (*itr == "--benchmark")
+		{
+			opt.benchmark = true;
+			return;
+		}
+	}
+
 	// save input file
 	infile.path = tc::io::Path(args.back());
 
@@ -632,7 +711,12 @@ void nstool::SettingsInitializer::parse_args(const std::vector<std::string>& arg
 	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(mShowKeydata, { "--showkeys" })));
 	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(mVerbose, {"-v", "--verbose"})));
 	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(opt.verify, {"-y", "--verify"})));
+	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(opt.verify_data, {"--verify-data"})));
 	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(opt.is_dev, {"-d", "--dev"})));
+	opts.registerOptionHandler(std::shared_ptr<SingleParamSizetOptionHandler>(new SingleParamSizetOptionHandler(opt.thread_num, {"-j", "--jobs"})));
+	opts.registerOptionHandler(std::shared_ptr<SingleParamSizetOptionHandler>(new SingleParamSizetOptionHandler(opt.io_queue_depth, {"--iodepth"})));
+	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(opt.mmap_input, {"--mmap"})));
+	opts.registerOptionHandler(std::shared_ptr<SingleParamPathOptionHandler>(new SingleParamPathOptionHandler(opt.sig_cache_path, {"--sigcache"})));
 
 	// process input file type
 	opts.registerOptionHandler(std::shared_ptr<FileTypeOptionHandler>(new FileTypeOptionHandler(infile.filetype, { "-t", "--type" })));
@@ -654,6 +738,11 @@ void nstool::SettingsInitializer::parse_args(const std::vector<std::string>& arg
 	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(fs.show_fs_tree, { "--fstree", "--listfs" })));
 	opts.registerOptionHandler(std::shared_ptr<ExtractDataPathOptionHandler>(new ExtractDataPathOptionHandler(fs.extract_jobs, { "-x", "--extract" })));
 	opts.registerOptionHandler(std::shared_ptr<CustomExtractDataPathOptionHandler>(new CustomExtractDataPathOptionHandler(fs.extract_jobs, { "--fsdir" }, tc::io::Path("/"))));
+	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(fs.show_extract_plan, { "--plan" })));
+	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(fs.resume, { "--resume" })));
+	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(fs.dedupe, { "--dedupe" })));
+	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(fs.mmap_output, { "--mmap-out" })));
+	opts.registerOptionHandler(std::shared_ptr<ExtractFormatOptionHandler>(new ExtractFormatOptionHandler(fs.extract_format, { "--format" })));
 
 	// xci options
 	opts.registerOptionHandler(std::shared_ptr<CustomExtractDataPathOptionHandler>(new CustomExtractDataPathOptionHandler(fs.extract_jobs, { "--update" }, tc::io::Path("/update/"))));
@@ -668,6 +757,8 @@ void nstool::SettingsInitializer::parse_args(const std::vector<std::string>& arg
 	opts.registerOptionHandler(std::shared_ptr<CustomExtractDataPathOptionHandler>(new CustomExtractDataPathOptionHandler(fs.extract_jobs, { "--part3" }, tc::io::Path("/3/"))));
 
 	opts.registerOptionHandler(std::shared_ptr<SingleParamPathOptionHandler>(new SingleParamPathOptionHandler(nca.base_nca_path, { "--basenca" })));
+	opts.registerOptionHandler(std::shared_ptr<SingleParamPathOptionHandler>(new SingleParamPathOptionHandler(nca.plaintext_nca_path, { "--plaintext-nca" })));
+	opts.registerOptionHandler(std::shared_ptr<FlagOptionHandler>(new FlagOptionHandler(nca.changed_only, { "--changed-only" })));
 
 	// kip options
 	opts.registerOptionHandler(std::shared_ptr<SingleParamPathOptionHandler>(new SingleParamPathOptionHandler(kip.extract_path, { "--kipdir" })));
@@ -800,9 +891,15 @@ void nstool::SettingsInitializer::usage_text() const
 	fmt::print("Usage: {:s} [options... ] <file>\n", BIN_NAME);
 	fmt::print("\n  General Options:\n");
 	fmt::print("      -d, --dev       Use devkit keyset.\n");
+	fmt::print("      -j, --jobs      Number of threads used to extract files. (0 uses all hardware threads, 1 is the default)\n");
+	fmt::print("      --iodepth       Number of reads/writes kept in flight for each file using io_uring (Linux only). (0 is the default, which uses synchronous I/O)\n");
+	fmt::print("      --mmap          Read the input file through a memory mapping. (Not available on Windows)\n");
+	fmt::print("      --benchmark     Measure the throughput of each AES-CTR, AES-XTS and SHA-256 backend supported by this CPU, and of patch table lookups. (No input file is required)\n");
 	fmt::print("      -k, --keyset    Specify keyset file.\n");
 	fmt::print("      -t, --type      Specify input file type. [xci, pfs, romfs, nca, meta, cnmt, nso, nro, ini, kip, nacp, aset, cert, tik]\n");
 	fmt::print("      -y, --verify    Verify file.\n");
+	fmt::print("      --verify-data   Verify every block of the hash layers of each NCA partition. (Uses \"-j\" threads)\n");
+	fmt::print("      --sigcache      Specify a file to remember the results of RSA signature checks in, so files already verified are not verified again.\n");
 	fmt::print("\n  Output Options:\n");
 	fmt::print("      --showkeys      Show keys generated.\n");
 	fmt::print("      --showlayout    Show layout metadata.\n");
@@ -811,18 +908,33 @@ void nstool::SettingsInitializer::usage_text() const
 	fmt::print("    {:s} [--fstree] [-x [<virtual path>] <out path>] <file>\n", BIN_NAME);
 	fmt::print("      --fstree        Print filesystem tree.\n");
 	fmt::print("      -x, --extract   Extract a file or directory to local filesystem.\n");
+	fmt::print("      --plan          Show the order files would be read in for \"-x\", without extracting them.\n");
+	fmt::print("      --resume        Skip files already extracted by \"-x\", and resume partially written files.\n");
+	fmt::print("      --dedupe        Reflink/hardlink files identical to a file already extracted by \"-x\", instead of writing them again.\n");
+	fmt::print("      --mmap-out      Preallocate and memory map files extracted by \"-x\", so data is decrypted directly into them. (Linux only)\n");
+	fmt::print("      --format        Output format for \"-x\". [dir, tar] (default: dir, with tar <out path> can be \"-\" for stdout)\n");
 	fmt::print("\n  XCI (GameCard Image)\n");
 	fmt::print("    {:s} [--fstree] [-x [<virtual path>] <out path>] <.xci file>\n", BIN_NAME);
 	fmt::print("      --fstree        Print filesystem tree.\n");
 	fmt::print("      -x, --extract   Extract a file or directory to local filesystem.\n");
+	fmt::print("      --plan          Show the order files would be read in for \"-x\", without extracting them.\n");
+	fmt::print("      --resume        Skip files already extracted by \"-x\", and resume partially written files.\n");
+	fmt::print("      --dedupe        Reflink/hardlink files identical to a file already extracted by \"-x\", instead of writing them again.\n");
+	fmt::print("      --mmap-out      Preallocate and memory map files extracted by \"-x\", so data is decrypted directly into them. (Linux only)\n");
+	fmt::print("      --format        Output format for \"-x\". [dir, tar] (default: dir, with tar <out path> can be \"-\" for stdout)\n");
 	fmt::print("      --update        Extract \"update\" partition to directory. (Alias for \"-x /update <out path>\")\n");
 	fmt::print("      --logo          Extract \"logo\" partition to directory. (Alias for \"-x /logo <out path>\")\n");
 	fmt::print("      --normal        Extract \"normal\" partition to directory. (Alias for \"-x /normal <out path>\")\n");
 	fmt::print("      --secure        Extract \"secure\" partition to directory. (Alias for \"-x /secure <out path>\")\n");
 	fmt::print("\n  NCA (Nintendo Content Archive)\n");
-	fmt::print("    {:s} [--fstree] [-x [<virtual path>] <out path>] [--bodykey <key> --titlekey <key> -tik <tik path> --basenca <.nca file>] <.nca file>\n", BIN_NAME);
+	fmt::print("    {:s} [--fstree] [-x [<virtual path>] <out path>] [--bodykey <key> --titlekey <key> -tik <tik path> --basenca <.nca file> [--changed-only]] [--plaintext-nca <out path>] <.nca file>\n", BIN_NAME);
 	fmt::print("      --fstree        Print filesystem tree.\n");
 	fmt::print("      -x, --extract   Extract a file or directory to local filesystem.\n");
+	fmt::print("      --plan          Show the order files would be read in for \"-x\", without extracting them.\n");
+	fmt::print("      --resume        Skip files already extracted by \"-x\", and resume partially written files.\n");
+	fmt::print("      --dedupe        Reflink/hardlink files identical to a file already extracted by \"-x\", instead of writing them again.\n");
+	fmt::print("      --mmap-out      Preallocate and memory map files extracted by \"-x\", so data is decrypted directly into them. (Linux only)\n");
+	fmt::print("      --format        Output format for \"-x\". [dir, tar] (default: dir, with tar <out path> can be \"-\" for stdout)\n");
 	fmt::print("      --titlekey      Specify (encrypted) title key extracted from ticket.\n");
 	fmt::print("      --contentkey    Specify content key.\n");
 	fmt::print("      --tik           Specify ticket to source title key.\n");
@@ -832,6 +944,8 @@ void nstool::SettingsInitializer::usage_text() const
 	fmt::print("      --part2         Extract partition \"2\" to directory. (Alias for \"-x /2 <out path>\")\n");
 	fmt::print("      --part3         Extract partition \"3\" to directory. (Alias for \"-x /3 <out path>\")\n");
 	fmt::print("      --basenca       Specify base NCA file for update NCA files.\n");
+	fmt::print("      --changed-only  With \"--basenca\", only extract files with data from the update NCA.\n");
+	fmt::print("      --plaintext-nca Write a copy of the NCA with the header and partitions decrypted.\n");
 	fmt::print("\n  NSO (Nintendo Shared Object), NRO (Nintendo Relocatable Object)\n");
 	fmt::print("    {:s} [--listapi --listsym] [--insttype <inst. type>] <file>\n", BIN_NAME);
 	fmt::print("      --listapi       Print SDK API List.\n");
@@ -869,16 +983,24 @@ void nstool::SettingsInitializer::dump_keys() const
 	std::vector<std::string> kaek_label = {"Application", "Ocean", "System"};
 	for (size_t kaek_index = 0; kaek_index < opt.keybag.nca_key_area_encryption_key.size(); kaek_index++)
 	{
-		for (auto itr = opt.keybag.nca_key_area_encryption_key[kaek_index].begin(); itr != opt.keybag.nca_key_area_encryption_key[kaek_index].end(); itr++)
+		for (size_t keygen = 0; keygen < opt.keybag.nca_key_area_encryption_key[kaek_index].size(); keygen++)
 		{
-			fmt::print("    KeyAreaEncryptionKey-{:s}-{:02x}:\n      {:s}\n", kaek_label[kaek_index], itr->first, tc::cli::FormatUtil::formatBytesAsString(itr->second.data(), itr->second.size(), true, ""));
+			if (opt.keybag.nca_key_area_encryption_key[kaek_index].isSet(byte_t(keygen)) == false)
+				continue;
+
+			const KeyBag::aes128_key_t& key = opt.keybag.nca_key_area_encryption_key[kaek_index].get(byte_t(keygen));
+			fmt::print("    KeyAreaEncryptionKey-{:s}-{:02x}:\n      {:s}\n", kaek_label[kaek_index], keygen, tc::cli::FormatUtil::formatBytesAsString(key.data(), key.size(), true, ""));
 		}
 	}
 	for (size_t kaek_index = 0; kaek_index < opt.keybag.nca_key_area_encryption_key_hw.size(); kaek_index++)
 	{
-		for (auto itr = opt.keybag.nca_key_area_encryption_key_hw[kaek_index].begin(); itr != opt.keybag.nca_key_area_encryption_key_hw[kaek_index].end(); itr++)
+		for (size_t keygen = 0; keygen < opt.keybag.nca_key_area_encryption_key_hw[kaek_index].size(); keygen++)
 		{
-			fmt::print("    KeyAreaEncryptionKeyHw-{:s}-{:02x}:\n      {:s}\n", kaek_label[kaek_index], itr->first, tc::cli::FormatUtil::formatBytesAsString(itr->second.data(), itr->second.size(), true, ""));
+			if (opt.keybag.nca_key_area_encryption_key_hw[kaek_index].isSet(byte_t(keygen)) == false)
+				continue;
+
+			const KeyBag::aes128_key_t& key = opt.keybag.nca_key_area_encryption_key_hw[kaek_index].get(byte_t(keygen));
+			fmt::print("    KeyAreaEncryptionKeyHw-{:s}-{:02x}:\n      {:s}\n", kaek_label[kaek_index], keygen, tc::cli::FormatUtil::formatBytesAsString(key.data(), key.size(), true, ""));
 		}
 	}
 	fmt::print("  NRR Keys:\n");
@@ -917,9 +1039,13 @@ void nstool::SettingsInitializer::dump_keys() const
 	}
 
 	fmt::print("  ETicket Keys:\n");
-	for (auto itr = opt.keybag.etik_common_key.begin(); itr != opt.keybag.etik_common_key.end(); itr++)
+	for (size_t keygen = 0; keygen < opt.keybag.etik_common_key.size(); keygen++)
 	{
-		fmt::print("    CommonKey-{:02x}:\n      {:s}\n", itr->first, tc::cli::FormatUtil::formatBytesAsString(itr->second.data(), itr->second.size(), true, ""));
+		if (opt.keybag.etik_common_key.isSet(byte_t(keygen)) == false)
+			continue;
+
+		const KeyBag::aes128_key_t& key = opt.keybag.etik_common_key.get(byte_t(keygen));
+		fmt::print("    CommonKey-{:02x}:\n      {:s}\n", keygen, tc::cli::FormatUtil::formatBytesAsString(key.data(), key.size(), true, ""));
 	}
 
 	fmt::print("  BroadOn Signer Profiles:\n");
@@ -41,8 +41,14 @@ struct Settings
 	{
 		CliOutputMode cli_output_mode;
 		bool verify;
+		bool verify_data;
 		bool is_dev;
 		KeyBag keybag;
+		size_t thread_num;
+		size_t io_queue_depth;
+		bool mmap_input;
+		bool benchmark;
+		tc::Optional<tc::io::Path> sig_cache_path;
 	} opt;
 
 	// code options
@@ -58,6 +64,11 @@ struct Settings
 	{
 		bool show_fs_tree;
 		std::vector<ExtractJob> extract_jobs;
+		bool show_extract_plan;
+		bool resume;
+		bool dedupe;
+		bool mmap_output;
+		ExtractFormat extract_format;
 	} fs;
 
 	// XCI options
@@ -77,6 +88,8 @@ struct Settings
 		tc::Optional<tc::io::Path> part2_extract_path;
 		tc::Optional<tc::io::Path> part3_extract_path;
 		tc::Optional<tc::io::Path> base_nca_path;
+		tc::Optional<tc::io::Path> plaintext_nca_path;
+		bool changed_only;
 	} nca;
 
 	// KIP options
@@ -99,8 +112,14 @@ struct Settings
 
 		opt.cli_output_mode = CliOutputMode();
 		opt.verify = false;
+		opt.verify_data = false;
 		opt.is_dev = false;
 		opt.keybag = KeyBag();
+		opt.thread_num = 1;
+		opt.io_queue_depth = 0;
+		opt.mmap_input = false;
+		opt.benchmark = false;
+		opt.sig_cache_path = tc::Optional<tc::io::Path>();
 
 		code.list_api = false;
 		code.list_symbols = false;
@@ -108,10 +127,17 @@ struct Settings
 
 		fs.show_fs_tree = false;
 		fs.extract_jobs = std::vector<ExtractJob>();
+		fs.show_extract_plan = false;
+		fs.resume = false;
+		fs.dedupe = false;
+		fs.mmap_output = false;
+		fs.extract_format = EXTRACT_FORMAT_DIR;
 
 		kip.extract_path = tc::Optional<tc::io::Path>();
 
 		nca.base_nca_path = tc::Optional<tc::io::Path>();
+		nca.plaintext_nca_path = tc::Optional<tc::io::Path>();
+		nca.changed_only = false;
 
 		aset.icon_extract_path = tc::Optional<tc::io::Path>();
 		aset.nacp_extract_path = tc::Optional<tc::io::Path>();
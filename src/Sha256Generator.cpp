@@ -0,0 +1,515 @@
+#include "Sha256Generator.h"
+#include "CpuFeatures.h"
+
+#include <cstring>
+#include <algorithm>
+
+// x86 SHA-NI/AVX2 backends are built with per-function target attributes (GCC/Clang) or intrinsics that need no flags (MSVC)
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+	#if defined(__GNUC__) || defined(__clang__)
+		#define NSTOOL_SHA256_X86 1
+		#define NSTOOL_SHA256_TARGET_SHANI __attribute__((target("sha,ssse3,sse4.1")))
+		#define NSTOOL_SHA256_TARGET_AVX2 __attribute__((target("avx2")))
+		#include <immintrin.h>
+	#elif defined(_MSC_VER)
+		#define NSTOOL_SHA256_X86 1
+		#define NSTOOL_SHA256_TARGET_SHANI
+		#define NSTOOL_SHA256_TARGET_AVX2
+		#include <immintrin.h>
+	#endif
+#endif
+
+// ARMv8 backend is built with a per-function target attribute, unless the compiler already targets the crypto extensions (e.g. Apple Silicon)
+// (clang before 16 only declares the SHA-256 intrinsics when the crypto extensions are targeted for the whole file)
+#if defined(__aarch64__)
+	#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+		#define NSTOOL_SHA256_ARMV8 1
+		#define NSTOOL_SHA256_TARGET_ARMV8
+	#elif defined(__GNUC__) && !defined(__clang__)
+		#define NSTOOL_SHA256_ARMV8 1
+		#define NSTOOL_SHA256_TARGET_ARMV8 __attribute__((target("+crypto")))
+	#elif defined(__clang__) && __clang_major__ >= 16
+		#define NSTOOL_SHA256_ARMV8 1
+		#define NSTOOL_SHA256_TARGET_ARMV8 __attribute__((target("sha2")))
+	#endif
+	#ifdef NSTOOL_SHA256_ARMV8
+		#include <arm_neon.h>
+	#endif
+#endif
+
+namespace {
+
+const uint32_t kInitialState[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#if defined(NSTOOL_SHA256_X86) || defined(NSTOOL_SHA256_ARMV8)
+alignas(16) const uint32_t kRoundConstants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+#endif
+
+inline void storeBe32(byte_t* data, uint32_t value)
+{
+	data[0] = byte_t(value >> 24);
+	data[1] = byte_t(value >> 16);
+	data[2] = byte_t(value >> 8);
+	data[3] = byte_t(value);
+}
+
+inline void storeBe64(byte_t* data, uint64_t value)
+{
+	storeBe32(data, uint32_t(value >> 32));
+	storeBe32(data + 4, uint32_t(value));
+}
+
+// write the padding for a message of data_len bytes, whose last (data_len % 64) bytes are already at the start of block, returns the number of blocks
+inline size_t padFinalBlocks(byte_t* block, size_t tail_len, uint64_t data_len)
+{
+	size_t block_num = tail_len < 56 ? 1 : 2;
+	block[tail_len] = 0x80;
+	memset(block + tail_len + 1, 0, block_num * 64 - tail_len - 1);
+	storeBe64(block + block_num * 64 - 8, data_len * 8);
+	return block_num;
+}
+
+#ifdef NSTOOL_SHA256_X86
+
+NSTOOL_SHA256_TARGET_SHANI void compressBlocksShaNi(uint32_t* state, const byte_t* data, size_t block_num)
+{
+	const __m128i kByteSwapMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	// state is kept as ABEF/CDGH as required by sha256rnds2
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1); // CDAB
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B); // EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+
+	for (; block_num > 0; block_num--, data += 64)
+	{
+		__m128i abef_save = state0;
+		__m128i cdgh_save = state1;
+
+		__m128i msg[4];
+		for (size_t i = 0; i < 4; i++)
+		{
+			msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), kByteSwapMask);
+		}
+
+		// 16 groups of 4 rounds, the message schedule is computed 4 words at a time
+		for (size_t i = 0; i < 16; i++)
+		{
+			if (i >= 4)
+			{
+				__m128i w = _mm_sha256msg1_epu32(msg[i % 4], msg[(i + 1) % 4]);
+				w = _mm_add_epi32(w, _mm_alignr_epi8(msg[(i + 3) % 4], msg[(i + 2) % 4], 4));
+				msg[i % 4] = _mm_sha256msg2_epu32(w, msg[(i + 3) % 4]);
+			}
+
+			__m128i wk = _mm_add_epi32(msg[i % 4], _mm_load_si128((const __m128i*)&kRoundConstants[i * 4]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+		}
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+	state1 = _mm_alignr_epi8(state1, tmp, 8); // HGFE
+	_mm_storeu_si128((__m128i*)&state[0], state0);
+	_mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+NSTOOL_SHA256_TARGET_AVX2 inline __m256i rotr32x8(__m256i x, int n)
+{
+	return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+// compress one block for each of 8 messages, lane i of each state word belongs to message i
+NSTOOL_SHA256_TARGET_AVX2 void compressBlocksAvx2x8(__m256i* state, const byte_t* const* data, size_t block_num)
+{
+	const __m256i kByteSwapMask = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL, 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	for (size_t block = 0; block < block_num; block++)
+	{
+		size_t block_offset = block * 64;
+
+		__m256i w[16];
+		for (size_t i = 0; i < 16; i++)
+		{
+			size_t word_offset = block_offset + i * 4;
+			int32_t lane[8];
+			for (size_t j = 0; j < 8; j++)
+			{
+				memcpy(&lane[j], data[j] + word_offset, sizeof(int32_t));
+			}
+			w[i] = _mm256_shuffle_epi8(_mm256_set_epi32(lane[7], lane[6], lane[5], lane[4], lane[3], lane[2], lane[1], lane[0]), kByteSwapMask);
+		}
+
+		__m256i a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+		for (size_t t = 0; t < 64; t++)
+		{
+			if (t >= 16)
+			{
+				__m256i w15 = w[(t - 15) % 16];
+				__m256i w2 = w[(t - 2) % 16];
+				__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr32x8(w15, 7), rotr32x8(w15, 18)), _mm256_srli_epi32(w15, 3));
+				__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr32x8(w2, 17), rotr32x8(w2, 19)), _mm256_srli_epi32(w2, 10));
+				w[t % 16] = _mm256_add_epi32(_mm256_add_epi32(w[t % 16], s0), _mm256_add_epi32(w[(t - 7) % 16], s1));
+			}
+
+			__m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(rotr32x8(e, 6), rotr32x8(e, 11)), rotr32x8(e, 25));
+			__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+			__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sum1), _mm256_add_epi32(ch, _mm256_add_epi32(w[t % 16], _mm256_set1_epi32(int32_t(kRoundConstants[t])))));
+			__m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(rotr32x8(a, 2), rotr32x8(a, 13)), rotr32x8(a, 22));
+			__m256i maj = _mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_xor_si256(a, b)));
+			__m256i t2 = _mm256_add_epi32(sum0, maj);
+
+			h = g;
+			g = f;
+			f = e;
+			e = _mm256_add_epi32(d, t1);
+			d = c;
+			c = b;
+			b = a;
+			a = _mm256_add_epi32(t1, t2);
+		}
+
+		state[0] = _mm256_add_epi32(state[0], a);
+		state[1] = _mm256_add_epi32(state[1], b);
+		state[2] = _mm256_add_epi32(state[2], c);
+		state[3] = _mm256_add_epi32(state[3], d);
+		state[4] = _mm256_add_epi32(state[4], e);
+		state[5] = _mm256_add_epi32(state[5], f);
+		state[6] = _mm256_add_epi32(state[6], g);
+		state[7] = _mm256_add_epi32(state[7], h);
+	}
+}
+
+// hash 8 messages of data_size bytes
+NSTOOL_SHA256_TARGET_AVX2 void generateHashesAvx2x8(byte_t* hash[8], const byte_t* const* data, size_t data_size)
+{
+	__m256i state[8];
+	for (size_t i = 0; i < 8; i++)
+	{
+		state[i] = _mm256_set1_epi32(int32_t(kInitialState[i]));
+	}
+
+	// whole blocks
+	size_t block_num = data_size / 64;
+	compressBlocksAvx2x8(state, data, block_num);
+
+	// padding blocks
+	size_t tail_len = data_size % 64;
+	byte_t final_block[8][128];
+	const byte_t* final_ptr[8];
+	size_t final_block_num = 0;
+	for (size_t i = 0; i < 8; i++)
+	{
+		memcpy(final_block[i], data[i] + block_num * 64, tail_len);
+		final_block_num = padFinalBlocks(final_block[i], tail_len, data_size);
+		final_ptr[i] = final_block[i];
+	}
+	compressBlocksAvx2x8(state, final_ptr, final_block_num);
+
+	alignas(32) uint32_t lane_state[8][8];
+	for (size_t i = 0; i < 8; i++)
+	{
+		_mm256_store_si256((__m256i*)lane_state[i], state[i]);
+	}
+	for (size_t lane = 0; lane < 8; lane++)
+	{
+		if (hash[lane] == nullptr)
+			continue;
+
+		for (size_t i = 0; i < 8; i++)
+		{
+			storeBe32(hash[lane] + i * 4, lane_state[i][lane]);
+		}
+	}
+}
+
+#endif
+
+#ifdef NSTOOL_SHA256_ARMV8
+
+NSTOOL_SHA256_TARGET_ARMV8 void compressBlocksArmv8(uint32_t* state, const byte_t* data, size_t block_num)
+{
+	uint32x4_t state0 = vld1q_u32(&state[0]);
+	uint32x4_t state1 = vld1q_u32(&state[4]);
+
+	for (; block_num > 0; block_num--, data += 64)
+	{
+		uint32x4_t abcd_save = state0;
+		uint32x4_t efgh_save = state1;
+
+		uint32x4_t msg[4];
+		for (size_t i = 0; i < 4; i++)
+		{
+			msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+		}
+
+		// 16 groups of 4 rounds, the message schedule is computed 4 words at a time
+		for (size_t i = 0; i < 16; i++)
+		{
+			if (i >= 4)
+			{
+				msg[i % 4] = vsha256su1q_u32(vsha256su0q_u32(msg[i % 4], msg[(i + 1) % 4]), msg[(i + 2) % 4], msg[(i + 3) % 4]);
+			}
+
+			uint32x4_t wk = vaddq_u32(msg[i % 4], vld1q_u32(&kRoundConstants[i * 4]));
+			uint32x4_t abcd = state0;
+			state0 = vsha256hq_u32(state0, state1, wk);
+			state1 = vsha256h2q_u32(state1, abcd, wk);
+		}
+
+		state0 = vaddq_u32(state0, abcd_save);
+		state1 = vaddq_u32(state1, efgh_save);
+	}
+
+	vst1q_u32(&state[0], state0);
+	vst1q_u32(&state[4], state1);
+}
+
+#endif
+
+}
+
+nstool::Sha256Generator::Sha256Generator(Backend backend) :
+	mModuleLabel("nstool::Sha256Generator"),
+	mBackend(backend == BACKEND_AUTO ? getPreferredBackend() : backend),
+	mSoftwareGenerator(),
+	mBufferLen(0),
+	mDataLen(0)
+{
+	if (isBackendSupported(mBackend) == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel, fmt::format("SHA-256 backend \"{:s}\" is not supported on this CPU.", getBackendName(mBackend)));
+	}
+
+	memcpy(mState, kInitialState, sizeof(mState));
+	memset(mBuffer, 0, sizeof(mBuffer));
+}
+
+void nstool::Sha256Generator::initialize()
+{
+	if (mBackend == BACKEND_SOFTWARE)
+	{
+		mSoftwareGenerator.initialize();
+		return;
+	}
+
+	memcpy(mState, kInitialState, sizeof(mState));
+	mBufferLen = 0;
+	mDataLen = 0;
+}
+
+void nstool::Sha256Generator::update(const byte_t* data, size_t data_size)
+{
+	if (mBackend == BACKEND_SOFTWARE)
+	{
+		mSoftwareGenerator.update(data, data_size);
+		return;
+	}
+
+	mDataLen += data_size;
+
+	// complete a partially filled block
+	if (mBufferLen > 0)
+	{
+		size_t len = std::min<size_t>(data_size, kBlockSize - mBufferLen);
+		memcpy(mBuffer + mBufferLen, data, len);
+		mBufferLen += len;
+		data += len;
+		data_size -= len;
+
+		if (mBufferLen < kBlockSize)
+			return;
+
+		compressBlocks(mBuffer, 1);
+		mBufferLen = 0;
+	}
+
+	// whole blocks are hashed directly from the input
+	size_t block_num = data_size / kBlockSize;
+	if (block_num > 0)
+	{
+		compressBlocks(data, block_num);
+		data += block_num * kBlockSize;
+		data_size -= block_num * kBlockSize;
+	}
+
+	if (data_size > 0)
+	{
+		memcpy(mBuffer, data, data_size);
+		mBufferLen = data_size;
+	}
+}
+
+void nstool::Sha256Generator::getHash(byte_t* hash)
+{
+	if (mBackend == BACKEND_SOFTWARE)
+	{
+		mSoftwareGenerator.getHash(hash);
+		return;
+	}
+
+	byte_t final_block[kBlockSize * 2];
+	memcpy(final_block, mBuffer, mBufferLen);
+	compressBlocks(final_block, padFinalBlocks(final_block, mBufferLen, mDataLen));
+	mBufferLen = 0;
+
+	for (size_t i = 0; i < 8; i++)
+	{
+		storeBe32(hash + i * 4, mState[i]);
+	}
+}
+
+nstool::Sha256Generator::Backend nstool::Sha256Generator::getBackend() const
+{
+	return mBackend;
+}
+
+nstool::Sha256Generator::Backend nstool::Sha256Generator::getPreferredBackend()
+{
+	if (isBackendSupported(BACKEND_SHANI))
+		return BACKEND_SHANI;
+	if (isBackendSupported(BACKEND_ARMV8))
+		return BACKEND_ARMV8;
+	return BACKEND_SOFTWARE;
+}
+
+bool nstool::Sha256Generator::isBackendSupported(Backend backend)
+{
+	switch (backend)
+	{
+		case (BACKEND_AUTO):
+		case (BACKEND_SOFTWARE):
+			return true;
+#ifdef NSTOOL_SHA256_X86
+		case (BACKEND_SHANI):
+			return getCpuFeatures().sha_ni;
+#endif
+#ifdef NSTOOL_SHA256_ARMV8
+		case (BACKEND_ARMV8):
+			return getCpuFeatures().armv8_sha2;
+#endif
+		default:
+			return false;
+	}
+}
+
+std::string nstool::Sha256Generator::getBackendName(Backend backend)
+{
+	switch (backend)
+	{
+		case (BACKEND_AUTO):
+			return "Auto";
+		case (BACKEND_SOFTWARE):
+			return "Software";
+		case (BACKEND_SHANI):
+			return "SHA-NI";
+		case (BACKEND_ARMV8):
+			return "ARMv8";
+		default:
+			return "Unknown";
+	}
+}
+
+std::vector<nstool::Sha256Generator::Backend> nstool::Sha256Generator::getSupportedBackends()
+{
+	std::vector<Backend> backends;
+	for (Backend backend : { BACKEND_SOFTWARE, BACKEND_SHANI, BACKEND_ARMV8 })
+	{
+		if (isBackendSupported(backend))
+		{
+			backends.push_back(backend);
+		}
+	}
+	return backends;
+}
+
+void nstool::Sha256Generator::generateHashes(byte_t* hash, const std::vector<const byte_t*>& data, size_t data_size)
+{
+	// SHA instructions are faster than 8 lanes of AVX2, so multi-buffer is only preferred without them
+	generateHashes(hash, data, data_size, isMultiBufferSupported() && getPreferredBackend() == BACKEND_SOFTWARE);
+}
+
+void nstool::Sha256Generator::generateHashes(byte_t* hash, const std::vector<const byte_t*>& data, size_t data_size, bool use_multi_buffer)
+{
+	size_t index = 0;
+
+#ifdef NSTOOL_SHA256_X86
+	if (use_multi_buffer && isMultiBufferSupported())
+	{
+		// groups of 8 messages, the last group is filled with duplicates of its last message whose hashes are discarded
+		for (; index < data.size(); index += 8)
+		{
+			const byte_t* lane_data[8];
+			byte_t* lane_hash[8];
+			for (size_t lane = 0; lane < 8; lane++)
+			{
+				bool is_used = index + lane < data.size();
+				lane_data[lane] = is_used ? data[index + lane] : data.back();
+				lane_hash[lane] = is_used ? hash + (index + lane) * kHashSize : nullptr;
+			}
+			generateHashesAvx2x8(lane_hash, lane_data, data_size);
+		}
+		return;
+	}
+#endif
+
+	Sha256Generator hash_gen;
+	for (; index < data.size(); index++)
+	{
+		hash_gen.initialize();
+		hash_gen.update(data[index], data_size);
+		hash_gen.getHash(hash + index * kHashSize);
+	}
+}
+
+bool nstool::Sha256Generator::isMultiBufferSupported()
+{
+#ifdef NSTOOL_SHA256_X86
+	return getCpuFeatures().avx2;
+#else
+	return false;
+#endif
+}
+
+void nstool::Sha256Generator::compressBlocks(const byte_t* data, size_t block_num)
+{
+	switch (mBackend)
+	{
+#ifdef NSTOOL_SHA256_X86
+		case (BACKEND_SHANI):
+			compressBlocksShaNi(mState, data, block_num);
+			break;
+#endif
+#ifdef NSTOOL_SHA256_ARMV8
+		case (BACKEND_ARMV8):
+			compressBlocksArmv8(mState, data, block_num);
+			break;
+#endif
+		default:
+			throw tc::InvalidOperationException(mModuleLabel, "Backend does not support block compression.");
+	}
+}
+
+void nstool::GenerateSha256Hash(byte_t* hash, const byte_t* data, size_t data_size)
+{
+	Sha256Generator hash_gen;
+	hash_gen.initialize();
+	hash_gen.update(data, data_size);
+	hash_gen.getHash(hash);
+}
\ No newline at end of file
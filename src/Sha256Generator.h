@@ -0,0 +1,72 @@
+#pragma once
+#include "types.h"
+
+#include <tc/crypto/Sha2256Generator.h>
+#include <vector>
+
+namespace nstool {
+
+/**
+ * @class Sha256Generator
+ * @brief SHA-256 generator with runtime selected backends, usable in place of tc::crypto::Sha2256Generator.
+ *
+ * Backends:
+ * - Software: tc::crypto::Sha2256Generator
+ * - ShaNi: x86 SHA extensions
+ * - Armv8: ARMv8 cryptographic extensions (SHA2)
+ *
+ * generateHashes() hashes many messages of the same size at once (e.g. hash-tree blocks). With AVX2 it hashes 8 messages in parallel,
+ * one per 32-bit lane, which is faster than hashing them one at a time when SHA instructions aren't available.
+ */
+class Sha256Generator
+{
+public:
+	enum Backend
+	{
+		BACKEND_AUTO,
+		BACKEND_SOFTWARE,
+		BACKEND_SHANI,
+		BACKEND_ARMV8
+	};
+
+	static const size_t kHashSize = 32;
+	static const size_t kBlockSize = 64;
+
+	Sha256Generator(Backend backend = BACKEND_AUTO);
+
+	void initialize();
+	void update(const byte_t* data, size_t data_size);
+	void getHash(byte_t* hash);
+
+	Backend getBackend() const;
+
+	static Backend getPreferredBackend();
+	static bool isBackendSupported(Backend backend);
+	static std::string getBackendName(Backend backend);
+	static std::vector<Backend> getSupportedBackends();
+
+	// hash each of the messages (which are all data_size bytes), hash must have room for (kHashSize * data.size()) bytes
+	static void generateHashes(byte_t* hash, const std::vector<const byte_t*>& data, size_t data_size);
+	static void generateHashes(byte_t* hash, const std::vector<const byte_t*>& data, size_t data_size, bool use_multi_buffer);
+	static bool isMultiBufferSupported();
+private:
+	std::string mModuleLabel;
+
+	Backend mBackend;
+
+	// software backend
+	tc::crypto::Sha2256Generator mSoftwareGenerator;
+
+	// hardware backends
+	uint32_t mState[8];
+	byte_t mBuffer[kBlockSize];
+	size_t mBufferLen;
+	uint64_t mDataLen;
+
+	void compressBlocks(const byte_t* data, size_t block_num);
+};
+
+// hash data with the preferred backend
+void GenerateSha256Hash(byte_t* hash, const byte_t* data, size_t data_size);
+
+}
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "SharedStream.h"
+
+#include <tc/ObjectDisposedException.h>
+
+nstool::SharedStream::SharedStream() :
+	mModuleLabel("nstool::SharedStream"),
+	mState(),
+	mPosition(0)
+{
+}
+
+nstool::SharedStream::SharedStream(const std::shared_ptr<tc::io::IStream>& stream) :
+	SharedStream()
+{
+	if (stream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "stream is null.");
+	}
+	if (stream->canRead() == false || stream->canSeek() == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel, "stream requires read/seek permissions.");
+	}
+
+	mState = std::make_shared<sSharedState>();
+	mState->stream = stream;
+	mState->length = stream->length();
+}
+
+std::shared_ptr<nstool::SharedStream> nstool::SharedStream::clone() const
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::clone()", "Failed to clone stream (stream is disposed)");
+	}
+
+	std::shared_ptr<SharedStream> stream = std::make_shared<SharedStream>();
+	stream->mState = mState;
+	stream->mPosition = 0;
+
+	return stream;
+}
+
+bool nstool::SharedStream::canRead() const
+{
+	return mState != nullptr;
+}
+
+bool nstool::SharedStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::SharedStream::canSeek() const
+{
+	return mState != nullptr;
+}
+
+int64_t nstool::SharedStream::length()
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mState->length;
+}
+
+int64_t nstool::SharedStream::position()
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mPosition;
+}
+
+size_t nstool::SharedStream::read(byte_t* ptr, size_t count)
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	// clamp count to what is left in the stream
+	if (mPosition >= mState->length)
+	{
+		return 0;
+	}
+	if (tc::io::IOUtil::castSizeToInt64(count) > mState->length - mPosition)
+	{
+		count = tc::io::IOUtil::castInt64ToSize(mState->length - mPosition);
+	}
+
+	size_t read_len = 0;
+	{
+		std::lock_guard<std::mutex> lock(mState->lock);
+		mState->stream->seek(mPosition, tc::io::SeekOrigin::Begin);
+		read_len = mState->stream->read(ptr, count);
+	}
+	mPosition += tc::io::IOUtil::castSizeToInt64(read_len);
+
+	return read_len;
+}
+
+size_t nstool::SharedStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for SharedStream");
+}
+
+int64_t nstool::SharedStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	int64_t new_position = 0;
+	switch (origin)
+	{
+		case (tc::io::SeekOrigin::Begin):
+			new_position = offset;
+			break;
+		case (tc::io::SeekOrigin::Current):
+			new_position = mPosition + offset;
+			break;
+		case (tc::io::SeekOrigin::End):
+			new_position = mState->length + offset;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Unknown seek origin.");
+	}
+
+	if (new_position < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Stream position cannot be negative.");
+	}
+
+	mPosition = new_position;
+
+	return mPosition;
+}
+
+void nstool::SharedStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for SharedStream");
+}
+
+void nstool::SharedStream::flush()
+{
+	if (mState == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+}
+
+void nstool::SharedStream::dispose()
+{
+	// only this reader is disposed, other clones (and the base stream) are left as is
+	mState.reset();
+	mPosition = 0;
+}
\ No newline at end of file
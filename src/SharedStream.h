@@ -0,0 +1,48 @@
+#pragma once
+#include "types.h"
+
+#include <mutex>
+
+namespace nstool {
+
+/**
+ * @class SharedStream
+ * @brief Read-only stream wrapper that allows one base stream to be shared between threads.
+ *
+ * Each SharedStream (and each clone of it) keeps its own position, and access to the base stream is serialised,
+ * so a stream stack (SubStream, decryption, hash layers, etc) can be built on top of each clone and used by a different thread.
+ */
+class SharedStream : public tc::io::IStream
+{
+public:
+	SharedStream();
+	SharedStream(const std::shared_ptr<tc::io::IStream>& stream);
+
+	// create a reader for the same base stream with an independent position
+	std::shared_ptr<SharedStream> clone() const;
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	std::string mModuleLabel;
+
+	struct sSharedState
+	{
+		std::shared_ptr<tc::io::IStream> stream;
+		int64_t length;
+		std::mutex lock;
+	};
+	std::shared_ptr<sSharedState> mState;
+	int64_t mPosition;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "SignatureCache.h"
+#include "Sha256Generator.h"
+
+#include <tc/io/FileStream.h>
+#include <tc/io/FileNotFoundException.h>
+#include <tc/cli/FormatUtil.h>
+
+#include <cstring>
+#include <sstream>
+
+nstool::SignatureCache::SignatureCache() :
+	mModuleLabel("nstool::SignatureCache"),
+	mLock(),
+	mResults(),
+	mCacheStream()
+{
+}
+
+nstool::SignatureCache::SignatureCache(const tc::io::Path& cache_path) :
+	SignatureCache()
+{
+	importCacheFile(cache_path);
+
+	mCacheStream = std::make_shared<tc::io::FileStream>(tc::io::FileStream(cache_path, tc::io::FileMode::Append, tc::io::FileAccess::Write));
+}
+
+bool nstool::SignatureCache::verify(SignatureAlgo algo, const byte_t* signature, const byte_t* hash, const tc::crypto::RsaKey& key)
+{
+	cache_id_t id = makeCacheId(algo, signature, hash, key);
+
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		auto itr = mResults.find(id);
+		if (itr != mResults.end())
+		{
+			return itr->second;
+		}
+	}
+
+	// verify without holding the lock, so other signatures can be verified at the same time
+	bool is_valid = verifySignature(algo, signature, hash, key);
+
+	std::lock_guard<std::mutex> lock(mLock);
+	if (mResults.find(id) == mResults.end())
+	{
+		mResults[id] = is_valid;
+
+		if (mCacheStream != nullptr)
+		{
+			std::string line = fmt::format("{:s}\t{:s}\n", tc::cli::FormatUtil::formatBytesAsString(id.data(), id.size(), false, ""), is_valid ? "V" : "F");
+			mCacheStream->write((const byte_t*)line.c_str(), line.size());
+			mCacheStream->flush();
+		}
+	}
+
+	return is_valid;
+}
+
+void nstool::SignatureCache::importCacheFile(const tc::io::Path& cache_path)
+{
+	// read existing cache file (if any)
+	std::string cache_file;
+	try {
+		tc::io::FileStream stream = tc::io::FileStream(cache_path, tc::io::FileMode::Open, tc::io::FileAccess::Read);
+		tc::ByteData data = tc::ByteData(tc::io::IOUtil::castInt64ToSize(stream.length()));
+		size_t data_read = stream.read(data.data(), data.size());
+		if (data_read != data.size())
+		{
+			fmt::print("[WARNING] Signature cache file was only partially read, the remaining records are ignored.\n");
+		}
+		cache_file = std::string((const char*)data.data(), data_read);
+	}
+	catch (tc::io::FileNotFoundException&) {
+		return;
+	}
+
+	// parse records, ignoring malformed lines (e.g. a record that was partially written when nstool was stopped)
+	std::istringstream cache_file_stream(cache_file);
+	std::string line;
+	while (std::getline(cache_file_stream, line))
+	{
+		std::vector<std::string> field;
+		std::istringstream line_stream(line);
+		for (std::string value; std::getline(line_stream, value, '\t');)
+		{
+			field.push_back(value);
+		}
+		if (field.size() != 2 || field[0].size() != kIdSize * 2 || (field[1] != "V" && field[1] != "F"))
+		{
+			continue;
+		}
+
+		tc::ByteData id_data = tc::cli::FormatUtil::hexStringToBytes(field[0]);
+		if (id_data.size() != kIdSize)
+		{
+			continue;
+		}
+
+		cache_id_t id;
+		memcpy(id.data(), id_data.data(), id.size());
+		mResults[id] = field[1] == "V";
+	}
+}
+
+size_t nstool::SignatureCache::getSignatureSize(SignatureAlgo algo)
+{
+	return (algo == SIGN_RSA4096_PKCS1_SHA256 || algo == SIGN_RSA4096_PKCS1_SHA1) ? 0x200 : 0x100;
+}
+
+size_t nstool::SignatureCache::getHashSize(SignatureAlgo algo)
+{
+	return (algo == SIGN_RSA2048_PKCS1_SHA1 || algo == SIGN_RSA4096_PKCS1_SHA1) ? 20 : 32;
+}
+
+bool nstool::SignatureCache::verifySignature(SignatureAlgo algo, const byte_t* signature, const byte_t* hash, const tc::crypto::RsaKey& key)
+{
+	switch (algo)
+	{
+		case (SIGN_RSA2048_PSS_SHA256):
+			return tc::crypto::VerifyRsa2048PssSha2256(signature, hash, key);
+		case (SIGN_RSA2048_PKCS1_SHA256):
+			return tc::crypto::VerifyRsa2048Pkcs1Sha2256(signature, hash, key);
+		case (SIGN_RSA4096_PKCS1_SHA256):
+			return tc::crypto::VerifyRsa4096Pkcs1Sha2256(signature, hash, key);
+		case (SIGN_RSA2048_PKCS1_SHA1):
+			return tc::crypto::VerifyRsa2048Pkcs1Sha1(signature, hash, key);
+		case (SIGN_RSA4096_PKCS1_SHA1):
+			return tc::crypto::VerifyRsa4096Pkcs1Sha1(signature, hash, key);
+		default:
+			return false;
+	}
+}
+
+nstool::SignatureCache::cache_id_t nstool::SignatureCache::makeCacheId(SignatureAlgo algo, const byte_t* signature, const byte_t* hash, const tc::crypto::RsaKey& key)
+{
+	// the public exponent is fixed, so the key is identified by its modulus
+	byte_t algo_id = byte_t(algo);
+
+	Sha256Generator hash_gen;
+	hash_gen.initialize();
+	hash_gen.update(&algo_id, sizeof(algo_id));
+	hash_gen.update(hash, getHashSize(algo));
+	hash_gen.update(signature, getSignatureSize(algo));
+	hash_gen.update(key.n.data(), key.n.size());
+
+	cache_id_t id;
+	hash_gen.getHash(id.data());
+	return id;
+}
+
+bool nstool::VerifySignature(const std::shared_ptr<SignatureCache>& cache, SignatureCache::SignatureAlgo algo, const byte_t* signature, const byte_t* hash, const tc::crypto::RsaKey& key)
+{
+	if (cache != nullptr)
+		return cache->verify(algo, signature, hash, key);
+	else
+		return SignatureCache::verifySignature(algo, signature, hash, key);
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+#include "types.h"
+
+#include <mutex>
+
+namespace nstool {
+
+/**
+ * @class SignatureCache
+ * @brief RSA signature verification, with results cached by (algorithm, hash, signature, public key).
+ *
+ * Verifications are thread safe, and run outside the cache lock so they can run in parallel.
+ * If a cache file is supplied, results are imported from it and new results are appended to it, so repeated runs don't verify the same signatures again.
+ * The cache file is a text file with one tab separated record per line: "<sha256 of the verification inputs> <V (valid) or F (invalid)>".
+ */
+class SignatureCache
+{
+public:
+	enum SignatureAlgo
+	{
+		SIGN_RSA2048_PSS_SHA256,
+		SIGN_RSA2048_PKCS1_SHA256,
+		SIGN_RSA4096_PKCS1_SHA256,
+		SIGN_RSA2048_PKCS1_SHA1,
+		SIGN_RSA4096_PKCS1_SHA1
+	};
+
+	SignatureCache();
+	SignatureCache(const tc::io::Path& cache_path);
+
+	// hash is the hash of the signed data, sized for the algorithm (SHA-1 or SHA-256)
+	bool verify(SignatureAlgo algo, const byte_t* signature, const byte_t* hash, const tc::crypto::RsaKey& key);
+
+	// verify without a cache
+	static bool verifySignature(SignatureAlgo algo, const byte_t* signature, const byte_t* hash, const tc::crypto::RsaKey& key);
+private:
+	static const size_t kIdSize = 32;
+	using cache_id_t = std::array<byte_t, kIdSize>;
+
+	std::string mModuleLabel;
+
+	std::mutex mLock;
+	std::map<cache_id_t, bool> mResults;
+	std::shared_ptr<tc::io::IStream> mCacheStream;
+
+	void importCacheFile(const tc::io::Path& cache_path);
+
+	static size_t getSignatureSize(SignatureAlgo algo);
+	static size_t getHashSize(SignatureAlgo algo);
+	static cache_id_t makeCacheId(SignatureAlgo algo, const byte_t* signature, const byte_t* hash, const tc::crypto::RsaKey& key);
+};
+
+// verify a signature with the cache if one is supplied, otherwise verify directly
+bool VerifySignature(const std::shared_ptr<SignatureCache>& cache, SignatureCache::SignatureAlgo algo, const byte_t* signature, const byte_t* hash, const tc::crypto::RsaKey& key);
+
+}
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "SparseStream.h"
+#include "IndirectStream.h"
+
+#include <tc/ObjectDisposedException.h>
+#include <tc/ArgumentOutOfRangeException.h>
+
+#include <algorithm>
+#include <cstring>
+
+nstool::SparseStream::SparseStream(const std::shared_ptr<tc::io::IStream>& data_stream, const std::shared_ptr<BucketTree>& table, int64_t length) :
+	mModuleLabel("nstool::SparseStream"),
+	mDataStream(data_stream),
+	mTable(table),
+	mLength(length),
+	mPosition(0),
+	mIsEncrypted(false),
+	mCipher(),
+	mEntryHint(0)
+{
+	if (mDataStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "data_stream is null.");
+	}
+	if (mTable == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "table is null.");
+	}
+	if (mDataStream->canRead() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support reading.");
+	}
+	if (mDataStream->canSeek() == false)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "stream does not support seeking.");
+	}
+	if (mTable->getEntryNum() != 0 && mTable->getEntrySize() != sizeof(IndirectStream::sEntry))
+	{
+		throw tc::ArgumentException(mModuleLabel, "table does not contain IndirectStorage entries.");
+	}
+	if (mLength < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel, "length cannot be negative.");
+	}
+}
+
+nstool::SparseStream::SparseStream(const std::shared_ptr<tc::io::IStream>& data_stream, const std::shared_ptr<BucketTree>& table, int64_t length, const AesKeySchedule& key, const pie::hac::detail::aes_iv_t& counter) :
+	SparseStream(data_stream, table, length)
+{
+	mIsEncrypted = true;
+	mCipher.initialize(key, counter.data());
+}
+
+bool nstool::SparseStream::canRead() const
+{
+	return mDataStream != nullptr;
+}
+
+bool nstool::SparseStream::canWrite() const
+{
+	return false;
+}
+
+bool nstool::SparseStream::canSeek() const
+{
+	return mDataStream != nullptr;
+}
+
+int64_t nstool::SparseStream::length()
+{
+	if (mDataStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::length()", "Failed to get stream length (stream is disposed)");
+	}
+
+	return mLength;
+}
+
+int64_t nstool::SparseStream::position()
+{
+	if (mDataStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::position()", "Failed to get stream position (stream is disposed)");
+	}
+
+	return mPosition;
+}
+
+size_t nstool::SparseStream::read(byte_t* ptr, size_t count)
+{
+	if (mDataStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::read()", "Failed to read from stream (stream is disposed)");
+	}
+
+	// clamp read to the end of the stream
+	if (mPosition >= mLength)
+	{
+		return 0;
+	}
+	count = size_t(std::min<int64_t>(int64_t(count), mLength - mPosition));
+
+	size_t data_read = 0;
+	while (data_read < count)
+	{
+		size_t data_size = count - data_read;
+		bool is_mapped = false;
+		int64_t physical_offset = 0;
+
+		if (mTable->getEntryNum() != 0 && mPosition >= mTable->getBeginOffset() && mPosition < mTable->getEndOffset())
+		{
+			mEntryHint = mTable->find(mPosition, mEntryHint);
+			data_size = size_t(std::min<int64_t>(int64_t(data_size), mTable->getEntryEndOffset(mEntryHint) - mPosition));
+
+			IndirectStream::sEntry entry;
+			memcpy(&entry, mTable->getEntry(mEntryHint), sizeof(IndirectStream::sEntry));
+			if (entry.storage_index.unwrap() == StorageIndex_Data)
+			{
+				is_mapped = true;
+				physical_offset = entry.physical_offset.unwrap() + (mPosition - mTable->getEntryBeginOffset(mEntryHint));
+			}
+			else if (entry.storage_index.unwrap() != StorageIndex_Zero)
+			{
+				throw tc::io::IOException(mModuleLabel+"::read()", fmt::format("SparseStorage entry had invalid storage index ({:d}).", entry.storage_index.unwrap()));
+			}
+		}
+		else if (mTable->getEntryNum() != 0 && mPosition < mTable->getBeginOffset())
+		{
+			data_size = size_t(std::min<int64_t>(int64_t(data_size), mTable->getBeginOffset() - mPosition));
+		}
+
+		if (is_mapped)
+		{
+			mDataStream->seek(physical_offset, tc::io::SeekOrigin::Begin);
+			if (mDataStream->read(ptr + data_read, data_size) != data_size)
+			{
+				throw tc::io::IOException(mModuleLabel+"::read()", "Failed to read SparseStorage data (data storage was too small).");
+			}
+
+			if (mIsEncrypted)
+			{
+				mCipher.crypt(ptr + data_read, ptr + data_read, data_size, mPosition);
+			}
+		}
+		else
+		{
+			// no data is stored for this range
+			memset(ptr + data_read, 0, data_size);
+		}
+
+		data_read += data_size;
+		mPosition += int64_t(data_size);
+	}
+
+	return data_read;
+}
+
+size_t nstool::SparseStream::write(const byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::write()", "write() is not supported for SparseStream.");
+}
+
+int64_t nstool::SparseStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	if (mDataStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::seek()", "Failed to set stream position (stream is disposed)");
+	}
+
+	int64_t new_position = 0;
+	switch (origin)
+	{
+		case (tc::io::SeekOrigin::Begin):
+			new_position = offset;
+			break;
+		case (tc::io::SeekOrigin::Current):
+			new_position = mPosition + offset;
+			break;
+		case (tc::io::SeekOrigin::End):
+			new_position = mLength + offset;
+			break;
+		default:
+			throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Unknown seek origin.");
+	}
+
+	if (new_position < 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleLabel+"::seek()", "Stream position cannot be negative.");
+	}
+
+	mPosition = new_position;
+	return mPosition;
+}
+
+void nstool::SparseStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for SparseStream.");
+}
+
+void nstool::SparseStream::flush()
+{
+	if (mDataStream == nullptr)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+}
+
+void nstool::SparseStream::dispose()
+{
+	if (mDataStream.get() != nullptr)
+	{
+		mDataStream->dispose();
+		mDataStream.reset();
+	}
+	mTable.reset();
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+#include "types.h"
+#include "AesCtrCipher.h"
+#include "BucketTree.h"
+
+#include <pietendo/hac/define/types.h>
+
+namespace nstool {
+
+/**
+ * @class SparseStream
+ * @brief Read-only stream for a partition compacted with SparseStorage, where only the ranges the title uses are stored.
+ *
+ * Offsets of the stream are NCA offsets. Each entry of the SparseStorage table (an IndirectStorage table) maps a range either to the physical data (storage index 0) or to nothing (storage index 1).
+ * Physical data is optionally decrypted with AES-128-CTR, using the counter of the (uncompacted) NCA offset. Unmapped ranges, and ranges past the end of the table, hold no data,
+ * so they are read as zeros without any I/O or decryption. Consecutive reads continue from the previous table entry, so sequential reads don't search the table.
+ */
+class SparseStream : public tc::io::IStream
+{
+public:
+#pragma pack(push,1)
+	// SparseStorage info, as stored in the NCA fs header
+	struct sSparseInfo
+	{
+		BucketTree::sInfo bucket;
+		tc::bn::le64<int64_t> physical_offset;
+		tc::bn::le16<uint16_t> generation;
+		std::array<byte_t, 6> reserved;
+	};
+	static_assert(sizeof(sSparseInfo) == 0x30, "sSparseInfo size.");
+#pragma pack(pop)
+
+	enum StorageIndex
+	{
+		StorageIndex_Data = 0,
+		StorageIndex_Zero = 1
+	};
+
+	// data stream is stored as is
+	SparseStream(const std::shared_ptr<tc::io::IStream>& data_stream, const std::shared_ptr<BucketTree>& table, int64_t length);
+
+	// data stream is decrypted, counter is the counter for offset 0 of this stream
+	SparseStream(const std::shared_ptr<tc::io::IStream>& data_stream, const std::shared_ptr<BucketTree>& table, int64_t length, const AesKeySchedule& key, const pie::hac::detail::aes_iv_t& counter);
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	std::string mModuleLabel;
+
+	std::shared_ptr<tc::io::IStream> mDataStream;
+	std::shared_ptr<BucketTree> mTable;
+	int64_t mLength;
+	int64_t mPosition;
+
+	bool mIsEncrypted;
+	AesCtrCipher mCipher;
+
+	// last entry used, to continue from on the next read
+	size_t mEntryHint;
+};
+
+}
\ No newline at end of file
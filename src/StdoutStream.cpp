@@ -0,0 +1,124 @@
+#include "StdoutStream.h"
+
+#include <cstdio>
+#include <tc/ObjectDisposedException.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+// file StdoutStream writes to, this is a duplicate of the original stdout after reserveStdout()
+static FILE* sDataFile = stdout;
+
+nstool::StdoutStream::StdoutStream() :
+	mModuleLabel("nstool::StdoutStream"),
+	mIsDisposed(false),
+	mPosition(0)
+{
+#ifdef _WIN32
+	// prevent "\n" being translated to "\r\n"
+	_setmode(_fileno(sDataFile), _O_BINARY);
+#endif
+}
+
+void nstool::StdoutStream::reserveStdout()
+{
+	if (sDataFile != stdout)
+	{
+		return;
+	}
+
+	fflush(stdout);
+	int data_fd = dup(fileno(stdout));
+	FILE* data_file = data_fd != -1 ? fdopen(data_fd, "wb") : nullptr;
+	if (data_file == nullptr || dup2(fileno(stderr), fileno(stdout)) == -1)
+	{
+		throw tc::io::IOException("nstool::StdoutStream::reserveStdout()", "Failed to separate standard output from standard error.");
+	}
+	sDataFile = data_file;
+}
+
+bool nstool::StdoutStream::canRead() const
+{
+	return false;
+}
+
+bool nstool::StdoutStream::canWrite() const
+{
+	return mIsDisposed == false;
+}
+
+bool nstool::StdoutStream::canSeek() const
+{
+	return false;
+}
+
+int64_t nstool::StdoutStream::length()
+{
+	return mPosition;
+}
+
+int64_t nstool::StdoutStream::position()
+{
+	return mPosition;
+}
+
+size_t nstool::StdoutStream::read(byte_t* ptr, size_t count)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::read()", "read() is not supported for StdoutStream");
+}
+
+size_t nstool::StdoutStream::write(const byte_t* ptr, size_t count)
+{
+	if (mIsDisposed)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::write()", "Failed to write to stream (stream is disposed)");
+	}
+
+	if (fwrite(ptr, 1, count, sDataFile) != count)
+	{
+		throw tc::io::IOException(mModuleLabel+"::write()", "Failed to write to standard output.");
+	}
+	mPosition += tc::io::IOUtil::castSizeToInt64(count);
+
+	return count;
+}
+
+int64_t nstool::StdoutStream::seek(int64_t offset, tc::io::SeekOrigin origin)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::seek()", "seek() is not supported for StdoutStream");
+}
+
+void nstool::StdoutStream::setLength(int64_t length)
+{
+	throw tc::NotSupportedException(mModuleLabel+"::setLength()", "setLength() is not supported for StdoutStream");
+}
+
+void nstool::StdoutStream::flush()
+{
+	if (mIsDisposed)
+	{
+		throw tc::ObjectDisposedException(mModuleLabel+"::flush()", "Failed to flush stream (stream is disposed)");
+	}
+
+	if (fflush(sDataFile) != 0)
+	{
+		throw tc::io::IOException(mModuleLabel+"::flush()", "Failed to flush standard output.");
+	}
+}
+
+void nstool::StdoutStream::dispose()
+{
+	if (mIsDisposed == false)
+	{
+		fflush(sDataFile);
+	}
+	mIsDisposed = true;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+#include "types.h"
+
+namespace nstool {
+
+/**
+ * @class StdoutStream
+ * @brief Write-only, non-seekable stream over the process standard output (in binary mode).
+ */
+class StdoutStream : public tc::io::IStream
+{
+public:
+	StdoutStream();
+
+	// keep standard output for StdoutStream data only, anything else printed to stdout (e.g. warnings) is sent to stderr instead
+	// note: this should be called before anything is printed
+	static void reserveStdout();
+
+	bool canRead() const;
+	bool canWrite() const;
+	bool canSeek() const;
+	int64_t length();
+	int64_t position();
+	size_t read(byte_t* ptr, size_t count);
+	size_t write(const byte_t* ptr, size_t count);
+	int64_t seek(int64_t offset, tc::io::SeekOrigin origin);
+	void setLength(int64_t length);
+	void flush();
+	void dispose();
+private:
+	std::string mModuleLabel;
+
+	bool mIsDisposed;
+	int64_t mPosition;
+};
+
+}
\ No newline at end of file
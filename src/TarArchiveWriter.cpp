@@ -0,0 +1,150 @@
+#include "TarArchiveWriter.h"
+
+#include <cstring>
+
+nstool::TarArchiveWriter::TarArchiveWriter(const std::shared_ptr<tc::io::IStream>& stream) :
+	mModuleLabel("nstool::TarArchiveWriter"),
+	mStream(stream),
+	mWrittenSize(0),
+	mIsClosed(false)
+{
+	if (mStream == nullptr)
+	{
+		throw tc::ArgumentNullException(mModuleLabel, "stream is null.");
+	}
+	if (mStream->canWrite() == false)
+	{
+		throw tc::NotSupportedException(mModuleLabel, "stream requires write permissions.");
+	}
+}
+
+void nstool::TarArchiveWriter::addDirectory(const std::string& name)
+{
+	writeEntryHeader(name + "/", '5', 0);
+}
+
+void nstool::TarArchiveWriter::addFile(const std::string& name, const std::shared_ptr<tc::io::IStream>& file, tc::ByteData& cache)
+{
+	int64_t size = file->length();
+
+	writeEntryHeader(name, '0', size);
+
+	// copy file data, then pad to the block size
+	file->seek(0, tc::io::SeekOrigin::Begin);
+	for (int64_t pos = 0; pos < size;)
+	{
+		size_t len = file->read(cache.data(), tc::io::IOUtil::castInt64ToSize(std::min<int64_t>(size - pos, tc::io::IOUtil::castSizeToInt64(cache.size()))));
+		if (len == 0)
+		{
+			throw tc::io::IOException(mModuleLabel, fmt::format("Failed to read data for \"{:s}\".", name));
+		}
+		writeData(cache.data(), len);
+		pos += tc::io::IOUtil::castSizeToInt64(len);
+	}
+	writePadding((kBlockSize - (size_t)(size % kBlockSize)) % kBlockSize);
+}
+
+void nstool::TarArchiveWriter::close()
+{
+	if (mIsClosed)
+	{
+		return;
+	}
+
+	// end of archive is two empty blocks, then the archive is padded to the record size
+	writePadding(2 * kBlockSize);
+	writePadding((kRecordSize - (size_t)(mWrittenSize % kRecordSize)) % kRecordSize);
+	mStream->flush();
+
+	mIsClosed = true;
+}
+
+void nstool::TarArchiveWriter::writeEntryHeader(const std::string& name, char type_flag, int64_t size)
+{
+	if (mIsClosed)
+	{
+		throw tc::InvalidOperationException(mModuleLabel, "Cannot add entries to a closed archive.");
+	}
+
+	// fields that do not fit in the ustar header are written as a pax extended header first
+	std::string pax_records;
+	auto addPaxRecord = [&pax_records](const std::string& key, const std::string& value) {
+		// record is "<length> <key>=<value>\n", where length includes the digits of length itself
+		size_t len = key.size() + value.size() + 3;
+		size_t digits = std::to_string(len).size();
+		len += digits;
+		if (std::to_string(len).size() != digits)
+		{
+			len += 1;
+		}
+		pax_records += fmt::format("{:d} {:s}={:s}\n", len, key, value);
+	};
+
+	if (name.size() > 100)
+	{
+		addPaxRecord("path", name);
+	}
+	if (size > kMaxUstarFileSize)
+	{
+		addPaxRecord("size", fmt::format("{:d}", size));
+	}
+
+	if (pax_records.empty() == false)
+	{
+		writeHeaderBlock("PaxHeader", 'x', tc::io::IOUtil::castSizeToInt64(pax_records.size()), 0644);
+		writeData((const byte_t*)pax_records.c_str(), pax_records.size());
+		writePadding((kBlockSize - (pax_records.size() % kBlockSize)) % kBlockSize);
+	}
+
+	writeHeaderBlock(name.substr(0, 100), type_flag, (size > kMaxUstarFileSize ? kMaxUstarFileSize : size), type_flag == '5' ? 0755 : 0644);
+}
+
+void nstool::TarArchiveWriter::writeHeaderBlock(const std::string& name, char type_flag, int64_t size, uint32_t mode)
+{
+	byte_t block[kBlockSize];
+	memset(block, 0, sizeof(block));
+
+	auto writeField = [&block](size_t offset, size_t field_size, const std::string& value) {
+		memcpy(block + offset, value.c_str(), std::min<size_t>(value.size(), field_size));
+	};
+
+	writeField(0, 100, name); // name
+	writeField(100, 8, fmt::format("{:07o}", mode)); // mode
+	writeField(108, 8, fmt::format("{:07o}", 0)); // uid
+	writeField(116, 8, fmt::format("{:07o}", 0)); // gid
+	writeField(124, 12, fmt::format("{:011o}", size)); // size
+	writeField(136, 12, fmt::format("{:011o}", 0)); // mtime
+	writeField(148, 8, "        "); // checksum (spaces while the checksum is calculated)
+	block[156] = type_flag; // typeflag
+	writeField(257, 6, std::string("ustar\0", 6)); // magic
+	writeField(263, 2, "00"); // version
+
+	uint32_t checksum = 0;
+	for (size_t i = 0; i < sizeof(block); i++)
+	{
+		checksum += block[i];
+	}
+	writeField(148, 8, fmt::format("{:06o}", checksum));
+	block[154] = 0;
+	block[155] = ' ';
+
+	writeData(block, sizeof(block));
+}
+
+void nstool::TarArchiveWriter::writeData(const byte_t* data, size_t size)
+{
+	mStream->write(data, size);
+	mWrittenSize += tc::io::IOUtil::castSizeToInt64(size);
+}
+
+void nstool::TarArchiveWriter::writePadding(size_t size)
+{
+	static const byte_t kZeroBlock[kBlockSize] = {0};
+
+	while (size > 0)
+	{
+		size_t len = size > kBlockSize ? kBlockSize : size;
+		writeData(kZeroBlock, len);
+		size -= len;
+	}
+}
\ No newline at end of file
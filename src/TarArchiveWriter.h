@@ -0,0 +1,40 @@
+#pragma once
+#include "types.h"
+
+namespace nstool {
+
+/**
+ * @class TarArchiveWriter
+ * @brief Writes a POSIX (pax/ustar) tar archive to a stream in a single sequential pass.
+ *
+ * Member names that do not fit in the ustar header, and file sizes of 8GiB or more, are stored in a pax extended header.
+ * Entries are given fixed permissions (0755 for directories, 0644 for files) and no owner or timestamp.
+ */
+class TarArchiveWriter
+{
+public:
+	TarArchiveWriter(const std::shared_ptr<tc::io::IStream>& stream);
+
+	void addDirectory(const std::string& name);
+	void addFile(const std::string& name, const std::shared_ptr<tc::io::IStream>& file, tc::ByteData& cache);
+
+	// write the end of archive marker, no more entries can be added after this
+	void close();
+private:
+	static const size_t kBlockSize = 512;
+	static const size_t kRecordSize = 20 * kBlockSize; // archives are padded to a multiple of this
+	static const int64_t kMaxUstarFileSize = 077777777777; // largest size that fits in the 11 digit octal size field
+
+	std::string mModuleLabel;
+
+	std::shared_ptr<tc::io::IStream> mStream;
+	int64_t mWrittenSize;
+	bool mIsClosed;
+
+	void writeEntryHeader(const std::string& name, char type_flag, int64_t size);
+	void writeHeaderBlock(const std::string& name, char type_flag, int64_t size, uint32_t mode);
+	void writeData(const byte_t* data, size_t size);
+	void writePadding(size_t size);
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "ThreadPool.h"
+
+nstool::ThreadPool::ThreadPool(size_t thread_num) :
+	mModuleName("nstool::ThreadPool"),
+	mThreads(),
+	mTaskQueue(),
+	mActiveTaskNum(0),
+	mStopWorkers(false),
+	mTaskException()
+{
+	if (thread_num == 0)
+	{
+		throw tc::ArgumentOutOfRangeException(mModuleName, "Thread pool requires at least one thread.");
+	}
+
+	for (size_t i = 0; i < thread_num; i++)
+	{
+		mThreads.push_back(std::thread(&ThreadPool::workerMain, this));
+	}
+}
+
+nstool::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopWorkers = true;
+	}
+	mTaskQueuedEvent.notify_all();
+
+	for (auto itr = mThreads.begin(); itr != mThreads.end(); itr++)
+	{
+		itr->join();
+	}
+}
+
+size_t nstool::ThreadPool::getThreadNum() const
+{
+	return mThreads.size();
+}
+
+void nstool::ThreadPool::enqueue(const std::function<void()>& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTaskQueue.push(task);
+	}
+	mTaskQueuedEvent.notify_one();
+}
+
+void nstool::ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mTaskCompleteEvent.wait(lock, [this]() { return mTaskQueue.empty() && mActiveTaskNum == 0; });
+
+	if (mTaskException != nullptr)
+	{
+		std::exception_ptr e = mTaskException;
+		mTaskException = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+void nstool::ThreadPool::execute(const std::vector<std::function<void()>>& tasks)
+{
+	if (tasks.empty())
+	{
+		return;
+	}
+
+	// completion state for this group only
+	struct sGroupState
+	{
+		std::mutex mutex;
+		std::condition_variable event;
+		size_t remaining;
+		std::exception_ptr exception;
+	} group;
+	group.remaining = tasks.size() - 1;
+
+	for (size_t i = 1; i < tasks.size(); i++)
+	{
+		sGroupState* group_ptr = &group;
+		std::function<void()> task = tasks[i];
+		enqueue([group_ptr, task]() {
+			std::exception_ptr task_exception;
+			try {
+				task();
+			}
+			catch (...) {
+				task_exception = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(group_ptr->mutex);
+			if (task_exception != nullptr && group_ptr->exception == nullptr)
+			{
+				group_ptr->exception = task_exception;
+			}
+			group_ptr->remaining--;
+			group_ptr->event.notify_all();
+		});
+	}
+
+	std::exception_ptr local_exception;
+	try {
+		tasks[0]();
+	}
+	catch (...) {
+		local_exception = std::current_exception();
+	}
+
+	// wait for the other tasks even if this one failed, as they may reference the caller's data
+	std::unique_lock<std::mutex> lock(group.mutex);
+	group.event.wait(lock, [&group]() { return group.remaining == 0; });
+
+	if (local_exception != nullptr)
+		std::rethrow_exception(local_exception);
+	if (group.exception != nullptr)
+		std::rethrow_exception(group.exception);
+}
+
+void nstool::ThreadPool::workerMain()
+{
+	while (true)
+	{
+		std::function<void()> task;
+
+		// wait for a task (or the signal to stop)
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mTaskQueuedEvent.wait(lock, [this]() { return mStopWorkers || mTaskQueue.empty() == false; });
+			if (mStopWorkers && mTaskQueue.empty())
+			{
+				return;
+			}
+
+			task = mTaskQueue.front();
+			mTaskQueue.pop();
+			mActiveTaskNum++;
+		}
+
+		// run task, saving the first exception for wait()
+		std::exception_ptr task_exception;
+		try {
+			task();
+		}
+		catch (...) {
+			task_exception = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (task_exception != nullptr && mTaskException == nullptr)
+			{
+				mTaskException = task_exception;
+			}
+			mActiveTaskNum--;
+		}
+		mTaskCompleteEvent.notify_all();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+#include "types.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <vector>
+#include <exception>
+
+namespace nstool {
+
+class ThreadPool
+{
+public:
+	ThreadPool(size_t thread_num);
+	~ThreadPool();
+
+	size_t getThreadNum() const;
+
+	// queue a task to be run by a worker thread
+	void enqueue(const std::function<void()>& task);
+
+	// block until all queued tasks have finished, the first exception thrown by a task (if any) is rethrown here
+	// note: this must not be called from inside a task
+	void wait();
+
+	// run a group of tasks (the first on the calling thread, the others by worker threads) and block until they have finished
+	// unlike wait() this only waits for these tasks, so the pool can be shared. The first exception thrown by a task (if any) is rethrown here
+	void execute(const std::vector<std::function<void()>>& tasks);
+private:
+	std::string mModuleName;
+
+	std::vector<std::thread> mThreads;
+	std::queue<std::function<void()>> mTaskQueue;
+	size_t mActiveTaskNum;
+	bool mStopWorkers;
+	std::exception_ptr mTaskException;
+
+	std::mutex mMutex;
+	std::condition_variable mTaskQueuedEvent;
+	std::condition_variable mTaskCompleteEvent;
+
+	void workerMain();
+};
+
+}
\ No newline at end of file
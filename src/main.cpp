@@ -1,6 +1,7 @@
 #include <tc.h>
 #include <tc/os/UnicodeMain.h>
 #include "Settings.h"
+#include "util.h"
 
 
 #include "GameCardProcess.h"
@@ -17,6 +18,8 @@
 #include "EsCertProcess.h"
 #include "EsTikProcess.h"
 #include "AssetProcess.h"
+#include "BenchmarkProcess.h"
+#include "SignatureCache.h"
 
 
 int umain(const std::vector<std::string>& args, const std::vector<std::string>& env)
@@ -24,21 +27,58 @@ int umain(const std::vector<std::string>& args, const std::vector<std::string>&
 	try 
 	{
 		nstool::Settings set = nstool::SettingsInitializer(args);
+
+		if (set.opt.benchmark)
+		{
+			nstool::BenchmarkProcess obj;
+			obj.process();
+			return 0;
+		}
 		
-		std::shared_ptr<tc::io::IStream> infile_stream = std::make_shared<tc::io::FileStream>(tc::io::FileStream(set.infile.path.get(), tc::io::FileMode::Open, tc::io::FileAccess::Read));
+		std::shared_ptr<nstool::SignatureCache> sig_cache;
+		if (set.opt.sig_cache_path.isSet())
+		{
+			sig_cache = std::make_shared<nstool::SignatureCache>(set.opt.sig_cache_path.get());
+		}
+		else
+		{
+			sig_cache = std::make_shared<nstool::SignatureCache>();
+		}
+
+		// base NCAs of update NCAs are processed once, and shared by every NCA processed in this run
+		std::shared_ptr<nstool::NcaProcess::BaseNcaCache> base_nca_cache = std::make_shared<nstool::NcaProcess::BaseNcaCache>();
+
+		std::shared_ptr<tc::io::IStream> infile_stream;
+		if (set.opt.mmap_input)
+		{
+			infile_stream = nstool::openMappedFileStream(set.infile.path.get());
+		}
+		else
+		{
+			infile_stream = nstool::openFileStream(set.infile.path.get(), tc::io::FileMode::Open, tc::io::FileAccess::Read, set.opt.io_queue_depth);
+		}
 
 		if (set.infile.filetype == nstool::Settings::FILE_TYPE_GAMECARD)
 		{	
 			nstool::GameCardProcess obj;
 
 			obj.setInputFile(infile_stream);
+			obj.setInputFilePath(set.infile.path.get());
 			
 			obj.setKeyCfg(set.opt.keybag);
 			obj.setCliOutputMode(set.opt.cli_output_mode);
 			obj.setVerifyMode(set.opt.verify);
+			obj.setSignatureCache(sig_cache);
 
 			obj.setShowFsTree(set.fs.show_fs_tree);
 			obj.setExtractJobs(set.fs.extract_jobs);
+			obj.setShowExtractPlan(set.fs.show_extract_plan);
+			obj.setResumeMode(set.fs.resume);
+			obj.setDedupeMode(set.fs.dedupe);
+			obj.setMappedOutputMode(set.fs.mmap_output);
+			obj.setIoQueueDepth(set.opt.io_queue_depth);
+			obj.setExtractFormat(set.fs.extract_format);
+			obj.setThreadNum(set.opt.thread_num);
 		
 			obj.process();
 		}
@@ -47,12 +87,20 @@ int umain(const std::vector<std::string>& args, const std::vector<std::string>&
 			nstool::PfsProcess obj;
 
 			obj.setInputFile(infile_stream);
+			obj.setInputFilePath(set.infile.path.get());
 
 			obj.setCliOutputMode(set.opt.cli_output_mode);
 			obj.setVerifyMode(set.opt.verify);
 
 			obj.setShowFsTree(set.fs.show_fs_tree);
 			obj.setExtractJobs(set.fs.extract_jobs);
+			obj.setShowExtractPlan(set.fs.show_extract_plan);
+			obj.setResumeMode(set.fs.resume);
+			obj.setDedupeMode(set.fs.dedupe);
+			obj.setMappedOutputMode(set.fs.mmap_output);
+			obj.setIoQueueDepth(set.opt.io_queue_depth);
+			obj.setExtractFormat(set.fs.extract_format);
+			obj.setThreadNum(set.opt.thread_num);
 			
 			obj.process();
 		}
@@ -62,11 +110,19 @@ int umain(const std::vector<std::string>& args, const std::vector<std::string>&
 			nstool::RomfsProcess obj;
 
 			obj.setInputFile(infile_stream);
+			obj.setInputFilePath(set.infile.path.get());
 			obj.setCliOutputMode(set.opt.cli_output_mode);
 			obj.setVerifyMode(set.opt.verify);
 
 			obj.setShowFsTree(set.fs.show_fs_tree);
 			obj.setExtractJobs(set.fs.extract_jobs);
+			obj.setShowExtractPlan(set.fs.show_extract_plan);
+			obj.setResumeMode(set.fs.resume);
+			obj.setDedupeMode(set.fs.dedupe);
+			obj.setMappedOutputMode(set.fs.mmap_output);
+			obj.setIoQueueDepth(set.opt.io_queue_depth);
+			obj.setExtractFormat(set.fs.extract_format);
+			obj.setThreadNum(set.opt.thread_num);
 
 			obj.process();
 		}
@@ -75,13 +131,26 @@ int umain(const std::vector<std::string>& args, const std::vector<std::string>&
 			nstool::NcaProcess obj;
 
 			obj.setInputFile(infile_stream);
+			obj.setInputFilePath(set.infile.path.get());
 			obj.setBaseNcaPath(set.nca.base_nca_path);
+			obj.setBaseNcaCache(base_nca_cache);
+			obj.setPlaintextNcaPath(set.nca.plaintext_nca_path);
 			obj.setKeyCfg(set.opt.keybag);
 			obj.setCliOutputMode(set.opt.cli_output_mode);
 			obj.setVerifyMode(set.opt.verify);
+			obj.setSignatureCache(sig_cache);
+			obj.setVerifyDataMode(set.opt.verify_data);
 
 			obj.setShowFsTree(set.fs.show_fs_tree);
 			obj.setExtractJobs(set.fs.extract_jobs);
+			obj.setShowExtractPlan(set.fs.show_extract_plan);
+			obj.setResumeMode(set.fs.resume);
+			obj.setDedupeMode(set.fs.dedupe);
+			obj.setMappedOutputMode(set.fs.mmap_output);
+			obj.setIoQueueDepth(set.opt.io_queue_depth);
+			obj.setExtractFormat(set.fs.extract_format);
+			obj.setThreadNum(set.opt.thread_num);
+			obj.setChangedOnlyMode(set.nca.changed_only);
 
 			obj.process();
 		}
@@ -139,6 +208,13 @@ int umain(const std::vector<std::string>& args, const std::vector<std::string>&
 
 			obj.setAssetRomfsShowFsTree(set.fs.show_fs_tree);
 			obj.setAssetRomfsExtractJobs(set.fs.extract_jobs);
+			obj.setAssetRomfsShowExtractPlan(set.fs.show_extract_plan);
+			obj.setAssetRomfsResumeMode(set.fs.resume);
+			obj.setAssetRomfsDedupeMode(set.fs.dedupe);
+			obj.setAssetRomfsMappedOutputMode(set.fs.mmap_output);
+			obj.setAssetRomfsIoQueueDepth(set.opt.io_queue_depth);
+			obj.setAssetRomfsExtractFormat(set.fs.extract_format);
+			obj.setAssetRomfsThreadNum(set.opt.thread_num);
 
 			obj.process();
 		}
@@ -183,6 +259,7 @@ int umain(const std::vector<std::string>& args, const std::vector<std::string>&
 			obj.setKeyCfg(set.opt.keybag);
 			obj.setCliOutputMode(set.opt.cli_output_mode);
 			obj.setVerifyMode(set.opt.verify);
+			obj.setSignatureCache(sig_cache);
 
 			obj.process();
 		}
@@ -195,6 +272,7 @@ int umain(const std::vector<std::string>& args, const std::vector<std::string>&
 			//obj.setCertificateChain(user_set.getCertificateChain());
 			obj.setCliOutputMode(set.opt.cli_output_mode);
 			obj.setVerifyMode(set.opt.verify);
+			obj.setSignatureCache(sig_cache);
 
 			obj.process();
 		}
@@ -213,6 +291,13 @@ int umain(const std::vector<std::string>& args, const std::vector<std::string>&
 
 			obj.setRomfsShowFsTree(set.fs.show_fs_tree);
 			obj.setRomfsExtractJobs(set.fs.extract_jobs);
+			obj.setRomfsShowExtractPlan(set.fs.show_extract_plan);
+			obj.setRomfsResumeMode(set.fs.resume);
+			obj.setRomfsDedupeMode(set.fs.dedupe);
+			obj.setRomfsMappedOutputMode(set.fs.mmap_output);
+			obj.setRomfsIoQueueDepth(set.opt.io_queue_depth);
+			obj.setRomfsExtractFormat(set.fs.extract_format);
+			obj.setRomfsThreadNum(set.opt.thread_num);
 
 			obj.process();
 		}
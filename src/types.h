@@ -24,9 +24,22 @@ struct CliOutputMode
 	{}
 };
 
+enum ExtractFormat
+{
+	EXTRACT_FORMAT_DIR, // files are written to a directory tree
+	EXTRACT_FORMAT_TAR, // files are written to a tar archive
+};
+
 struct ExtractJob {
 	tc::io::Path virtual_path;
 	tc::io::Path extract_path;
 };
 
+// location of a file's data within the input file
+struct FileExtent {
+	int64_t offset;
+	int64_t size;
+	bool is_plaintext; // true if the data is stored as is (no encryption/compression)
+};
+
 }
\ No newline at end of file
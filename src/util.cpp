@@ -1,15 +1,75 @@
 #include "util.h"
+#include "AsyncFileStream.h"
+#include "MappedFileStream.h"
 
 #include <tc/io/FileStream.h>
 #include <tc/io/SubStream.h>
 #include <tc/io/IOUtil.h>
 
 #include <sstream>
+#include <cstring>
 #include <algorithm>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <cerrno>
+#include <sys/mman.h>
+#endif
 
 inline bool isNotPrintable(char chr) { return isprint(chr) == false; }
 
+// streams at least this large are copied with writeStreamToStreamPipelined()
+static const int64_t kPipelineMinStreamLength = 0x400000;
+static const size_t kPipelineBufferSize = 0x100000;
+static const size_t kPipelineBufferNum = 4;
+
+// all-zero blocks of this size are skipped (left as holes in sparse files) rather than written, when the output stream can seek
+static const size_t kHoleBlockSize = 0x1000;
+
+static bool isZeroFilled(const byte_t* data, size_t size)
+{
+	return size == 0 || (data[0] == 0 && memcmp(data, data + 1, size - 1) == 0);
+}
+
+// write data to out_stream, seeking over all-zero blocks instead of writing them
+// the last block of the stream (is_final_write) is always written, so the output ends up the correct length
+static void writeSparseData(const std::shared_ptr<tc::io::IStream>& out_stream, const byte_t* data, size_t size, bool is_final_write)
+{
+	size_t write_begin = 0;
+	for (size_t pos = 0; pos < size;)
+	{
+		size_t block_size = std::min<size_t>(kHoleBlockSize, size - pos);
+		bool is_last_block = is_final_write && pos + block_size == size;
+
+		if (is_last_block == false && isZeroFilled(data + pos, block_size))
+		{
+			// write out the data blocks before this one, then skip over it
+			if (pos > write_begin)
+			{
+				out_stream->write(data + write_begin, pos - write_begin);
+			}
+			out_stream->seek(tc::io::IOUtil::castSizeToInt64(block_size), tc::io::SeekOrigin::Current);
+			write_begin = pos + block_size;
+		}
+
+		pos += block_size;
+	}
+
+	if (size > write_begin)
+	{
+		out_stream->write(data + write_begin, size - write_begin);
+	}
+}
+
 void nstool::processResFile(const std::shared_ptr<tc::io::IStream>& file, std::map<std::string, std::string>& dict)
 {
 	if (file == nullptr || !file->canRead() || file->length() == 0)
@@ -88,8 +148,16 @@ void nstool::writeStreamToFile(const std::shared_ptr<tc::io::IStream>& in_stream
 
 void nstool::writeStreamToStream(const std::shared_ptr<tc::io::IStream>& in_stream, const std::shared_ptr<tc::io::IStream>& out_stream, tc::ByteData& cache)
 {
+	// large streams are read and written concurrently
+	if (in_stream->length() >= kPipelineMinStreamLength)
+	{
+		writeStreamToStreamPipelined(in_stream, out_stream, std::max<size_t>(cache.size(), kPipelineBufferSize), kPipelineBufferNum);
+		return;
+	}
+
 	// iterate thru child files
 	size_t cache_read_len;
+	bool skip_zero_blocks = out_stream->canSeek();
 	
 	in_stream->seek(0, tc::io::SeekOrigin::Begin);
 	out_stream->seek(0, tc::io::SeekOrigin::Begin);
@@ -101,7 +169,14 @@ void nstool::writeStreamToStream(const std::shared_ptr<tc::io::IStream>& in_stre
 			throw tc::io::IOException("nstool::writeStreamToStream()", "Failed to read from source streeam.");
 		}
 
-		out_stream->write(cache.data(), cache_read_len);
+		if (skip_zero_blocks)
+		{
+			writeSparseData(out_stream, cache.data(), cache_read_len, remaining_data <= int64_t(cache_read_len));
+		}
+		else
+		{
+			out_stream->write(cache.data(), cache_read_len);
+		}
 
 		remaining_data -= int64_t(cache_read_len);
 	}
@@ -113,6 +188,395 @@ void nstool::writeStreamToStream(const std::shared_ptr<tc::io::IStream>& in_stre
 	writeStreamToStream(in_stream, out_stream, cache);
 }
 
+void nstool::writeStreamToStreamPipelined(const std::shared_ptr<tc::io::IStream>& in_stream, const std::shared_ptr<tc::io::IStream>& out_stream, size_t buffer_size, size_t buffer_num)
+{
+	if (buffer_size == 0 || buffer_num == 0)
+	{
+		throw tc::ArgumentOutOfRangeException("nstool::writeStreamToStreamPipelined()", "Buffer size and buffer count must be non-zero.");
+	}
+
+	// ring of buffers shared between the read thread (which fills them) and this thread (which writes them out)
+	// note: decryption and hash validation happen inside in_stream->read(), so they run in the read thread
+	struct sBufferRing
+	{
+		std::vector<tc::ByteData> buffer;
+		std::vector<size_t> data_len;
+		size_t head; // index of the next buffer to be written
+		size_t filled_num; // number of buffers waiting to be written
+		bool read_complete;
+		bool write_aborted;
+		std::exception_ptr read_exception;
+
+		std::mutex lock;
+		std::condition_variable buffer_filled_event;
+		std::condition_variable buffer_emptied_event;
+	} ring;
+
+	for (size_t i = 0; i < buffer_num; i++)
+	{
+		ring.buffer.push_back(tc::ByteData(buffer_size));
+	}
+	ring.data_len = std::vector<size_t>(buffer_num, 0);
+	ring.head = 0;
+	ring.filled_num = 0;
+	ring.read_complete = false;
+	ring.write_aborted = false;
+
+	int64_t stream_length = in_stream->length();
+	bool skip_zero_blocks = out_stream->canSeek();
+	in_stream->seek(0, tc::io::SeekOrigin::Begin);
+	out_stream->seek(0, tc::io::SeekOrigin::Begin);
+
+	std::thread read_thread([&ring, &in_stream, stream_length, buffer_num]() {
+		try {
+			for (int64_t remaining_data = stream_length; remaining_data > 0;)
+			{
+				// wait for an empty buffer
+				size_t index;
+				{
+					std::unique_lock<std::mutex> lock(ring.lock);
+					ring.buffer_emptied_event.wait(lock, [&ring, buffer_num]() { return ring.write_aborted || ring.filled_num < buffer_num; });
+					if (ring.write_aborted)
+					{
+						break;
+					}
+					index = (ring.head + ring.filled_num) % buffer_num;
+				}
+
+				size_t read_len = in_stream->read(ring.buffer[index].data(), ring.buffer[index].size());
+				if (read_len == 0)
+				{
+					throw tc::io::IOException("nstool::writeStreamToStreamPipelined()", "Failed to read from source streeam.");
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(ring.lock);
+					ring.data_len[index] = read_len;
+					ring.filled_num++;
+				}
+				ring.buffer_filled_event.notify_one();
+
+				remaining_data -= int64_t(read_len);
+			}
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(ring.lock);
+			ring.read_exception = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(ring.lock);
+			ring.read_complete = true;
+		}
+		ring.buffer_filled_event.notify_one();
+	});
+
+	try {
+		for (int64_t written_len = 0;;)
+		{
+			// wait for a filled buffer
+			size_t index;
+			{
+				std::unique_lock<std::mutex> lock(ring.lock);
+				ring.buffer_filled_event.wait(lock, [&ring]() { return ring.read_complete || ring.filled_num > 0; });
+				if (ring.filled_num == 0)
+				{
+					break;
+				}
+				index = ring.head;
+			}
+
+			written_len += int64_t(ring.data_len[index]);
+			if (skip_zero_blocks)
+			{
+				writeSparseData(out_stream, ring.buffer[index].data(), ring.data_len[index], written_len >= stream_length);
+			}
+			else
+			{
+				out_stream->write(ring.buffer[index].data(), ring.data_len[index]);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(ring.lock);
+				ring.head = (ring.head + 1) % buffer_num;
+				ring.filled_num--;
+			}
+			ring.buffer_emptied_event.notify_one();
+		}
+	}
+	catch (...) {
+		{
+			std::lock_guard<std::mutex> lock(ring.lock);
+			ring.write_aborted = true;
+		}
+		ring.buffer_emptied_event.notify_one();
+		read_thread.join();
+		throw;
+	}
+
+	read_thread.join();
+
+	if (ring.read_exception != nullptr)
+	{
+		std::rethrow_exception(ring.read_exception);
+	}
+}
+
+bool nstool::copyFileRange(const tc::io::Path& in_path, int64_t offset, int64_t length, const tc::io::Path& out_path)
+{
+#ifdef __linux__
+	if (offset < 0 || length < 0)
+	{
+		return false;
+	}
+
+	int in_fd = open(in_path.to_string().c_str(), O_RDONLY | O_CLOEXEC);
+	if (in_fd == -1)
+	{
+		return false;
+	}
+	int out_fd = open(out_path.to_string().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (out_fd == -1)
+	{
+		close(in_fd);
+		return false;
+	}
+
+	bool copied = false;
+
+	// try to share the data blocks (reflink), this only works for block aligned ranges on filesystems like btrfs/XFS
+#ifdef FICLONERANGE
+	if (copied == false && length > 0)
+	{
+		struct file_clone_range clone_range;
+		clone_range.src_fd = in_fd;
+		clone_range.src_offset = uint64_t(offset);
+		clone_range.src_length = uint64_t(length);
+		clone_range.dest_offset = 0;
+
+		copied = ioctl(out_fd, FICLONERANGE, &clone_range) == 0;
+	}
+#endif
+
+	// try an in-kernel copy
+#ifdef __NR_copy_file_range
+	if (copied == false)
+	{
+		loff_t in_offset = offset;
+		loff_t out_offset = 0;
+		int64_t remaining = length;
+		while (remaining > 0)
+		{
+			ssize_t copy_len = syscall(__NR_copy_file_range, in_fd, &in_offset, out_fd, &out_offset, size_t(std::min<int64_t>(remaining, 0x40000000)), 0);
+			if (copy_len <= 0)
+			{
+				break;
+			}
+			remaining -= copy_len;
+		}
+		copied = remaining == 0;
+	}
+#endif
+
+	// try sendfile(), which still avoids copying the data through user space
+	if (copied == false && ftruncate(out_fd, 0) == 0 && lseek(out_fd, 0, SEEK_SET) == 0)
+	{
+		off_t in_offset = offset;
+		int64_t remaining = length;
+		while (remaining > 0)
+		{
+			ssize_t copy_len = sendfile(out_fd, in_fd, &in_offset, size_t(std::min<int64_t>(remaining, 0x40000000)));
+			if (copy_len <= 0)
+			{
+				break;
+			}
+			remaining -= copy_len;
+		}
+		copied = remaining == 0;
+	}
+
+	close(in_fd);
+	if (close(out_fd) != 0)
+	{
+		copied = false;
+	}
+
+	return copied;
+#else
+	return false;
+#endif
+}
+
+bool nstool::linkFile(const tc::io::Path& in_path, const tc::io::Path& out_path)
+{
+#ifdef __linux__
+	std::string in_path_str = in_path.to_string();
+	std::string out_path_str = out_path.to_string();
+
+	// remove the existing file first, since it may itself be a hardlink that must not be modified
+	if (unlink(out_path_str.c_str()) != 0 && errno != ENOENT)
+	{
+		return false;
+	}
+
+	// try to share the data blocks (reflink), so the files can still be modified independently
+#ifdef FICLONE
+	int in_fd = open(in_path_str.c_str(), O_RDONLY | O_CLOEXEC);
+	if (in_fd != -1)
+	{
+		int out_fd = open(out_path_str.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+		if (out_fd != -1)
+		{
+			bool cloned = ioctl(out_fd, FICLONE, in_fd) == 0;
+			if (close(out_fd) != 0)
+			{
+				cloned = false;
+			}
+			close(in_fd);
+
+			if (cloned)
+			{
+				return true;
+			}
+			unlink(out_path_str.c_str());
+		}
+		else
+		{
+			close(in_fd);
+		}
+	}
+#endif
+
+	return link(in_path_str.c_str(), out_path_str.c_str()) == 0;
+#else
+	return false;
+#endif
+}
+
+bool nstool::writeStreamToMappedFile(const std::shared_ptr<tc::io::IStream>& in_stream, const tc::io::Path& out_path)
+{
+#ifdef __linux__
+	// files are mapped a window at a time, so large files don't need to fit in the address space
+	static const int64_t kMapWindowSize = 0x4000000;
+
+	int64_t length = in_stream->length();
+	if (length <= 0)
+	{
+		return false;
+	}
+
+	int out_fd = open(out_path.to_string().c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (out_fd == -1)
+	{
+		return false;
+	}
+
+	// reserve the space up front, as running out of space while writing to a mapping can't be handled (SIGBUS)
+	if (fallocate(out_fd, 0, 0, off_t(length)) != 0)
+	{
+		close(out_fd);
+		unlink(out_path.to_string().c_str());
+		return false;
+	}
+
+	// read (and decrypt) the stream directly into the mapped file pages
+	// all-zero blocks (e.g. unmapped ranges of sparse partitions) are then punched out of the file, so they are left as holes like writeStreamToStream() does
+	in_stream->seek(0, tc::io::SeekOrigin::Begin);
+	for (int64_t window_offset = 0; window_offset < length; window_offset += kMapWindowSize)
+	{
+		size_t window_size = size_t(std::min<int64_t>(kMapWindowSize, length - window_offset));
+		void* map = mmap(nullptr, window_size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, off_t(window_offset));
+		if (map == MAP_FAILED)
+		{
+			close(out_fd);
+			throw tc::io::IOException("nstool::writeStreamToMappedFile()", fmt::format("Failed to map output file ({:s}).", strerror(errno)));
+		}
+		madvise(map, window_size, MADV_SEQUENTIAL);
+
+		for (size_t pos = 0; pos < window_size;)
+		{
+			size_t read_len = 0;
+			try {
+				read_len = in_stream->read((byte_t*)map + pos, window_size - pos);
+			}
+			catch (...) {
+				munmap(map, window_size);
+				close(out_fd);
+				throw;
+			}
+			if (read_len == 0)
+			{
+				munmap(map, window_size);
+				close(out_fd);
+				throw tc::io::IOException("nstool::writeStreamToMappedFile()", "Failed to read from source stream.");
+			}
+			pos += read_len;
+		}
+
+		std::vector<std::pair<int64_t, int64_t>> zero_ranges;
+		for (size_t pos = 0; pos < window_size; pos += kHoleBlockSize)
+		{
+			size_t block_size = std::min<size_t>(kHoleBlockSize, window_size - pos);
+			if (isZeroFilled((const byte_t*)map + pos, block_size) == false)
+			{
+				continue;
+			}
+
+			int64_t block_offset = window_offset + tc::io::IOUtil::castSizeToInt64(pos);
+			if (zero_ranges.empty() == false && zero_ranges.back().first + zero_ranges.back().second == block_offset)
+				zero_ranges.back().second += tc::io::IOUtil::castSizeToInt64(block_size);
+			else
+				zero_ranges.push_back(std::make_pair(block_offset, tc::io::IOUtil::castSizeToInt64(block_size)));
+		}
+
+		munmap(map, window_size);
+
+		// if the filesystem can't punch holes, the zeros are left allocated
+		for (auto itr = zero_ranges.begin(); itr != zero_ranges.end(); itr++)
+		{
+			fallocate(out_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off_t(itr->first), off_t(itr->second));
+		}
+	}
+
+	if (close(out_fd) != 0)
+	{
+		throw tc::io::IOException("nstool::writeStreamToMappedFile()", "Failed to close output file.");
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::shared_ptr<tc::io::IStream> nstool::openFileStream(const tc::io::Path& path, tc::io::FileMode mode, tc::io::FileAccess access, size_t io_queue_depth)
+{
+	if (io_queue_depth > 0 && AsyncFileStream::isSupported())
+	{
+		return std::make_shared<AsyncFileStream>(path, mode, access, io_queue_depth);
+	}
+
+	return std::make_shared<tc::io::FileStream>(tc::io::FileStream(path, mode, access));
+}
+
+std::shared_ptr<tc::io::IStream> nstool::openMappedFileStream(const tc::io::Path& path)
+{
+	if (MappedFileStream::isSupported())
+	{
+		try {
+			return std::make_shared<MappedFileStream>(path);
+		}
+		catch (tc::io::IOException&) {
+			// file couldn't be mapped (e.g. not a regular file), FileStream will report any other problem
+		}
+		catch (tc::NotSupportedException&) {
+			// file is too large to map into the address space
+		}
+	}
+
+	return std::make_shared<tc::io::FileStream>(tc::io::FileStream(path, tc::io::FileMode::Open, tc::io::FileAccess::Read));
+}
+
 std::string nstool::getTruncatedBytesString(const byte_t* data, size_t len)
 {
 	if (data == nullptr) { return fmt::format(""); }
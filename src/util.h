@@ -10,8 +10,20 @@ void writeSubStreamToFile(const std::shared_ptr<tc::io::IStream>& in_stream, int
 void writeSubStreamToFile(const std::shared_ptr<tc::io::IStream>& in_stream, int64_t offset, int64_t length, const tc::io::Path& out_path, size_t cache_size = 0x10000);
 void writeStreamToFile(const std::shared_ptr<tc::io::IStream>& in_stream, const tc::io::Path& out_path, tc::ByteData& cache);
 void writeStreamToFile(const std::shared_ptr<tc::io::IStream>& in_stream, const tc::io::Path& out_path, size_t cache_size = 0x10000);
+// note: if out_stream can seek, all-zero blocks are skipped rather than written (leaving holes in sparse files), so out_stream must be new or already zeroed
 void writeStreamToStream(const std::shared_ptr<tc::io::IStream>& in_stream, const std::shared_ptr<tc::io::IStream>& out_stream, tc::ByteData& cache);
 void writeStreamToStream(const std::shared_ptr<tc::io::IStream>& in_stream, const std::shared_ptr<tc::io::IStream>& out_stream, size_t cache_size = 0x10000);
+// copy a byte range of a local file to a new local file within the kernel (reflink/copy_file_range/sendfile), returns false if this isn't possible
+bool copyFileRange(const tc::io::Path& in_path, int64_t offset, int64_t length, const tc::io::Path& out_path);
+// replace out_path with a reflink (or failing that a hardlink) of in_path, returns false if this isn't possible
+bool linkFile(const tc::io::Path& in_path, const tc::io::Path& out_path);
+// open a local file, using AsyncFileStream when io_queue_depth is non-zero and io_uring is available, otherwise FileStream
+std::shared_ptr<tc::io::IStream> openFileStream(const tc::io::Path& path, tc::io::FileMode mode, tc::io::FileAccess access, size_t io_queue_depth = 0);
+// open a local file for reading using MappedFileStream, falling back to FileStream if the file can't be mapped
+std::shared_ptr<tc::io::IStream> openMappedFileStream(const tc::io::Path& path);
+// write a stream to a new local file by reading it directly into a (preallocated) memory mapping of the file, returns false if this isn't possible
+bool writeStreamToMappedFile(const std::shared_ptr<tc::io::IStream>& in_stream, const tc::io::Path& out_path);
+void writeStreamToStreamPipelined(const std::shared_ptr<tc::io::IStream>& in_stream, const std::shared_ptr<tc::io::IStream>& out_stream, size_t buffer_size, size_t buffer_num);
 
 
 std::string getTruncatedBytesString(const byte_t* data, size_t len);